@@ -0,0 +1,102 @@
+// bench/bench_checksum.c
+// Микробенчмарк контрольной суммы: каждая реализация (scalar, sse2, avx2),
+// которую поддерживает процессор, на блоках 20 (заголовок IPv4), 64, 1500 и
+// 9000 байт. Печатает нс на блок и ГБ/с. Перед замером суммы всех
+// реализаций сверяются со скалярной на блоках разной длины и выравнивания.
+// Блоки короче 64 байт checksum_add всегда считает скалярно.
+//
+// Запуск: ./bench_checksum [байт_на_реализацию_и_размер]
+#include "checksum.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_BYTES 2000000000LL
+#define BENCH_BUFFER_SIZE (64 * 1024) // Рабочий набор в L2
+#define BENCH_MAX_BLOCK 9000
+
+static u_char buffer[BENCH_BUFFER_SIZE + 64];
+static long long bench_bytes;
+static volatile unsigned long long bench_sink; // Против удаления циклов
+
+static const size_t block_sizes[] = {20, 64, 1500, 9000};
+static const checksum_impl_t impls[] = {
+    CHECKSUM_IMPL_SCALAR, CHECKSUM_IMPL_SSE2, CHECKSUM_IMPL_AVX2};
+
+// Все реализации должны давать одну и ту же свернутую сумму
+static int cross_check(void) {
+  for (size_t len = 0; len <= 2 * 1024; len += (len < 160 ? 1 : 97)) {
+    for (size_t shift = 0; shift < 8; shift++) {
+      checksum_select(CHECKSUM_IMPL_SCALAR);
+      u_int16_t expected =
+          checksum_fold(checksum_add(buffer + shift, len, 0x1234));
+      for (size_t i = 1; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (checksum_select(impls[i]) != 0) {
+          continue;
+        }
+        u_int16_t got =
+            checksum_fold(checksum_add(buffer + shift, len, 0x1234));
+        if (got != expected) {
+          fprintf(stderr,
+                  "bench_checksum: %s: длина %zu, сдвиг %zu: 0x%04x вместо "
+                  "0x%04x\n",
+                  checksum_impl_name(impls[i]), len, shift, got, expected);
+          return -1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static void bench_block(checksum_impl_t impl, size_t block) {
+  long long blocks = bench_bytes / (long long)block;
+  size_t slots = BENCH_BUFFER_SIZE / BENCH_MAX_BLOCK;
+  unsigned long long acc = 0;
+  checksum_select(impl);
+  double start = monotonic_seconds();
+  for (long long i = 0; i < blocks; i++) {
+    const u_char *data =
+        buffer + (size_t)(i % (long long)slots) * BENCH_MAX_BLOCK;
+    acc += checksum_fold(checksum_add(data, block, 0));
+  }
+  double elapsed = monotonic_seconds() - start;
+  bench_sink += acc;
+  printf("bench=checksum impl=%s block=%zu blocks=%lld seconds=%.6f "
+         "ns_per_block=%.2f gbytes_per_second=%.2f\n",
+         checksum_impl_name(impl), block, blocks, elapsed,
+         blocks > 0 ? elapsed * 1e9 / (double)blocks : 0.0,
+         elapsed > 0 ? (double)blocks * (double)block / elapsed / 1e9 : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+  bench_bytes = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_BYTES;
+  if (bench_bytes <= 0) {
+    fprintf(stderr, "Использование: %s [байт]\n", argv[0]);
+    return 1;
+  }
+  srand(1);
+  for (size_t i = 0; i < sizeof(buffer); i++) {
+    buffer[i] = (u_char)rand();
+  }
+  if (cross_check() != 0) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+    if (!checksum_impl_supported(impls[i])) {
+      printf("bench=checksum impl=%s unsupported\n",
+             checksum_impl_name(impls[i]));
+      continue;
+    }
+    for (size_t j = 0; j < sizeof(block_sizes) / sizeof(block_sizes[0]); j++) {
+      bench_block(impls[i], block_sizes[j]);
+    }
+  }
+  checksum_init();
+  printf("bench=checksum selected=%s\n",
+         checksum_impl_name(checksum_current_impl()));
+  return 0;
+}
@@ -0,0 +1,148 @@
+// bench/bench_e2e.c
+// Сквозной бенчмарк: синтетический трафик (traffic_gen.h) проходит весь
+// путь рабочего потока - очередь, packet_describe, таблица потоков,
+// счетчики и контрольные суммы - при 1, 2, 4, ... рабочих потоках. Пакеты
+// заранее собраны в памяти (рабочий набор повторяется со сдвигом времени),
+// поэтому меряется обработка, а не libpcap и диск. Два режима постановки:
+// copy (queue_batch_add, как -r и -i) и zero_copy (как -B tpacket и -R).
+//
+// Запуск: ./bench_e2e [пакетов] [макс_потоков] [параметры трафика]
+#include "checksum.h"
+#include "flow_table.h"
+#include "output_sink.h"
+#include "stats.h"
+#include "thread_pool_queue.h"
+#include "traffic_gen.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_PACKETS 4000000LL
+#define BENCH_WORKING_SET 65536 // Разных пакетов в памяти
+
+typedef struct {
+  struct pcap_pkthdr header;
+  const u_char *data;
+} bench_packet_t;
+
+static bench_packet_t *packets;
+static u_char *packet_bytes;
+static long long bench_packets;
+static traffic_gen_options_t traffic;
+
+static int build_working_set(void) {
+  packets = calloc(BENCH_WORKING_SET, sizeof(*packets));
+  packet_bytes = malloc((size_t)BENCH_WORKING_SET * TRAFFIC_GEN_MAX_FRAME);
+  if (packets == NULL || packet_bytes == NULL) {
+    perror("bench_e2e: Ошибка выделения памяти");
+    return -1;
+  }
+  size_t used = 0;
+  for (int i = 0; i < BENCH_WORKING_SET; i++) {
+    u_char *frame = packet_bytes + used;
+    traffic_gen_packet(&traffic, (unsigned long long)i, frame,
+                       &packets[i].header);
+    packets[i].data = frame;
+    used += packets[i].header.caplen;
+  }
+  return 0;
+}
+
+static void release_nothing(void *cookie) { (void)cookie; }
+
+// Один прогон; -1 при ошибке инициализации
+static double run(int workers, int zero_copy, flow_table_stats_t *flows) {
+  flow_table_options_t flow_options;
+  flow_table_get_default_options(&flow_options);
+  queue_options_t queue_options;
+  queue_get_default_options(&queue_options);
+  queue_options.snaplen = zero_copy ? 64 : TRAFFIC_GEN_MAX_FRAME;
+  queue_set_options(&queue_options);
+  if (flow_tables_init(workers, &flow_options) != 0 ||
+      checksum_counters_init(workers) != 0 || stats_init(workers, 1) != 0 ||
+      queue_init_batch(workers, process_packet_task, process_packet_batch) !=
+          0) {
+    flow_tables_destroy();
+    checksum_counters_destroy();
+    stats_destroy();
+    return -1;
+  }
+  static packet_batch_t batch;
+  queue_set_producer_stats(stats_producer_get(0));
+  // Время идет дальше с каждым проходом по рабочему набору
+  u_int64_t cycle_us =
+      (u_int64_t)BENCH_WORKING_SET * 1000000ULL / traffic.rate_pps;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_packet_t *p = &packets[i % BENCH_WORKING_SET];
+    struct pcap_pkthdr header = p->header;
+    u_int64_t shift = (u_int64_t)(i / BENCH_WORKING_SET) * cycle_us;
+    u_int64_t usec = (u_int64_t)header.ts.tv_usec + shift;
+    header.ts.tv_sec += (time_t)(usec / 1000000);
+    header.ts.tv_usec = (suseconds_t)(usec % 1000000);
+    if (zero_copy) {
+      queue_batch_add_zero_copy(&batch, &header, p->data, release_nothing,
+                                NULL);
+    } else {
+      queue_batch_add(&batch, &header, p->data);
+    }
+  }
+  queue_add_packet_batch(&batch);
+  queue_shutdown();
+  double elapsed = monotonic_seconds() - start;
+  flow_tables_get_stats(flows);
+  flow_tables_destroy();
+  checksum_counters_destroy();
+  stats_destroy();
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  bench_packets = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_PACKETS;
+  int max_workers = argc > 2 ? atoi(argv[2]) : 4;
+  traffic_gen_default_options(&traffic);
+  if (bench_packets <= 0 || max_workers <= 0 ||
+      (argc > 3 && traffic_gen_parse(argv[3], &traffic) != 0)) {
+    fprintf(stderr,
+            "Использование: %s [пакетов] [макс_потоков] [параметры]\n",
+            argv[0]);
+    return 1;
+  }
+  checksum_init();
+  output_sink_set_enabled(0);
+  if (build_working_set() != 0) {
+    return 1;
+  }
+  char params[256];
+  traffic_gen_describe(&traffic, params, sizeof(params));
+  unsigned long long bytes = 0;
+  for (long long i = 0; i < bench_packets; i++) {
+    bytes += packets[i % BENCH_WORKING_SET].header.len;
+  }
+
+  // queue_init/queue_shutdown печатают свои сообщения - результаты идут
+  // строками "bench=... key=value"
+  for (int workers = 1; workers <= max_workers; workers *= 2) {
+    for (int zero_copy = 0; zero_copy <= 1; zero_copy++) {
+      flow_table_stats_t flows;
+      fflush(stdout);
+      double elapsed = run(workers, zero_copy, &flows);
+      if (elapsed < 0) {
+        fprintf(stderr, "bench_e2e: не удалось запустить %d потоков\n",
+                workers);
+        return 1;
+      }
+      printf("bench=e2e mode=%s workers=%d packets=%lld seconds=%.6f "
+             "packets_per_sec=%.0f mbit_per_sec=%.2f flows=%llu params=%s\n",
+             zero_copy ? "zero_copy" : "copy", workers, bench_packets,
+             elapsed, elapsed > 0 ? bench_packets / elapsed : 0.0,
+             elapsed > 0 ? bytes * 8.0 / elapsed / 1e6 : 0.0, flows.created,
+             params);
+    }
+  }
+  free(packets);
+  free(packet_bytes);
+  return 0;
+}
@@ -0,0 +1,298 @@
+// bench/bench_frag.c
+// Сверка сборки фрагментов IPv4 с генератором и ее скорость. Трафик
+// traffic_gen_frames содержит фрагментированные датаграммы (по порядку, в
+// обратном порядке, с повтором, с перекрытием, без последнего фрагмента)
+// вперемешку с целыми пакетами тех же потоков и поток фрагментов с одного
+// адреса. Он проходит весь путь рабочего потока - очередь, packet_describe,
+// ip_reassembly, передачу датаграммы владельцу потока, таблицу потоков и
+// контрольные суммы - при 1, 2, 4, ... рабочих потоках, с копированием в
+// пул и без. Итоги сборки и число потоков сравниваются с тем, что
+// сгенерировано; при расхождении - сообщение в stderr и код выхода 1.
+//
+// Запуск: ./bench_frag [номеров] [макс_потоков] [параметры трафика]
+//         (по умолчанию frag=20,flood=2,rate=10000)
+#include "checksum.h"
+#include "flow_table.h"
+#include "ip_reassembly.h"
+#include "output_sink.h"
+#include "stats.h"
+#include "thread_pool_queue.h"
+#include "traffic_gen.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_PACKETS 1000000LL
+#define BENCH_DEFAULT_TRAFFIC "frag=20,flood=2,rate=10000"
+#define BENCH_WORKING_SET 16384 // Разных номеров в памяти
+#define BENCH_ARENA (1024 * 1024) // Маленькая арена: поток фрагментов
+                                  // упирается в квоту источника
+#define BENCH_TIMEOUT 1 // Секунд на сборку
+
+typedef struct {
+  struct pcap_pkthdr header;
+  const u_char *data;
+} bench_packet_t;
+
+// Что должно получиться (по номерам генератора)
+typedef struct {
+  unsigned long long packets;   // Кадров
+  unsigned long long fragments; // Кадров-фрагментов
+  unsigned long long datagrams; // Датаграмм, которые соберутся
+  unsigned long long invalid;   // Датаграмм с перекрытием
+  unsigned long long unfinished; // Без последнего фрагмента и поток
+                                 // фрагментов
+  unsigned long long flows; // Потоков с целыми пакетами или датаграммами
+} bench_truth_t;
+
+static bench_packet_t *packets;
+static u_char *packet_bytes;
+static unsigned int *first_packet; // Кадры номера: [first, first + count)
+static unsigned char *packet_count;
+static traffic_gen_kind_t *kinds;
+static unsigned int *flow_numbers;
+static unsigned int working_set_packets;
+static long long bench_packets;
+static traffic_gen_options_t traffic;
+
+// Рабочий набор: кадры всех номеров подряд (два прохода - сначала размер)
+static int build_working_set(void) {
+  static u_char frames[TRAFFIC_GEN_MAX_FRAMES * TRAFFIC_GEN_MAX_FRAME];
+  struct pcap_pkthdr headers[TRAFFIC_GEN_MAX_FRAMES];
+  size_t bytes = 0;
+  for (int i = 0; i < BENCH_WORKING_SET; i++) {
+    traffic_gen_kind_t kind;
+    unsigned int flow;
+    unsigned int count = traffic_gen_frames(&traffic, (unsigned long long)i,
+                                            frames, headers, &kind, &flow);
+    for (unsigned int j = 0; j < count; j++) {
+      bytes += headers[j].caplen;
+    }
+    working_set_packets += count;
+  }
+  packets = calloc(working_set_packets, sizeof(*packets));
+  packet_bytes = malloc(bytes);
+  first_packet = calloc(BENCH_WORKING_SET, sizeof(*first_packet));
+  packet_count = calloc(BENCH_WORKING_SET, sizeof(*packet_count));
+  kinds = calloc(BENCH_WORKING_SET, sizeof(*kinds));
+  flow_numbers = calloc(BENCH_WORKING_SET, sizeof(*flow_numbers));
+  if (packets == NULL || packet_bytes == NULL || first_packet == NULL ||
+      packet_count == NULL || kinds == NULL || flow_numbers == NULL) {
+    perror("bench_frag: Ошибка выделения памяти");
+    return -1;
+  }
+  size_t used = 0;
+  unsigned int next = 0;
+  for (int i = 0; i < BENCH_WORKING_SET; i++) {
+    unsigned int count =
+        traffic_gen_frames(&traffic, (unsigned long long)i, frames, headers,
+                           &kinds[i], &flow_numbers[i]);
+    first_packet[i] = next;
+    packet_count[i] = (unsigned char)count;
+    for (unsigned int j = 0; j < count; j++, next++) {
+      memcpy(packet_bytes + used, frames + (size_t)j * TRAFFIC_GEN_MAX_FRAME,
+             headers[j].caplen);
+      packets[next].header = headers[j];
+      packets[next].data = packet_bytes + used;
+      used += headers[j].caplen;
+    }
+  }
+  return 0;
+}
+
+static int count_truth(bench_truth_t *truth) {
+  unsigned char *seen = calloc(traffic.flows, 1);
+  if (seen == NULL) {
+    perror("bench_frag: Ошибка выделения памяти");
+    return -1;
+  }
+  memset(truth, 0, sizeof(*truth));
+  for (long long i = 0; i < bench_packets; i++) {
+    int n = (int)(i % BENCH_WORKING_SET);
+    truth->packets += packet_count[n];
+    int whole = kinds[n] == TRAFFIC_GEN_WHOLE;
+    int complete = kinds[n] == TRAFFIC_GEN_FRAG_IN_ORDER ||
+                   kinds[n] == TRAFFIC_GEN_FRAG_REVERSE ||
+                   kinds[n] == TRAFFIC_GEN_FRAG_DUPLICATE;
+    if (!whole) {
+      truth->fragments += packet_count[n];
+    }
+    truth->datagrams += complete;
+    truth->invalid += kinds[n] == TRAFFIC_GEN_FRAG_OVERLAP;
+    truth->unfinished += kinds[n] == TRAFFIC_GEN_FRAG_MISSING ||
+                         kinds[n] == TRAFFIC_GEN_FLOOD;
+    if ((whole || complete) && !seen[flow_numbers[n]]) {
+      seen[flow_numbers[n]] = 1;
+      truth->flows++;
+    }
+  }
+  free(seen);
+  return 0;
+}
+
+static void release_nothing(void *cookie) { (void)cookie; }
+
+// Расхождение с генератором: сообщение и 1
+static int differs(const char *what, unsigned long long expected,
+                   unsigned long long actual, int workers, int zero_copy) {
+  if (expected == actual) {
+    return 0;
+  }
+  fprintf(stderr,
+          "bench_frag: %s (%s, потоков %d): ожидалось %llu, получено %llu\n",
+          what, zero_copy ? "zero_copy" : "copy", workers, expected, actual);
+  return 1;
+}
+
+// Один прогон со сверкой; -1 при ошибке инициализации
+static double run(int workers, int zero_copy, const bench_truth_t *truth,
+                  int *mismatches) {
+  flow_table_options_t flow_options;
+  flow_table_get_default_options(&flow_options);
+  flow_options.active_timeout = 1000000; // Только простой завершает поток
+  ip_reassembly_options_t reassembly_options;
+  ip_reassembly_get_default_options(&reassembly_options);
+  reassembly_options.memory_budget = BENCH_ARENA;
+  reassembly_options.timeout = BENCH_TIMEOUT;
+  queue_options_t queue_options;
+  queue_get_default_options(&queue_options);
+  queue_options.snaplen = zero_copy ? 64 : TRAFFIC_GEN_MAX_FRAME;
+  queue_set_options(&queue_options);
+  if (flow_tables_init(workers, &flow_options) != 0 ||
+      checksum_counters_init(workers) != 0 || stats_init(workers, 1) != 0 ||
+      ip_reassembly_init(workers, &reassembly_options) != 0 ||
+      queue_init_batch(workers, process_packet_task, process_packet_batch) !=
+          0) {
+    flow_tables_destroy();
+    checksum_counters_destroy();
+    stats_destroy();
+    ip_reassembly_destroy();
+    return -1;
+  }
+  static packet_batch_t batch;
+  queue_set_producer_stats(stats_producer_get(0));
+  // Время идет дальше с каждым проходом по рабочему набору
+  u_int64_t cycle_us =
+      (u_int64_t)BENCH_WORKING_SET * 1000000ULL / traffic.rate_pps;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    int n = (int)(i % BENCH_WORKING_SET);
+    u_int64_t shift = (u_int64_t)(i / BENCH_WORKING_SET) * cycle_us;
+    for (unsigned int j = 0; j < packet_count[n]; j++) {
+      const bench_packet_t *p = &packets[first_packet[n] + j];
+      struct pcap_pkthdr header = p->header;
+      u_int64_t usec = (u_int64_t)header.ts.tv_usec + shift;
+      header.ts.tv_sec += (time_t)(usec / 1000000);
+      header.ts.tv_usec = (suseconds_t)(usec % 1000000);
+      if (zero_copy) {
+        queue_batch_add_zero_copy(&batch, &header, p->data, release_nothing,
+                                  NULL);
+      } else {
+        queue_batch_add(&batch, &header, p->data);
+      }
+    }
+  }
+  queue_add_packet_batch(&batch);
+  queue_shutdown();
+  double elapsed = monotonic_seconds() - start;
+
+  ip_reassembly_stats_t reassembly;
+  ip_reassembly_get_stats(&reassembly);
+  flow_table_stats_t flows;
+  flow_tables_get_stats(&flows);
+  checksum_counters_t sums;
+  checksum_counters_sum(&sums);
+  queue_stats_t queue_stats;
+  queue_get_stats(&queue_stats);
+  *mismatches =
+      differs("фрагментов", truth->fragments, reassembly.fragments, workers,
+              zero_copy) +
+      differs("собрано датаграмм", truth->datagrams, reassembly.datagrams,
+              workers, zero_copy) +
+      differs("отброшено с перекрытием", truth->invalid, reassembly.invalid,
+              workers, zero_copy) +
+      differs("не собрано (таймаут, вытеснение, квота, в сборке)",
+              truth->unfinished,
+              reassembly.timeouts + reassembly.evicted +
+                  reassembly.quota_drops + reassembly.pending,
+              workers, zero_copy) +
+      differs("потоков", truth->flows, flows.created, workers, zero_copy) +
+      differs("неверных сумм TCP/UDP", 0, sums.l4_bad, workers, zero_copy) +
+      differs("потеряно при передаче", 0, queue_stats.forward_dropped,
+              workers, zero_copy);
+  printf("bench_frag: %s, потоков %d: таймаут %llu, вытеснено %llu, "
+         "квота %llu, в сборке %llu, передано владельцу %llu\n",
+         zero_copy ? "zero_copy" : "copy", workers, reassembly.timeouts,
+         reassembly.evicted, reassembly.quota_drops, reassembly.pending,
+         queue_stats.forwarded);
+  flow_tables_destroy();
+  checksum_counters_destroy();
+  stats_destroy();
+  ip_reassembly_destroy();
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  bench_packets = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_PACKETS;
+  int max_workers = argc > 2 ? atoi(argv[2]) : 4;
+  traffic_gen_default_options(&traffic);
+  traffic_gen_parse(BENCH_DEFAULT_TRAFFIC, &traffic);
+  if (bench_packets <= 0 || max_workers <= 0 ||
+      (argc > 3 && traffic_gen_parse(argv[3], &traffic) != 0)) {
+    fprintf(stderr,
+            "Использование: %s [номеров] [макс_потоков] [параметры]\n",
+            argv[0]);
+    return 1;
+  }
+  // Номер из рабочего набора повторяется через проход по набору с теми же
+  // адресами и идентификатором IP: старая датаграмма без последнего
+  // фрагмента должна к этому времени истечь
+  if ((unsigned long long)BENCH_WORKING_SET * 1000000ULL / traffic.rate_pps <=
+      BENCH_TIMEOUT * 1000000ULL) {
+    fprintf(stderr, "bench_frag: rate должен быть меньше %d\n",
+            BENCH_WORKING_SET / BENCH_TIMEOUT);
+    return 1;
+  }
+  checksum_init();
+  checksum_set_mode(CHECKSUM_MODE_ALL);
+  output_sink_set_enabled(0);
+  bench_truth_t truth;
+  if (build_working_set() != 0 || count_truth(&truth) != 0) {
+    return 1;
+  }
+  char params[256];
+  traffic_gen_describe(&traffic, params, sizeof(params));
+
+  // queue_init/queue_shutdown печатают свои сообщения - результаты идут
+  // строками "bench=... key=value"
+  int failed = 0;
+  for (int workers = 1; workers <= max_workers; workers *= 2) {
+    for (int zero_copy = 0; zero_copy <= 1; zero_copy++) {
+      int mismatches = 0;
+      fflush(stdout);
+      double elapsed = run(workers, zero_copy, &truth, &mismatches);
+      if (elapsed < 0) {
+        fprintf(stderr, "bench_frag: не удалось запустить %d потоков\n",
+                workers);
+        return 1;
+      }
+      failed += mismatches;
+      printf("bench=frag mode=%s workers=%d packets=%llu seconds=%.6f "
+             "packets_per_sec=%.0f datagrams=%llu flows=%llu check=%s "
+             "params=%s\n",
+             zero_copy ? "zero_copy" : "copy", workers, truth.packets,
+             elapsed, elapsed > 0 ? truth.packets / elapsed : 0.0,
+             truth.datagrams, truth.flows, mismatches == 0 ? "ok" : "failed",
+             params);
+    }
+  }
+  free(packets);
+  free(packet_bytes);
+  free(first_packet);
+  free(packet_count);
+  free(kinds);
+  free(flow_numbers);
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+// bench/bench_hll.c
+// Микробенчмарк HyperLogLog: точность оценки на 10^2..10^7 различных
+// значений (относительная ошибка против точного числа), время hll_add на
+// значение и время слияния набора регистров (побайтовый максимум).
+//
+// Запуск: ./bench_hll [максимум_значений]
+#include "flow_hash.h"
+#include "hll.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_MAX 10000000LL
+#define BENCH_MERGE_BYTES (17 * HLL_KEY_COUNT * HLL_REGISTERS) // 8 подсетей
+#define BENCH_MERGE_ROUNDS 20000
+
+static _Alignas(64) u_int8_t registers[HLL_REGISTERS];
+static _Alignas(64) u_int8_t merge_into[BENCH_MERGE_BYTES];
+static _Alignas(64) u_int8_t merge_from[BENCH_MERGE_BYTES];
+static volatile u_int8_t bench_sink; // Против удаления циклов
+
+// Значения 0..count-1 через тот же финализатор, что и в разборе пакетов
+static void bench_accuracy(long long count) {
+  memset(registers, 0, sizeof(registers));
+  double start = monotonic_seconds();
+  for (long long i = 0; i < count; i++) {
+    hll_add(registers, flow_hash_mix64((u_int64_t)i));
+  }
+  double elapsed = monotonic_seconds() - start;
+  double estimate = hll_estimate(registers);
+  printf("bench=hll distinct=%lld estimate=%.0f error_percent=%.2f "
+         "ns_per_add=%.2f\n",
+         count, estimate, (estimate - (double)count) * 100.0 / (double)count,
+         count > 0 ? elapsed * 1e9 / (double)count : 0.0);
+}
+
+static void bench_merge(void) {
+  for (size_t i = 0; i < BENCH_MERGE_BYTES; i++) {
+    merge_from[i] = (u_int8_t)(rand() % 20);
+  }
+  double start = monotonic_seconds();
+  for (int round = 0; round < BENCH_MERGE_ROUNDS; round++) {
+    merge_from[round % BENCH_MERGE_BYTES] ^= 1;
+    hll_merge(merge_into, merge_from, BENCH_MERGE_BYTES);
+  }
+  double elapsed = monotonic_seconds() - start;
+  bench_sink = merge_into[0];
+  printf("bench=hll merge_bytes=%d us_per_merge=%.2f gbytes_per_second=%.2f\n",
+         BENCH_MERGE_BYTES, elapsed * 1e6 / BENCH_MERGE_ROUNDS,
+         elapsed > 0 ? (double)BENCH_MERGE_BYTES * BENCH_MERGE_ROUNDS /
+                           elapsed / 1e9
+                     : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+  long long max_count = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_MAX;
+  if (max_count < 100) {
+    fprintf(stderr, "Использование: %s [максимум_значений >= 100]\n",
+            argv[0]);
+    return 1;
+  }
+  srand(1);
+  for (long long count = 100; count <= max_count; count *= 10) {
+    bench_accuracy(count);
+  }
+  bench_merge();
+  return 0;
+}
@@ -0,0 +1,337 @@
+// bench/bench_parsers.c
+// Микробенчмарк парсеров: время разбора одного заголовка (нс/пакет) для
+// Ethernet, снятия меток и туннелей (без меток, QinQ, VXLAN), IPv4, IPv6
+// (без расширений и с цепочкой из четырех заголовков расширения), TCP,
+// UDP, ICMP и полного packet_describe. Пакеты
+// собираются в памяти (пачка кадров с разными адресами и портами), каждый
+// парсер прогоняется по ним много раз.
+//
+// Запуск: ./bench_parsers [количество_пакетов]
+#include "packet_descriptor.h"
+#include "stats.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_PACKETS 20000000LL
+#define BENCH_FRAMES 256 // Кадров в рабочем наборе (все в L1/L2)
+#define BENCH_FRAME_SIZE 128
+#define BENCH_ETH_LEN 14
+#define BENCH_IP_LEN 20
+#define BENCH_TCP_LEN 32 // С опцией timestamps (12 байт)
+
+typedef struct {
+  u_char data[BENCH_FRAME_SIZE];
+  struct pcap_pkthdr header;
+} bench_frame_t;
+
+static bench_frame_t frames[BENCH_FRAMES];
+static long long bench_packets;
+static volatile unsigned long long bench_sink; // Против удаления циклов
+
+static void store_be16(u_char *p, u_int16_t value) {
+  p[0] = (u_char)(value >> 8);
+  p[1] = (u_char)value;
+}
+
+// Ethernet + IPv4 + заголовок протокола protocol; возвращает длину кадра
+static bpf_u_int32 build_frame(u_char *frame, u_int8_t protocol, int index) {
+  memset(frame, 0, BENCH_FRAME_SIZE);
+  for (int i = 0; i < 6; i++) {
+    frame[i] = (u_char)(0x02 + i);
+    frame[6 + i] = (u_char)(0x10 + i + index);
+  }
+  store_be16(frame + 12, 0x0800);
+
+  u_char *ip = frame + BENCH_ETH_LEN;
+  u_int16_t l4_len = protocol == IPPROTO_TCP ? BENCH_TCP_LEN : 8;
+  ip[0] = 0x45;
+  store_be16(ip + 2, (u_int16_t)(BENCH_IP_LEN + l4_len + 16));
+  store_be16(ip + 4, (u_int16_t)index);
+  ip[8] = 64;
+  ip[9] = protocol;
+  u_int32_t src = htonl(0x0a000001u + (u_int32_t)index);
+  u_int32_t dst = htonl(0xc0a80001u + (u_int32_t)(index * 7));
+  memcpy(ip + 12, &src, 4);
+  memcpy(ip + 16, &dst, 4);
+
+  u_char *l4 = ip + BENCH_IP_LEN;
+  if (protocol == IPPROTO_ICMP) {
+    l4[0] = 8; // Эхо-запрос
+    store_be16(l4 + 4, 0x1234);
+    store_be16(l4 + 6, (u_int16_t)index);
+  } else {
+    store_be16(l4, (u_int16_t)(1024 + index));
+    store_be16(l4 + 2, protocol == IPPROTO_TCP ? 443 : 53);
+    if (protocol == IPPROTO_TCP) {
+      l4[12] = (BENCH_TCP_LEN / 4) << 4;
+      l4[13] = 0x18; // PSH ACK
+      store_be16(l4 + 14, 65535);
+    } else {
+      store_be16(l4 + 4, 8 + 16);
+    }
+  }
+  return BENCH_ETH_LEN + BENCH_IP_LEN + l4_len + 16;
+}
+
+// Ethernet + IPv6 (+ Hop-by-Hop, Destination Options, Routing и Fragment
+// при with_ext) + TCP; возвращает длину кадра
+static bpf_u_int32 build_ipv6_frame(u_char *frame, int index, int with_ext) {
+  memset(frame, 0, BENCH_FRAME_SIZE);
+  for (int i = 0; i < 6; i++) {
+    frame[i] = (u_char)(0x02 + i);
+    frame[6 + i] = (u_char)(0x10 + i + index);
+  }
+  store_be16(frame + 12, 0x86DD);
+
+  u_char *ip = frame + BENCH_ETH_LEN;
+  ip[0] = 0x60;
+  ip[7] = 64;
+  ip[8] = 0x20;
+  ip[9] = 0x01;
+  ip[23] = (u_char)index;
+  ip[24] = 0x20;
+  ip[25] = 0x01;
+  ip[39] = (u_char)(index * 7 + 1);
+  bpf_u_int32 offset = BENCH_ETH_LEN + IPV6_HEADER_LEN;
+  u_char *next_header = ip + 6;
+  if (with_ext) {
+    static const u_int8_t chain[] = {IPPROTO_HOPOPTS, IPPROTO_DSTOPTS,
+                                     IPPROTO_ROUTING, IPPROTO_FRAGMENT};
+    for (size_t i = 0; i < sizeof(chain); i++) {
+      *next_header = chain[i];
+      next_header = frame + offset;
+      offset += 8; // Hdr Ext Len = 0, Fragment: смещение 0, M = 0
+    }
+  }
+  *next_header = IPPROTO_TCP;
+  u_char *l4 = frame + offset;
+  store_be16(l4, (u_int16_t)(1024 + index));
+  store_be16(l4 + 2, 443);
+  l4[12] = (TCP_MIN_HEADER_LEN / 4) << 4;
+  l4[13] = 0x10;
+  offset += TCP_MIN_HEADER_LEN;
+  store_be16(ip + 4, (u_int16_t)(offset - BENCH_ETH_LEN - IPV6_HEADER_LEN));
+  return offset;
+}
+
+static void build_ipv6_frames(int with_ext) {
+  for (int i = 0; i < BENCH_FRAMES; i++) {
+    bpf_u_int32 len = build_ipv6_frame(frames[i].data, i, with_ext);
+    frames[i].header.caplen = len;
+    frames[i].header.len = len;
+    frames[i].header.ts.tv_sec = 1700000000 + i;
+  }
+}
+
+static void build_frames(u_int8_t protocol) {
+  for (int i = 0; i < BENCH_FRAMES; i++) {
+    bpf_u_int32 len = build_frame(frames[i].data, protocol, i);
+    frames[i].header.caplen = len;
+    frames[i].header.len = len;
+    frames[i].header.ts.tv_sec = 1700000000 + i;
+  }
+}
+
+// Обертки для decap: QinQ (две метки) и VXLAN (IPv4 + UDP + VXLAN + Ethernet)
+#define BENCH_ENCAP_NONE 0
+#define BENCH_ENCAP_QINQ 1
+#define BENCH_ENCAP_VXLAN 2
+
+static void build_encap_frames(int encap) {
+  build_frames(IPPROTO_TCP);
+  for (int i = 0; i < BENCH_FRAMES && encap != BENCH_ENCAP_NONE; i++) {
+    u_char inner[BENCH_FRAME_SIZE];
+    bpf_u_int32 inner_len = frames[i].header.caplen;
+    memcpy(inner, frames[i].data, inner_len);
+    u_char *f = frames[i].data;
+    bpf_u_int32 len;
+    if (encap == BENCH_ENCAP_QINQ) {
+      // MAC-адреса, 0x88a8 + S-tag, 0x8100 + C-tag, дальше исходный EtherType
+      memcpy(f, inner, 12);
+      store_be16(f + 12, 0x88a8);
+      store_be16(f + 14, (u_int16_t)(10 + i));
+      store_be16(f + 16, 0x8100);
+      store_be16(f + 18, 100);
+      memcpy(f + 20, inner + 12, inner_len - 12);
+      len = inner_len + 8;
+    } else {
+      // Внешние Ethernet + IPv4 + UDP (порт 4789) + VXLAN, затем кадр целиком
+      bpf_u_int32 outer = BENCH_ETH_LEN + BENCH_IP_LEN + 8 + 8;
+      if (outer + inner_len > BENCH_FRAME_SIZE) {
+        inner_len = BENCH_FRAME_SIZE - outer;
+      }
+      build_frame(f, IPPROTO_UDP, i);
+      u_char *udp = f + BENCH_ETH_LEN + BENCH_IP_LEN;
+      store_be16(udp + 2, DECAP_VXLAN_PORT);
+      memset(udp + 8, 0, 8);
+      udp[8] = 0x08; // Флаг I: VNI действителен
+      udp[13] = (u_char)i;
+      memcpy(udp + 16, inner, inner_len);
+      len = outer + inner_len;
+    }
+    frames[i].header.caplen = len;
+    frames[i].header.len = len;
+  }
+}
+
+static void report(const char *parser, double elapsed) {
+  printf("bench=parsers parser=%s packets=%lld seconds=%.6f "
+         "ns_per_packet=%.2f\n",
+         parser, bench_packets, elapsed,
+         bench_packets > 0 ? elapsed * 1e9 / (double)bench_packets : 0.0);
+}
+
+static void bench_ethernet(void) {
+  build_frames(IPPROTO_TCP);
+  parsed_ethernet_header_t header;
+  unsigned long long acc = 0;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    acc += parse_ethernet_header(f->data, f->header.caplen, &header);
+    acc += header.ether_shost[5];
+  }
+  report("ethernet", monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+static void bench_ipv4(void) {
+  build_frames(IPPROTO_TCP);
+  parsed_ipv4_header_t header;
+  unsigned long long acc = 0;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    ip_parse_result_t result = parse_ipv4_header(
+        f->data + BENCH_ETH_LEN, f->header.caplen - BENCH_ETH_LEN, &header);
+    acc += result.payload_available_len + header.source_ip.s_addr;
+  }
+  report("ipv4", monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+static void bench_ipv6(int with_ext, const char *name) {
+  build_ipv6_frames(with_ext);
+  parsed_ipv6_header_t header;
+  unsigned long long acc = 0;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    ip_parse_result_t result = parse_ipv6_header(
+        f->data + BENCH_ETH_LEN, f->header.caplen - BENCH_ETH_LEN, &header);
+    acc += result.payload_available_len + result.transport_protocol;
+  }
+  report(name, monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+static void bench_decap(int encap, const char *name) {
+  build_encap_frames(encap);
+  decap_result_t result;
+  unsigned long long acc = 0;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    acc += (unsigned long long)decap_packet(f->data, f->header.caplen, &result);
+    acc += result.l3_offset + result.ether_type;
+  }
+  report(name, monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+static void bench_tcp(void) {
+  build_frames(IPPROTO_TCP);
+  parsed_tcp_header_t header;
+  unsigned long long acc = 0;
+  bpf_u_int32 offset = BENCH_ETH_LEN + BENCH_IP_LEN;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    acc += (unsigned long long)parse_tcp_header(
+        f->data + offset, f->header.caplen - offset, &header);
+    acc += header.source_port + header.flags;
+  }
+  report("tcp", monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+static void bench_udp(void) {
+  build_frames(IPPROTO_UDP);
+  parsed_udp_header_t header;
+  unsigned long long acc = 0;
+  bpf_u_int32 offset = BENCH_ETH_LEN + BENCH_IP_LEN;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    acc += (unsigned long long)parse_udp_header(
+        f->data + offset, f->header.caplen - offset, &header);
+    acc += header.source_port + header.length;
+  }
+  report("udp", monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+static void bench_icmp(void) {
+  build_frames(IPPROTO_ICMP);
+  parsed_icmp_header_t header;
+  unsigned long long acc = 0;
+  bpf_u_int32 offset = BENCH_ETH_LEN + BENCH_IP_LEN;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    acc += (unsigned long long)parse_icmp_header(
+        f->data + offset, f->header.caplen - offset, &header);
+    acc += header.sequence;
+  }
+  report("icmp", monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+// Полный разбор кадра в дескриптор (то, что делает рабочий поток)
+// (protocol 0 - IPv6 + TCP, with_ext - с цепочкой расширений)
+static void bench_describe(u_int8_t protocol, int with_ext, const char *name) {
+  if (protocol == 0) {
+    build_ipv6_frames(with_ext);
+  } else {
+    build_frames(protocol);
+  }
+  packet_descriptor_t desc;
+  unsigned long long acc = 0;
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_packets; i++) {
+    const bench_frame_t *f = &frames[i & (BENCH_FRAMES - 1)];
+    packet_describe(&f->header, f->data, &desc);
+    acc += desc.layers + desc.src_port + desc.payload_offset;
+  }
+  report(name, monotonic_seconds() - start);
+  bench_sink += acc;
+}
+
+int main(int argc, char *argv[]) {
+  bench_packets = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_PACKETS;
+  if (bench_packets <= 0) {
+    fprintf(stderr, "Использование: %s [пакетов]\n", argv[0]);
+    return 1;
+  }
+
+  bench_ethernet();
+  bench_ipv4();
+  bench_ipv6(0, "ipv6");
+  bench_ipv6(1, "ipv6_ext4");
+  bench_decap(BENCH_ENCAP_NONE, "decap_untagged");
+  bench_decap(BENCH_ENCAP_QINQ, "decap_qinq");
+  bench_decap(BENCH_ENCAP_VXLAN, "decap_vxlan");
+  bench_tcp();
+  bench_udp();
+  bench_icmp();
+  bench_describe(IPPROTO_TCP, 0, "describe_tcp");
+  bench_describe(IPPROTO_UDP, 0, "describe_udp");
+  bench_describe(IPPROTO_ICMP, 0, "describe_icmp");
+  bench_describe(0, 0, "describe_ipv6_tcp");
+  bench_describe(0, 1, "describe_ipv6_ext4_tcp");
+  return 0;
+}
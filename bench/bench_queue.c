@@ -0,0 +1,239 @@
+// bench/bench_queue.c
+// Микробенчмарк очереди задач: старая схема (мьютекс + две условные
+// переменные над кольцом на 100 слотов) против lock-free кольца с ожиданием
+// на futex, плюс полный путь queue_add_packet -> worker_loop и его пакетный
+// вариант queue_batch_add/queue_add_packet_batch.
+//
+// Запуск: ./bench_queue [количество_сообщений] [макс_потребителей]
+#include "futex_event.h"
+#include "ring_buffer.h"
+#include "stats.h"
+#include "thread_pool_queue.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_MESSAGES 2000000
+#define BENCH_MUTEX_CAPACITY 100 // Как QUEUE_CAPACITY в старой реализации
+#define BENCH_RING_CAPACITY 1024
+#define BENCH_SPIN_COUNT 256
+
+static long long bench_messages;
+static atomic_llong consumed_total;
+
+// --- Базовая линия: мьютекс + условные переменные ---
+static void *mutex_queue[BENCH_MUTEX_CAPACITY];
+static int mutex_count, mutex_head, mutex_tail;
+static int mutex_done;
+static pthread_mutex_t mutex_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mutex_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t mutex_not_full = PTHREAD_COND_INITIALIZER;
+
+static void *mutex_consumer(void *arg) {
+  (void)arg;
+  long long local = 0;
+  while (1) {
+    pthread_mutex_lock(&mutex_lock);
+    while (mutex_count == 0 && !mutex_done) {
+      pthread_cond_wait(&mutex_not_empty, &mutex_lock);
+    }
+    if (mutex_count == 0 && mutex_done) {
+      pthread_mutex_unlock(&mutex_lock);
+      break;
+    }
+    mutex_head = (mutex_head + 1) % BENCH_MUTEX_CAPACITY;
+    mutex_count--;
+    pthread_cond_signal(&mutex_not_full);
+    pthread_mutex_unlock(&mutex_lock);
+    local++;
+  }
+  atomic_fetch_add(&consumed_total, local);
+  return NULL;
+}
+
+static void mutex_produce_all(void) {
+  for (long long i = 0; i < bench_messages; i++) {
+    pthread_mutex_lock(&mutex_lock);
+    while (mutex_count == BENCH_MUTEX_CAPACITY) {
+      pthread_cond_wait(&mutex_not_full, &mutex_lock);
+    }
+    mutex_queue[mutex_tail] = (void *)(intptr_t)(i + 1);
+    mutex_tail = (mutex_tail + 1) % BENCH_MUTEX_CAPACITY;
+    mutex_count++;
+    pthread_cond_signal(&mutex_not_empty);
+    pthread_mutex_unlock(&mutex_lock);
+  }
+  pthread_mutex_lock(&mutex_lock);
+  mutex_done = 1;
+  pthread_cond_broadcast(&mutex_not_empty);
+  pthread_mutex_unlock(&mutex_lock);
+}
+
+static void mutex_reset(void) {
+  mutex_count = mutex_head = mutex_tail = 0;
+  mutex_done = 0;
+}
+
+// --- Lock-free кольцо + futex ---
+static ring_buffer_t bench_ring;
+static futex_event_t ring_not_empty, ring_not_full;
+static atomic_int ring_done;
+
+static void *ring_consumer(void *arg) {
+  (void)arg;
+  long long local = 0;
+  void *obj;
+  while (1) {
+    if (ring_dequeue_burst(&bench_ring, &obj, 1) == 1) {
+      futex_event_notify(&ring_not_full, 0);
+      local++;
+      continue;
+    }
+    if (atomic_load(&ring_done) && ring_count(&bench_ring) == 0) {
+      break;
+    }
+    int ready = 0;
+    for (int i = 0; i < BENCH_SPIN_COUNT && !ready; i++) {
+      ready = ring_count(&bench_ring) > 0;
+      ring_cpu_relax();
+    }
+    if (!ready) {
+      u_int32_t seq = futex_event_prepare(&ring_not_empty);
+      if (ring_count(&bench_ring) > 0 || atomic_load(&ring_done)) {
+        futex_event_cancel(&ring_not_empty);
+      } else {
+        futex_event_wait(&ring_not_empty, seq, 100);
+      }
+    }
+  }
+  atomic_fetch_add(&consumed_total, local);
+  return NULL;
+}
+
+static void ring_produce_all(void) {
+  for (long long i = 0; i < bench_messages; i++) {
+    void *obj = (void *)(intptr_t)(i + 1);
+    while (ring_enqueue_burst(&bench_ring, &obj, 1) == 0) {
+      u_int32_t seq = futex_event_prepare(&ring_not_full);
+      if (ring_count(&bench_ring) < bench_ring.capacity) {
+        futex_event_cancel(&ring_not_full);
+      } else {
+        futex_event_wait(&ring_not_full, seq, 100);
+      }
+    }
+    futex_event_notify(&ring_not_empty, 0);
+  }
+  atomic_store(&ring_done, 1);
+  futex_event_notify(&ring_not_empty, 1);
+}
+
+// --- Полный путь пула потоков ---
+static void noop_processing(packet_task_t *task) { (void)task; }
+
+static double run_pool(int consumers) {
+  static u_char packet[64];
+  struct pcap_pkthdr header;
+  memset(&header, 0, sizeof(header));
+  header.caplen = header.len = sizeof(packet);
+
+  if (queue_init(consumers, noop_processing) != 0) {
+    return 0;
+  }
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_messages; i++) {
+    queue_add_packet(&header, packet);
+  }
+  queue_shutdown();
+  return monotonic_seconds() - start;
+}
+
+static void noop_batch_processing(packet_task_t **tasks, unsigned int count) {
+  (void)tasks;
+  (void)count;
+}
+
+static double run_pool_batch(int consumers) {
+  static u_char packet[64];
+  static packet_batch_t batch;
+  struct pcap_pkthdr header;
+  memset(&header, 0, sizeof(header));
+  header.caplen = header.len = sizeof(packet);
+
+  if (queue_init_batch(consumers, noop_processing, noop_batch_processing) !=
+      0) {
+    return 0;
+  }
+  double start = monotonic_seconds();
+  for (long long i = 0; i < bench_messages; i++) {
+    queue_batch_add(&batch, &header, packet); // Полная пачка уходит сама
+  }
+  queue_add_packet_batch(&batch);
+  queue_shutdown();
+  return monotonic_seconds() - start;
+}
+
+static double run_threads(int consumers, void *(*consumer)(void *),
+                          void (*produce_all)(void)) {
+  pthread_t threads[consumers];
+  atomic_store(&consumed_total, 0);
+  double start = monotonic_seconds();
+  for (int i = 0; i < consumers; i++) {
+    pthread_create(&threads[i], NULL, consumer, NULL);
+  }
+  produce_all();
+  for (int i = 0; i < consumers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double elapsed = monotonic_seconds() - start;
+  if (atomic_load(&consumed_total) != bench_messages) {
+    fprintf(stderr, "ОШИБКА: получено %lld из %lld сообщений\n",
+            (long long)atomic_load(&consumed_total), bench_messages);
+  }
+  return elapsed;
+}
+
+static void report(const char *name, int consumers, double elapsed) {
+  printf("bench=queue impl=%s consumers=%d messages=%lld seconds=%.6f "
+         "ops_per_sec=%.0f\n",
+         name, consumers, bench_messages, elapsed,
+         elapsed > 0 ? bench_messages / elapsed : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+  bench_messages = argc > 1 ? atoll(argv[1]) : BENCH_DEFAULT_MESSAGES;
+  int max_consumers = argc > 2 ? atoi(argv[2]) : 4;
+  if (bench_messages <= 0 || max_consumers <= 0) {
+    fprintf(stderr, "Использование: %s [сообщений] [макс_потребителей]\n",
+            argv[0]);
+    return 1;
+  }
+
+  // queue_init/queue_shutdown печатают свои сообщения, поэтому результаты
+  // выводим строками "bench=... key=value" - их легко отфильтровать grep'ом
+  for (int consumers = 1; consumers <= max_consumers; consumers *= 2) {
+    mutex_reset();
+    report("mutex_condvar", consumers,
+           run_threads(consumers, mutex_consumer, mutex_produce_all));
+
+    ring_init(&bench_ring, BENCH_RING_CAPACITY, 0);
+    futex_event_init(&ring_not_empty);
+    futex_event_init(&ring_not_full);
+    atomic_store(&ring_done, 0);
+    report("lockfree_ring", consumers,
+           run_threads(consumers, ring_consumer, ring_produce_all));
+    ring_destroy(&bench_ring);
+
+    fflush(stdout);
+    double pool_elapsed = run_pool(consumers);
+    report("thread_pool_queue", consumers, pool_elapsed);
+
+    fflush(stdout);
+    double batch_elapsed = run_pool_batch(consumers);
+    report("thread_pool_queue_batch", consumers, batch_elapsed);
+  }
+  return 0;
+}
@@ -0,0 +1,118 @@
+#!/bin/sh
+# bench/run_bench.sh
+# Прогоняет все бенчмарки и analyst -r по сгенерированному файлу, собирает
+# строки "bench=... key=value" в файл результатов. Если задан файл базовых
+# результатов, сравнивает с ним и возвращает 1 при регрессии больше допуска.
+#
+# Запуск (из корня, после make bench): sh bench/run_bench.sh [результаты]
+#         [базовые_результаты]
+# Переменные: BENCH_THREADS (по умолчанию nproc), BENCH_PACKETS (1000000),
+#             BENCH_TRAFFIC (параметры генератора), BENCH_TOLERANCE (10 %),
+#             BENCH_TRACE (временный файл .pcap)
+set -e
+
+results=${1:-bench_results.txt}
+baseline=$2
+threads=${BENCH_THREADS:-$(nproc 2>/dev/null || echo 4)}
+packets=${BENCH_PACKETS:-1000000}
+traffic=${BENCH_TRAFFIC:-seed=1}
+tolerance=${BENCH_TOLERANCE:-10}
+trace=${BENCH_TRACE:-${TMPDIR:-/tmp}/analyst_bench.pcap}
+
+# Пропускная способность analyst -r (и -R) по его отчету о воспроизведении
+run_analyst() {
+  mode=$1
+  workers=$2
+  shift 2
+  ./analyst -r "$trace" -o none -t "$workers" "$@" 2>/dev/null |
+    awk -v mode="$mode" -v workers="$workers" -v packets="$packets" \
+      -v params="$params" '
+      /^Пропускная способность:/ {
+        printf "bench=analyst mode=%s workers=%s packets=%s " \
+               "packets_per_sec=%s params=%s\n",
+               mode, workers, packets, $3, params
+      }'
+}
+
+# Файл для analyst -r; params - полное описание трафика, как у bench_e2e
+gen_line=$(./bench_gen "$trace" "$packets" "$traffic")
+params=${gen_line##*params=}
+# Вне конвейера: расхождение сборки с генератором останавливает прогон
+frag_lines=$(./bench_frag "$packets" "$threads")
+
+{
+  ./bench_parsers "$packets"
+  ./bench_queue "$packets" "$threads"
+  ./bench_checksum
+  ./bench_hll
+  echo "$gen_line"
+  ./bench_e2e "$packets" "$threads" "$traffic"
+  echo "$frag_lines"
+  workers=1
+  while [ "$workers" -le "$threads" ]; do
+    run_analyst pcap "$workers"
+    run_analyst mmap "$workers" -R "$workers"
+    workers=$((workers * 2))
+  done
+} | grep '^bench=' >"$results"
+rm -f "$trace"
+echo "Результаты: $results ($(wc -l <"$results") строк)"
+
+if [ -z "$baseline" ]; then
+  exit 0
+fi
+
+# Строки сопоставляются по всем полям, кроме измерений; сравнивается одно
+# главное измерение строки: *_per_sec - чем больше, тем лучше, ns_per_* и
+# us_per_* - чем меньше, тем лучше
+awk -v tolerance="$tolerance" '
+  function parse(line,    n, i, f, name, value, key) {
+    n = split(line, f, " ")
+    key = ""
+    metric_name = ""
+    for (i = 1; i <= n; i++) {
+      name = f[i]
+      sub(/=.*/, "", name)
+      value = f[i]
+      sub(/^[^=]*=/, "", value)
+      if (name ~ /_per_sec$|^ns_per_|^us_per_/) {
+        if (metric_name == "") {
+          metric_name = name
+          metric_value = value
+        }
+      } else if (name !~ /^(seconds|estimate|error_percent|bytes|flows)$/ &&
+                 name !~ /^gbytes_per_second$/) {
+        key = key " " f[i]
+      }
+    }
+    return key
+  }
+  FNR == NR {
+    key = parse($0)
+    if (metric_name != "") {
+      base_name[key] = metric_name
+      base_value[key] = metric_value
+    }
+    next
+  }
+  {
+    key = parse($0)
+    if (metric_name == "" || !(key in base_value) || base_value[key] <= 0) {
+      next
+    }
+    compared++
+    change = (metric_value - base_value[key]) * 100.0 / base_value[key]
+    if (metric_name ~ /^(ns|us)_per_/) {
+      change = -change
+    }
+    if (change < -tolerance) {
+      printf "РЕГРЕССИЯ%s: %s %s -> %s (%.1f %%)\n", key, metric_name,
+             base_value[key], metric_value, change
+      regressions++
+    }
+  }
+  END {
+    printf "Сравнено строк: %d, регрессий (допуск %s %%): %d\n",
+           compared, tolerance, regressions
+    exit regressions > 0
+  }' "$baseline" "$results"
@@ -0,0 +1,443 @@
+// bench/traffic_gen.c
+#include "traffic_gen.h"
+#include "checksum.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_BASE_SECONDS 1700000000ULL
+#define GEN_ETH_LEN 14
+#define GEN_VLAN_LEN 4
+#define GEN_IPV4_LEN 20
+#define GEN_IPV6_LEN 40
+#define GEN_TCP_LEN 20
+#define GEN_UDP_LEN 8
+#define GEN_ICMP_LEN 8
+#define GEN_MIN_ETH_FRAME 60 // Короткий кадр дополняется нулями
+#define GEN_FRAG_CHUNK 1480  // Данных во фрагменте: MTU 1500 - заголовок IP
+#define GEN_MAX_FRAGMENTS 4
+#define GEN_MAX_DATAGRAM                                                       \
+  (GEN_ETH_LEN + GEN_VLAN_LEN + GEN_IPV4_LEN +                                 \
+   GEN_MAX_FRAGMENTS * GEN_FRAG_CHUNK)
+#define GEN_FLOOD_SOURCE 0xAC100001u // 172.16.0.1
+
+// Свойства потока - функция только от seed и номера потока
+typedef struct {
+  u_int8_t protocol; // IPPROTO_TCP, IPPROTO_UDP, IPPROTO_ICMP(V6)
+  int ipv6;
+  int vlan;
+  u_int16_t vlan_id;
+  u_int32_t client; // Номер клиента: адрес 10.0.0.0/8 или 2001:db8::/32
+  u_int32_t server;
+  u_int16_t client_port;
+  u_int16_t server_port;
+} gen_flow_t;
+
+// splitmix64: дешевое перемешивание без состояния
+static u_int64_t mix(u_int64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static void store_be16(u_char *p, u_int16_t value) {
+  p[0] = (u_char)(value >> 8);
+  p[1] = (u_char)value;
+}
+
+static void store_be32(u_char *p, u_int32_t value) {
+  store_be16(p, (u_int16_t)(value >> 16));
+  store_be16(p + 2, (u_int16_t)value);
+}
+
+// Контрольная сумма в поле (порядок байт сети, как у суммы по данным)
+static void store_checksum(u_char *field, u_int64_t sum) {
+  u_int16_t value = (u_int16_t)~checksum_fold(sum);
+  memcpy(field, &value, sizeof(value));
+}
+
+void traffic_gen_default_options(traffic_gen_options_t *options) {
+  options->seed = 1;
+  options->flows = 10000;
+  options->tcp_percent = 70;
+  options->udp_percent = 25;
+  options->ipv6_percent = 10;
+  options->vlan_percent = 10;
+  options->size_min = 64;
+  options->size_max = 1518;
+  options->rate_pps = 1000000;
+  options->frag_percent = 0;
+  options->flood_percent = 0;
+}
+
+static int parse_unsigned(const char *text, unsigned long long max,
+                          unsigned long long *value) {
+  char *end;
+  *value = strtoull(text, &end, 10);
+  return end != text && *end == '\0' && *value <= max ? 0 : -1;
+}
+
+int traffic_gen_parse(const char *text, traffic_gen_options_t *options) {
+  char copy[512];
+  if (snprintf(copy, sizeof(copy), "%s", text) >= (int)sizeof(copy)) {
+    fprintf(stderr, "Слишком длинные параметры трафика\n");
+    return -1;
+  }
+  char *saveptr;
+  for (char *item = strtok_r(copy, ",", &saveptr); item != NULL;
+       item = strtok_r(NULL, ",", &saveptr)) {
+    char *value = strchr(item, '=');
+    if (value == NULL) {
+      fprintf(stderr, "Неверный параметр трафика: %s\n", item);
+      return -1;
+    }
+    *value++ = '\0';
+    unsigned long long number = 0;
+    int bad;
+    if (strcmp(item, "size") == 0) {
+      char *dash = strchr(value, '-');
+      unsigned long long max = 0;
+      if (dash != NULL) {
+        *dash = '\0';
+      }
+      bad = parse_unsigned(value, TRAFFIC_GEN_MAX_FRAME, &number) != 0 ||
+            parse_unsigned(dash != NULL ? dash + 1 : value,
+                           TRAFFIC_GEN_MAX_FRAME, &max) != 0 ||
+            number < TRAFFIC_GEN_MIN_FRAME || max < number;
+      options->size_min = (unsigned int)number;
+      options->size_max = (unsigned int)max;
+    } else if (strcmp(item, "seed") == 0) {
+      bad = parse_unsigned(value, ~0ULL, &options->seed) != 0;
+    } else {
+      bad = parse_unsigned(value, 0xFFFFFFFFULL, &number) != 0;
+      if (strcmp(item, "flows") == 0 && number > 0) {
+        options->flows = (unsigned int)number;
+      } else if (strcmp(item, "tcp") == 0 && number <= 100) {
+        options->tcp_percent = (unsigned int)number;
+      } else if (strcmp(item, "udp") == 0 && number <= 100) {
+        options->udp_percent = (unsigned int)number;
+      } else if (strcmp(item, "ipv6") == 0 && number <= 100) {
+        options->ipv6_percent = (unsigned int)number;
+      } else if (strcmp(item, "vlan") == 0 && number <= 100) {
+        options->vlan_percent = (unsigned int)number;
+      } else if (strcmp(item, "rate") == 0 && number > 0) {
+        options->rate_pps = (unsigned int)number;
+      } else if (strcmp(item, "frag") == 0 && number <= 100) {
+        options->frag_percent = (unsigned int)number;
+      } else if (strcmp(item, "flood") == 0 && number <= 100) {
+        options->flood_percent = (unsigned int)number;
+      } else {
+        bad = 1;
+      }
+    }
+    if (bad) {
+      fprintf(stderr, "Неверный параметр трафика: %s\n", item);
+      return -1;
+    }
+  }
+  if (options->tcp_percent + options->udp_percent > 100) {
+    fprintf(stderr, "Доли tcp и udp в сумме больше 100%%\n");
+    return -1;
+  }
+  return 0;
+}
+
+void traffic_gen_describe(const traffic_gen_options_t *options, char *buffer,
+                          size_t size) {
+  int used = snprintf(
+      buffer, size,
+      "tcp=%u,udp=%u,ipv6=%u,vlan=%u,flows=%u,size=%u-%u,rate=%u,seed=%llu",
+      options->tcp_percent, options->udp_percent, options->ipv6_percent,
+      options->vlan_percent, options->flows, options->size_min,
+      options->size_max, options->rate_pps, options->seed);
+  // Без фрагментов строка прежняя: с ней сравниваются старые результаты
+  if (used > 0 && (size_t)used < size && options->frag_percent > 0) {
+    used += snprintf(buffer + used, size - (size_t)used, ",frag=%u",
+                     options->frag_percent);
+  }
+  if (used > 0 && (size_t)used < size && options->flood_percent > 0) {
+    snprintf(buffer + used, size - (size_t)used, ",flood=%u",
+             options->flood_percent);
+  }
+}
+
+static void flow_properties(const traffic_gen_options_t *options,
+                            u_int32_t flow, gen_flow_t *out) {
+  static const u_int16_t server_ports[] = {80, 443, 53, 22, 8080, 123};
+  u_int64_t h = mix(options->seed * 0x100000001B3ULL + flow);
+  u_int64_t h2 = mix(h);
+  unsigned int choice = (unsigned int)(h % 100);
+  out->ipv6 = (h2 % 100) < options->ipv6_percent;
+  out->vlan = ((h2 >> 8) % 100) < options->vlan_percent;
+  out->vlan_id = (u_int16_t)(1 + (h2 >> 16) % 4094);
+  if (choice < options->tcp_percent) {
+    out->protocol = IPPROTO_TCP;
+  } else if (choice < options->tcp_percent + options->udp_percent) {
+    out->protocol = IPPROTO_UDP;
+  } else {
+    out->protocol = out->ipv6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP;
+  }
+  out->client = flow; // Разные потоки - разные клиенты
+  out->server = (u_int32_t)((h >> 32) % 256);
+  out->client_port = (u_int16_t)(1024 + (h2 >> 32) % 60000);
+  out->server_port =
+      server_ports[(h >> 40) % (sizeof(server_ports) / sizeof(*server_ports))];
+}
+
+// Длины заголовков кадра потока
+static void header_lengths(const gen_flow_t *flow, u_int32_t *l2_len,
+                           u_int32_t *l3_len, u_int32_t *l4_len) {
+  *l2_len = GEN_ETH_LEN + (flow->vlan ? GEN_VLAN_LEN : 0);
+  *l3_len = flow->ipv6 ? GEN_IPV6_LEN : GEN_IPV4_LEN;
+  *l4_len = flow->protocol == IPPROTO_TCP   ? GEN_TCP_LEN
+            : flow->protocol == IPPROTO_UDP ? GEN_UDP_LEN
+                                            : GEN_ICMP_LEN;
+}
+
+// Метка времени номера index
+static void set_header(const traffic_gen_options_t *options,
+                       unsigned long long index, u_int32_t size,
+                       struct pcap_pkthdr *header) {
+  u_int64_t us = index * 1000000ULL / options->rate_pps;
+  header->ts.tv_sec = (time_t)(GEN_BASE_SECONDS + us / 1000000);
+  header->ts.tv_usec = (suseconds_t)(us % 1000000);
+  header->caplen = size;
+  header->len = size;
+}
+
+// Кадр пакета номера index с payload_len байтами данных приложения; у
+// IPv4 dont_fragment задает флаг DF. Возвращает длину кадра
+static u_int32_t build_frame(unsigned long long index, const gen_flow_t *flow,
+                             int reply, u_int32_t payload_len,
+                             int dont_fragment, u_char *frame) {
+  u_int32_t l2_len, l3_len, l4_len;
+  header_lengths(flow, &l2_len, &l3_len, &l4_len);
+  u_int32_t size = l2_len + l3_len + l4_len + payload_len;
+
+  memset(frame, 0, size);
+  // Ethernet: MAC клиента зависит от потока, сервера (шлюза) - общий
+  u_char client_mac[6] = {0x02, 0x00, (u_char)(flow->client >> 24),
+                          (u_char)(flow->client >> 16),
+                          (u_char)(flow->client >> 8), (u_char)flow->client};
+  u_char server_mac[6] = {0x02, 0xff, 0x00, 0x00, 0x00, 0x01};
+  memcpy(frame, reply ? client_mac : server_mac, 6);
+  memcpy(frame + 6, reply ? server_mac : client_mac, 6);
+  u_char *p = frame + 12;
+  if (flow->vlan) {
+    store_be16(p, 0x8100);
+    store_be16(p + 2, flow->vlan_id);
+    p += GEN_VLAN_LEN;
+  }
+  store_be16(p, flow->ipv6 ? 0x86DD : 0x0800);
+  u_char *l3 = p + 2;
+  u_char *l4 = l3 + l3_len;
+
+  // Адреса: клиент 10.x.x.x (2001:db8::x), сервер 192.168.0.x (2001:db8:1::x)
+  u_int64_t sum;
+  if (flow->ipv6) {
+    struct in6_addr client, server;
+    memset(&client, 0, sizeof(client));
+    memset(&server, 0, sizeof(server));
+    client.s6_addr[0] = server.s6_addr[0] = 0x20;
+    client.s6_addr[1] = server.s6_addr[1] = 0x01;
+    client.s6_addr[2] = server.s6_addr[2] = 0x0d;
+    client.s6_addr[3] = server.s6_addr[3] = 0xb8;
+    server.s6_addr[5] = 1;
+    store_be32(client.s6_addr + 12, flow->client);
+    server.s6_addr[15] = (u_int8_t)flow->server;
+    l3[0] = 0x60;
+    store_be16(l3 + 4, (u_int16_t)(l4_len + payload_len));
+    l3[6] = flow->protocol;
+    l3[7] = 64;
+    memcpy(l3 + 8, reply ? &server : &client, 16);
+    memcpy(l3 + 24, reply ? &client : &server, 16);
+    sum = checksum_pseudo_ipv6(reply ? &server : &client,
+                               reply ? &client : &server, flow->protocol,
+                               l4_len + payload_len);
+  } else {
+    struct in_addr client, server;
+    client.s_addr = htonl(0x0A000000u | (flow->client & 0x00FFFFFFu));
+    server.s_addr = htonl(0xC0A80000u | flow->server);
+    l3[0] = 0x45;
+    store_be16(l3 + 2, (u_int16_t)(l3_len + l4_len + payload_len));
+    store_be16(l3 + 4, (u_int16_t)index);
+    l3[6] = dont_fragment ? 0x40 : 0; // DF
+    l3[8] = 64;
+    l3[9] = flow->protocol;
+    memcpy(l3 + 12, reply ? &server : &client, 4);
+    memcpy(l3 + 16, reply ? &client : &server, 4);
+    store_checksum(l3 + 10, checksum_add(l3, GEN_IPV4_LEN, 0));
+    sum = checksum_pseudo_ipv4(reply ? &server : &client,
+                               reply ? &client : &server, flow->protocol,
+                               l4_len + payload_len);
+  }
+
+  u_int16_t source_port = reply ? flow->server_port : flow->client_port;
+  u_int16_t destination_port = reply ? flow->client_port : flow->server_port;
+  u_char *checksum_field;
+  if (flow->protocol == IPPROTO_TCP) {
+    store_be16(l4, source_port);
+    store_be16(l4 + 2, destination_port);
+    store_be32(l4 + 4, (u_int32_t)index);
+    store_be32(l4 + 8, (u_int32_t)(index >> 1));
+    l4[12] = (GEN_TCP_LEN / 4) << 4;
+    l4[13] = payload_len > 0 ? 0x18 : 0x10; // PSH ACK или ACK
+    store_be16(l4 + 14, 65535);
+    checksum_field = l4 + 16;
+  } else if (flow->protocol == IPPROTO_UDP) {
+    store_be16(l4, source_port);
+    store_be16(l4 + 2, destination_port);
+    store_be16(l4 + 4, (u_int16_t)(GEN_UDP_LEN + payload_len));
+    checksum_field = l4 + 6;
+  } else {
+    l4[0] = flow->ipv6 ? (reply ? 129 : 128) : (reply ? 0 : 8); // Эхо
+    store_be16(l4 + 4, (u_int16_t)flow->client);
+    store_be16(l4 + 6, (u_int16_t)index);
+    checksum_field = l4 + 2;
+    if (!flow->ipv6) {
+      sum = 0; // У ICMPv4 нет псевдозаголовка
+    }
+  }
+  for (u_int32_t i = 0; i < payload_len; i++) {
+    l4[l4_len + i] = (u_char)(index + i);
+  }
+  store_checksum(checksum_field, checksum_add(l4, l4_len + payload_len, sum));
+  if (flow->protocol == IPPROTO_UDP && checksum_field[0] == 0 &&
+      checksum_field[1] == 0) {
+    checksum_field[0] = checksum_field[1] = 0xFF; // 0 в UDP - "без суммы"
+  }
+  return size;
+}
+
+void traffic_gen_packet(const traffic_gen_options_t *options,
+                        unsigned long long index, u_char *frame,
+                        struct pcap_pkthdr *header) {
+  u_int64_t h = mix(options->seed ^ mix(index));
+  gen_flow_t flow;
+  flow_properties(options, (u_int32_t)(h % options->flows), &flow);
+  int reply = (h >> 32) & 1; // Половина пакетов - в обратную сторону
+
+  u_int32_t l2_len, l3_len, l4_len;
+  header_lengths(&flow, &l2_len, &l3_len, &l4_len);
+  u_int32_t size =
+      options->size_min +
+      (u_int32_t)((h >> 40) % (options->size_max - options->size_min + 1));
+  if (size < l2_len + l3_len + l4_len) {
+    size = l2_len + l3_len + l4_len;
+  }
+  build_frame(index, &flow, reply, size - l2_len - l3_len - l4_len, 1, frame);
+  set_header(options, index, size, header);
+}
+
+// Фрагмент датаграммы (кадр build_frame без DF): данные [start, start +
+// length) после заголовка IPv4. Возвращает длину кадра
+static u_int32_t write_fragment(const u_char *datagram, u_int32_t l2_len,
+                                u_int32_t start, u_int32_t length,
+                                int more_fragments, u_char *frame) {
+  memcpy(frame, datagram, l2_len + GEN_IPV4_LEN);
+  u_char *ip = frame + l2_len;
+  store_be16(ip + 2, (u_int16_t)(GEN_IPV4_LEN + length));
+  store_be16(ip + 6, (u_int16_t)((more_fragments ? 0x2000 : 0) | start / 8));
+  ip[10] = ip[11] = 0;
+  store_checksum(ip + 10, checksum_add(ip, GEN_IPV4_LEN, 0));
+  memcpy(ip + GEN_IPV4_LEN, datagram + l2_len + GEN_IPV4_LEN + start, length);
+  u_int32_t size = l2_len + GEN_IPV4_LEN + length;
+  if (size < GEN_MIN_ETH_FRAME) {
+    memset(frame + size, 0, GEN_MIN_ETH_FRAME - size);
+    size = GEN_MIN_ETH_FRAME;
+  }
+  return size;
+}
+
+unsigned int traffic_gen_frames(const traffic_gen_options_t *options,
+                                unsigned long long index, u_char *frames,
+                                struct pcap_pkthdr *headers,
+                                traffic_gen_kind_t *kind, unsigned int *flow) {
+  u_int64_t h = mix(options->seed ^ mix(index));
+  u_int64_t hf = mix(h ^ 0xF4A6D1E3ULL); // Выбор фрагментации и сценария
+  u_char datagram[GEN_MAX_DATAGRAM];
+  gen_flow_t props;
+  if (hf % 100 < options->flood_percent) {
+    // Первая часть датаграммы 3 КиБ на случайный сервер, вторая не придет
+    props.protocol = IPPROTO_UDP;
+    props.ipv6 = 0;
+    props.vlan = 0;
+    props.vlan_id = 0;
+    props.client = 0;
+    props.server = (u_int32_t)((hf >> 32) % 256);
+    props.client_port = 4444;
+    props.server_port = 53;
+    build_frame(index, &props, 0, 2 * GEN_FRAG_CHUNK - GEN_UDP_LEN, 0,
+                datagram);
+    store_be32(datagram + GEN_ETH_LEN + 12, GEN_FLOOD_SOURCE);
+    u_int32_t size =
+        write_fragment(datagram, GEN_ETH_LEN, 0, GEN_FRAG_CHUNK, 1, frames);
+    set_header(options, index, size, &headers[0]);
+    *kind = TRAFFIC_GEN_FLOOD;
+    *flow = 0;
+    return 1;
+  }
+  *flow = (unsigned int)(h % options->flows);
+  flow_properties(options, *flow, &props);
+  if (props.protocol != IPPROTO_UDP || props.ipv6 ||
+      (hf >> 8) % 100 >= options->frag_percent) {
+    traffic_gen_packet(options, index, frames, &headers[0]);
+    *kind = TRAFFIC_GEN_WHOLE;
+    return 1;
+  }
+
+  // Датаграмма из 2-4 фрагментов, последний - от 1 до GEN_FRAG_CHUNK байт
+  unsigned int fragments = 2 + (unsigned int)((hf >> 24) % 3);
+  u_int32_t data_len = (fragments - 1) * GEN_FRAG_CHUNK + 1 +
+                       (u_int32_t)((hf >> 32) % GEN_FRAG_CHUNK);
+  u_int32_t l2_len, l3_len, l4_len;
+  header_lengths(&props, &l2_len, &l3_len, &l4_len);
+  build_frame(index, &props, (h >> 32) & 1, data_len - GEN_UDP_LEN, 0,
+              datagram);
+  unsigned int scenario = (unsigned int)((hf >> 16) % 100);
+  *kind = scenario < 60   ? TRAFFIC_GEN_FRAG_IN_ORDER
+          : scenario < 75 ? TRAFFIC_GEN_FRAG_REVERSE
+          : scenario < 85 ? TRAFFIC_GEN_FRAG_DUPLICATE
+          : scenario < 92 ? TRAFFIC_GEN_FRAG_OVERLAP
+                          : TRAFFIC_GEN_FRAG_MISSING;
+
+  // Порядок фрагментов по сценарию
+  unsigned int order[TRAFFIC_GEN_MAX_FRAMES];
+  unsigned int count = 0;
+  if (*kind == TRAFFIC_GEN_FRAG_DUPLICATE) {
+    order[count++] = 0;
+  }
+  unsigned int sent = *kind == TRAFFIC_GEN_FRAG_OVERLAP ||
+                              *kind == TRAFFIC_GEN_FRAG_MISSING
+                          ? fragments - 1
+                          : fragments;
+  for (unsigned int i = 0; i < sent; i++) {
+    order[count++] = *kind == TRAFFIC_GEN_FRAG_REVERSE ? sent - 1 - i : i;
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    u_int32_t start = order[i] * GEN_FRAG_CHUNK;
+    u_int32_t end = start + GEN_FRAG_CHUNK < data_len
+                        ? start + GEN_FRAG_CHUNK
+                        : data_len;
+    u_int32_t size =
+        write_fragment(datagram, l2_len, start, end - start, end < data_len,
+                       frames + (size_t)i * TRAFFIC_GEN_MAX_FRAME);
+    set_header(options, index, size, &headers[i]);
+  }
+  if (*kind == TRAFFIC_GEN_FRAG_OVERLAP) {
+    // Хвост датаграммы, начатый на 8 байт раньше конца предыдущего
+    // фрагмента (не длиннее GEN_FRAG_CHUNK): не повтор, а частичное
+    // перекрытие
+    u_int32_t start = (fragments - 1) * GEN_FRAG_CHUNK - 8;
+    u_int32_t length = data_len - start < GEN_FRAG_CHUNK ? data_len - start
+                                                         : GEN_FRAG_CHUNK;
+    u_int32_t size = write_fragment(
+        datagram, l2_len, start, length, start + length < data_len,
+        frames + (size_t)count * TRAFFIC_GEN_MAX_FRAME);
+    set_header(options, index, size, &headers[count++]);
+  }
+  return count;
+}
@@ -0,0 +1,96 @@
+// bench/traffic_gen.h
+// Детерминированный генератор синтетического трафика для бенчмарков:
+// пакет с номером i зависит только от параметров и i, поэтому прогоны с
+// одинаковыми параметрами сравнимы между версиями. Свойства потока
+// (протокол, IPv4/IPv6, VLAN, адреса, порты) выводятся из номера потока,
+// размер и время - из номера пакета. Номер может превратиться и в
+// фрагментированную датаграмму IPv4 (несколько кадров, traffic_gen_frames).
+#ifndef TRAFFIC_GEN_H
+#define TRAFFIC_GEN_H
+
+#include <pcap.h>
+#include <sys/types.h>
+
+#define TRAFFIC_GEN_MAX_FRAME 1518 // Ethernet + VLAN, MTU 1500
+#define TRAFFIC_GEN_MIN_FRAME 64
+#define TRAFFIC_GEN_MAX_FRAMES 5 // Кадров на номер: 4 фрагмента и повтор
+
+typedef struct {
+  unsigned long long seed;
+  unsigned int flows;        // Сколько разных потоков (5-кортежей)
+  unsigned int tcp_percent;  // Доли протоколов; остаток - ICMP
+  unsigned int udp_percent;
+  unsigned int ipv6_percent; // Доля потоков IPv6
+  unsigned int vlan_percent; // Доля потоков с меткой 802.1Q
+  unsigned int size_min;     // Длина кадра, равномерно в [min, max]
+  unsigned int size_max;
+  unsigned int rate_pps;     // Шаг меток времени (пакетов в секунду)
+  unsigned int frag_percent; // Доля номеров потоков UDP/IPv4, отправляемых
+                             // фрагментированной датаграммой
+  unsigned int flood_percent; // Доля номеров - одиночный первый фрагмент
+                              // от одного источника (поток фрагментов)
+} traffic_gen_options_t;
+
+void traffic_gen_default_options(traffic_gen_options_t *options);
+
+/**
+ * @brief Разбирает параметры вида "tcp=60,udp=30,ipv6=20,vlan=10,
+ * flows=1000,size=64-1500,rate=1000000,seed=1,frag=20,flood=2" (любое
+ * подмножество).
+ *
+ * @return int 0 при успехе, -1 при ошибке (сообщение в stderr).
+ */
+int traffic_gen_parse(const char *text, traffic_gen_options_t *options);
+
+// Параметры одной строкой в том же виде (для отчетов бенчмарков); frag и
+// flood - только ненулевые
+void traffic_gen_describe(const traffic_gen_options_t *options, char *buffer,
+                          size_t size);
+
+/**
+ * @brief Собирает пакет с номером index.
+ *
+ * Контрольные суммы IPv4, TCP, UDP и ICMP правильные (нужен
+ * checksum_init). frame - не меньше TRAFFIC_GEN_MAX_FRAME байт.
+ */
+void traffic_gen_packet(const traffic_gen_options_t *options,
+                        unsigned long long index, u_char *frame,
+                        struct pcap_pkthdr *header);
+
+// Во что генератор превратил номер пакета (для сверки с итогами сборки)
+typedef enum {
+  TRAFFIC_GEN_WHOLE = 0,      // Обычный пакет (traffic_gen_packet)
+  TRAFFIC_GEN_FRAG_IN_ORDER,  // Датаграмма: фрагменты по порядку
+  TRAFFIC_GEN_FRAG_REVERSE,   // Фрагменты в обратном порядке
+  TRAFFIC_GEN_FRAG_DUPLICATE, // Первый фрагмент повторен
+  TRAFFIC_GEN_FRAG_OVERLAP,   // Последний фрагмент частично перекрывает
+                              // предыдущий - датаграмма отбрасывается
+  TRAFFIC_GEN_FRAG_MISSING,   // Последний фрагмент потерян - датаграмма
+                              // ждет сборки до таймаута
+  TRAFFIC_GEN_FLOOD,          // Первый фрагмент с адреса 172.16.0.1 без
+                              // продолжения
+  TRAFFIC_GEN_KIND_COUNT
+} traffic_gen_kind_t;
+
+/**
+ * @brief Собирает кадры номера index: один пакет или фрагменты датаграммы.
+ *
+ * Без frag и flood совпадает с traffic_gen_packet. Иначе часть номеров
+ * потоков UDP/IPv4 становится датаграммой из 2-4 фрагментов по MTU 1500
+ * (того же потока, что и остальные его пакеты) с одним из сценариев
+ * traffic_gen_kind_t, а часть номеров - потоком фрагментов с одного
+ * адреса. Идентификатор IP - младшие 16 бит номера.
+ *
+ * @param frames Кадры подряд с шагом TRAFFIC_GEN_MAX_FRAME (место на
+ *               TRAFFIC_GEN_MAX_FRAMES кадров).
+ * @param headers Заголовки кадров (TRAFFIC_GEN_MAX_FRAMES).
+ * @param kind Что получилось.
+ * @param flow Номер потока (у TRAFFIC_GEN_FLOOD - 0, потока нет).
+ * @return unsigned int Количество кадров.
+ */
+unsigned int traffic_gen_frames(const traffic_gen_options_t *options,
+                                unsigned long long index, u_char *frames,
+                                struct pcap_pkthdr *headers,
+                                traffic_gen_kind_t *kind, unsigned int *flow);
+
+#endif // TRAFFIC_GEN_H
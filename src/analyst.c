@@ -1,6 +1,21 @@
 #include "thread_pool_queue.h"
+#include "capture_index.h"
+#include "capture_threads.h"
+#include "checksum.h"
+#include "hll.h"
+#include "ip_reassembly.h"
+#include "latency.h"
+#include "metrics_server.h"
+#include "output_sink.h"
+#include "pcap_capture.h"
+#include "pcap_mmap.h"
+#include "pcap_writer.h"
+#include "predicate.h"
+#include "stats.h"
+#include "topk.h"
 #include "utils.h"
 #include <arpa/inet.h>
+#include <getopt.h>
 #include <pcap.h>
 #include <signal.h> // Добавить обработку сигналов
 #include <stdio.h>
@@ -10,149 +25,961 @@
 #include <unistd.h>
 
 #define STANDART_SIZE 10
+// В режиме zero-copy данные не копируются в слот пула - буфер слота
+// минимальный
+#define ZERO_COPY_SLOT_DATA_SIZE 64
 static volatile int keep_pcap_loop_running =
     1; // volatile для отключения оптимизации и немедленного изменения
-// static pcap_t *global_pcap_handle = NULL; !!!!!!!!!!!!!!!!ТУТ ДОЛЖНА БЫТЬ
-// ОТРАБОТКА СИГНАЛОВ
+// Нужен обработчику сигналов
+static pcap_capture_set_t *global_capture_set = NULL;
 
-void pcap_packet_callback(u_char *user_args, // Новая функция колбэк
-                          const struct pcap_pkthdr *pkthdr,
-                          const u_char *packet_content) {
-  (void)user_args; // Пока не используется
+// Ctrl+C: прерываем pcap_dispatch, дальше main корректно завершает пул потоков
+static void handle_stop_signal(int signo) {
+  (void)signo;
+  keep_pcap_loop_running = 0;
+  if (global_capture_set != NULL) {
+    pcap_capture_break(global_capture_set);
+  }
+}
 
-  if (!keep_pcap_loop_running) { // Проверка флага остановки
-    return;
+static void print_usage(const char *prog_name) {
+  fprintf(stderr,
+          "Использование: %s [-i интерфейс] [-r файл.pcap [-R потоки]] "
+          "[-c количество] "
+          "[-t потоки] [-q емкость] [-s snaplen] [-H] [-D режим] "
+          "[-b пачка] [-B захват] [-F fanout] [-M сокеты] [-o вывод]\n"
+          "       [-f МиБ] [-T простой:активный] [-A МиБ[:секунд]] "
+          "[-C проверка]\n"
+          "       [-S секунд] [-K N] [-U] [-N подсеть] [-l] [-m адрес]\n"
+          "       [-P предикат] [-w файл [-G секунд] [-L МиБ] [-E байт] "
+          "[-X]]\n"
+          "       [-I файл.pcap] [-Q запрос] [выражение BPF]\n"
+          "  -i интерфейс  захват с указанного интерфейса; несколько через "
+          "запятую\n"
+          "                (eth0,eth1) или all - со всех активных, кроме "
+          "loopback\n"
+          "  -r файл       воспроизведение .pcap/.pcapng на максимальной "
+          "скорости\n"
+          "  -R потоки     с -r: читать классический pcap через mmap "
+          "несколькими потоками\n"
+          "                (части файла по %lu МиБ, пакеты без копирования)\n"
+          "  -c количество сколько пакетов обработать (0 - без ограничения;\n"
+          "                по умолчанию %d для интерфейса и весь файл для -r)\n"
+          "  -t потоки     количество рабочих потоков (по умолчанию - по "
+          "числу ядер)\n"
+          "  -q емкость    емкость очереди задач, округляется до степени "
+          "двойки (по умолчанию %d)\n"
+          "  -s snaplen    размер захвата и буфера пакета в пуле (по "
+          "умолчанию %d для интерфейса,\n"
+          "                snaplen файла, но не больше %d, для -r)\n"
+          "  -H            разместить пул пакетов на huge pages\n"
+          "  -D режим      распределение по потокам: flow - по хэшу потока "
+          "(по умолчанию),\n"
+          "                shared - общая очередь (без таблиц потоков и "
+          "сборки фрагментов)\n"
+          "  -b пачка      сколько задач рабочий поток забирает за раз "
+          "(1..%d, по умолчанию %d)\n"
+          "  -B захват     способ захвата с интерфейса: pcap (по умолчанию) "
+          "или tpacket -\n"
+          "                AF_PACKET TPACKET_V3 без копирования пакетов\n"
+          "  -F fanout     несколько сокетов tpacket в группе PACKET_FANOUT, "
+          "по потоку\n"
+          "                захвата на сокет: hash (по потоку), cpu или lb\n"
+          "  -M сокеты     количество сокетов для -F (по умолчанию - по числу "
+          "ядер,\n"
+          "                но не больше рабочих потоков)\n"
+          "  -o вывод      text - печатать разобранные пакеты (по "
+          "умолчанию),\n"
+          "                none - только анализ, без вывода\n"
+          "  -f МиБ        память под таблицы потоков (по умолчанию %lu)\n"
+          "  -T простой:активный\n"
+          "                таймауты потоков в секундах (по умолчанию "
+          "%d:%d)\n"
+          "  -A МиБ[:секунд]\n"
+          "                сборка фрагментов IPv4: память арен (0 - не "
+          "собирать, по\n"
+          "                умолчанию %lu) и таймаут сборки (по умолчанию "
+          "%d)\n"
+          "  -C проверка   контрольные суммы: ip - заголовок IPv4 (по "
+          "умолчанию),\n"
+          "                all - еще TCP/UDP, none - не проверять\n"
+          "  -S секунд     печатать статистику (скорость, протоколы, "
+          "ожидания очереди,\n"
+          "                потери ядра) каждые N секунд (по умолчанию - "
+          "только итог)\n"
+          "  -K N          печатать N самых активных IP источника, IP "
+          "назначения и потоков\n"
+          "                по байтам и пакетам (1..%d, с -S - еще каждый "
+          "интервал)\n"
+          "  -U            оценивать число уникальных источников, портов "
+          "назначения и\n"
+          "                потоков (HyperLogLog, с -S - еще каждый "
+          "интервал)\n"
+          "  -N подсеть    то же отдельно для входящего и исходящего "
+          "трафика подсети\n"
+          "                (адрес/длина, IPv4 или IPv6; до %d раз, включает "
+          "-U)\n"
+          "  -l            гистограммы задержки пакета (ожидание в очереди, "
+          "обработка)\n"
+          "                и глубины колец: p50/p99/p99.9/макс (с -S - еще "
+          "каждый интервал)\n"
+          "  -m адрес      отдавать счетчики в формате Prometheus (GET "
+          "/metrics): порт\n"
+          "                (на %s), адрес:порт или unix:путь\n"
+          "  -P предикат   второй этап фильтрации по разобранному пакету, "
+          "например\n"
+          "                \"tcp and syn and not ack\", \"vlan 10 and dst "
+          "net 10.0.0.0/8\"\n"
+          "                (см. predicate.h)\n"
+          "  -w файл       записывать пакеты (прошедшие фильтры) в .pcap; "
+          "диск не тормозит\n"
+          "                захват: если он не успевает, пакеты "
+          "отбрасываются со счетчиком\n"
+          "  -G секунд     новый файл каждые N секунд (файл.00000, "
+          "файл.00001, ...)\n"
+          "  -L МиБ        новый файл после N МиБ\n"
+          "  -E байт       записывать только первые N байт пакета "
+          "(например, заголовки)\n"
+          "  -X            строить рядом с каждым файлом -w индекс времени "
+          "и потоков (.idx)\n"
+          "  -I файл       построить индекс готового файла .pcap и выйти\n"
+          "  -Q запрос     с -r: читать по индексу только нужные записи, "
+          "например\n"
+          "                \"flow=tcp/10.0.0.1/1234/10.0.0.2/80 "
+          "from=1700000000 to=1700000060\"\n"
+          "  выражение BPF фильтр захвата в синтаксисе pcap-filter(7): для "
+          "интерфейса\n"
+          "                выполняется в ядре, для файла - в libpcap\n",
+          prog_name, PCAP_MMAP_CHUNK_SIZE / (1024 * 1024), STANDART_SIZE,
+          QUEUE_DEFAULT_CAPACITY, BUFSIZ,
+          QUEUE_DEFAULT_SNAPLEN, QUEUE_MAX_BATCH, QUEUE_DEFAULT_BATCH_SIZE,
+          FLOW_TABLE_DEFAULT_MEMORY / (1024 * 1024),
+          FLOW_TABLE_DEFAULT_IDLE_TIMEOUT, FLOW_TABLE_DEFAULT_ACTIVE_TIMEOUT,
+          IP_REASSEMBLY_DEFAULT_MEMORY / (1024 * 1024),
+          IP_REASSEMBLY_DEFAULT_TIMEOUT, TOPK_MAX_REPORT, HLL_MAX_SUBNETS,
+          METRICS_SERVER_DEFAULT_HOST);
+}
+
+// Аргументы после опций - выражение BPF, как у tcpdump; -1, если не
+// помещается в буфер
+static int join_filter_arguments(char **args, int count, char *buffer,
+                                 size_t size) {
+  size_t used = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < count; i++) {
+    int written = snprintf(buffer + used, size - used, "%s%s",
+                           i > 0 ? " " : "", args[i]);
+    if (written < 0 || (size_t)written >= size - used) {
+      return -1;
+    }
+    used += (size_t)written;
   }
-  // Добавляем пакет в очередь пула потоков
-  queue_add_packet(pkthdr, packet_content);
+  return 0;
 }
 
-int main() {
-  pcap_t *handle;
+// Добавляет имя интерфейса к списку через запятую; -1 при нехватке памяти
+static int append_interface(char **list, const char *name) {
+  size_t used = *list != NULL ? strlen(*list) : 0;
+  char *grown = realloc(*list, used + strlen(name) + 2);
+  if (grown == NULL) {
+    return -1;
+  }
+  snprintf(grown + used, strlen(name) + 2, "%s%s", used > 0 ? "," : "",
+           name);
+  *list = grown;
+  return 0;
+}
+
+// Разбивает список "eth0,eth1" на месте; количество имен или -1
+static int split_interface_list(char *list, const char **names, int max) {
+  int count = 0;
+  for (char *name = strtok(list, ","); name != NULL;
+       name = strtok(NULL, ",")) {
+    if (count >= max) {
+      fprintf(stderr, "Не больше %d интерфейсов\n", max);
+      return -1;
+    }
+    names[count++] = name;
+  }
+  return count > 0 ? count : -1;
+}
+
+// Отчет о пропускной способности после воспроизведения файла
+static void print_replay_report(int producer_count,
+                                const queue_stats_t *queue_stats,
+                                double init_time, double capture_time,
+                                double drain_time) {
+  double total_time = capture_time + drain_time;
+  printf("\n=== Отчет о воспроизведении ===\n");
+  unsigned long long packets = 0, bytes = 0;
+  for (int i = 0; i < producer_count; i++) { // Потоки чтения -R
+    packets += stats_load(&stats_producer_get(i)->packets);
+    bytes += stats_load(&stats_producer_get(i)->bytes);
+  }
+  printf("Пакетов: %llu, байт: %llu\n", packets, bytes);
+  printf("Отброшено (пул исчерпан): %llu, обрезано до snaplen: %llu\n",
+         queue_stats->pool_exhausted, queue_stats->truncated);
+  printf("Этапы (wall time):\n");
+  printf("  Инициализация пула потоков:          %.6f с\n", init_time);
+  printf("  Чтение файла и постановка в очередь: %.6f с\n", capture_time);
+  printf("  Дообработка очереди и завершение:    %.6f с\n", drain_time);
+  printf("  Всего (чтение + обработка):          %.6f с\n", total_time);
+  if (total_time > 0) {
+    printf("Пропускная способность: %.0f пакетов/с, %.0f байт/с (%.2f "
+           "Мбит/с)\n",
+           packets / total_time, bytes / total_time,
+           bytes * 8.0 / total_time / 1e6);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  pcap_t *handle = NULL;
+  static pcap_capture_set_t capture_set; // Дескрипторы libpcap
+  const char *dev_names[STATS_MAX_INTERFACES];
+  int dev_count = 0;
+  int capture_all = 0; // -i all
+  static capture_threads_t tpacket; // Используется при -B tpacket
+  int use_tpacket = 0;
+  int fanout_type = CAPTURE_NO_FANOUT;
+  int fanout_sockets = 0; // 0 - по умолчанию
   char errbuf[PCAP_ERRBUF_SIZE];
-  pcap_if_t *alldevs;
+  pcap_if_t *alldevs = NULL;
   pcap_if_t *d;
   char *dev_name = NULL;
-  int num_worker_threads;
+  const char *replay_file = NULL;
+  int mmap_readers = 0;          // -R, 0 - чтение через libpcap
+  static pcap_mmap_file_t mapped_file;
+  struct bpf_program mmap_filter; // Фильтр BPF для потоков чтения -R
+  int have_mmap_filter = 0;
+  int packet_count = -1; // -1: значение по умолчанию для режима
+  int num_worker_threads = 0;
+  int opt;
+  queue_options_t queue_options;
+  queue_stats_t queue_stats;
+  flow_table_options_t flow_options;
+  flow_table_stats_t flow_stats;
+  ip_reassembly_options_t reassembly_options;
+  int reassembly_requested = 0; // -A задан явно
+  int snaplen = 0; // 0 - значение по умолчанию для режима
+  double stats_interval = 0; // -S, 0 - без периодических отчетов
+  int topk_report = 0;       // -K, 0 - без списков самых активных
+  int count_unique = 0;      // -U/-N, оценки HyperLogLog
+  int measure_latency = 0;   // -l, гистограммы задержки
+  const char *metrics_address = NULL; // -m, без него - без сервера метрик
+  static char capture_filter[4096]; // Выражение BPF, "" - без фильтра
+  pcap_writer_options_t writer_options; // -w, path == NULL - без записи
+  const char *index_file = NULL;         // -I, построить индекс и выйти
+  const char *query_text = NULL;         // -Q, чтение -r по индексу
+  capture_index_query_t index_query;
   tzset(); // Время для проверки ошибки
+  checksum_init(); // Ядро суммирования по возможностям процессора
+
+  queue_get_default_options(&queue_options);
+  flow_table_get_default_options(&flow_options);
+  ip_reassembly_get_default_options(&reassembly_options);
+  pcap_writer_get_default_options(&writer_options);
+  const char *optstring =
+      "i:r:R:c:t:q:s:HD:b:B:F:M:o:f:T:A:C:S:K:UN:lm:P:w:G:L:E:XI:Q:h";
+  while ((opt = getopt(argc, argv, optstring)) != -1) {
+    switch (opt) {
+    case 'i':
+      dev_name = strdup(optarg);
+      if (dev_name == NULL) {
+        fprintf(stderr, "Не удалось выделить память для имени устройства\n");
+        return 1;
+      }
+      break;
+    case 'r':
+      replay_file = optarg;
+      break;
+    case 'R':
+      mmap_readers = atoi(optarg);
+      if (mmap_readers <= 0 || mmap_readers > PCAP_MMAP_MAX_READERS) {
+        fprintf(stderr, "Потоков чтения -R должно быть от 1 до %d\n",
+                PCAP_MMAP_MAX_READERS);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'c':
+      packet_count = atoi(optarg);
+      break;
+    case 't':
+      num_worker_threads = atoi(optarg);
+      break;
+    case 'q':
+      queue_options.capacity = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      snaplen = atoi(optarg);
+      break;
+    case 'H':
+      queue_options.use_huge_pages = 1;
+      break;
+    case 'D':
+      if (strcmp(optarg, "shared") == 0) {
+        queue_options.dispatch_mode = QUEUE_DISPATCH_SHARED;
+      } else if (strcmp(optarg, "flow") == 0) {
+        queue_options.dispatch_mode = QUEUE_DISPATCH_FLOW;
+      } else {
+        fprintf(stderr, "Неизвестный режим распределения: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'b':
+      queue_options.batch_size = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'B':
+      if (strcmp(optarg, "tpacket") == 0) {
+        use_tpacket = 1;
+      } else if (strcmp(optarg, "pcap") == 0) {
+        use_tpacket = 0;
+      } else {
+        fprintf(stderr, "Неизвестный способ захвата: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'F':
+      if (strcmp(optarg, "hash") == 0) {
+        fanout_type = PACKET_FANOUT_HASH;
+      } else if (strcmp(optarg, "cpu") == 0) {
+        fanout_type = PACKET_FANOUT_CPU;
+      } else if (strcmp(optarg, "lb") == 0) {
+        fanout_type = PACKET_FANOUT_LB;
+      } else {
+        fprintf(stderr, "Неизвестный режим fanout: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      use_tpacket = 1; // Fanout только для сокетов tpacket
+      break;
+    case 'M':
+      fanout_sockets = atoi(optarg);
+      break;
+    case 'f':
+      flow_options.memory_budget = strtoul(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 'T':
+      if (sscanf(optarg, "%u:%u", &flow_options.idle_timeout,
+                 &flow_options.active_timeout) != 2) {
+        fprintf(stderr, "Неверные таймауты потоков: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'A': {
+      char *end;
+      unsigned long megabytes = strtoul(optarg, &end, 10);
+      if (end == optarg || (*end != '\0' && *end != ':') ||
+          (*end == ':' &&
+           sscanf(end + 1, "%u", &reassembly_options.timeout) != 1) ||
+          reassembly_options.timeout == 0) {
+        fprintf(stderr, "Неверные параметры сборки фрагментов: %s\n",
+                optarg);
+        free(dev_name);
+        return 1;
+      }
+      reassembly_options.memory_budget = megabytes * 1024 * 1024;
+      reassembly_requested = 1;
+      break;
+    }
+    case 'C':
+      if (strcmp(optarg, "none") == 0) {
+        checksum_set_mode(CHECKSUM_MODE_NONE);
+      } else if (strcmp(optarg, "ip") == 0) {
+        checksum_set_mode(CHECKSUM_MODE_IP);
+      } else if (strcmp(optarg, "all") == 0) {
+        checksum_set_mode(CHECKSUM_MODE_ALL);
+      } else {
+        fprintf(stderr, "Неизвестный режим проверки сумм: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'S':
+      stats_interval = atof(optarg);
+      break;
+    case 'K':
+      topk_report = atoi(optarg);
+      if (topk_report <= 0 || topk_report > TOPK_MAX_REPORT) {
+        fprintf(stderr, "Неверный размер списка самых активных: %s\n",
+                optarg);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'U':
+      count_unique = 1;
+      break;
+    case 'N':
+      if (hll_add_subnet(optarg) != 0) {
+        fprintf(stderr, "Неверная подсеть: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      count_unique = 1;
+      break;
+    case 'l':
+      measure_latency = 1;
+      break;
+    case 'm':
+      metrics_address = optarg;
+      break;
+    case 'P':
+      if (predicate_compile(optarg) != 0) {
+        free(dev_name);
+        return 1;
+      }
+      break;
+    case 'w':
+      writer_options.path = optarg;
+      break;
+    case 'G':
+      writer_options.rotate_seconds = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'L':
+      writer_options.rotate_bytes =
+          strtoull(optarg, NULL, 10) * 1024ULL * 1024ULL;
+      break;
+    case 'E':
+      writer_options.snaplen = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'X':
+      writer_options.build_index = 1;
+      break;
+    case 'I':
+      index_file = optarg;
+      break;
+    case 'Q':
+      query_text = optarg;
+      break;
+    case 'o':
+      if (strcmp(optarg, "none") == 0) {
+        output_sink_set_enabled(0);
+      } else if (strcmp(optarg, "text") == 0) {
+        output_sink_set_enabled(1);
+      } else {
+        fprintf(stderr, "Неизвестный режим вывода: %s\n", optarg);
+        free(dev_name);
+        return 1;
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+      free(dev_name);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
 
-  // 1. Получить список всех устройств pcap_findalldevs(укзатель на струтуру,
-  // буффер для ошибки)
-  if (pcap_findalldevs(&alldevs, errbuf) == -1) {
-    fprintf(stderr, "Ошибка при вызове pcap_findalldevs: %s\n", errbuf);
+  if (join_filter_arguments(argv + optind, argc - optind, capture_filter,
+                            sizeof(capture_filter)) != 0) {
+    fprintf(stderr, "Слишком длинное выражение фильтра\n");
+    free(dev_name);
     return 1;
   }
-  // Печатаем информацию о интерфейсе(ПОКА)
-  for (d = alldevs; d != NULL; d = d->next) {
-    print_addresses(d);
+  if (index_file != NULL) {
+    free(dev_name);
+    return capture_index_build(index_file) == 0 ? 0 : 1;
+  }
+  if (query_text != NULL &&
+      (replay_file == NULL ||
+       capture_index_parse_query(query_text, &index_query) != 0)) {
+    if (replay_file == NULL) {
+      fprintf(stderr, "-Q работает только с -r\n");
+    }
+    free(dev_name);
+    return 1;
+  }
+  if (mmap_readers > 0 &&
+      (replay_file == NULL || query_text != NULL || packet_count > 0)) {
+    fprintf(stderr, "-R работает только с -r, без -Q и -c\n");
+    free(dev_name);
+    return 1;
+  }
+  if (replay_file != NULL && use_tpacket) {
+    fprintf(stderr, "-B tpacket и -F работают только с интерфейсом, не с "
+                    "-r\n");
+    free(dev_name);
+    return 1;
+  }
+  // Из общей очереди фрагменты одной датаграммы берут разные рабочие
+  // потоки, и ни в одной арене она не собралась бы
+  if (queue_options.dispatch_mode == QUEUE_DISPATCH_SHARED &&
+      reassembly_options.memory_budget > 0) {
+    if (reassembly_requested) {
+      fprintf(stderr, "-A не работает с -D shared\n");
+      free(dev_name);
+      return 1;
+    }
+    printf("Сборка фрагментов отключена: в режиме -D shared фрагменты "
+           "датаграммы разбирают разные рабочие потоки\n");
+    reassembly_options.memory_budget = 0;
   }
-  printf("\n");
 
-  // Выбираем интерфейс
-  for (d = alldevs; d != NULL; d = d->next) {
-    printf("Найден интерфейс: %s", d->name);
-    if (d->description) {
-      printf(" (%s)", d->description);
+  if (replay_file != NULL) {
+    // Режим воспроизведения: интерфейсы не нужны
+    handle = pcap_open_offline(replay_file, errbuf);
+    if (handle == NULL) {
+      fprintf(stderr, "Не удалось открыть файл %s: %s\n", replay_file, errbuf);
+      free(dev_name);
+      return 1;
+    }
+    if (packet_count < 0) {
+      packet_count = 0; // Весь файл
+    }
+    if (snaplen <= 0) {
+      // snaplen из заголовка файла часто 262144 - слоты такого размера
+      // раздули бы пул, поэтому ограничиваем (длиннее - обрежутся со
+      // счетчиком)
+      snaplen = pcap_snapshot(handle);
+      if (snaplen <= 0 || snaplen > QUEUE_DEFAULT_SNAPLEN) {
+        snaplen = QUEUE_DEFAULT_SNAPLEN;
+      }
+    }
+    if ((capture_filter[0] != '\0' &&
+         set_capture_filter(handle, NULL, capture_filter) != 0) ||
+        pcap_capture_init(&capture_set, 1) != 0) {
+      pcap_close(handle);
+      free(dev_name);
+      return 1;
+    }
+    pcap_capture_add(&capture_set, handle, NULL);
+    if (mmap_readers > 0 &&
+        pcap_mmap_open(replay_file, &mapped_file, 1) != 0) {
+      fprintf(stderr, "%s - не классический pcap с порядком байт машины, "
+                      "читает libpcap (-R не действует)\n",
+              replay_file);
+      mmap_readers = 0;
+    }
+    if (mmap_readers > 0 && capture_filter[0] != '\0') {
+      // libpcap фильтрует только в pcap_dispatch - потокам чтения своя
+      // копия, собранная для типа канального уровня файла
+      if (compile_socket_filter(capture_filter, (int)mapped_file.linktype,
+                                snaplen, &mmap_filter) != 0) {
+        pcap_mmap_close(&mapped_file);
+        pcap_capture_close(&capture_set);
+        free(dev_name);
+        return 1;
+      }
+      have_mmap_filter = 1;
+    }
+  } else {
+    // 1. Получить список всех устройств pcap_findalldevs(укзатель на
+    // струтуру, буффер для ошибки)
+    if (pcap_findalldevs(&alldevs, errbuf) == -1) {
+      fprintf(stderr, "Ошибка при вызове pcap_findalldevs: %s\n", errbuf);
+      free(dev_name);
+      return 1;
+    }
+    // Печатаем информацию о интерфейсе(ПОКА)
+    for (d = alldevs; d != NULL; d = d->next) {
+      print_addresses(d);
     }
     printf("\n");
 
-    // Проверяем, что это не loopback интерфейс и что он "UP" (активен)
-    // Флаг PCAP_IF_LOOPBACK проверяет, является ли интерфейс loopback
-    // Флаг PCAP_IF_UP (если доступен в вашей версии libpcap) проверяет, активен
-    // ли интерфейс Если нет PCAP_IF_UP, можно просто брать первый не-loopback
+    // Выбираем интерфейс (если не задан через -i) или все подходящие (-i
+    // all)
+    capture_all = dev_name != NULL && strcmp(dev_name, "all") == 0;
+    if (capture_all) {
+      free(dev_name);
+      dev_name = NULL;
+    }
+    for (d = alldevs; d != NULL && (dev_name == NULL || capture_all);
+         d = d->next) {
+      printf("Найден интерфейс: %s", d->name);
+      if (d->description) {
+        printf(" (%s)", d->description);
+      }
+      printf("\n");
 
-    // Условие выбора интерфейса:
-    // - НЕ loopback (PCAP_IF_LOOPBACK)
-    // - Активен (PCAP_IF_UP)
-    // - Работает (PCAP_IF_RUNNING)
-    if (!(d->flags & PCAP_IF_LOOPBACK) && (d->flags & PCAP_IF_RUNNING) &&
-        (d->flags & PCAP_IF_UP)) {
+      // Проверяем, что это не loopback интерфейс и что он "UP" (активен)
+      // Флаг PCAP_IF_LOOPBACK проверяет, является ли интерфейс loopback
+      // Флаг PCAP_IF_UP (если доступен в вашей версии libpcap) проверяет,
+      // активен ли интерфейс Если нет PCAP_IF_UP, можно просто брать первый
+      // не-loopback
 
-      // Нашли подходящий интерфейс
+      // Условие выбора интерфейса:
+      // - НЕ loopback (PCAP_IF_LOOPBACK)
+      // - Активен (PCAP_IF_UP)
+      // - Работает (PCAP_IF_RUNNING)
+      if (!(d->flags & PCAP_IF_LOOPBACK) && (d->flags & PCAP_IF_RUNNING) &&
+          (d->flags & PCAP_IF_UP)) {
 
-      dev_name = strdup(d->name);
-      if (dev_name == NULL) {
-        fprintf(stderr, "Не удалось выделить память для имени устройства\n");
-        pcap_freealldevs(alldevs);
-        alldevs = NULL;
+        // Нашли подходящий интерфейс
+
+        if (append_interface(&dev_name, d->name) != 0) {
+          fprintf(stderr, "Не удалось выделить память для имени устройства\n");
+          free(dev_name);
+          pcap_freealldevs(alldevs);
+          alldevs = NULL;
+          return 1;
+        }
+        printf("Выбран интерфейс: %s\n", d->name);
+      }
+    }
+    // Если не найдено интерфесов
+    if (dev_name == NULL) {
+      fprintf(stderr,
+              "Не найдено подходящего сетевого устройства для захвата.\n");
+      if (alldevs) { // Если список был получен, но устройство не выбрано
+        printf("Доступные устройства:\n");
+        for (d = alldevs; d != NULL; d = d->next) {
+          printf("- %s", d->name);
+          if (d->flags & PCAP_IF_LOOPBACK)
+            printf(" (Loopback)");
+          if (d->flags & PCAP_IF_UP)
+            printf(" (Up)");
+          else
+            printf(" (Down)");
+          if (d->flags & PCAP_IF_RUNNING)
+            printf(" (Running)");
+          else
+            printf(" (Not Running)");
+          printf("\n");
+        }
+      }
+
+      pcap_freealldevs(alldevs); // Освобождаем список
+      return 1;
+    }
+    pcap_freealldevs(alldevs);
+    alldevs = NULL;
+
+    // Открыть устройство для захвата
+    // Параметры: имя устройства, размер буфера для пакетов (snaplen),
+    // promiscuous mode (1 для включения), таймаут (ms), буфер ошибок
+    if (snaplen <= 0) {
+      snaplen = BUFSIZ;
+    }
+    dev_count =
+        split_interface_list(dev_name, dev_names, STATS_MAX_INTERFACES);
+    if (dev_count < 0) {
+      fprintf(stderr, "Неверный список интерфейсов\n");
+      free(dev_name);
+      return 1;
+    }
+    // Сокеты tpacket открываются ниже, когда известно число рабочих потоков
+    if (!use_tpacket && pcap_capture_init(&capture_set, dev_count) != 0) {
+      free(dev_name);
+      return 1;
+    }
+    for (int i = 0; !use_tpacket && i < dev_count; i++) {
+      handle = pcap_open_live(dev_names[i], snaplen, 1, 1000, errbuf);
+      if (handle == NULL) {
+        fprintf(stderr, "Не удалось открыть устройство %s: %s\n",
+                dev_names[i], errbuf);
+        pcap_capture_close(&capture_set);
+        free(dev_name); // Освобождаем скопированное имя
         return 1;
       }
-      printf("Выбран интерфейс: %s\n", dev_name);
-      break; // Выходим из цикла, так как нашли подходящее устройство
-    }
-  }
-  // Если не найдено интерфесов
-  if (dev_name == NULL) {
-    fprintf(stderr,
-            "Не найдено подходящего сетевого устройства для захвата.\n");
-    if (alldevs) { // Если список был получен, но устройство не выбрано
-      printf("Доступные устройства:\n");
-      for (d = alldevs; d != NULL; d = d->next) {
-        printf("- %s", d->name);
-        if (d->flags & PCAP_IF_LOOPBACK)
-          printf(" (Loopback)");
-        if (d->flags & PCAP_IF_UP)
-          printf(" (Up)");
-        else
-          printf(" (Down)");
-        if (d->flags & PCAP_IF_RUNNING)
-          printf(" (Running)");
-        else
-          printf(" (Not Running)");
-        printf("\n");
-      }
-    }
-
-    pcap_freealldevs(alldevs); // Освобождаем список
-    return 1;
+      if (capture_filter[0] != '\0' &&
+          set_capture_filter(handle, dev_names[i], capture_filter) != 0) {
+        pcap_close(handle);
+        pcap_capture_close(&capture_set);
+        free(dev_name);
+        return 1;
+      }
+      pcap_capture_add(&capture_set, handle, dev_names[i]);
+    }
+    if (packet_count < 0) {
+      packet_count = STANDART_SIZE;
+    }
   }
-
-  // Открыть устройство для захвата
-  // Параметры: имя устройства, размер буфера для пакетов (snaplen),
-  // promiscuous mode (1 для включения), таймаут (ms), буфер ошибок
-  handle = pcap_open_live(dev_name, BUFSIZ, 1, 1000, errbuf);
-  if (handle == NULL) {
-    fprintf(stderr, "Не удалось открыть устройство %s: %s\n", dev_name, errbuf);
-    free(dev_name); // Освобождаем скопированное имя
-    return 1;
+  if (!use_tpacket && capture_filter[0] != '\0') {
+    printf("Фильтр захвата: %s\n", capture_filter);
   }
-  num_worker_threads =
-      sysconf(_SC_NPROCESSORS_ONLN); // Пока для Linux!!! Переделать с условной
-                                     // компиляцией для мака и винды
+
   if (num_worker_threads <= 0) {
-    // Если sysconf не сработал или вернул невалидное значение,
-    // используем значение по умолчанию
-    fprintf(stderr, "Не удалось определить количество ядер, используем 4 "
-                    "потока по умолчанию.\n");
-    num_worker_threads = 4;
-  } else {
-    printf("Обнаружено %d процессорных ядер, используем столько же рабочих "
-           "потоков.\n",
-           num_worker_threads);
+    num_worker_threads =
+        sysconf(_SC_NPROCESSORS_ONLN); // Пока для Linux!!! Переделать с
+                                       // условной компиляцией для мака и винды
+    if (num_worker_threads <= 0) {
+      // Если sysconf не сработал или вернул невалидное значение,
+      // используем значение по умолчанию
+      fprintf(stderr, "Не удалось определить количество ядер, используем 4 "
+                      "потока по умолчанию.\n");
+      num_worker_threads = 4;
+    } else {
+      printf("Обнаружено %d процессорных ядер, используем столько же рабочих "
+             "потоков.\n",
+             num_worker_threads);
+    }
+  }
+
+  if (use_tpacket) {
+    int socket_count = 1;
+    if (fanout_type != CAPTURE_NO_FANOUT) {
+      socket_count = fanout_sockets;
+      if (socket_count <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        socket_count = cpus > 0 ? (int)cpus : 1;
+        if (socket_count > num_worker_threads) {
+          socket_count = num_worker_threads;
+        }
+      }
+    }
+    // Группы рабочих потоков только при fanout по хэшу: иначе один поток
+    // (flow) может прийти в разные сокеты
+    int worker_groups = fanout_type == PACKET_FANOUT_HASH &&
+                        queue_options.dispatch_mode == QUEUE_DISPATCH_FLOW;
+    // Фильтр компилируется один раз и ставится на каждый сокет
+    struct bpf_program socket_filter;
+    int have_filter = capture_filter[0] != '\0';
+    if (have_filter &&
+        compile_socket_filter(capture_filter, DLT_EN10MB, snaplen,
+                              &socket_filter) != 0) {
+      free(dev_name);
+      return 1;
+    }
+    int opened = capture_threads_open(
+        &tpacket, dev_names, dev_count, (unsigned int)snaplen,
+        have_filter ? &socket_filter : NULL, socket_count, fanout_type,
+        num_worker_threads, worker_groups);
+    if (have_filter) {
+      pcap_freecode(&socket_filter);
+    }
+    if (opened != 0) {
+      fprintf(stderr, "Не удалось открыть кольца TPACKET_V3\n");
+      free(dev_name);
+      return 1;
+    }
+    if (have_filter) {
+      printf("Фильтр захвата: %s\n", capture_filter);
+    }
   }
 
-  // Инициализируем очередь
-  int res_qeue_int = queue_init(num_worker_threads, process_packet_task);
+  // Заголовок файла записи: тип канального уровня и snaplen захвата
+  writer_options.file_snaplen = (unsigned int)snaplen;
+  if (!use_tpacket) {
+    writer_options.linktype = pcap_datalink(capture_set.captures[0].handle);
+  }
+  // Инициализируем очередь; при zero-copy слот хранит только заголовок
+  int producer_count = use_tpacket        ? tpacket.socket_count
+                       : mmap_readers > 0 ? mmap_readers
+                                          : capture_set.count;
+  queue_options.snaplen = use_tpacket || mmap_readers > 0
+                              ? ZERO_COPY_SLOT_DATA_SIZE
+                              : (unsigned int)snaplen;
+  queue_options.producers = (unsigned int)producer_count;
+  queue_set_options(&queue_options);
+  double time_start = monotonic_seconds();
+  // Таблицы потоков - по одной на рабочий поток (без общих блокировок).
+  // Из общей очереди пакеты одного потока берут разные рабочие потоки, и
+  // поток завелся бы в нескольких таблицах - в этом режиме таблиц нет
+  int use_flow_tables = queue_options.dispatch_mode == QUEUE_DISPATCH_FLOW;
+  if (!use_flow_tables) {
+    printf("Таблицы потоков отключены: в режиме -D shared пакеты одного "
+           "потока разбирают разные рабочие потоки\n");
+  }
+  flow_options.export_fn = export_flow_record;
+  // Каждая подсистема - со своим сообщением; очистка общая
+  const char *init_error = NULL;
+  if (use_flow_tables &&
+      flow_tables_init(num_worker_threads, &flow_options) != 0) {
+    init_error = "Не удалось создать таблицы потоков";
+  } else if (checksum_counters_init(num_worker_threads) != 0) {
+    init_error = "Не удалось создать счетчики контрольных сумм";
+  } else if (stats_init(num_worker_threads, producer_count) != 0) {
+    init_error = "Не удалось создать счетчики статистики";
+  } else if (topk_report > 0 &&
+             (topk_init(num_worker_threads, (unsigned int)topk_report) !=
+                  0 ||
+              stats_add_report_hook(topk_report_interval) != 0)) {
+    init_error = "Не удалось создать списки самых активных (-K)";
+  } else if (reassembly_options.memory_budget > 0 &&
+             (ip_reassembly_init(num_worker_threads, &reassembly_options) !=
+                  0 ||
+              stats_add_report_hook(ip_reassembly_report_interval) != 0)) {
+    init_error = "Не удалось создать арены сборки фрагментов (-A)";
+  } else if (count_unique &&
+             (hll_init(num_worker_threads) != 0 ||
+              stats_add_report_hook(hll_report_interval) != 0)) {
+    init_error = "Не удалось создать оценки уникальных адресов (-U/-N)";
+  } else if (
+      // При чтении файла метки времени в прошлом: отсчет от постановки
+      measure_latency &&
+      (latency_init(num_worker_threads, replay_file != NULL
+                                            ? LATENCY_FROM_ENQUEUE
+                                            : LATENCY_FROM_CAPTURE) != 0 ||
+       stats_add_report_hook(latency_report_interval) != 0)) {
+    init_error = "Не удалось создать гистограммы задержки (-l)";
+  } else if (writer_options.path != NULL &&
+             (pcap_writer_init(num_worker_threads, &writer_options) != 0 ||
+              stats_add_report_hook(pcap_writer_report_interval) != 0)) {
+    // Причину (чаще всего недоступный путь) печатает pcap_writer_init
+    init_error = "Не удалось запустить запись на диск (-w)";
+  }
+  if (init_error != NULL) {
+    fprintf(stderr, "%s\n", init_error);
+    flow_tables_destroy();
+    checksum_counters_destroy();
+    stats_destroy();
+    topk_destroy();
+    hll_destroy();
+    latency_destroy();
+    ip_reassembly_destroy();
+    pcap_writer_close();
+    if (use_tpacket) {
+      capture_threads_close(&tpacket);
+    } else {
+      pcap_capture_close(&capture_set);
+    }
+    pcap_mmap_close(&mapped_file);
+    if (have_mmap_filter) {
+      pcap_freecode(&mmap_filter);
+    }
+    free(dev_name);
+    return 1;
+  }
+  int res_qeue_int = queue_init_batch(num_worker_threads, process_packet_task,
+                                     process_packet_batch);
   if (res_qeue_int < 0) {
     fprintf(stderr, "Не удалось создать очередь %d\n",
             res_qeue_int); // Придумать отработку ошибок(пока они просто -1)
+    flow_tables_destroy();
+    checksum_counters_destroy();
+    stats_destroy();
+    topk_destroy();
+    hll_destroy();
+    latency_destroy();
+    ip_reassembly_destroy();
+    pcap_writer_close();
+    if (use_tpacket) {
+      capture_threads_close(&tpacket);
+    } else {
+      pcap_capture_close(&capture_set);
+    }
+    pcap_mmap_close(&mapped_file);
+    if (have_mmap_filter) {
+      pcap_freecode(&mmap_filter);
+    }
     free(dev_name); // Освобождаем скопированное имя
-    pcap_freealldevs(alldevs); // Освобождаем список
+    return 1;
   }
 
-  printf("Прослушивание на устройстве %s...\n", dev_name);
-  pcap_freealldevs(alldevs);
+  global_capture_set = &capture_set;
+  signal(SIGINT, handle_stop_signal);
+  signal(SIGTERM, handle_stop_signal);
 
-  // Параметры: хендл pcap, количество пакетов для захвата (-1 для
-  // бесконечного), функция-обработчик, пользовательские данные (NULL в данном
-  // случае)
-  pcap_loop(handle, STANDART_SIZE, pcap_packet_callback,
-            NULL); // Пока 100 пакетов
+  if (replay_file != NULL) {
+    printf("Воспроизведение файла %s...\n", replay_file);
+  } else {
+    printf("Прослушивание на устройстве %s", dev_names[0]);
+    for (int i = 1; i < dev_count; i++) {
+      printf(", %s", dev_names[i]);
+    }
+    printf("...\n");
+  }
+
+  if (stats_interval > 0 &&
+      stats_reporter_start((unsigned int)(stats_interval * 1000)) != 0) {
+    fprintf(stderr, "Периодическая статистика отключена\n");
+  }
+  if (metrics_address != NULL) {
+    if (metrics_server_start(metrics_address) == 0) {
+      printf("Метрики Prometheus (GET /metrics): %s\n", metrics_address);
+    } else {
+      fprintf(stderr, "Сервер метрик отключен\n");
+    }
+  }
+  double time_capture_start = monotonic_seconds();
+  if (use_tpacket) {
+    // Потоки захвата по одному на сокет; main только ждет их
+    if (capture_threads_start(&tpacket, packet_count,
+                              &keep_pcap_loop_running) == 0) {
+      capture_threads_join(&tpacket);
+    }
+  } else if (mmap_readers > 0) {
+    // Части отображенного файла читают -R потоков, задачи ссылаются на него
+    pcap_mmap_run(&mapped_file, mmap_readers,
+                  have_mmap_filter ? &mmap_filter : NULL,
+                  &keep_pcap_loop_running);
+  } else if (query_text != NULL) {
+    // По индексу читаются только записи, подходящие под запрос
+    pcap_capture_run_index(&capture_set, replay_file, &index_query,
+                           &keep_pcap_loop_running);
+  } else {
+    // Один дескриптор читается в main, несколько - каждый своим потоком
+    pcap_capture_run(&capture_set, packet_count, &keep_pcap_loop_running);
+  }
+  double time_capture_end = monotonic_seconds();
+  metrics_server_stop(); // Читает кольца очереди - до queue_shutdown
 
   // Закрыть сессию и освободить ресурсы
-  pcap_close(handle);
-  queue_shutdown(); // Закрываем очередь
-  free(dev_name);   // Освобождаем скопированное имя
+  global_capture_set = NULL;
+  if (use_tpacket) {
+    // Задачи ссылаются на кадры кольца: сначала дообработать очередь
+    queue_shutdown();
+    capture_threads_print_stats(&tpacket);
+    capture_threads_close(&tpacket);
+  } else {
+    pcap_capture_close(&capture_set);
+    queue_shutdown(); // Закрываем очередь (дожидается обработки всех задач)
+  }
+  if (mmap_readers > 0) {
+    pcap_mmap_stats_t mmap_stats;
+    pcap_mmap_get_stats(&mmap_stats);
+    printf("Чтение mmap: потоков %d, частей %llu, записей %llu, отброшено "
+           "фильтром %llu, сбоев синхронизации %llu, обрезано в конце %llu "
+           "байт\n",
+           mmap_readers, mmap_stats.chunks, mmap_stats.packets,
+           mmap_stats.filtered, mmap_stats.sync_errors,
+           mmap_stats.tail_bytes);
+    pcap_mmap_close(&mapped_file); // Рабочие потоки отдали все записи
+    if (have_mmap_filter) {
+      pcap_freecode(&mmap_filter);
+    }
+  }
+  double time_drain_end = monotonic_seconds();
+  stats_reporter_stop();
+  queue_get_stats(&queue_stats);
+  // Рабочие потоки остановлены - таблицы потоков можно читать из main
+  flow_tables_get_stats(&flow_stats);
+  flow_tables_destroy(); // Экспорт оставшихся потоков
+  output_sink_flush();
+  if (use_flow_tables) {
+    printf("Потоки: создано %llu, активных при завершении %llu, завершено "
+           "по простою %llu, по активному таймауту %llu, вытеснено %llu\n",
+           flow_stats.created, flow_stats.active,
+           flow_stats.evicted[FLOW_END_IDLE],
+           flow_stats.evicted[FLOW_END_ACTIVE],
+           flow_stats.evicted[FLOW_END_FORCED]);
+  }
+  if (checksum_get_mode() != CHECKSUM_MODE_NONE) {
+    checksum_counters_t checksum_stats;
+    checksum_counters_sum(&checksum_stats);
+    printf("Контрольные суммы (%s): IPv4 верных %llu, неверных %llu",
+           checksum_impl_name(checksum_current_impl()), checksum_stats.ip_good,
+           checksum_stats.ip_bad);
+    if (checksum_get_mode() == CHECKSUM_MODE_ALL) {
+      printf("; TCP/UDP верных %llu, неверных %llu, не проверено %llu",
+             checksum_stats.l4_good, checksum_stats.l4_bad,
+             checksum_stats.l4_unchecked);
+    }
+    printf("\n");
+  }
+  checksum_counters_destroy();
+  ip_reassembly_report_final(); // Рабочие потоки остановлены
+  ip_reassembly_destroy();
+  stats_print_summary(time_drain_end - time_capture_start);
+  topk_report_final(); // Рабочие потоки остановлены - скетчи свободны
+  topk_destroy();
+  hll_report_final();
+  hll_destroy();
+  latency_report_final();
+  latency_destroy();
+  pcap_writer_close(); // Дописывает блоки рабочих потоков и закрывает файл
+
+  if (replay_file != NULL) {
+    print_replay_report(mmap_readers > 0 ? mmap_readers : 1, &queue_stats,
+                        time_capture_start - time_start,
+                        time_capture_end - time_capture_start,
+                        time_drain_end - time_capture_end);
+  }
+  stats_destroy();
+  free(dev_name); // Освобождаем скопированное имя
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,542 @@
+#include "capture_index.h"
+#include "flow_hash.h"
+#include "packet_descriptor.h"
+#include "pcap_mmap.h"
+#include "stats.h"
+#include "utils.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define CAPTURE_INDEX_MAGIC "TAIDX01"
+#define CAPTURE_INDEX_NO_RECORD UINT64_MAX
+#define CAPTURE_INDEX_DEDUP_PROBE 8
+
+// Заголовок файла индекса; за ним массивы block_starts, buckets, flows
+typedef struct {
+  char magic[8];
+  u_int32_t block_size;
+  u_int32_t bucket_seconds;
+  u_int64_t file_size; // Размер pcap при построении
+  u_int64_t block_count;
+  u_int64_t bucket_count;
+  u_int64_t flow_count;
+} capture_index_header_t;
+
+u_int32_t capture_index_key_hash(const flow_key_t *key) {
+  u_int64_t words[sizeof(flow_key_t) / 8];
+  memcpy(words, key, sizeof(words));
+  u_int64_t h = 0;
+  for (size_t i = 0; i < sizeof(words) / 8; i++) {
+    h = flow_hash_mix64(h ^ words[i]);
+  }
+  return (u_int32_t)(h ^ (h >> 32));
+}
+
+// --- Построение ---
+
+void capture_index_builder_init(capture_index_builder_t *builder) {
+  memset(builder, 0, sizeof(*builder));
+}
+
+void capture_index_builder_free(capture_index_builder_t *builder) {
+  free(builder->block_starts);
+  free(builder->buckets);
+  free(builder->flows);
+  capture_index_builder_init(builder);
+}
+
+// Место под еще один элемент массива (удвоение); -1 при нехватке памяти
+static int reserve(void **array, size_t *capacity, size_t count,
+                   size_t element_size) {
+  if (count < *capacity) {
+    return 0;
+  }
+  size_t grown = *capacity > 0 ? *capacity * 2 : 1024;
+  void *resized = realloc(*array, grown * element_size);
+  if (resized == NULL) {
+    return -1;
+  }
+  *array = resized;
+  *capacity = grown;
+  return 0;
+}
+
+// 1, если поток уже отмечен в этом блоке
+static int seen_in_block(capture_index_builder_t *builder, u_int32_t hash,
+                         u_int32_t block) {
+  u_int32_t tag = block + 1;
+  u_int32_t slot = flow_hash_mix32(hash) & (CAPTURE_INDEX_DEDUP_SLOTS - 1);
+  for (int probe = 0; probe < CAPTURE_INDEX_DEDUP_PROBE; probe++) {
+    u_int32_t i = (slot + probe) & (CAPTURE_INDEX_DEDUP_SLOTS - 1);
+    if (builder->dedup_tags[i] != tag) {
+      builder->dedup_tags[i] = tag;
+      builder->dedup_hashes[i] = hash;
+      return 0;
+    }
+    if (builder->dedup_hashes[i] == hash) {
+      return 1;
+    }
+  }
+  return 0; // Таблица блока забита - повтор уберет сортировка
+}
+
+void capture_index_builder_add(capture_index_builder_t *builder,
+                               u_int64_t offset, u_int32_t size,
+                               u_int32_t ts_sec, u_int32_t key_hash,
+                               int has_key) {
+  if (builder->failed) {
+    return;
+  }
+  u_int64_t block = offset / CAPTURE_INDEX_BLOCK_SIZE;
+  while (builder->block_count <= block) {
+    if (reserve((void **)&builder->block_starts, &builder->block_capacity,
+                builder->block_count, sizeof(u_int64_t)) != 0) {
+      builder->failed = 1;
+      return;
+    }
+    builder->block_starts[builder->block_count] =
+        builder->block_count == block ? offset : CAPTURE_INDEX_NO_RECORD;
+    builder->block_count++;
+  }
+
+  u_int32_t second = ts_sec - ts_sec % CAPTURE_INDEX_BUCKET_SECONDS;
+  capture_index_bucket_t *last =
+      builder->bucket_count > 0 ? &builder->buckets[builder->bucket_count - 1]
+                                : NULL;
+  if (last != NULL && last->second == second) {
+    last->end_offset = offset + size;
+  } else {
+    // Записи разных рабочих потоков слегка перемешаны по времени - у
+    // секунды может быть несколько диапазонов
+    if (reserve((void **)&builder->buckets, &builder->bucket_capacity,
+                builder->bucket_count, sizeof(capture_index_bucket_t)) != 0) {
+      builder->failed = 1;
+      return;
+    }
+    capture_index_bucket_t *bucket = &builder->buckets[builder->bucket_count++];
+    bucket->first_offset = offset;
+    bucket->end_offset = offset + size;
+    bucket->second = second;
+    bucket->reserved = 0;
+  }
+
+  if (!has_key || seen_in_block(builder, key_hash, (u_int32_t)block)) {
+    return;
+  }
+  if (reserve((void **)&builder->flows, &builder->flow_capacity,
+              builder->flow_count, sizeof(capture_index_flow_t)) != 0) {
+    builder->failed = 1;
+    return;
+  }
+  builder->flows[builder->flow_count].key_hash = key_hash;
+  builder->flows[builder->flow_count].block = (u_int32_t)block;
+  builder->flow_count++;
+}
+
+static int compare_flows(const void *a, const void *b) {
+  const capture_index_flow_t *x = a, *y = b;
+  if (x->key_hash != y->key_hash) {
+    return x->key_hash < y->key_hash ? -1 : 1;
+  }
+  return (x->block > y->block) - (x->block < y->block);
+}
+
+int capture_index_builder_write(capture_index_builder_t *builder,
+                                const char *pcap_path, u_int64_t file_size) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s%s", pcap_path, CAPTURE_INDEX_SUFFIX);
+  if (builder->failed) {
+    fprintf(stderr, "capture_index: не хватило памяти, индекс %s не "
+                    "записан\n",
+            path);
+    capture_index_builder_free(builder);
+    return -1;
+  }
+  // Поиск потока - двоичный по отсортированному массиву без повторов
+  qsort(builder->flows, builder->flow_count, sizeof(capture_index_flow_t),
+        compare_flows);
+  size_t unique = 0;
+  for (size_t i = 0; i < builder->flow_count; i++) {
+    if (unique == 0 ||
+        compare_flows(&builder->flows[unique - 1], &builder->flows[i]) != 0) {
+      builder->flows[unique++] = builder->flows[i];
+    }
+  }
+
+  capture_index_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CAPTURE_INDEX_MAGIC, sizeof(CAPTURE_INDEX_MAGIC));
+  header.block_size = CAPTURE_INDEX_BLOCK_SIZE;
+  header.bucket_seconds = CAPTURE_INDEX_BUCKET_SECONDS;
+  header.file_size = file_size;
+  header.block_count = builder->block_count;
+  header.bucket_count = builder->bucket_count;
+  header.flow_count = unique;
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "capture_index: Не удалось открыть %s: %s\n", path,
+            strerror(errno));
+    capture_index_builder_free(builder);
+    return -1;
+  }
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(builder->block_starts, sizeof(u_int64_t),
+                  builder->block_count, file) == builder->block_count &&
+           fwrite(builder->buckets, sizeof(capture_index_bucket_t),
+                  builder->bucket_count, file) == builder->bucket_count &&
+           fwrite(builder->flows, sizeof(capture_index_flow_t), unique,
+                  file) == unique;
+  if (fclose(file) != 0) {
+    ok = 0;
+  }
+  if (!ok) {
+    fprintf(stderr, "capture_index: Ошибка записи %s\n", path);
+  }
+  capture_index_builder_free(builder);
+  return ok ? 0 : -1;
+}
+
+int capture_index_build(const char *pcap_path) {
+  pcap_mmap_file_t file;
+  if (pcap_mmap_open(pcap_path, &file, 0) != 0) {
+    return -1;
+  }
+  double started = monotonic_seconds();
+  capture_index_builder_t builder;
+  capture_index_builder_init(&builder);
+  unsigned long long packets = 0, flow_packets = 0;
+  u_int64_t offset = PCAP_MMAP_FILE_HEADER_SIZE;
+  struct pcap_pkthdr header;
+  const u_char *data;
+  u_int32_t size;
+  while ((size = pcap_mmap_record(&file, offset, &header, &data)) > 0) {
+    packet_descriptor_t desc;
+    flow_key_t key;
+    u_int8_t tcp_flags;
+    int has_key = packet_describe(&header, data, &desc) == 0 &&
+                  flow_key_from_packet(&desc, &key, &tcp_flags) == 0;
+    capture_index_builder_add(&builder, offset, size,
+                              (u_int32_t)header.ts.tv_sec,
+                              has_key ? capture_index_key_hash(&key) : 0,
+                              has_key);
+    packets++;
+    flow_packets += has_key;
+    offset += size;
+  }
+  size_t blocks = builder.block_count, buckets = builder.bucket_count;
+  int result = capture_index_builder_write(&builder, pcap_path, file.size);
+  pcap_mmap_close(&file);
+  if (result == 0) {
+    char path[4096];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", pcap_path, CAPTURE_INDEX_SUFFIX);
+    printf("Индекс %s: %llu записей (%llu IP), блоков %zu, интервалов "
+           "времени %zu, %lld байт, %.3f с\n",
+           path, packets, flow_packets, blocks, buckets,
+           stat(path, &st) == 0 ? (long long)st.st_size : -1LL,
+           monotonic_seconds() - started);
+  }
+  return result;
+}
+
+// --- Запрос ---
+
+static int parse_protocol(const char *text, u_int8_t *protocol) {
+  static const struct {
+    const char *name;
+    u_int8_t number;
+  } names[] = {{"tcp", 6}, {"udp", 17}, {"icmp", 1}, {"icmp6", 58},
+               {"sctp", 132}};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(text, names[i].name) == 0) {
+      *protocol = names[i].number;
+      return 0;
+    }
+  }
+  char *end;
+  unsigned long number = strtoul(text, &end, 10);
+  if (*text == '\0' || *end != '\0' || number > 255) {
+    return -1;
+  }
+  *protocol = (u_int8_t)number;
+  return 0;
+}
+
+static int parse_address(const char *text, u_int8_t address[16]) {
+  u_int8_t mask[16];
+  int prefix;
+  if (parse_ip_prefix(text, address, mask, &prefix) != 0 ||
+      strchr(text, '/') != NULL) {
+    return -1;
+  }
+  return 0;
+}
+
+static int parse_port(const char *text, u_int16_t *port) {
+  char *end;
+  unsigned long number = strtoul(text, &end, 10);
+  if (*text == '\0' || *end != '\0' || number > 65535) {
+    return -1;
+  }
+  *port = (u_int16_t)number;
+  return 0;
+}
+
+// flow=протокол/адрес/порт/адрес/порт
+static int parse_flow(char *text, flow_key_t *key) {
+  char *fields[5];
+  int count = 0;
+  for (char *field = strtok(text, "/"); field != NULL;
+       field = strtok(NULL, "/")) {
+    if (count >= 5) {
+      return -1;
+    }
+    fields[count++] = field;
+  }
+  u_int8_t protocol;
+  u_int8_t src[16], dst[16];
+  u_int16_t sport, dport;
+  if (count != 5 || parse_protocol(fields[0], &protocol) != 0 ||
+      parse_address(fields[1], src) != 0 || parse_port(fields[2], &sport) ||
+      parse_address(fields[3], dst) != 0 || parse_port(fields[4], &dport)) {
+    return -1;
+  }
+  flow_key_make(key, src, sport, dst, dport, protocol);
+  return 0;
+}
+
+static int parse_seconds(const char *text, double *seconds) {
+  char *end;
+  *seconds = strtod(text, &end);
+  return *text == '\0' || *end != '\0' ? -1 : 0;
+}
+
+int capture_index_parse_query(const char *text,
+                              capture_index_query_t *query) {
+  memset(query, 0, sizeof(*query));
+  query->from = 0;
+  query->to = 1e18;
+  char copy[1024];
+  if (snprintf(copy, sizeof(copy), "%s", text) >= (int)sizeof(copy)) {
+    fprintf(stderr, "Слишком длинный запрос\n");
+    return -1;
+  }
+  char *saveptr;
+  for (char *term = strtok_r(copy, " ", &saveptr); term != NULL;
+       term = strtok_r(NULL, " ", &saveptr)) {
+    int bad;
+    const char *original = text + (term - copy); // parse_flow режет term
+    size_t length = strlen(term);
+    if (strncmp(term, "flow=", 5) == 0) {
+      bad = parse_flow(term + 5, &query->flow);
+      query->has_flow = 1;
+    } else if (strncmp(term, "from=", 5) == 0) {
+      bad = parse_seconds(term + 5, &query->from);
+      query->has_time = 1;
+    } else if (strncmp(term, "to=", 3) == 0) {
+      bad = parse_seconds(term + 3, &query->to);
+      query->has_time = 1;
+    } else {
+      bad = 1;
+    }
+    if (bad) {
+      fprintf(stderr, "Неверная часть запроса: %.*s\n", (int)length,
+              original);
+      return -1;
+    }
+  }
+  if (!query->has_flow && !query->has_time) {
+    fprintf(stderr, "Пустой запрос: нужны flow= и/или from=/to=\n");
+    return -1;
+  }
+  return 0;
+}
+
+// Индекс целиком в памяти; массивы указывают внутрь буфера
+typedef struct {
+  void *buffer;
+  capture_index_header_t header;
+  const u_int64_t *block_starts;
+  const capture_index_bucket_t *buckets;
+  const capture_index_flow_t *flows;
+} loaded_index_t;
+
+static int load_index(const char *pcap_path, size_t pcap_size,
+                      loaded_index_t *index) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s%s", pcap_path, CAPTURE_INDEX_SUFFIX);
+  memset(index, 0, sizeof(*index));
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "capture_index: нет индекса %s (постройте его: -I %s)\n",
+            path, pcap_path);
+    return -1;
+  }
+  capture_index_header_t *header = &index->header;
+  if (fread(header, sizeof(*header), 1, file) != 1 ||
+      memcmp(header->magic, CAPTURE_INDEX_MAGIC,
+             sizeof(CAPTURE_INDEX_MAGIC)) != 0 ||
+      header->block_size != CAPTURE_INDEX_BLOCK_SIZE) {
+    fprintf(stderr, "capture_index: %s - не индекс этой версии\n", path);
+    fclose(file);
+    return -1;
+  }
+  if (header->file_size != pcap_size) {
+    fprintf(stderr, "capture_index: индекс %s построен для файла другого "
+                    "размера - постройте заново\n",
+            path);
+    fclose(file);
+    return -1;
+  }
+  size_t size = header->block_count * sizeof(u_int64_t) +
+                header->bucket_count * sizeof(capture_index_bucket_t) +
+                header->flow_count * sizeof(capture_index_flow_t);
+  index->buffer = malloc(size > 0 ? size : 1);
+  if (index->buffer == NULL || fread(index->buffer, 1, size, file) != size) {
+    fprintf(stderr, "capture_index: не удалось прочитать %s\n", path);
+    free(index->buffer);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+  index->block_starts = index->buffer;
+  index->buckets =
+      (const capture_index_bucket_t *)(index->block_starts +
+                                       header->block_count);
+  index->flows = (const capture_index_flow_t *)(index->buckets +
+                                                header->bucket_count);
+  return 0;
+}
+
+// Проверка записи: время и точный ключ потока
+static int record_matches(const capture_index_query_t *query,
+                          const struct pcap_pkthdr *header,
+                          const u_char *data) {
+  if (query->has_time) {
+    double ts = (double)header->ts.tv_sec + header->ts.tv_usec / 1e6;
+    if (ts < query->from || ts > query->to) {
+      return 0;
+    }
+  }
+  if (query->has_flow) {
+    packet_descriptor_t desc;
+    flow_key_t key;
+    u_int8_t tcp_flags;
+    if (packet_describe(header, data, &desc) != 0 ||
+        flow_key_from_packet(&desc, &key, &tcp_flags) != 0 ||
+        memcmp(&key, &query->flow, sizeof(key)) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+typedef struct {
+  unsigned long long records; // Просмотрено записей
+  unsigned long long blocks;  // Прочитано блоков
+  long long matched;
+} query_counters_t;
+
+// Записи, начинающиеся в [begin, end)
+static void scan_range(const pcap_mmap_file_t *file, u_int64_t begin,
+                       u_int64_t end, const capture_index_query_t *query,
+                       pcap_handler handler, u_char *user,
+                       volatile int *keep_running,
+                       query_counters_t *counters) {
+  struct pcap_pkthdr header;
+  const u_char *data;
+  u_int32_t size;
+  for (u_int64_t offset = begin;
+       offset < end &&
+       (size = pcap_mmap_record(file, offset, &header, &data)) > 0;
+       offset += size) {
+    if (keep_running != NULL && !*keep_running) {
+      return;
+    }
+    counters->records++;
+    if (record_matches(query, &header, data)) {
+      handler(user, &header, data);
+      counters->matched++;
+    }
+  }
+}
+
+long long capture_index_query(const char *pcap_path,
+                              const capture_index_query_t *query,
+                              pcap_handler handler, u_char *user,
+                              volatile int *keep_running) {
+  pcap_mmap_file_t file;
+  if (pcap_mmap_open(pcap_path, &file, 0) != 0) {
+    return -1;
+  }
+  loaded_index_t index;
+  if (load_index(pcap_path, file.size, &index) != 0) {
+    pcap_mmap_close(&file);
+    return -1;
+  }
+  double started = monotonic_seconds();
+  query_counters_t counters = {0, 0, 0};
+
+  // Интервал времени -> диапазон смещений (объединение нужных секунд)
+  u_int64_t low = PCAP_MMAP_FILE_HEADER_SIZE, high = file.size;
+  if (query->has_time) {
+    low = UINT64_MAX;
+    high = 0;
+    for (u_int64_t i = 0; i < index.header.bucket_count; i++) {
+      const capture_index_bucket_t *bucket = &index.buckets[i];
+      if (bucket->second <= query->to &&
+          bucket->second + (double)index.header.bucket_seconds >
+              query->from) {
+        low = bucket->first_offset < low ? bucket->first_offset : low;
+        high = bucket->end_offset > high ? bucket->end_offset : high;
+      }
+    }
+  }
+
+  if (!query->has_flow) {
+    if (low < high) {
+      scan_range(&file, low, high, query, handler, user, keep_running,
+                 &counters);
+    }
+  } else {
+    // Нижняя граница хэша в отсортированном массиве
+    u_int32_t hash = capture_index_key_hash(&query->flow);
+    size_t left = 0, right = index.header.flow_count;
+    while (left < right) {
+      size_t middle = left + (right - left) / 2;
+      if (index.flows[middle].key_hash < hash) {
+        left = middle + 1;
+      } else {
+        right = middle;
+      }
+    }
+    for (size_t i = left;
+         i < index.header.flow_count && index.flows[i].key_hash == hash;
+         i++) {
+      u_int64_t block = index.flows[i].block;
+      u_int64_t block_end = (block + 1) * CAPTURE_INDEX_BLOCK_SIZE;
+      if (block >= index.header.block_count ||
+          index.block_starts[block] == CAPTURE_INDEX_NO_RECORD ||
+          block_end <= low || block * CAPTURE_INDEX_BLOCK_SIZE >= high) {
+        continue;
+      }
+      counters.blocks++;
+      u_int64_t begin = index.block_starts[block];
+      scan_range(&file, begin, block_end < high ? block_end : high, query,
+                 handler, user, keep_running, &counters);
+    }
+  }
+
+  printf("Индекс: просмотрено %llu записей (блоков потока %llu) из %zu "
+         "байт файла, подходит %lld, %.3f мс\n",
+         counters.records, counters.blocks, file.size, counters.matched,
+         (monotonic_seconds() - started) * 1000.0);
+  free(index.buffer);
+  pcap_mmap_close(&file);
+  return counters.matched;
+}
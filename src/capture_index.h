@@ -0,0 +1,125 @@
+#ifndef CAPTURE_INDEX_H
+#define CAPTURE_INDEX_H
+
+#include "flow_table.h"
+#include <pcap.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define CAPTURE_INDEX_BLOCK_SIZE 65536 // Шаг индекса потоков по файлу
+#define CAPTURE_INDEX_BUCKET_SECONDS 1 // Шаг индекса по времени
+#define CAPTURE_INDEX_SUFFIX ".idx"    // Индекс лежит рядом: файл.pcap.idx
+#define CAPTURE_INDEX_DEDUP_SLOTS 1024 // Потоков блока без повторов
+
+// Диапазон файла с записями одной секунды (смежные записи одной секунды)
+typedef struct {
+  u_int64_t first_offset; // Первая запись
+  u_int64_t end_offset;   // Конец последней записи
+  u_int32_t second;       // Начало интервала (секунды UNIX)
+  u_int32_t reserved;
+} capture_index_bucket_t;
+
+// Поток встречается в блоке файла (блоки по CAPTURE_INDEX_BLOCK_SIZE)
+typedef struct {
+  u_int32_t key_hash; // capture_index_key_hash
+  u_int32_t block;
+} capture_index_flow_t;
+
+/**
+ * @brief Построитель индекса одного файла pcap.
+ *
+ * Записи добавляются по возрастанию смещения. Для каждого блока файла
+ * запоминается смещение первой записи, которая в нем начинается (с него
+ * можно читать записи блока), для каждой секунды - диапазон смещений, для
+ * каждого потока - блоки, где он встречается (повторы внутри блока
+ * отсекаются сразу, остальные - при записи индекса).
+ */
+typedef struct {
+  u_int64_t *block_starts; // UINT64_MAX - в блоке не начинается ни одна запись
+  size_t block_count;
+  size_t block_capacity;
+  capture_index_bucket_t *buckets;
+  size_t bucket_count;
+  size_t bucket_capacity;
+  capture_index_flow_t *flows;
+  size_t flow_count;
+  size_t flow_capacity;
+  u_int32_t dedup_hashes[CAPTURE_INDEX_DEDUP_SLOTS];
+  u_int32_t dedup_tags[CAPTURE_INDEX_DEDUP_SLOTS]; // Номер блока + 1
+  int failed; // Не хватило памяти - индекс не пишется
+} capture_index_builder_t;
+
+// Хэш ключа потока для индекса (оба направления дают один ключ)
+u_int32_t capture_index_key_hash(const flow_key_t *key);
+
+void capture_index_builder_init(capture_index_builder_t *builder);
+
+// Учитывает запись pcap: смещение от начала файла, полный размер записи с
+// заголовком; key_hash - только для пакетов IP (has_key)
+void capture_index_builder_add(capture_index_builder_t *builder,
+                               u_int64_t offset, u_int32_t size,
+                               u_int32_t ts_sec, u_int32_t key_hash,
+                               int has_key);
+
+/**
+ * @brief Пишет индекс в pcap_path CAPTURE_INDEX_SUFFIX и очищает
+ * построитель для следующего файла.
+ *
+ * @param file_size Размер файла pcap: по нему запрос проверяет, что индекс
+ *                  построен для этого файла.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int capture_index_builder_write(capture_index_builder_t *builder,
+                                const char *pcap_path, u_int64_t file_size);
+
+void capture_index_builder_free(capture_index_builder_t *builder);
+
+/**
+ * @brief Строит индекс готового файла pcap (отдельный проход).
+ *
+ * Записи разбираются тем же разбором, что и в рабочих потоках
+ * (packet_describe, flow_key_from_packet). Поддерживается классический
+ * pcap с порядком байт машины (такой пишет pcap_writer).
+ *
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int capture_index_build(const char *pcap_path);
+
+// Запрос к файлу: поток и/или интервал времени
+typedef struct {
+  int has_flow;
+  flow_key_t flow;
+  int has_time;
+  double from; // Секунды UNIX, включительно
+  double to;
+} capture_index_query_t;
+
+/**
+ * @brief Разбирает запрос вида
+ * "flow=tcp/10.0.0.1/1234/10.0.0.2/80 from=1700000000 to=1700000060".
+ *
+ * flow - протокол (tcp, udp, icmp, icmp6, sctp или номер), адреса и порты
+ * (направление не важно; для протоколов без портов - 0). from/to - секунды
+ * UNIX, можно с дробной частью. Любую часть можно опустить, но не все.
+ *
+ * @return int 0 при успехе, -1 при ошибке (сообщение в stderr).
+ */
+int capture_index_parse_query(const char *text, capture_index_query_t *query);
+
+/**
+ * @brief Находит по индексу записи, подходящие под запрос, и передает их
+ * обработчику в порядке файла.
+ *
+ * Читаются только блоки, где по индексу есть поток, в пределах смещений
+ * нужных секунд; каждая запись проверяется точно (ключ и время), поэтому
+ * коллизии хэша и грубость индекса на ответ не влияют.
+ *
+ * @param keep_running Флаг остановки (может быть NULL).
+ * @return int Число найденных записей или -1 при ошибке.
+ */
+long long capture_index_query(const char *pcap_path,
+                              const capture_index_query_t *query,
+                              pcap_handler handler, u_char *user,
+                              volatile int *keep_running);
+
+#endif // CAPTURE_INDEX_H
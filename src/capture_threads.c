@@ -0,0 +1,196 @@
+#include "capture_threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CAPTURE_POLL_TIMEOUT_MS 100 // Перепроверка флага остановки
+
+// Задача ссылается на кадр в кольце, кадр освобождается рабочим потоком
+// после обработки (tpacket_release_frame)
+static void capture_packet_callback(u_char *user_args,
+                                    const struct pcap_pkthdr *pkthdr,
+                                    const u_char *packet_content,
+                                    void *cookie) {
+  capture_socket_t *socket = (capture_socket_t *)user_args;
+
+  if (!*socket->owner->keep_running) {
+    tpacket_release_frame(cookie);
+    return;
+  }
+  stats_add(&socket->stats->packets, 1);
+  stats_add(&socket->stats->bytes, pkthdr->len);
+  queue_batch_add_zero_copy(&socket->batch, pkthdr, packet_content,
+                            tpacket_release_frame, cookie);
+}
+
+// Счетчики ядра с прошлого вызова добавляются к накопленным
+static void update_kernel_stats(capture_socket_t *socket) {
+  unsigned long long kernel_packets = 0, kernel_drops = 0;
+  if (tpacket_get_stats(&socket->tpacket, &kernel_packets, &kernel_drops) ==
+      0) {
+    stats_add(&socket->stats->kernel_received, kernel_packets);
+    stats_add(&socket->stats->kernel_drops, kernel_drops);
+  }
+}
+
+static void *capture_thread_loop(void *arg) {
+  capture_socket_t *socket = (capture_socket_t *)arg;
+  capture_threads_t *ct = socket->owner;
+
+  queue_set_producer_group(socket->first_worker, socket->worker_count);
+  queue_set_producer_stats(socket->stats);
+  while (*ct->keep_running) {
+    int limit = QUEUE_MAX_BATCH;
+    if (ct->limited) {
+      long long remaining = atomic_load(&ct->remaining);
+      if (remaining <= 0) {
+        break;
+      }
+      if (remaining < limit) {
+        limit = (int)remaining;
+      }
+    }
+    int result = tpacket_dispatch(&socket->tpacket, limit,
+                                  CAPTURE_POLL_TIMEOUT_MS,
+                                  capture_packet_callback, (u_char *)socket);
+    queue_add_packet_batch(&socket->batch);
+    if (stats_kernel_refresh_due(socket->stats)) {
+      update_kernel_stats(socket);
+    }
+    if (result < 0) {
+      break;
+    }
+    if (ct->limited && result > 0 &&
+        atomic_fetch_sub(&ct->remaining, result) <= result) {
+      *ct->keep_running = 0; // Лимит исчерпан - останавливаем все потоки
+      break;
+    }
+  }
+  update_kernel_stats(socket); // Итог для capture_threads_print_stats
+  return NULL;
+}
+
+int capture_threads_open(capture_threads_t *ct,
+                         const char *const *dev_names, int dev_count,
+                         unsigned int snaplen,
+                         const struct bpf_program *filter, int socket_count,
+                         int fanout_type, int num_workers, int worker_groups) {
+  memset(ct, 0, sizeof(*ct));
+  if (dev_count <= 0 || socket_count <= 0 ||
+      (fanout_type == CAPTURE_NO_FANOUT && socket_count != 1)) {
+    fprintf(stderr, "capture_threads_open: неверное количество сокетов %d\n",
+            socket_count);
+    return -1;
+  }
+  int total = dev_count * socket_count;
+  ct->sockets = aligned_alloc(64, sizeof(*ct->sockets) * total);
+  if (ct->sockets == NULL) {
+    perror("capture_threads_open: Ошибка выделения памяти для сокетов");
+    return -1;
+  }
+  memset(ct->sockets, 0, sizeof(*ct->sockets) * total);
+  // Номер группы fanout уникален для процесса, у интерфейсов - свои группы
+  u_int16_t group_base = (u_int16_t)(getpid() & 0xFFFF);
+  // Поток, видимый на нескольких интерфейсах, приходит в разные сокеты -
+  // группы рабочих потоков разнесли бы его по разным таблицам
+  if (dev_count > 1) {
+    worker_groups = 0;
+  }
+
+  for (int i = 0; i < total; i++) {
+    capture_socket_t *socket = &ct->sockets[i];
+    int device = i / socket_count;
+    socket->owner = ct;
+    socket->dev_name = dev_names[device];
+    if (tpacket_open(&socket->tpacket, socket->dev_name, snaplen, filter, 0,
+                     0) != 0) {
+      capture_threads_close(ct);
+      return -1;
+    }
+    ct->socket_count = i + 1;
+    if (fanout_type != CAPTURE_NO_FANOUT &&
+        tpacket_join_fanout(&socket->tpacket,
+                            (u_int16_t)(group_base + device),
+                            fanout_type) != 0) {
+      capture_threads_close(ct);
+      return -1;
+    }
+    if (worker_groups && socket_count > 1) {
+      // Рабочие потоки делятся между сокетами поровну; если сокетов больше,
+      // чем рабочих потоков, группы из одного потока пересекаются
+      socket->first_worker = i * num_workers / socket_count;
+      socket->worker_count =
+          (i + 1) * num_workers / socket_count - socket->first_worker;
+      if (socket->worker_count == 0) {
+        socket->worker_count = 1;
+      }
+      printf("capture_threads_open: сокет %d -> рабочие потоки %d..%d\n", i,
+             socket->first_worker,
+             socket->first_worker + socket->worker_count - 1);
+    }
+  }
+  return 0;
+}
+
+int capture_threads_start(capture_threads_t *ct, int packet_count,
+                          volatile int *keep_running) {
+  ct->keep_running = keep_running;
+  ct->limited = packet_count > 0;
+  atomic_store(&ct->remaining, packet_count);
+  for (int i = 0; i < ct->socket_count; i++) {
+    ct->sockets[i].stats = stats_producer_get(i);
+    if (ct->sockets[i].stats == NULL) {
+      fprintf(stderr, "capture_threads_start: нет счетчиков для сокета %d\n",
+              i);
+      *keep_running = 0;
+      capture_threads_join(ct);
+      return -1;
+    }
+    stats_producer_set_interface(ct->sockets[i].stats,
+                                 ct->sockets[i].dev_name);
+    int result = pthread_create(&ct->sockets[i].thread, NULL,
+                                capture_thread_loop, &ct->sockets[i]);
+    if (result != 0) {
+      fprintf(stderr, "Ошибка создания потока захвата #%d: %s\n", i,
+              strerror(result));
+      *keep_running = 0;
+      capture_threads_join(ct);
+      return -1;
+    }
+    ct->started = i + 1;
+  }
+  return 0;
+}
+
+void capture_threads_join(capture_threads_t *ct) {
+  for (int i = 0; i < ct->started; i++) {
+    pthread_join(ct->sockets[i].thread, NULL);
+  }
+  ct->started = 0;
+}
+
+void capture_threads_print_stats(capture_threads_t *ct) {
+  for (int i = 0; i < ct->socket_count; i++) {
+    const stats_producer_t *stats = ct->sockets[i].stats;
+    if (stats == NULL) {
+      continue; // Потоки не запускались
+    }
+    printf("Сокет %d (%s): захвачено %llu пакетов (%llu байт), принято "
+           "ядром %llu, отброшено %llu, ожиданий места в очереди %llu.\n",
+           i, ct->sockets[i].dev_name, stats_load(&stats->packets),
+           stats_load(&stats->bytes),
+           stats_load(&stats->kernel_received),
+           stats_load(&stats->kernel_drops),
+           stats_load(&stats->queue_full_waits));
+  }
+}
+
+void capture_threads_close(capture_threads_t *ct) {
+  for (int i = 0; i < ct->socket_count; i++) {
+    tpacket_close(&ct->sockets[i].tpacket);
+  }
+  free(ct->sockets);
+  ct->sockets = NULL;
+  ct->socket_count = 0;
+}
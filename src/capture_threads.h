@@ -0,0 +1,92 @@
+#ifndef CAPTURE_THREADS_H
+#define CAPTURE_THREADS_H
+
+#include "thread_pool_queue.h"
+#include "tpacket_capture.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define CAPTURE_NO_FANOUT -1 // Один сокет без группы PACKET_FANOUT
+
+struct capture_threads;
+
+// Сокет захвата и обслуживающий его поток
+typedef struct {
+  _Alignas(64) tpacket_capture_t tpacket; // Сокеты разных потоков - в
+                                          // разных кэш-линиях
+  packet_batch_t batch;        // Пачка задач этого потока захвата
+  const char *dev_name;        // Интерфейс сокета
+  stats_producer_t *stats;     // Счетчики (stats_producer_get по номеру)
+  int first_worker;            // Группа рабочих потоков этого сокета
+  int worker_count;            // 0 - все рабочие потоки
+  pthread_t thread;
+  struct capture_threads *owner;
+} capture_socket_t;
+
+/**
+ * @brief Захват с интерфейсов несколькими потоками через PACKET_FANOUT.
+ *
+ * На каждом интерфейсе открывается по socket_count сокетов TPACKET_V3,
+ * объединенных в группу PACKET_FANOUT (у каждого интерфейса своя группа:
+ * группа не может охватывать разные устройства); ядро распределяет между
+ * ними пакеты, и у каждого сокета свой поток захвата. При
+ * PACKET_FANOUT_HASH поток (flow) всегда попадает в один сокет, поэтому
+ * каждый сокет кормит свою группу рабочих потоков; при CPU/LB поток может
+ * прийти в любой сокет, и все сокеты кормят все рабочие потоки (по хэшу
+ * потока).
+ */
+typedef struct capture_threads {
+  capture_socket_t *sockets;
+  int socket_count;
+  int started; // Сколько потоков запущено
+  atomic_llong remaining; // Сколько пакетов осталось захватить (-c)
+  int limited;            // 0 - без ограничения
+  volatile int *keep_running; // Общий флаг остановки
+} capture_threads_t;
+
+/**
+ * @brief Открывает сокеты и распределяет по ним рабочие потоки.
+ *
+ * @param dev_names Интерфейсы захвата.
+ * @param dev_count Количество интерфейсов.
+ * @param filter Фильтр BPF для каждого сокета (tpacket_open) или NULL.
+ * @param socket_count Количество сокетов (потоков захвата) на интерфейс.
+ * @param fanout_type PACKET_FANOUT_HASH/CPU/LB или CAPTURE_NO_FANOUT (тогда
+ *                    socket_count должен быть 1).
+ * @param num_workers Количество рабочих потоков очереди.
+ * @param worker_groups 1 - делить рабочие потоки между сокетами (имеет
+ *                      смысл при PACKET_FANOUT_HASH и QUEUE_DISPATCH_FLOW
+ *                      на одном интерфейсе: поток, видимый на двух
+ *                      интерфейсах, должен попасть в одну таблицу).
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int capture_threads_open(capture_threads_t *ct,
+                         const char *const *dev_names, int dev_count,
+                         unsigned int snaplen,
+                         const struct bpf_program *filter, int socket_count,
+                         int fanout_type, int num_workers, int worker_groups);
+
+/**
+ * @brief Запускает потоки захвата.
+ *
+ * Поток сокета i ведет счетчики в stats_producer_get(i), поэтому stats_init
+ * вызывается раньше с числом продюсеров не меньше общего числа сокетов.
+ *
+ * @param packet_count Сколько пакетов захватить всего (0 - до остановки;
+ *                     потоки могут немного превысить значение).
+ * @param keep_running Флаг остановки: потоки выходят, когда он равен 0, и
+ *                     сбрасывают его, исчерпав packet_count.
+ */
+int capture_threads_start(capture_threads_t *ct, int packet_count,
+                          volatile int *keep_running);
+
+// Дожидается завершения потоков захвата
+void capture_threads_join(capture_threads_t *ct);
+
+// Печатает по каждому сокету: захвачено, принято и отброшено ядром
+void capture_threads_print_stats(capture_threads_t *ct);
+
+// Закрывает сокеты; вызывать после queue_shutdown
+void capture_threads_close(capture_threads_t *ct);
+
+#endif // CAPTURE_THREADS_H
@@ -0,0 +1,230 @@
+#include "checksum.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_HAVE_X86 1
+#endif
+
+typedef u_int64_t (*checksum_kernel_fn)(const u_char *data, size_t len,
+                                        u_int64_t sum);
+
+static atomic_int checksum_mode = CHECKSUM_MODE_IP;
+static checksum_counters_t *counters; // По одному блоку на рабочий поток
+static int num_counters;
+
+// Хвост меньше 8 байт: 4, 2 и 1 байт (последний дополняется нулем)
+static inline u_int64_t add_tail(const u_char *data, size_t len,
+                                 u_int64_t sum) {
+  if (len & 4) {
+    u_int32_t word;
+    memcpy(&word, data, 4);
+    sum += word;
+    data += 4;
+  }
+  if (len & 2) {
+    u_int16_t word;
+    memcpy(&word, data, 2);
+    sum += word;
+    data += 2;
+  }
+  if (len & 1) {
+    u_int16_t word = 0;
+    memcpy(&word, data, 1);
+    sum += word;
+  }
+  return sum;
+}
+
+static u_int64_t checksum_scalar(const u_char *data, size_t len,
+                                 u_int64_t sum) {
+  // Два 32-битных слова за шаг; переполнения нет до 2^32 слов
+  while (len >= 8) {
+    u_int64_t word;
+    memcpy(&word, data, 8);
+    sum += word & 0xFFFFFFFFu;
+    sum += word >> 32;
+    data += 8;
+    len -= 8;
+  }
+  return add_tail(data, len, sum);
+}
+
+#ifdef CHECKSUM_HAVE_X86
+__attribute__((target("sse2"))) static u_int64_t
+checksum_sse2(const u_char *data, size_t len, u_int64_t sum) {
+  // 32-битные слова расширяются до 64 бит (unpack с нулем) и складываются
+  // в четыре аккумулятора по две 64-битные дорожки
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+  while (len >= 32) {
+    __m128i a = _mm_loadu_si128((const __m128i *)data);
+    __m128i b = _mm_loadu_si128((const __m128i *)(data + 16));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+    acc2 = _mm_add_epi64(acc2, _mm_unpacklo_epi32(b, zero));
+    acc3 = _mm_add_epi64(acc3, _mm_unpackhi_epi32(b, zero));
+    data += 32;
+    len -= 32;
+  }
+  acc0 = _mm_add_epi64(_mm_add_epi64(acc0, acc1), _mm_add_epi64(acc2, acc3));
+  u_int64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, acc0);
+  sum += lanes[0] + lanes[1];
+  return checksum_scalar(data, len, sum);
+}
+
+__attribute__((target("avx2"))) static u_int64_t
+checksum_avx2(const u_char *data, size_t len, u_int64_t sum) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+  while (len >= 64) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)data);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(data + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+    acc2 = _mm256_add_epi64(acc2, _mm256_unpacklo_epi32(b, zero));
+    acc3 = _mm256_add_epi64(acc3, _mm256_unpackhi_epi32(b, zero));
+    data += 64;
+    len -= 64;
+  }
+  acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+                          _mm256_add_epi64(acc2, acc3));
+  u_int64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, acc0);
+  sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return checksum_scalar(data, len, sum);
+}
+#endif
+
+static const struct {
+  const char *name;
+  checksum_kernel_fn kernel;
+} checksum_impls[] = {
+    [CHECKSUM_IMPL_SCALAR] = {"scalar", checksum_scalar},
+#ifdef CHECKSUM_HAVE_X86
+    [CHECKSUM_IMPL_SSE2] = {"sse2", checksum_sse2},
+    [CHECKSUM_IMPL_AVX2] = {"avx2", checksum_avx2},
+#else
+    [CHECKSUM_IMPL_SSE2] = {"sse2", NULL},
+    [CHECKSUM_IMPL_AVX2] = {"avx2", NULL},
+#endif
+};
+
+// Пока checksum_init не вызван - скалярная версия
+static checksum_kernel_fn checksum_kernel = checksum_scalar;
+static checksum_impl_t checksum_impl = CHECKSUM_IMPL_SCALAR;
+
+int checksum_impl_supported(checksum_impl_t impl) {
+  switch (impl) {
+  case CHECKSUM_IMPL_SCALAR:
+    return 1;
+#ifdef CHECKSUM_HAVE_X86
+  case CHECKSUM_IMPL_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case CHECKSUM_IMPL_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return 0;
+  }
+}
+
+const char *checksum_impl_name(checksum_impl_t impl) {
+  return checksum_impls[impl].name;
+}
+
+checksum_impl_t checksum_current_impl(void) { return checksum_impl; }
+
+int checksum_select(checksum_impl_t impl) {
+  if (!checksum_impl_supported(impl)) {
+    return -1;
+  }
+  checksum_kernel = checksum_impls[impl].kernel;
+  checksum_impl = impl;
+  return 0;
+}
+
+void checksum_init(void) {
+  if (checksum_select(CHECKSUM_IMPL_AVX2) != 0 &&
+      checksum_select(CHECKSUM_IMPL_SSE2) != 0) {
+    checksum_select(CHECKSUM_IMPL_SCALAR);
+  }
+}
+
+u_int64_t checksum_add(const void *data, size_t len, u_int64_t sum) {
+  // Короткие заголовки (IPv4 - 20 байт) SIMD не ускоряет
+  if (len < 64) {
+    return checksum_scalar(data, len, sum);
+  }
+  return checksum_kernel(data, len, sum);
+}
+
+u_int64_t checksum_pseudo_ipv4(const struct in_addr *src,
+                               const struct in_addr *dst, u_int8_t protocol,
+                               u_int32_t length) {
+  u_int64_t sum = (u_int64_t)src->s_addr + dst->s_addr;
+  // Протокол и длина - 16-битные слова в сетевом порядке
+  sum += htons(protocol);
+  sum += htons((u_int16_t)length);
+  return sum;
+}
+
+u_int64_t checksum_pseudo_ipv6(const struct in6_addr *src,
+                               const struct in6_addr *dst, u_int8_t protocol,
+                               u_int32_t length) {
+  u_int64_t sum = checksum_scalar((const u_char *)src, 16, 0);
+  sum = checksum_scalar((const u_char *)dst, 16, sum);
+  sum += htonl(length);
+  sum += htonl(protocol);
+  return sum;
+}
+
+void checksum_set_mode(checksum_mode_t mode) {
+  atomic_store_explicit(&checksum_mode, mode, memory_order_relaxed);
+}
+
+checksum_mode_t checksum_get_mode(void) {
+  return atomic_load_explicit(&checksum_mode, memory_order_relaxed);
+}
+
+int checksum_counters_init(int num_workers) {
+  if (num_workers <= 0) {
+    return -1;
+  }
+  counters = aligned_alloc(64, sizeof(checksum_counters_t) * num_workers);
+  if (counters == NULL) {
+    perror("checksum_counters_init: Ошибка выделения памяти");
+    return -1;
+  }
+  memset(counters, 0, sizeof(checksum_counters_t) * num_workers);
+  num_counters = num_workers;
+  return 0;
+}
+
+checksum_counters_t *checksum_counters_get(int worker_id) {
+  if (worker_id < 0 || worker_id >= num_counters) {
+    return NULL;
+  }
+  return &counters[worker_id];
+}
+
+void checksum_counters_sum(checksum_counters_t *total) {
+  memset(total, 0, sizeof(*total));
+  for (int i = 0; i < num_counters; i++) {
+    total->ip_good += counters[i].ip_good;
+    total->ip_bad += counters[i].ip_bad;
+    total->l4_good += counters[i].l4_good;
+    total->l4_bad += counters[i].l4_bad;
+    total->l4_unchecked += counters[i].l4_unchecked;
+  }
+}
+
+void checksum_counters_destroy(void) {
+  free(counters);
+  counters = NULL;
+  num_counters = 0;
+}
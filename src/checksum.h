@@ -0,0 +1,84 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Что проверять в packet_describe (по умолчанию - заголовок IPv4)
+typedef enum {
+  CHECKSUM_MODE_NONE = 0, // Ничего
+  CHECKSUM_MODE_IP = 1,   // Заголовок IPv4
+  CHECKSUM_MODE_ALL = 2,  // Заголовок IPv4 и TCP/UDP с псевдозаголовком
+} checksum_mode_t;
+
+// Реализации суммирования (checksum_select)
+typedef enum {
+  CHECKSUM_IMPL_SCALAR = 0,
+  CHECKSUM_IMPL_SSE2 = 1,
+  CHECKSUM_IMPL_AVX2 = 2,
+} checksum_impl_t;
+
+/**
+ * @brief Контрольная сумма Интернета (RFC 1071) с выбором реализации по
+ * CPUID.
+ *
+ * Данные складываются 32-битными словами в порядке байт хоста в 64-битный
+ * аккумулятор; checksum_fold сворачивает его до 16 бит. Сумма в
+ * дополнительном коде не зависит от порядка байт, поэтому проверка
+ * "свернутая сумма == 0xffff" верна без перестановок. Ядра SSE2 и AVX2
+ * собраны с атрибутом target, выбор - один раз в checksum_init.
+ */
+
+// Выбирает самую быструю реализацию, которую поддерживает процессор
+void checksum_init(void);
+
+// Принудительный выбор (для бенчмарка): -1, если процессор не умеет
+int checksum_select(checksum_impl_t impl);
+int checksum_impl_supported(checksum_impl_t impl);
+const char *checksum_impl_name(checksum_impl_t impl);
+checksum_impl_t checksum_current_impl(void);
+
+// Добавляет len байт data к частичной сумме sum (длина любая; нечетный
+// последний байт дополняется нулем)
+u_int64_t checksum_add(const void *data, size_t len, u_int64_t sum);
+
+// Частичные суммы псевдозаголовков TCP/UDP (длина - в хостовом порядке)
+u_int64_t checksum_pseudo_ipv4(const struct in_addr *src,
+                               const struct in_addr *dst, u_int8_t protocol,
+                               u_int32_t length);
+u_int64_t checksum_pseudo_ipv6(const struct in6_addr *src,
+                               const struct in6_addr *dst, u_int8_t protocol,
+                               u_int32_t length);
+
+// Сворачивает частичную сумму до 16 бит (без инверсии)
+static inline u_int16_t checksum_fold(u_int64_t sum) {
+  sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFFu) + (sum >> 32);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  return (u_int16_t)sum;
+}
+
+// Режим проверки для packet_describe
+void checksum_set_mode(checksum_mode_t mode);
+checksum_mode_t checksum_get_mode(void);
+
+// Счетчики проверок рабочего потока (пишет только владелец)
+typedef struct {
+  _Alignas(64) unsigned long long ip_good;
+  unsigned long long ip_bad;
+  unsigned long long l4_good;
+  unsigned long long l4_bad;
+  // Обрезан snaplen или UDP без суммы; фрагменты не проверяются и здесь
+  // не учитываются (сумма покрывает всю датаграмму)
+  unsigned long long l4_unchecked;
+} checksum_counters_t;
+
+// --- Счетчики по рабочим потокам (индекс - queue_worker_id) ---
+int checksum_counters_init(int num_workers);
+checksum_counters_t *checksum_counters_get(int worker_id);
+void checksum_counters_sum(checksum_counters_t *total);
+void checksum_counters_destroy(void);
+
+#endif // CHECKSUM_H
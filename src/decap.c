@@ -0,0 +1,241 @@
+#include "decap.h"
+#include <string.h>
+
+#define DECAP_STEP_ERROR -1 // Заголовок обрезан
+#define DECAP_STEP_DONE 0   // Дошли до внутреннего L3 (или неизвестного)
+#define DECAP_STEP_NEXT 1   // Сняли слой, ether_type/l3_offset обновлены
+
+#define ETH_P_QINQ_OLD 0x9100 // Двойная метка до стандарта 802.1ad
+#define ETH_P_TEB 0x6558      // GRE: внутри Ethernet-кадр
+
+#define GRE_FLAG_CHECKSUM 0x8000
+#define GRE_FLAG_KEY 0x2000
+#define GRE_FLAG_SEQUENCE 0x1000
+#define GRE_VERSION_MASK 0x0007
+#define VXLAN_HEADER_LEN 8
+#define VXLAN_FLAG_VNI 0x08
+#define MPLS_LABEL_LEN 4
+
+typedef int (*decap_step_fn)(const u_char *packet, bpf_u_int32 caplen,
+                             decap_result_t *result);
+
+static inline u_int16_t load_be16(const u_char *p) {
+  return (u_int16_t)((p[0] << 8) | p[1]);
+}
+
+static inline u_int32_t load_be32(const u_char *p) {
+  u_int32_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohl(value);
+}
+
+// Внутренний Ethernet-заголовок (VXLAN, GRE TEB) с offset
+static int enter_ethernet(const u_char *packet, bpf_u_int32 caplen,
+                          bpf_u_int32 offset, decap_result_t *result) {
+  if (caplen < offset + ETH_HLEN) {
+    return DECAP_STEP_ERROR;
+  }
+  result->ether_type = load_be16(packet + offset + 2 * ETH_ALEN);
+  result->l3_offset = (u_int16_t)(offset + ETH_HLEN);
+  return DECAP_STEP_NEXT;
+}
+
+static int decap_vlan(const u_char *packet, bpf_u_int32 caplen,
+                      decap_result_t *result) {
+  bpf_u_int32 offset = result->l3_offset;
+  if (caplen < offset + 4) {
+    return DECAP_STEP_ERROR;
+  }
+  if (result->vlan_count < DECAP_MAX_VLANS) {
+    result->vlan_ids[result->vlan_count] = load_be16(packet + offset) & 0x0FFF;
+  }
+  result->vlan_count++;
+  result->ether_type = load_be16(packet + offset + 2);
+  result->l3_offset = (u_int16_t)(offset + 4);
+  return DECAP_STEP_NEXT;
+}
+
+static int decap_mpls(const u_char *packet, bpf_u_int32 caplen,
+                      decap_result_t *result) {
+  bpf_u_int32 offset = result->l3_offset;
+  // Стек меток до бита S (дно стека)
+  for (int i = 0; i < DECAP_MAX_LAYERS; i++) {
+    if (caplen < offset + MPLS_LABEL_LEN) {
+      return DECAP_STEP_ERROR;
+    }
+    u_int32_t entry = load_be32(packet + offset);
+    if (result->mpls_count == 0) {
+      result->mpls_label = entry >> 12;
+    }
+    result->mpls_count++;
+    offset += MPLS_LABEL_LEN;
+    if (entry & 0x100) {
+      // Под стеком нет EtherType: тип определяется по версии IP
+      result->l3_offset = (u_int16_t)offset;
+      if (caplen <= offset) {
+        return DECAP_STEP_ERROR;
+      }
+      switch (packet[offset] >> 4) {
+      case 4:
+        result->ether_type = ETH_P_IP;
+        return DECAP_STEP_NEXT;
+      case 6:
+        result->ether_type = ETH_P_IPV6;
+        return DECAP_STEP_NEXT;
+      default: // Псевдопровод или другое - дальше не разбираем
+        return DECAP_STEP_DONE;
+      }
+    }
+  }
+  return DECAP_STEP_ERROR;
+}
+
+static int decap_gre(const u_char *packet, bpf_u_int32 caplen,
+                     bpf_u_int32 offset, decap_result_t *result) {
+  if (caplen < offset + 4) {
+    return DECAP_STEP_ERROR;
+  }
+  u_int16_t flags = load_be16(packet + offset);
+  if ((flags & GRE_VERSION_MASK) != 0) {
+    return DECAP_STEP_DONE; // GRE версии 1 (PPTP) не снимаем
+  }
+  u_int16_t protocol = load_be16(packet + offset + 2);
+  bpf_u_int32 header_len = 4;
+  if (flags & GRE_FLAG_CHECKSUM) {
+    header_len += 4;
+  }
+  u_int32_t key = 0;
+  if (flags & GRE_FLAG_KEY) {
+    if (caplen < offset + header_len + 4) {
+      return DECAP_STEP_ERROR;
+    }
+    key = load_be32(packet + offset + header_len);
+    header_len += 4;
+  }
+  if (flags & GRE_FLAG_SEQUENCE) {
+    header_len += 4;
+  }
+  if (caplen < offset + header_len) {
+    return DECAP_STEP_ERROR;
+  }
+  result->tunnel_type = DECAP_TUNNEL_GRE;
+  result->tunnel_id = key;
+  result->tunnel_count++;
+  if (protocol == ETH_P_TEB) {
+    return enter_ethernet(packet, caplen, offset + header_len, result);
+  }
+  result->ether_type = protocol;
+  result->l3_offset = (u_int16_t)(offset + header_len);
+  return DECAP_STEP_NEXT;
+}
+
+static int decap_vxlan(const u_char *packet, bpf_u_int32 caplen,
+                       bpf_u_int32 offset, decap_result_t *result) {
+  if (caplen < offset + VXLAN_HEADER_LEN) {
+    return DECAP_STEP_ERROR;
+  }
+  if (!(packet[offset] & VXLAN_FLAG_VNI)) {
+    return DECAP_STEP_DONE; // Не VXLAN, просто UDP на этом порту
+  }
+  result->tunnel_type = DECAP_TUNNEL_VXLAN;
+  result->tunnel_id = load_be32(packet + offset + 4) >> 8;
+  result->tunnel_count++;
+  return enter_ethernet(packet, caplen, offset + VXLAN_HEADER_LEN, result);
+}
+
+// Туннель внутри IP: GRE (протокол 47) или VXLAN (UDP, порт 4789)
+static int decap_ip_payload(const u_char *packet, bpf_u_int32 caplen,
+                            u_int8_t protocol, bpf_u_int32 offset,
+                            decap_result_t *result) {
+  if (protocol == IPPROTO_GRE) {
+    return decap_gre(packet, caplen, offset, result);
+  }
+  if (protocol == IPPROTO_UDP && caplen >= offset + 8 &&
+      load_be16(packet + offset + 2) == DECAP_VXLAN_PORT) {
+    return decap_vxlan(packet, caplen, offset + 8, result);
+  }
+  return DECAP_STEP_DONE;
+}
+
+static int decap_ipv4(const u_char *packet, bpf_u_int32 caplen,
+                      decap_result_t *result) {
+  bpf_u_int32 offset = result->l3_offset;
+  if (caplen < offset + 20) {
+    return DECAP_STEP_DONE; // Ошибку покажет parse_ipv4_header
+  }
+  const u_char *ip = packet + offset;
+  u_int8_t protocol = ip[9];
+  // Быстрый выход для обычного трафика: не GRE и не UDP
+  if (protocol != IPPROTO_GRE && protocol != IPPROTO_UDP) {
+    return DECAP_STEP_DONE;
+  }
+  bpf_u_int32 ihl = (bpf_u_int32)(ip[0] & 0x0F) * 4;
+  if ((ip[0] >> 4) != 4 || ihl < 20 || (load_be16(ip + 6) & 0x3FFF) != 0) {
+    return DECAP_STEP_DONE; // Фрагменты туннеля не собираем
+  }
+  return decap_ip_payload(packet, caplen, protocol, offset + ihl, result);
+}
+
+static int decap_ipv6(const u_char *packet, bpf_u_int32 caplen,
+                      decap_result_t *result) {
+  bpf_u_int32 offset = result->l3_offset;
+  if (caplen < offset + 40) {
+    return DECAP_STEP_DONE;
+  }
+  // Туннели за заголовками расширения встречаются редко - смотрим только
+  // Next Header фиксированного заголовка
+  u_int8_t protocol = packet[offset + 6];
+  if (protocol != IPPROTO_GRE && protocol != IPPROTO_UDP) {
+    return DECAP_STEP_DONE;
+  }
+  return decap_ip_payload(packet, caplen, protocol, offset + 40, result);
+}
+
+// IPv4 и IPv6 - первыми: для кадра без меток поиск заканчивается сразу
+static const struct {
+  u_int16_t ether_type;
+  decap_step_fn step;
+} decap_table[] = {
+    {ETH_P_IP, decap_ipv4},         {ETH_P_IPV6, decap_ipv6},
+    {ETH_P_8021Q, decap_vlan},      {ETH_P_8021AD, decap_vlan},
+    {ETH_P_QINQ_OLD, decap_vlan},   {ETH_P_MPLS_UC, decap_mpls},
+    {ETH_P_MPLS_MC, decap_mpls},
+};
+
+static inline decap_step_fn find_step(u_int16_t ether_type) {
+  for (size_t i = 0; i < sizeof(decap_table) / sizeof(decap_table[0]); i++) {
+    if (decap_table[i].ether_type == ether_type) {
+      return decap_table[i].step;
+    }
+  }
+  return NULL;
+}
+
+int decap_packet_layers(const u_char *packet, bpf_u_int32 caplen,
+                        decap_result_t *result) {
+  result->vlan_count = 0;
+  result->mpls_count = 0;
+  result->tunnel_type = DECAP_TUNNEL_NONE;
+  result->tunnel_count = 0;
+  result->mpls_label = 0;
+  result->tunnel_id = 0;
+  if (caplen < ETH_HLEN) {
+    result->ether_type = 0;
+    result->l3_offset = 0;
+    return -1;
+  }
+  result->ether_type = load_be16(packet + 2 * ETH_ALEN);
+  result->l3_offset = ETH_HLEN;
+
+  for (int depth = 0; depth < DECAP_MAX_LAYERS; depth++) {
+    decap_step_fn step = find_step(result->ether_type);
+    if (step == NULL) {
+      return 0; // ARP и прочее - как есть
+    }
+    int status = step(packet, caplen, result);
+    if (status != DECAP_STEP_NEXT) {
+      return status == DECAP_STEP_DONE ? 0 : -1;
+    }
+  }
+  return -1;
+}
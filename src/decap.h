@@ -0,0 +1,97 @@
+#ifndef DECAP_H
+#define DECAP_H
+
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <pcap.h>
+#include <sys/types.h>
+
+#define DECAP_MAX_LAYERS 8 // Больше меток/туннелей подряд - ошибка
+#define DECAP_MAX_VLANS 2  // Сколько идентификаторов VLAN запоминается
+#define DECAP_VXLAN_PORT 4789
+
+// Туннель, снятый последним (decap_result_t.tunnel_type)
+#define DECAP_TUNNEL_NONE 0
+#define DECAP_TUNNEL_GRE 1
+#define DECAP_TUNNEL_VXLAN 2
+
+/**
+ * @brief Результат снятия меток и туннелей с кадра.
+ *
+ * Смещения считаются от начала кадра. Если внутри кадра (VXLAN, GRE с
+ * Transparent Ethernet Bridging) есть свой Ethernet-заголовок, l3_offset
+ * указывает уже за него.
+ */
+typedef struct {
+  u_int16_t ether_type; // EtherType внутреннего L3 в хостовом порядке
+  u_int16_t l3_offset;  // Начало внутреннего заголовка сетевого уровня
+  u_int8_t vlan_count;  // Всего меток 802.1Q/802.1ad
+  u_int8_t mpls_count;  // Всего меток MPLS
+  u_int8_t tunnel_type; // DECAP_TUNNEL_*
+  u_int8_t tunnel_count;
+  u_int16_t vlan_ids[DECAP_MAX_VLANS]; // Первые метки, внешняя - первой
+  u_int32_t mpls_label;                // Верхняя метка MPLS
+  u_int32_t tunnel_id;                 // Ключ GRE или VNI VXLAN, 0 - нет
+} decap_result_t;
+
+// Медленный путь decap_packet: проход по таблице обработчиков
+int decap_packet_layers(const u_char *packet, bpf_u_int32 caplen,
+                        decap_result_t *result);
+
+// Кадр без меток с IPv4/IPv6, который не может быть туннелем: не GRE и
+// не UDP на порт VXLAN
+static inline int decap_is_plain(const u_char *packet, bpf_u_int32 caplen) {
+  if (caplen < ETH_HLEN + 40) { // Ethernet + фиксированный заголовок IPv6
+    return 0;
+  }
+  u_int16_t ether_type = (u_int16_t)((packet[12] << 8) | packet[13]);
+  const u_char *ip = packet + ETH_HLEN;
+  u_int8_t protocol;
+  bpf_u_int32 l4_offset;
+  if (ether_type == ETH_P_IP) {
+    protocol = ip[9];
+    l4_offset = (bpf_u_int32)(ip[0] & 0x0F) * 4;
+  } else if (ether_type == ETH_P_IPV6) {
+    protocol = ip[6];
+    l4_offset = 40;
+  } else {
+    return 0;
+  }
+  if (protocol == IPPROTO_UDP) {
+    return caplen >= ETH_HLEN + l4_offset + 4 &&
+           ((ip[l4_offset + 2] << 8) | ip[l4_offset + 3]) != DECAP_VXLAN_PORT;
+  }
+  return protocol != IPPROTO_GRE;
+}
+
+/**
+ * @brief Снимает VLAN (802.1Q, QinQ), MPLS, GRE и VXLAN за один проход.
+ *
+ * Каждый шаг выбирается по таблице EtherType -> обработчик. Обычный кадр
+ * без меток и туннелей (decap_is_plain) разбирается здесь же, без вызова
+ * и без таблицы.
+ *
+ * @param packet Начало Ethernet-кадра.
+ * @param caplen Длина захваченных данных.
+ * @param result Куда записать внутренний EtherType, смещение и метки.
+ * @return int 0 - успех, -1 - кадр короче Ethernet-заголовка, метка или
+ *             туннельный заголовок обрезаны или вложенность больше
+ *             DECAP_MAX_LAYERS (result описывает то, что успели снять).
+ */
+static inline int decap_packet(const u_char *packet, bpf_u_int32 caplen,
+                               decap_result_t *result) {
+  if (decap_is_plain(packet, caplen)) {
+    result->ether_type = (u_int16_t)((packet[12] << 8) | packet[13]);
+    result->l3_offset = ETH_HLEN;
+    result->vlan_count = 0;
+    result->mpls_count = 0;
+    result->tunnel_type = DECAP_TUNNEL_NONE;
+    result->tunnel_count = 0;
+    result->mpls_label = 0;
+    result->tunnel_id = 0;
+    return 0;
+  }
+  return decap_packet_layers(packet, caplen, result);
+}
+
+#endif // DECAP_H
@@ -11,14 +11,15 @@ typedef struct {
 } parsed_ethernet_header_t;
 
 /**
- * @brief Разбираем Ethernet-заголовок пакета.
+ * @brief Разбираем Ethernet-заголовок пакета (без вывода).
  *
  * @param packet Указатель на начало Ethernet-кадра.
- * @param pkthdr Указатель на pcap_pkthdr для получения длины пакета.
+ * @param caplen Длина захваченных данных.
+ * @param header Куда скопировать заголовок (может быть NULL).
  * @return u_int16_t Тип протокола следующего уровня (EtherType) в ХОСТОВОМ
  * порядке байт, или 0 в случае ошибки.
  */
-u_int16_t parse_ethernet_header(const u_char *packet,
-                                const struct pcap_pkthdr *pkthdr);
+u_int16_t parse_ethernet_header(const u_char *packet, bpf_u_int32 caplen,
+                                parsed_ethernet_header_t *header);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "flow_hash.h"
+#include "decap.h"
+#include "ip_parser.h"
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <string.h>
+
+#define FLOW_HASH_SEED 0x9e3779b9u
+
+static inline u_int32_t load_be32(const u_char *p) {
+  u_int32_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohl(value);
+}
+
+static inline u_int16_t load_be16(const u_char *p) {
+  return (u_int16_t)((p[0] << 8) | p[1]);
+}
+
+// Запасной маршрут для кадров без IP: симметричный хэш пары MAC-адресов
+static u_int32_t hash_mac_pair(const u_char *packet) {
+  u_int32_t h = FLOW_HASH_SEED;
+  for (int i = 0; i < ETHER_ADDR_LEN; i++) {
+    // XOR байтов назначения и источника симметричен
+    h = (h ^ (u_int32_t)(packet[i] ^ packet[ETHER_ADDR_LEN + i])) * 16777619u;
+  }
+  return flow_hash_mix32(h);
+}
+
+static inline u_int32_t ports_pair(const u_char *l4) {
+  u_int16_t sport = load_be16(l4);
+  u_int16_t dport = load_be16(l4 + 2);
+  u_int16_t low = sport < dport ? sport : dport;
+  u_int16_t high = sport < dport ? dport : sport;
+  return ((u_int32_t)low << 16) | high;
+}
+
+static inline int has_ports(u_int8_t protocol) {
+  return protocol == IPPROTO_TCP || protocol == IPPROTO_UDP ||
+         protocol == IPPROTO_SCTP;
+}
+
+// IPv6: протокол и порты - после цепочки заголовков расширения (тот же
+// разбор, что и в packet_describe, чтобы хэш совпадал с ключом потока)
+static u_int32_t hash_ipv6(const u_char *ip, bpf_u_int32 ip_len) {
+  parsed_ipv6_header_t header;
+  ip_parse_result_t result = parse_ipv6_header(ip, ip_len, &header);
+  u_int8_t protocol = result.transport_protocol;
+  u_int32_t ports = 0;
+  int is_fragment =
+      header.has_fragment && (header.flags_mf || header.fragment_offset != 0);
+  if (result.payload_ptr != NULL && !is_fragment && has_ports(protocol) &&
+      result.payload_available_len >= 4) {
+    ports = ports_pair(result.payload_ptr);
+  }
+
+  const u_char *src = ip + 8;
+  const u_char *dst = ip + 24;
+  const u_char *low = memcmp(src, dst, 16) <= 0 ? src : dst;
+  const u_char *high = low == src ? dst : src;
+  u_int32_t h = FLOW_HASH_SEED ^ protocol;
+  for (int i = 0; i < 16; i += 4) {
+    h = flow_hash_mix32(h ^ load_be32(low + i));
+  }
+  for (int i = 0; i < 16; i += 4) {
+    h = flow_hash_mix32(h ^ load_be32(high + i));
+  }
+  return flow_hash_mix32(h ^ ports);
+}
+
+u_int32_t flow_hash_packet(const u_char *packet, bpf_u_int32 caplen) {
+  if (caplen < ETHER_HDR_LEN) {
+    return 0;
+  }
+  // Хэшируется внутренний пакет: пакеты одного потока в разных VLAN,
+  // MPLS-путях и туннелях попадают в один рабочий поток
+  decap_result_t encap;
+  decap_packet(packet, caplen, &encap);
+  u_int16_t ether_type = encap.ether_type;
+  const u_char *ip = packet + encap.l3_offset;
+  bpf_u_int32 ip_len = caplen - encap.l3_offset;
+
+  if (ether_type == ETHERTYPE_IPV6 && ip_len >= IPV6_HEADER_LEN &&
+      (ip[0] >> 4) == 6) {
+    return hash_ipv6(ip, ip_len);
+  }
+  if (ether_type != ETHERTYPE_IP || ip_len < 20 || (ip[0] >> 4) != 4) {
+    return hash_mac_pair(packet);
+  }
+
+  u_int32_t ihl_bytes = (u_int32_t)(ip[0] & 0x0F) * 4;
+  u_int8_t protocol = ip[9];
+  u_int16_t frag = load_be16(ip + 6);
+  u_int32_t src = load_be32(ip + 12);
+  u_int32_t dst = load_be32(ip + 16);
+  u_int32_t ports = 0;
+
+  // Порты есть только в нефрагментированном пакете (или в первом фрагменте,
+  // но его тоже хэшируем без портов - вместе с остальными фрагментами)
+  int is_fragment = (frag & 0x3FFF) != 0; // MF или ненулевое смещение
+  if (!is_fragment && ihl_bytes >= 20 && ip_len >= ihl_bytes + 4 &&
+      has_ports(protocol)) {
+    ports = ports_pair(ip + ihl_bytes);
+  }
+
+  u_int32_t low_ip = src < dst ? src : dst;
+  u_int32_t high_ip = src < dst ? dst : src;
+  u_int32_t h = FLOW_HASH_SEED ^ protocol;
+  h = flow_hash_mix32(h ^ low_ip);
+  h = flow_hash_mix32(h ^ high_ip);
+  h = flow_hash_mix32(h ^ ports);
+  return h;
+}
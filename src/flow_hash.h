@@ -0,0 +1,46 @@
+#ifndef FLOW_HASH_H
+#define FLOW_HASH_H
+
+#include <pcap.h>
+#include <sys/types.h>
+
+/**
+ * @brief Симметричный хэш потока для распределения пакетов по рабочим
+ * потокам (программный аналог RSS).
+ *
+ * Для IPv4 хэшируются адреса, протокол и порты TCP/UDP/SCTP; адреса и порты
+ * упорядочиваются перед смешиванием, поэтому оба направления потока дают
+ * одинаковый хэш. Для фрагментов IPv4 порты не берутся (их нет в
+ * не-первых фрагментах), чтобы все фрагменты дейтаграммы попадали в один
+ * поток. Для IPv6 протокол и порты берутся после цепочки заголовков
+ * расширения. Метки VLAN/MPLS и туннели GRE/VXLAN снимаются (decap_packet),
+ * хэшируется внутренний пакет. Кадры без IP хэшируются по паре
+ * MAC-адресов.
+ *
+ * @param packet Указатель на начало Ethernet-кадра.
+ * @param caplen Длина захваченных данных.
+ * @return u_int32_t Хэш потока.
+ */
+u_int32_t flow_hash_packet(const u_char *packet, bpf_u_int32 caplen);
+
+// Финализатор murmur3: быстрое перемешивание 32-битного значения
+static inline u_int32_t flow_hash_mix32(u_int32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+// Финализатор murmur3 для 64 бит (fmix64)
+static inline u_int64_t flow_hash_mix64(u_int64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+#endif // FLOW_HASH_H
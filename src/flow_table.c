@@ -0,0 +1,287 @@
+#include "flow_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define USEC_PER_SEC 1000000ULL
+
+static flow_table_t *flow_tables; // По одной на рабочий поток
+static int num_flow_tables;
+
+int flow_key_from_packet(const packet_descriptor_t *desc, flow_key_t *key,
+                         u_int8_t *tcp_flags) {
+  u_int8_t src[16], dst[16];
+  if (desc->layers & PACKET_HAS_IPV4) {
+    // IPv4-mapped: ::ffff:a.b.c.d
+    memset(src, 0, 10);
+    src[10] = src[11] = 0xff;
+    memcpy(dst, src, 12);
+    memcpy(src + 12, &desc->ipv4.source_ip, 4);
+    memcpy(dst + 12, &desc->ipv4.destination_ip, 4);
+  } else if (desc->layers & PACKET_HAS_IPV6) {
+    memcpy(src, &desc->ipv6.source_ip, 16);
+    memcpy(dst, &desc->ipv6.destination_ip, 16);
+  } else {
+    return -1;
+  }
+  // Порты в дескрипторе уже отобраны по правилам flow_hash_packet, иначе
+  // хэш из очереди не совпал бы с ключом
+  *tcp_flags = (desc->layers & PACKET_HAS_TCP) ? desc->tcp.flags : 0;
+  flow_key_make(key, src, desc->src_port, dst, desc->dst_port,
+                desc->ip_protocol);
+  return 0;
+}
+
+void flow_key_make(flow_key_t *key, const u_int8_t src[16], u_int16_t sport,
+                   const u_int8_t dst[16], u_int16_t dport,
+                   u_int8_t protocol) {
+  memset(key, 0, sizeof(*key));
+  key->protocol = protocol;
+  int order = memcmp(src, dst, 16);
+  if (order < 0 || (order == 0 && sport <= dport)) {
+    memcpy(key->ip_lo, src, 16);
+    key->port_lo = sport;
+    memcpy(key->ip_hi, dst, 16);
+    key->port_hi = dport;
+  } else {
+    memcpy(key->ip_lo, dst, 16);
+    key->port_lo = dport;
+    memcpy(key->ip_hi, src, 16);
+    key->port_hi = sport;
+  }
+}
+
+static inline int flow_key_equal(const flow_key_t *a, const flow_key_t *b) {
+  // Ключи собираются через memset, поэтому сравнение побайтное
+  return memcmp(a, b, sizeof(flow_key_t)) == 0;
+}
+
+static int flow_table_init(flow_table_t *table, size_t memory_bytes,
+                           const flow_table_options_t *options) {
+  memset(table, 0, sizeof(*table));
+  // Наибольшая степень двойки слотов, помещающаяся в бюджет
+  size_t slots = 64;
+  while (slots * 2 * sizeof(flow_entry_t) <= memory_bytes &&
+         slots * 2 <= (1UL << 31)) {
+    slots *= 2;
+  }
+  table->memory_size = slots * sizeof(flow_entry_t);
+  // Анонимное отображение: нули даром, страницы - по мере заполнения
+  table->entries = mmap(NULL, table->memory_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (table->entries == MAP_FAILED) {
+    table->entries = NULL;
+    perror("flow_table_init: Ошибка mmap");
+    return -1;
+  }
+  table->mask = (u_int32_t)(slots - 1);
+  table->max_count =
+      (u_int32_t)(slots * FLOW_TABLE_MAX_LOAD_PERCENT / 100);
+  table->idle_timeout_us = options->idle_timeout * USEC_PER_SEC;
+  table->active_timeout_us = options->active_timeout * USEC_PER_SEC;
+  table->sweep_slots = options->sweep_slots;
+  table->export_fn = options->export_fn;
+  return 0;
+}
+
+// Удаляет запись из слота index сдвигом назад: следующие записи кластера,
+// которые можно найти раньше, переезжают ближе к своему домашнему слоту
+static void flow_table_remove(flow_table_t *table, u_int32_t index,
+                              flow_end_reason_t reason) {
+  if (table->export_fn != NULL) {
+    table->export_fn(&table->entries[index], reason);
+  }
+  table->stats.evicted[reason]++;
+  table->count--;
+
+  u_int32_t hole = index;
+  u_int32_t next = index;
+  while (1) {
+    next = (next + 1) & table->mask;
+    flow_entry_t *entry = &table->entries[next];
+    if (!entry->used) {
+      break;
+    }
+    u_int32_t home = entry->hash & table->mask;
+    // Запись остается, если ее домашний слот лежит в (hole, next]
+    int stays = hole <= next ? (hole < home && home <= next)
+                             : (hole < home || home <= next);
+    if (stays) {
+      continue;
+    }
+    table->entries[hole] = *entry;
+    hole = next;
+  }
+  table->entries[hole].used = 0;
+}
+
+// Вытесняет самый давний из первых FLOW_TABLE_EVICT_PROBE занятых слотов,
+// начиная с start
+static void flow_table_evict_near(flow_table_t *table, u_int32_t start) {
+  u_int32_t victim = start;
+  while (!table->entries[victim].used) { // count > 0, поэтому найдется
+    victim = (victim + 1) & table->mask;
+  }
+  u_int32_t candidate = victim;
+  for (u_int32_t i = 1; i < FLOW_TABLE_EVICT_PROBE; i++) {
+    candidate = (candidate + 1) & table->mask;
+    if (!table->entries[candidate].used) {
+      break;
+    }
+    if (table->entries[candidate].last_seen_us <
+        table->entries[victim].last_seen_us) {
+      victim = candidate;
+    }
+  }
+  flow_table_remove(table, victim, FLOW_END_FORCED);
+}
+
+static inline void flow_entry_start(flow_entry_t *entry, u_int32_t hash,
+                                    const flow_key_t *key, u_int64_t ts_us) {
+  entry->key = *key;
+  entry->hash = hash;
+  entry->used = 1;
+  entry->tcp_flags = 0;
+  entry->packets = 0;
+  entry->bytes = 0;
+  entry->first_seen_us = ts_us;
+  entry->last_seen_us = ts_us;
+}
+
+flow_entry_t *flow_table_update(flow_table_t *table, u_int32_t hash,
+                                const flow_key_t *key, u_int64_t ts_us,
+                                u_int32_t bytes, u_int8_t tcp_flags) {
+  if (ts_us > table->now_us) {
+    table->now_us = ts_us;
+  }
+  u_int32_t index = hash & table->mask;
+  flow_entry_t *entry;
+  while (1) {
+    entry = &table->entries[index];
+    if (!entry->used) {
+      break;
+    }
+    if (entry->hash == hash && flow_key_equal(&entry->key, key)) {
+      goto found;
+    }
+    index = (index + 1) & table->mask;
+  }
+
+  if (table->count >= table->max_count) {
+    // Бюджет памяти исчерпан: вытесняем самый давний поток рядом с домашним
+    // слотом и заново ищем свободное место
+    flow_table_evict_near(table, hash & table->mask);
+    index = hash & table->mask;
+    while (table->entries[index].used) {
+      index = (index + 1) & table->mask;
+    }
+    entry = &table->entries[index];
+  }
+  table->count++;
+  flow_entry_start(entry, hash, key, ts_us);
+  table->stats.created++;
+
+found:
+  entry->packets++;
+  entry->bytes += bytes;
+  entry->tcp_flags |= tcp_flags;
+  if (ts_us > entry->last_seen_us) {
+    entry->last_seen_us = ts_us;
+  }
+  if (ts_us < entry->first_seen_us) {
+    entry->first_seen_us = ts_us; // Части файла -R читаются параллельно
+  }
+  return entry;
+}
+
+void flow_table_sweep(flow_table_t *table) {
+  u_int64_t now = table->now_us;
+  u_int32_t index = table->sweep_cursor;
+  for (unsigned int i = 0; i < table->sweep_slots && table->count > 0; i++) {
+    flow_entry_t *entry = &table->entries[index];
+    if (entry->used) {
+      if (now - entry->last_seen_us > table->idle_timeout_us &&
+          entry->last_seen_us <= now) {
+        flow_table_remove(table, index, FLOW_END_IDLE);
+        continue; // На место удаленной могла переехать другая запись
+      }
+      if (now - entry->first_seen_us > table->active_timeout_us &&
+          entry->first_seen_us <= now) {
+        flow_table_remove(table, index, FLOW_END_ACTIVE);
+        continue;
+      }
+    }
+    index = (index + 1) & table->mask;
+  }
+  table->sweep_cursor = index;
+}
+
+void flow_table_get_default_options(flow_table_options_t *options) {
+  options->memory_budget = FLOW_TABLE_DEFAULT_MEMORY;
+  options->idle_timeout = FLOW_TABLE_DEFAULT_IDLE_TIMEOUT;
+  options->active_timeout = FLOW_TABLE_DEFAULT_ACTIVE_TIMEOUT;
+  options->sweep_slots = FLOW_TABLE_DEFAULT_SWEEP_SLOTS;
+  options->export_fn = NULL;
+}
+
+int flow_tables_init(int num_tables, const flow_table_options_t *options) {
+  if (num_tables <= 0) {
+    return -1;
+  }
+  flow_tables = aligned_alloc(64, sizeof(flow_table_t) * num_tables);
+  if (flow_tables == NULL) {
+    perror("flow_tables_init: Ошибка выделения памяти");
+    return -1;
+  }
+  size_t per_table = options->memory_budget / (size_t)num_tables;
+  for (int i = 0; i < num_tables; i++) {
+    if (flow_table_init(&flow_tables[i], per_table, options) != 0) {
+      num_flow_tables = i;
+      flow_tables_destroy();
+      return -1;
+    }
+  }
+  num_flow_tables = num_tables;
+  printf("flow_tables_init: %d таблиц потоков по %u слотов (%zu МиБ "
+         "всего).\n",
+         num_tables, flow_tables[0].mask + 1,
+         flow_tables[0].memory_size * num_tables / (1024 * 1024));
+  return 0;
+}
+
+flow_table_t *flow_tables_get(int worker_id) {
+  if (worker_id < 0 || worker_id >= num_flow_tables) {
+    return NULL;
+  }
+  return &flow_tables[worker_id];
+}
+
+void flow_tables_get_stats(flow_table_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (int i = 0; i < num_flow_tables; i++) {
+    const flow_table_stats_t *table_stats = &flow_tables[i].stats;
+    stats->created += table_stats->created;
+    stats->active += flow_tables[i].count;
+    for (int reason = 0; reason < 4; reason++) {
+      stats->evicted[reason] += table_stats->evicted[reason];
+    }
+  }
+}
+
+void flow_tables_destroy(void) {
+  for (int i = 0; i < num_flow_tables; i++) {
+    flow_table_t *table = &flow_tables[i];
+    if (table->export_fn != NULL) {
+      for (u_int32_t index = 0; index <= table->mask; index++) {
+        if (table->entries[index].used) {
+          table->export_fn(&table->entries[index], FLOW_END_SHUTDOWN);
+        }
+      }
+    }
+    munmap(table->entries, table->memory_size);
+  }
+  free(flow_tables);
+  flow_tables = NULL;
+  num_flow_tables = 0;
+}
@@ -0,0 +1,132 @@
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include "packet_descriptor.h"
+#include <stddef.h>
+#include <sys/types.h>
+
+#define FLOW_TABLE_DEFAULT_MEMORY (256UL * 1024 * 1024) // На все таблицы
+#define FLOW_TABLE_DEFAULT_IDLE_TIMEOUT 30    // Секунд без пакетов
+#define FLOW_TABLE_DEFAULT_ACTIVE_TIMEOUT 300 // Секунд с первого пакета
+#define FLOW_TABLE_DEFAULT_SWEEP_SLOTS 256    // Слотов за один шаг обхода
+#define FLOW_TABLE_MAX_LOAD_PERCENT 75 // Дальше новые потоки вытесняют старые
+#define FLOW_TABLE_EVICT_PROBE 8 // Сколько слотов смотреть при вытеснении
+
+// Ключ потока: 5-кортеж IPv4 или IPv6. Конечные точки упорядочены (меньшая
+// пара адрес/порт - первой), поэтому оба направления дают один ключ
+typedef struct {
+  u_int8_t ip_lo[16]; // IPv6 или IPv4-mapped (::ffff:a.b.c.d), сетевой порядок
+  u_int8_t ip_hi[16];
+  u_int16_t port_lo; // Порты TCP/UDP/SCTP, 0 для остальных и фрагментов
+  u_int16_t port_hi;
+  u_int8_t protocol; // Протокол верхнего уровня (для IPv6 - после расширений)
+  u_int8_t reserved[3]; // Всегда 0
+} flow_key_t;
+
+// Запись потока: две кэш-линии. В первой - все, что нужно поиску и обходу
+// таймаутов, во второй - счетчики
+typedef struct {
+  _Alignas(64) flow_key_t key;
+  u_int32_t hash;     // Хэш потока (flow_hash_packet), 0..2^32-1
+  u_int8_t used;      // 1 - слот занят
+  u_int8_t tcp_flags; // OR флагов TCP всех пакетов потока
+  u_int16_t reserved;
+  u_int64_t first_seen_us; // Время первого и последнего пакета (мкс)
+  u_int64_t last_seen_us;
+  _Alignas(64) u_int64_t packets;
+  u_int64_t bytes;
+} flow_entry_t;
+
+// Почему запись покинула таблицу
+typedef enum {
+  FLOW_END_IDLE = 0,   // Простой дольше idle_timeout
+  FLOW_END_ACTIVE = 1, // Поток живет дольше active_timeout
+  FLOW_END_FORCED = 2, // Таблица заполнена - вытеснен самый старый
+  FLOW_END_SHUTDOWN = 3, // Завершение программы
+} flow_end_reason_t;
+
+// Экспорт завершенного потока (вызывается в рабочем потоке-владельце)
+typedef void (*flow_export_fn)(const flow_entry_t *flow,
+                               flow_end_reason_t reason);
+
+typedef struct {
+  size_t memory_budget;        // Байт на все таблицы (по рабочим потокам)
+  unsigned int idle_timeout;   // Секунды
+  unsigned int active_timeout; // Секунды
+  unsigned int sweep_slots;    // Слотов за один вызов flow_table_sweep
+  flow_export_fn export_fn;    // Может быть NULL
+} flow_table_options_t;
+
+typedef struct {
+  unsigned long long created;
+  unsigned long long active; // Сейчас в таблицах
+  unsigned long long evicted[4]; // По flow_end_reason_t
+} flow_table_stats_t;
+
+/**
+ * @brief Таблица потоков одного рабочего потока.
+ *
+ * Открытая адресация с линейным пробированием по заранее посчитанному
+ * хэшу, удаление сдвигом назад (без "надгробий"). Память выделяется один
+ * раз под фиксированное число слотов. Таймауты проверяются постепенно:
+ * каждый вызов flow_table_sweep просматривает sweep_slots слотов от
+ * курсора. Время - по меткам пакетов, поэтому при воспроизведении файла
+ * таймауты работают во времени трассы.
+ */
+typedef struct {
+  flow_entry_t *entries;
+  size_t memory_size;
+  u_int32_t mask;       // Количество слотов - 1
+  u_int32_t count;      // Занято слотов
+  u_int32_t max_count;  // Предел заполнения
+  u_int32_t sweep_cursor;
+  u_int64_t now_us;     // Самая поздняя метка времени пакета
+  u_int64_t idle_timeout_us;
+  u_int64_t active_timeout_us;
+  unsigned int sweep_slots;
+  flow_export_fn export_fn;
+  flow_table_stats_t stats;
+} flow_table_t;
+
+/**
+ * @brief Собирает ключ потока из разобранного пакета.
+ *
+ * @return int 0 - ключ построен (пакет IPv4 или IPv6), -1 - пакет не
+ *             относится к потокам IP.
+ */
+int flow_key_from_packet(const packet_descriptor_t *desc, flow_key_t *key,
+                         u_int8_t *tcp_flags);
+
+// Ключ по конечным точкам (адреса по 16 байт, IPv4-mapped; порты в
+// порядке хоста) - для запросов, где пакета нет
+void flow_key_make(flow_key_t *key, const u_int8_t src[16], u_int16_t sport,
+                   const u_int8_t dst[16], u_int16_t dport,
+                   u_int8_t protocol);
+
+/**
+ * @brief Учитывает пакет в потоке (создает поток при необходимости).
+ *
+ * @param hash Хэш потока, посчитанный при постановке в очередь.
+ * @return flow_entry_t* Запись потока.
+ */
+flow_entry_t *flow_table_update(flow_table_t *table, u_int32_t hash,
+                                const flow_key_t *key, u_int64_t ts_us,
+                                u_int32_t bytes, u_int8_t tcp_flags);
+
+// Один шаг обхода: проверяет таймауты в следующих sweep_slots слотах
+void flow_table_sweep(flow_table_t *table);
+
+// --- Набор таблиц по рабочим потокам (индекс - queue_worker_id) ---
+void flow_table_get_default_options(flow_table_options_t *options);
+int flow_tables_init(int num_tables, const flow_table_options_t *options);
+
+// Таблица рабочего потока, NULL - нет таблиц или неверный номер
+flow_table_t *flow_tables_get(int worker_id);
+
+// Сумма счетчиков всех таблиц (после остановки рабочих потоков)
+void flow_tables_get_stats(flow_table_stats_t *stats);
+
+// Экспортирует оставшиеся потоки (FLOW_END_SHUTDOWN) и освобождает память
+void flow_tables_destroy(void);
+
+#endif // FLOW_TABLE_H
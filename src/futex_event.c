@@ -0,0 +1,61 @@
+#include "futex_event.h"
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+void futex_event_init(futex_event_t *ev) {
+  atomic_init(&ev->seq, 0);
+  atomic_init(&ev->waiters, 0);
+}
+
+u_int32_t futex_event_prepare(futex_event_t *ev) {
+  // seq_cst: регистрация должна стать видимой до повторной проверки условия
+  atomic_fetch_add_explicit(&ev->waiters, 1, memory_order_seq_cst);
+  return atomic_load_explicit(&ev->seq, memory_order_seq_cst);
+}
+
+void futex_event_cancel(futex_event_t *ev) {
+  atomic_fetch_sub_explicit(&ev->waiters, 1, memory_order_relaxed);
+}
+
+void futex_event_wait(futex_event_t *ev, u_int32_t seq,
+                      unsigned int timeout_ms) {
+#ifdef __linux__
+  struct timespec timeout;
+  struct timespec *timeout_ptr = NULL;
+  if (timeout_ms > 0) {
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    timeout_ptr = &timeout;
+  }
+  // EAGAIN (номер уже сменился), EINTR и таймаут просто возвращают
+  // управление - вызывающий в любом случае перепроверяет условие
+  syscall(SYS_futex, &ev->seq, FUTEX_WAIT_PRIVATE, seq, timeout_ptr, NULL, 0);
+#else
+  // Без futex: короткий сон, вызывающий перепроверит условие
+  (void)timeout_ms;
+  if (atomic_load_explicit(&ev->seq, memory_order_acquire) == seq) {
+    usleep(100);
+  }
+#endif
+  atomic_fetch_sub_explicit(&ev->waiters, 1, memory_order_relaxed);
+}
+
+void futex_event_notify(futex_event_t *ev, int wake_all) {
+  // Условие (например, хвост кольца) уже записано; полный барьер, чтобы
+  // чтение waiters не переупорядочилось раньше этой записи
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ev->waiters, memory_order_relaxed) == 0) {
+    return;
+  }
+  atomic_fetch_add_explicit(&ev->seq, 1, memory_order_release);
+#ifdef __linux__
+  syscall(SYS_futex, &ev->seq, FUTEX_WAKE_PRIVATE, wake_all ? INT_MAX : 1,
+          NULL, NULL, 0);
+#endif
+}
@@ -0,0 +1,42 @@
+#ifndef FUTEX_EVENT_H
+#define FUTEX_EVENT_H
+
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/**
+ * @brief Событие для засыпания потоков без мьютекса (eventcount на futex).
+ *
+ * Протокол ожидающего:
+ *   seq = futex_event_prepare(ev);
+ *   if (условие уже выполнено) { futex_event_cancel(ev); }
+ *   else { futex_event_wait(ev, seq, timeout_ms); }
+ * Сигналящий сначала делает условие истинным, затем вызывает
+ * futex_event_notify. Системный вызов делается только если кто-то реально
+ * спит, поэтому на горячем пути без ожидающих это одна атомарная загрузка.
+ */
+typedef struct {
+  _Atomic u_int32_t seq;     // Номер события (слово futex)
+  _Atomic u_int32_t waiters; // Сколько потоков собирается заснуть/спит
+} futex_event_t;
+
+void futex_event_init(futex_event_t *ev);
+
+// Регистрирует ожидающего и возвращает текущий номер события
+u_int32_t futex_event_prepare(futex_event_t *ev);
+
+// Отмена ожидания после prepare (условие оказалось выполнено)
+void futex_event_cancel(futex_event_t *ev);
+
+/**
+ * @brief Засыпает, пока номер события равен seq.
+ *
+ * @param timeout_ms Таймаут в миллисекундах, 0 - без таймаута.
+ */
+void futex_event_wait(futex_event_t *ev, u_int32_t seq,
+                      unsigned int timeout_ms);
+
+// Будит одного (wake_all = 0) или всех ожидающих, если они есть
+void futex_event_notify(futex_event_t *ev, int wake_all);
+
+#endif // FUTEX_EVENT_H
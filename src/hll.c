@@ -0,0 +1,311 @@
+#include "hll.h"
+#include "flow_hash.h"
+#include "stats.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HLL_PORT_SEED 0x9e3779b97f4a7c15ULL // Разводит ключи портов и адресов
+
+// Подсеть в виде 16 байт (IPv4 - IPv4-mapped) и маски
+typedef struct {
+  u_int64_t network[2];
+  u_int64_t mask[2];
+  char text[INET6_ADDRSTRLEN + 4]; // Для отчета: адрес/длина
+} hll_subnet_t;
+
+static hll_subnet_t subnets[HLL_MAX_SUBNETS];
+static int num_subnets;
+static hll_worker_t *workers; // По паре наборов на рабочий поток
+static int num_workers_global;
+static size_t set_size; // Байт регистров в наборе
+// Слияние за интервал и за все время (только поток отчетов или main)
+static hll_set_t interval_set;
+static hll_set_t total_set;
+
+#define HLL_MAX_RANK (64 - HLL_PRECISION + 1)
+
+// Поправки улучшенной оценки (O. Ertl, "New cardinality estimation
+// algorithms for HyperLogLog sketches", 2017): sigma - для пустых
+// регистров, tau - для насыщенных
+static double estimate_sigma(double x) {
+  if (x == 1.0) {
+    return INFINITY;
+  }
+  double y = 1.0, z = x, previous;
+  do {
+    x *= x;
+    previous = z;
+    z += x * y;
+    y += y;
+  } while (z != previous);
+  return z;
+}
+
+static double estimate_tau(double x) {
+  if (x == 0.0 || x == 1.0) {
+    return 0.0;
+  }
+  double y = 1.0, z = 1.0 - x, previous;
+  do {
+    x = sqrt(x);
+    previous = z;
+    y *= 0.5;
+    z -= (1.0 - x) * (1.0 - x) * y;
+  } while (z != previous);
+  return z / 3.0;
+}
+
+// Оценка по гистограмме регистров без таблиц смещения и без порога
+// перехода к linear counting, где у классической формулы заметный сдвиг
+double hll_estimate(const u_int8_t *registers) {
+  unsigned int histogram[HLL_MAX_RANK + 1] = {0};
+  for (u_int32_t i = 0; i < HLL_REGISTERS; i++) {
+    histogram[registers[i]]++;
+  }
+  const double m = HLL_REGISTERS;
+  double z = m * estimate_tau(1.0 - histogram[HLL_MAX_RANK] / m);
+  for (int k = HLL_MAX_RANK - 1; k >= 1; k--) {
+    z = 0.5 * (z + histogram[k]);
+  }
+  z += m * estimate_sigma(histogram[0] / m);
+  return m * m / (2.0 * M_LN2) / z;
+}
+
+void hll_merge(u_int8_t *into, const u_int8_t *from, size_t count) {
+#ifdef __SSE2__
+  for (size_t i = 0; i < count; i += 16) {
+    __m128i a = _mm_load_si128((const __m128i *)(into + i));
+    __m128i b = _mm_load_si128((const __m128i *)(from + i));
+    _mm_store_si128((__m128i *)(into + i), _mm_max_epu8(a, b));
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    if (into[i] < from[i]) {
+      into[i] = from[i];
+    }
+  }
+#endif
+}
+
+int hll_add_subnet(const char *cidr) {
+  if (num_subnets >= HLL_MAX_SUBNETS) {
+    fprintf(stderr, "hll_add_subnet: не больше %d подсетей\n",
+            HLL_MAX_SUBNETS);
+    return -1;
+  }
+  hll_subnet_t *subnet = &subnets[num_subnets];
+  u_int8_t network[16], mask[16];
+  int prefix;
+  if (parse_ip_prefix(cidr, network, mask, &prefix) != 0) {
+    fprintf(stderr, "hll_add_subnet: неверная подсеть %s\n", cidr);
+    return -1;
+  }
+  memcpy(subnet->network, network, 16);
+  memcpy(subnet->mask, mask, 16);
+  // Для отчета - как задано, но всегда с длиной префикса
+  const char *slash = strchr(cidr, '/');
+  int length = slash != NULL ? (int)(slash - cidr) : (int)strlen(cidr);
+  snprintf(subnet->text, sizeof(subnet->text), "%.*s/%d", length, cidr,
+           prefix);
+  num_subnets++;
+  return 0;
+}
+
+static int set_init(hll_set_t *set) {
+  set->registers = aligned_alloc(64, set_size);
+  if (set->registers == NULL) {
+    perror("hll_init: Ошибка выделения памяти для регистров");
+    return -1;
+  }
+  memset(set->registers, 0, set_size);
+  return 0;
+}
+
+static void set_free(hll_set_t *set) {
+  free(set->registers);
+  set->registers = NULL;
+}
+
+int hll_init(int num_workers) {
+  if (num_workers <= 0) {
+    return -1;
+  }
+  set_size = (size_t)(1 + 2 * num_subnets) * HLL_KEY_COUNT * HLL_REGISTERS;
+  workers = aligned_alloc(64, sizeof(hll_worker_t) * num_workers);
+  if (workers == NULL) {
+    perror("hll_init: Ошибка выделения памяти");
+    return -1;
+  }
+  memset(workers, 0, sizeof(hll_worker_t) * num_workers);
+  num_workers_global = num_workers;
+  for (int i = 0; i < num_workers; i++) {
+    atomic_init(&workers[i].published_ready, 0);
+    if (set_init(&workers[i].sets[0]) != 0 ||
+        set_init(&workers[i].sets[1]) != 0) {
+      hll_destroy();
+      return -1;
+    }
+  }
+  if (set_init(&interval_set) != 0 || set_init(&total_set) != 0) {
+    hll_destroy();
+    return -1;
+  }
+  return 0;
+}
+
+int hll_enabled(void) { return workers != NULL; }
+
+hll_worker_t *hll_worker_get(int worker_id) {
+  if (worker_id < 0 || worker_id >= num_workers_global) {
+    return NULL;
+  }
+  return &workers[worker_id];
+}
+
+void hll_destroy(void) {
+  for (int i = 0; i < num_workers_global && workers != NULL; i++) {
+    set_free(&workers[i].sets[0]);
+    set_free(&workers[i].sets[1]);
+  }
+  set_free(&interval_set);
+  set_free(&total_set);
+  free(workers);
+  workers = NULL;
+  num_workers_global = 0;
+  num_subnets = 0;
+}
+
+static inline int subnet_contains(const hll_subnet_t *subnet,
+                                  const u_int64_t address[2]) {
+  return ((address[0] & subnet->mask[0]) == subnet->network[0]) &
+         ((address[1] & subnet->mask[1]) == subnet->network[1]);
+}
+
+// Учет в трех счетчиках группы; хэши общие для всех групп пакета
+static inline void count_group(u_int8_t *group, const u_int64_t *hashes,
+                               int has_ports) {
+  hll_add(group + HLL_SOURCES * HLL_REGISTERS, hashes[HLL_SOURCES]);
+  if (has_ports) {
+    hll_add(group + HLL_DESTINATION_PORTS * HLL_REGISTERS,
+            hashes[HLL_DESTINATION_PORTS]);
+  }
+  hll_add(group + HLL_FLOWS * HLL_REGISTERS, hashes[HLL_FLOWS]);
+}
+
+void hll_count_packet(hll_worker_t *worker, const packet_descriptor_t *desc,
+                      u_int32_t flow_hash) {
+  u_int8_t src_bytes[16], dst_bytes[16];
+  if (desc->layers & PACKET_HAS_IPV4) {
+    memset(src_bytes, 0, 10);
+    src_bytes[10] = src_bytes[11] = 0xff;
+    memcpy(dst_bytes, src_bytes, 12);
+    memcpy(src_bytes + 12, &desc->ipv4.source_ip, 4);
+    memcpy(dst_bytes + 12, &desc->ipv4.destination_ip, 4);
+  } else if (desc->layers & PACKET_HAS_IPV6) {
+    memcpy(src_bytes, &desc->ipv6.source_ip, 16);
+    memcpy(dst_bytes, &desc->ipv6.destination_ip, 16);
+  } else {
+    return;
+  }
+  u_int64_t src[2], dst[2];
+  memcpy(src, src_bytes, 16);
+  memcpy(dst, dst_bytes, 16);
+
+  // По одному хэшу на ключ, дальше он только раскладывается по группам
+  u_int64_t hashes[HLL_KEY_COUNT];
+  hashes[HLL_SOURCES] = flow_hash_mix64(src[0] ^ flow_hash_mix64(src[1]));
+  hashes[HLL_DESTINATION_PORTS] = flow_hash_mix64(
+      (((u_int64_t)desc->ip_protocol << 16) | desc->dst_port) ^ HLL_PORT_SEED);
+  hashes[HLL_FLOWS] = flow_hash_mix64(flow_hash);
+  int has_ports = (desc->layers & PACKET_HAS_PORTS) != 0;
+
+  u_int8_t *registers = worker->sets[worker->active].registers;
+  const size_t group_size = (size_t)HLL_KEY_COUNT * HLL_REGISTERS;
+  count_group(registers, hashes, has_ports);
+  for (int i = 0; i < num_subnets; i++) {
+    u_int8_t *inbound = registers + (size_t)(1 + 2 * i) * group_size;
+    if (subnet_contains(&subnets[i], dst)) {
+      count_group(inbound, hashes, has_ports);
+    }
+    if (subnet_contains(&subnets[i], src)) {
+      count_group(inbound + group_size, hashes, has_ports);
+    }
+  }
+}
+
+void hll_worker_tick(hll_worker_t *worker) {
+  unsigned int epoch = stats_current_epoch();
+  if (epoch == worker->epoch ||
+      atomic_load_explicit(&worker->published_ready, memory_order_acquire)) {
+    return; // Интервал тот же или прошлый набор еще не забран
+  }
+  worker->epoch = epoch;
+  worker->published = worker->active;
+  worker->active ^= 1;
+  memset(worker->sets[worker->active].registers, 0, set_size);
+  atomic_store_explicit(&worker->published_ready, 1, memory_order_release);
+}
+
+static void print_group(const char *name, const char *direction,
+                        const u_int8_t *group) {
+  printf("  %s%s: источников ~%.0f, портов назначения ~%.0f, потоков "
+         "~%.0f\n",
+         name, direction,
+         hll_estimate(group + HLL_SOURCES * HLL_REGISTERS),
+         hll_estimate(group + HLL_DESTINATION_PORTS * HLL_REGISTERS),
+         hll_estimate(group + HLL_FLOWS * HLL_REGISTERS));
+}
+
+static void print_set(const char *period, const hll_set_t *set) {
+  const size_t group_size = (size_t)HLL_KEY_COUNT * HLL_REGISTERS;
+  printf("Уникальных значений (%s):\n", period);
+  print_group("весь трафик IP", "", set->registers);
+  for (int i = 0; i < num_subnets; i++) {
+    const u_int8_t *inbound = set->registers + (1 + 2 * i) * group_size;
+    print_group(subnets[i].text, " входящий", inbound);
+    print_group(subnets[i].text, " исходящий", inbound + group_size);
+  }
+  fflush(stdout);
+}
+
+void hll_report_interval(void) {
+  if (workers == NULL) {
+    return;
+  }
+  memset(interval_set.registers, 0, set_size);
+  for (int i = 0; i < num_workers_global; i++) {
+    hll_worker_t *worker = &workers[i];
+    if (atomic_load_explicit(&worker->published_ready, memory_order_acquire)) {
+      hll_merge(interval_set.registers,
+                worker->sets[worker->published].registers, set_size);
+      atomic_store_explicit(&worker->published_ready, 0, memory_order_release);
+    }
+  }
+  // Объединение множеств не теряет точности: итог копится по интервалам
+  hll_merge(total_set.registers, interval_set.registers, set_size);
+  print_set("за предыдущий интервал", &interval_set);
+}
+
+void hll_report_final(void) {
+  if (workers == NULL) {
+    return;
+  }
+  for (int i = 0; i < num_workers_global; i++) {
+    hll_worker_t *worker = &workers[i];
+    if (atomic_load_explicit(&worker->published_ready, memory_order_acquire)) {
+      hll_merge(total_set.registers, worker->sets[worker->published].registers,
+                set_size);
+      atomic_store_explicit(&worker->published_ready, 0, memory_order_release);
+    }
+    hll_merge(total_set.registers, worker->sets[worker->active].registers,
+              set_size);
+  }
+  print_set("за все время", &total_set);
+}
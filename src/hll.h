@@ -0,0 +1,101 @@
+#ifndef HLL_H
+#define HLL_H
+
+#include "packet_descriptor.h"
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define HLL_PRECISION 12 // 4096 регистров: стандартная ошибка ~1,6%
+#define HLL_REGISTERS (1u << HLL_PRECISION)
+#define HLL_MAX_SUBNETS 8
+
+// Что считается в каждой группе
+typedef enum {
+  HLL_SOURCES = 0,           // Уникальные IP источника
+  HLL_DESTINATION_PORTS = 1, // Уникальные пары протокол/порт назначения
+  HLL_FLOWS = 2,             // Уникальные потоки (хэш потока из очереди)
+  HLL_KEY_COUNT
+} hll_key_t;
+
+/**
+ * @brief Регистры HyperLogLog всех групп одного набора.
+ *
+ * Группа 0 - весь трафик IP, затем для каждой подсети из hll_add_subnet
+ * две группы: входящий (назначение в подсети) и исходящий (источник в
+ * подсети) трафик. Регистры счетчика лежат подряд (смещение -
+ * (группа * HLL_KEY_COUNT + ключ) * HLL_REGISTERS), по байту на регистр,
+ * с выравниванием 64 - слияние наборов - побайтовый максимум векторами.
+ */
+typedef struct {
+  u_int8_t *registers;
+} hll_set_t;
+
+/**
+ * @brief Регистры рабочего потока: активный набор и опубликованный.
+ *
+ * Передача потоку отчетов - как у скетчей topk: увидев новый интервал
+ * (stats_current_epoch), владелец отдает активный набор (published_ready =
+ * 1) и продолжает в чистом, если прошлый уже забран.
+ */
+typedef struct {
+  _Alignas(64) hll_set_t sets[2];
+  int active;         // Только владелец
+  int published;      // Какой набор отдан (пишется до published_ready)
+  unsigned int epoch; // Последний увиденный интервал
+  atomic_int published_ready;
+} hll_worker_t;
+
+// Учет хэша в регистрах одного счетчика: старшие HLL_PRECISION бит -
+// номер регистра, в регистре - максимальная позиция первой единицы
+static inline void hll_add(u_int8_t *registers, u_int64_t hash) {
+  u_int32_t index = (u_int32_t)(hash >> (64 - HLL_PRECISION));
+  // Граничный бит ограничивает ранг, если остальные биты нулевые
+  u_int64_t rest = (hash << HLL_PRECISION) | (1ULL << (HLL_PRECISION - 1));
+  u_int8_t rank = (u_int8_t)(__builtin_clzll(rest) + 1);
+  if (registers[index] < rank) {
+    registers[index] = rank;
+  }
+}
+
+// Оценка числа различных значений по регистрам одного счетчика
+double hll_estimate(const u_int8_t *registers);
+
+// Объединение множеств: into[i] = max(into[i], from[i]) (count - кратно 64)
+void hll_merge(u_int8_t *into, const u_int8_t *from, size_t count);
+
+// --- Счетчики по рабочим потокам (индекс - queue_worker_id) ---
+
+/**
+ * @brief Добавляет подсеть для раздельного счета (до hll_init).
+ *
+ * @param cidr Подсеть IPv4 или IPv6 вида адрес/длина (без длины - один
+ *             адрес).
+ * @return int 0 при успехе, -1 при ошибке разбора или если подсетей
+ *         больше HLL_MAX_SUBNETS.
+ */
+int hll_add_subnet(const char *cidr);
+
+/**
+ * @brief Выделяет регистры рабочих потоков и наборы для отчетов.
+ *
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int hll_init(int num_workers);
+int hll_enabled(void);
+hll_worker_t *hll_worker_get(int worker_id);
+void hll_destroy(void);
+
+// Учет пакета IP; flow_hash - хэш потока, посчитанный при постановке
+void hll_count_packet(hll_worker_t *worker, const packet_descriptor_t *desc,
+                      u_int32_t flow_hash);
+
+// Раз в пачку: публикация набора, если начался новый интервал
+void hll_worker_tick(hll_worker_t *worker);
+
+// Поток отчетов: слить опубликованные наборы и напечатать оценки
+void hll_report_interval(void);
+
+// После остановки рабочих потоков: оценки за все время
+void hll_report_final(void);
+
+#endif // HLL_H
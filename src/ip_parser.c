@@ -2,115 +2,154 @@
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 #include <pcap.h>
-#include <stdio.h>
 #include <string.h>
 
 #ifndef IP_MIN_HEADER_LEN
 #define IP_MIN_HEADER_LEN 20
 #endif
 
-ipv4_parse_result_t parse_ipv4_header(const u_char *ip_packet,
-                                      bpf_u_int32 len) {
-  ipv4_parse_result_t result;
+ip_parse_result_t parse_ipv4_header(const u_char *ip_packet, bpf_u_int32 len,
+                                    parsed_ipv4_header_t *header) {
+  ip_parse_result_t result;
   // Инициализируем результат нулями
-  memset(&result, 0, sizeof(ipv4_parse_result_t));
+  memset(&result, 0, sizeof(ip_parse_result_t));
 
-  const struct ip *fixed_part_header; // Объявляем указатель
+  struct ip fixed_part_header;
   u_int32_t actual_header_length_bytes;
   u_int8_t version;
   u_int8_t ihl_in_words;
 
-  if (len < 1) {
-    printf("  [IPv4] Пакет слишком короткий для чтения первого байта (длина: "
-           "%u)\n",
-           len);
-    return result; // Ошибка
+  if (len < IP_MIN_HEADER_LEN) {
+    return result; // Ошибка: нет даже фиксированной части
   }
 
-  u_int8_t first_byte = *((u_int8_t *)ip_packet);
+  u_int8_t first_byte = ip_packet[0];
   version = (first_byte >> 4) & 0x0F; // Версия
   ihl_in_words = first_byte & 0x0F;   // IHL
   actual_header_length_bytes =
       ihl_in_words * 4; // Реальная длина IP-заголовка в байтах
 
-  // Проверяем корректность версии и IHL
-  if (version != 4) {
-    printf("  [IPv4] Неверная версия IP: %u (ожидалось 4)\n", version);
+  // Проверяем корректность версии и IHL, и что заголовок (включая опции)
+  // целиком захвачен
+  if (version != 4 || actual_header_length_bytes < IP_MIN_HEADER_LEN ||
+      len < actual_header_length_bytes) {
     return result;
   }
 
-  if (actual_header_length_bytes < 20) {
-    printf("  [IPv4] Некорректная длина заголовка IHL: %u слов (реальная длина "
-           "%u байт, мин. 20 байт)\n",
-           ihl_in_words, actual_header_length_bytes);
-    return result;
-  }
-
-  // Проверяем, достаточно ли данных для полного заголовка (включая опции)
-  if (len < actual_header_length_bytes) {
-    printf("  [IPv4] Пакет слишком короткий для полного IP-заголовка (длина: "
-           "%u, нужно: %u)\n",
-           len, actual_header_length_bytes);
-    return result; // Ошибка
+  // Копируем фиксированную часть (пакет может быть не выровнен)
+  memcpy(&fixed_part_header, ip_packet, IP_MIN_HEADER_LEN);
+
+  if (header != NULL) {
+    u_int16_t frag = ntohs(fixed_part_header.ip_off);
+    header->version = version;
+    header->ihl = (u_int8_t)actual_header_length_bytes;
+    header->tos = fixed_part_header.ip_tos;
+    header->total_length = ntohs(fixed_part_header.ip_len);
+    header->identification = ntohs(fixed_part_header.ip_id);
+    header->flags_df = (frag & IP_DF) != 0;
+    header->flags_mf = (frag & IP_MF) != 0;
+    header->fragment_offset = frag & IP_OFFMASK;
+    header->ttl = fixed_part_header.ip_ttl;
+    header->protocol = fixed_part_header.ip_p;
+    header->header_checksum = ntohs(fixed_part_header.ip_sum);
+    header->source_ip = fixed_part_header.ip_src;
+    header->destination_ip = fixed_part_header.ip_dst;
   }
 
-  // Накидываем структуру
-  fixed_part_header = (const struct ip *)ip_packet;
-
-  // Выводим информацию
-  printf("  [IPv4 заголовок]\n");
-  printf("    Версия: %u\n", version);
-  printf("    Длина заголовка (IHL): %u байт (%u слов по 4 байта)\n",
-         actual_header_length_bytes, ihl_in_words);
-  printf("    Тип сервиса (TOS): 0x%02x\n", fixed_part_header->ip_tos);
-  printf("    Общая длина IP-пакета: %u байт\n",
-         ntohs(fixed_part_header->ip_len));
-  printf("    Идентификатор: 0x%04x\n", ntohs(fixed_part_header->ip_id));
-  printf("    Время жизни (TTL): %u\n", fixed_part_header->ip_ttl);
-  printf("    Протокол: %u", fixed_part_header->ip_p);
+  result.transport_protocol = fixed_part_header.ip_p;
+  result.payload_ptr = ip_packet + actual_header_length_bytes;
+  result.payload_available_len = len - actual_header_length_bytes;
 
-  switch (fixed_part_header->ip_p) {
-  case IPPROTO_TCP:
-    printf(" (TCP)\n");
-    break;
-  case IPPROTO_UDP:
-    printf(" (UDP)\n");
-    break;
-  case IPPROTO_ICMP:
-    printf(" (ICMP)\n");
-    break;
+  return result;
+}
 
-  default:
-    printf(" (Неизвестный: %d)\n", fixed_part_header->ip_p);
-    break;
+ip_parse_result_t parse_ipv6_header(const u_char *ip_packet, bpf_u_int32 len,
+                                    parsed_ipv6_header_t *header) {
+  ip_parse_result_t result;
+  memset(&result, 0, sizeof(ip_parse_result_t));
+  parsed_ipv6_header_t local;
+  if (header == NULL) {
+    header = &local; // Поля фрагментации нужны самому разбору
   }
-  printf("    Контрольная сумма заголовка: 0x%04x\n",
-         ntohs(fixed_part_header->ip_sum));
-
-  char src_ip_str[INET_ADDRSTRLEN];
-  char dst_ip_str[INET_ADDRSTRLEN];
-  inet_ntop(AF_INET, &(fixed_part_header->ip_src), src_ip_str, INET_ADDRSTRLEN);
-  inet_ntop(AF_INET, &(fixed_part_header->ip_dst), dst_ip_str, INET_ADDRSTRLEN);
-  printf("    IP источника: %s\n", src_ip_str);
-  printf("    IP назначения: %s\n", dst_ip_str);
 
-  if (actual_header_length_bytes > IP_MIN_HEADER_LEN) {
-    printf("  В IP-заголовке есть опции!\n");
-    u_int32_t options_part_length =
-        actual_header_length_bytes - IP_MIN_HEADER_LEN;
-    // const u_char *options_start_ptr = ip_packet + IP_MIN_HEADER_LEN; //
-    // (void)options_start_ptr; для заглушки
-    printf("    Длина опциональной части: %u байт\n", options_part_length);
-    // TODO: Разбор или вывод опций, если нужно
-  } else {
-    // printf("  IP-заголовок без опций (стандартные 20 байт).\n");
+  if (len < IPV6_HEADER_LEN || (ip_packet[0] >> 4) != 6) {
+    return result;
   }
-
-  // const u_char *transport_protocol_data_ptr = ip_packet +
-  // actual_header_length_bytes; (void)transport_protocol_data_ptr; // Заглушка,
-  result.transport_protocol = fixed_part_header->ip_p;
-  result.payload_ptr = ip_packet + actual_header_length_bytes;
-  result.payload_available_len = len - actual_header_length_bytes;
-
-  return result; // Возвращаем сохраненное значение ip_p
-}
\ No newline at end of file
+  u_int32_t first_word;
+  memcpy(&first_word, ip_packet, sizeof(first_word));
+  first_word = ntohl(first_word);
+  header->version = 6;
+  header->traffic_class = (u_int8_t)(first_word >> 20);
+  header->flow_label = first_word & 0xFFFFF;
+  header->payload_length = (u_int16_t)((ip_packet[4] << 8) | ip_packet[5]);
+  header->next_header = ip_packet[6];
+  header->hop_limit = ip_packet[7];
+  memcpy(&header->source_ip, ip_packet + 8, sizeof(struct in6_addr));
+  memcpy(&header->destination_ip, ip_packet + 24, sizeof(struct in6_addr));
+  header->ext_header_count = 0;
+  header->has_fragment = 0;
+  header->flags_mf = 0;
+  header->fragment_offset = 0;
+  header->fragment_id = 0;
+
+  u_int8_t next = header->next_header;
+  bpf_u_int32 offset = IPV6_HEADER_LEN;
+  // Ограниченный проход по цепочке: каждый заголовок расширения начинается
+  // с (next header, длина), кроме Fragment (всегда 8 байт) и AH (длина в
+  // 4-байтовых словах минус 2)
+  for (int i = 0; i <= IPV6_MAX_EXT_HEADERS; i++) {
+    bpf_u_int32 ext_len;
+    switch (next) {
+    case IPPROTO_HOPOPTS:
+    case IPPROTO_ROUTING:
+    case IPPROTO_DSTOPTS:
+      if (len < offset + 2) {
+        return result;
+      }
+      ext_len = ((bpf_u_int32)ip_packet[offset + 1] + 1) * 8;
+      break;
+    case IPPROTO_AH:
+      if (len < offset + 2) {
+        return result;
+      }
+      ext_len = ((bpf_u_int32)ip_packet[offset + 1] + 2) * 4;
+      break;
+    case IPPROTO_FRAGMENT: {
+      if (len < offset + 8) {
+        return result;
+      }
+      const u_char *frag = ip_packet + offset;
+      u_int16_t offlg = (u_int16_t)((frag[2] << 8) | frag[3]);
+      u_int32_t id;
+      memcpy(&id, frag + 4, sizeof(id));
+      header->has_fragment = 1;
+      header->fragment_offset = offlg >> 3;
+      header->flags_mf = offlg & 1;
+      header->fragment_id = ntohl(id);
+      ext_len = 8;
+      break;
+    }
+    default: // Протокол верхнего уровня (или No Next Header, ESP)
+      header->ext_header_length = (u_int16_t)(offset - IPV6_HEADER_LEN);
+      result.transport_protocol = next;
+      result.payload_ptr = ip_packet + offset;
+      result.payload_available_len = len - offset;
+      return result;
+    }
+    if (i == IPV6_MAX_EXT_HEADERS || len < offset + ext_len) {
+      return result; // Слишком длинная цепочка или заголовок обрезан
+    }
+    next = ip_packet[offset];
+    offset += ext_len;
+    header->ext_header_count++;
+    if (header->has_fragment && header->fragment_offset != 0) {
+      // В не-первом фрагменте дальше идут данные, а не заголовки
+      header->ext_header_length = (u_int16_t)(offset - IPV6_HEADER_LEN);
+      result.transport_protocol = next;
+      result.payload_ptr = ip_packet + offset;
+      result.payload_available_len = len - offset;
+      return result;
+    }
+  }
+  return result;
+}
@@ -2,10 +2,15 @@
 #define IP_PARSER_H
 
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <arpa/inet.h>
 #include <pcap.h>
+
+#define IPV6_HEADER_LEN 40
+#define IPV6_MAX_EXT_HEADERS 8 // Больше заголовков расширения - ошибка
 /**
- * @brief Структура для хранения результата разбора IPv4-заголовка.
+ * @brief Структура для хранения результата разбора IP-заголовка (IPv4 или
+ * IPv6 - одна и та же, чтобы дальше оба семейства разбирались одинаково).
  *
  * @param transport_protocol Номер протокола транспортного уровня (TCP, UDP, ICMP и т.д.) 
  *                              0, если произошла ошибка или протокол не определен.
@@ -19,37 +24,75 @@ typedef struct {
     const u_char *payload_ptr;      
     bpf_u_int32 payload_available_len; 
     // (Опционально) Дополнительная информация из IP-заголовка, если она нужна вызывающей стороне
-} ipv4_parse_result_t;
+} ip_parse_result_t;
 
 
-/**
- * @brief Разбирает IPv4-заголовок пакета.
- *
- * @param ip_packet Указатель на начало IP-заголовка.
- * @param len Длина доступных данных, начиная с ip_packet.
- * @return ipv4_parse_result_t Структура с результатами разбора.
- *                             Поле transport_protocol будет 0 и payload_ptr будет NULL в случае ошибки.
- */
-ipv4_parse_result_t parse_ipv4_header(const u_char *ip_packet, bpf_u_int32 len);
-
-
-// Структура для хранения IPv4-заголовка (Пока не используется)
+// Структура для хранения IPv4-заголовка (заполняется parse_ipv4_header)
 typedef struct {
     u_int8_t  version;
     u_int8_t  ihl; // Длина заголовка в байтах
     u_int8_t  tos;
     u_int16_t total_length; // В хостовом порядке
-    u_int16_t identification; 
+    u_int16_t identification; // В хостовом порядке
     u_int8_t  flags_df;
     u_int8_t  flags_mf;
-    u_int16_t fragment_offset; // Сдвинутое значение
+    u_int16_t fragment_offset; // В 8-байтовых единицах (без флагов)
     u_int8_t  ttl;
     u_int8_t  protocol;
-    u_int16_t header_checksum;
+    u_int16_t header_checksum; // В хостовом порядке
     struct in_addr  source_ip;
     struct in_addr  destination_ip;
 } parsed_ipv4_header_t;
 
+/**
+ * @brief Разбирает IPv4-заголовок пакета (без вывода).
+ *
+ * @param ip_packet Указатель на начало IP-заголовка.
+ * @param len Длина доступных данных, начиная с ip_packet.
+ * @param header Куда записать поля заголовка (может быть NULL).
+ * @return ip_parse_result_t Структура с результатами разбора.
+ *                             Поле transport_protocol будет 0 и payload_ptr будет NULL в случае ошибки.
+ */
+ip_parse_result_t parse_ipv4_header(const u_char *ip_packet, bpf_u_int32 len,
+                                    parsed_ipv4_header_t *header);
+
+// Структура для хранения IPv6-заголовка (заполняется parse_ipv6_header)
+typedef struct {
+    u_int8_t  version;
+    u_int8_t  traffic_class;
+    u_int32_t flow_label;
+    u_int16_t payload_length; // В хостовом порядке
+    u_int8_t  next_header;    // Из фиксированного заголовка
+    u_int8_t  hop_limit;
+    struct in6_addr source_ip;
+    struct in6_addr destination_ip;
+    u_int8_t  ext_header_count;   // Пройдено заголовков расширения
+    u_int16_t ext_header_length;  // Их суммарная длина в байтах
+    u_int8_t  has_fragment;       // Есть заголовок Fragment
+    u_int8_t  flags_mf;
+    u_int16_t fragment_offset;    // В 8-байтовых единицах
+    u_int32_t fragment_id;
+} parsed_ipv6_header_t;
+
+/**
+ * @brief Разбирает IPv6-заголовок и цепочку заголовков расширения (без
+ * вывода).
+ *
+ * Проходит Hop-by-Hop, Routing, Fragment, Destination Options и AH (не
+ * больше IPV6_MAX_EXT_HEADERS), пока не дойдет до протокола верхнего
+ * уровня. В не-первом фрагменте разбор останавливается на заголовке
+ * Fragment: payload_ptr указывает на данные фрагмента.
+ *
+ * @param ip_packet Указатель на начало IPv6-заголовка.
+ * @param len Длина доступных данных, начиная с ip_packet.
+ * @param header Куда записать поля заголовка (может быть NULL).
+ * @return ip_parse_result_t Как у parse_ipv4_header; payload_ptr будет NULL,
+ *                           если заголовок или цепочка расширений обрезаны
+ *                           или слишком длинные.
+ */
+ip_parse_result_t parse_ipv6_header(const u_char *ip_packet, bpf_u_int32 len,
+                                    parsed_ipv6_header_t *header);
+
 
 
 
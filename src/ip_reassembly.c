@@ -0,0 +1,647 @@
+#include "ip_reassembly.h"
+#include "checksum.h"
+#include "flow_hash.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REASM_PAGE_SHIFT 9
+#define REASM_PAGE_SIZE (1u << REASM_PAGE_SHIFT)
+#define REASM_MAX_DATA 65535 // Полная длина IPv4 - вместе с заголовком
+#define REASM_MAX_PAGES                                                        \
+  ((REASM_MAX_DATA + REASM_PAGE_SIZE - 1) / REASM_PAGE_SIZE)
+#define REASM_MAX_HEADER 256 // Заголовки кадра до данных IP (с туннелями)
+#define REASM_MAX_RANGES 16  // Непрерывных кусков данных в сборке
+#define REASM_PAGES_PER_DATAGRAM 4 // В среднем, для разметки арены
+#define REASM_MIN_DATAGRAMS 16
+#define REASM_NONE 0xFFFFFFFFu
+
+#define REASM_HAVE_FIRST 0x01 // Есть фрагмент со смещением 0
+#define REASM_HAVE_LAST 0x02  // Есть фрагмент без MF: длина известна
+
+// Датаграмма в сборке; данные лежат в страницах арены по смещению
+typedef struct {
+  u_int32_t src, dst; // В сетевом порядке, как в in_addr
+  u_int16_t id;
+  u_int8_t protocol;
+  u_int8_t flags;         // REASM_HAVE_*
+  u_int32_t hash_next;    // Цепочка корзины или список свободных
+  u_int32_t older, newer; // Список по времени создания
+  u_int32_t source;       // Запись источника (квота)
+  u_int64_t first_us;     // Метка времени первого пришедшего фрагмента
+  u_int32_t data_len;     // Длина данных (после REASM_HAVE_LAST)
+  u_int16_t header_len;   // Байт заголовков кадра первого фрагмента
+  u_int16_t ip_offset;    // Начало заголовка IPv4 в них
+  u_int8_t range_count;
+  struct {
+    u_int32_t start, end; // [start, end), не перекрываются и не смежны
+  } ranges[REASM_MAX_RANGES];
+  u_int32_t pages[REASM_MAX_PAGES]; // REASM_NONE - страницы нет
+  u_char header[REASM_MAX_HEADER];
+} reasm_datagram_t;
+
+// Сколько держит один источник (существует, пока datagrams > 0)
+typedef struct {
+  u_int32_t addr;
+  u_int32_t next; // Цепочка корзины или список свободных
+  u_int32_t datagrams;
+  u_int32_t pages;
+} reasm_source_t;
+
+struct ip_reassembly_worker {
+  _Alignas(64) reasm_datagram_t *datagrams;
+  reasm_source_t *sources; // Столько же, сколько датаграмм
+  u_int32_t *buckets;      // Датаграммы по ключу
+  u_int32_t *source_buckets;
+  u_int32_t *page_next; // Список свободных страниц
+  u_char *pages;
+  u_char *frame; // Собранный кадр
+  u_int32_t mask; // Корзин обеих таблиц - 1
+  u_int32_t free_datagram, free_source, free_page;
+  u_int32_t oldest, newest;
+  u_int32_t live, pages_live;
+  u_int32_t seed;
+  // Счетчики: пишет владелец, читает отчет (stats_load)
+  _Alignas(64) unsigned long long fragments;
+  unsigned long long assembled;
+  unsigned long long timeouts;
+  unsigned long long evicted;
+  unsigned long long quota_drops;
+  unsigned long long invalid;
+  unsigned long long truncated;
+  unsigned long long pending;
+  unsigned long long pages_used;
+};
+
+static ip_reassembly_worker_t *workers;
+static int num_workers_global;
+static u_int32_t datagrams_per_worker;
+static u_int32_t pages_per_worker;
+static u_int32_t datagram_limit; // Квоты одного источника
+static u_int32_t page_limit;
+static u_int64_t timeout_us;
+static ip_reassembly_stats_t reported; // Прошлый отчет за интервал
+
+void ip_reassembly_get_default_options(ip_reassembly_options_t *options) {
+  options->memory_budget = IP_REASSEMBLY_DEFAULT_MEMORY;
+  options->timeout = IP_REASSEMBLY_DEFAULT_TIMEOUT;
+}
+
+static int worker_init(ip_reassembly_worker_t *w, u_int32_t seed) {
+  u_int32_t buckets = 1;
+  while (buckets < datagrams_per_worker) {
+    buckets <<= 1;
+  }
+  memset(w, 0, sizeof(*w));
+  w->datagrams = malloc(sizeof(reasm_datagram_t) * datagrams_per_worker);
+  w->sources = malloc(sizeof(reasm_source_t) * datagrams_per_worker);
+  w->buckets = malloc(sizeof(u_int32_t) * buckets);
+  w->source_buckets = malloc(sizeof(u_int32_t) * buckets);
+  w->page_next = malloc(sizeof(u_int32_t) * pages_per_worker);
+  w->pages = malloc((size_t)REASM_PAGE_SIZE * pages_per_worker);
+  w->frame = malloc(REASM_MAX_HEADER + REASM_MAX_DATA);
+  if (w->datagrams == NULL || w->sources == NULL || w->buckets == NULL ||
+      w->source_buckets == NULL || w->page_next == NULL || w->pages == NULL ||
+      w->frame == NULL) {
+    perror("ip_reassembly_init: Ошибка выделения памяти");
+    return -1;
+  }
+  w->mask = buckets - 1;
+  memset(w->buckets, 0xff, sizeof(u_int32_t) * buckets);
+  memset(w->source_buckets, 0xff, sizeof(u_int32_t) * buckets);
+  for (u_int32_t i = 0; i < datagrams_per_worker; i++) {
+    w->datagrams[i].hash_next = i + 1 < datagrams_per_worker ? i + 1
+                                                             : REASM_NONE;
+    w->sources[i].next = i + 1 < datagrams_per_worker ? i + 1 : REASM_NONE;
+  }
+  for (u_int32_t i = 0; i < pages_per_worker; i++) {
+    w->page_next[i] = i + 1 < pages_per_worker ? i + 1 : REASM_NONE;
+  }
+  w->free_datagram = w->free_source = w->free_page = 0;
+  w->oldest = w->newest = REASM_NONE;
+  w->seed = seed;
+  return 0;
+}
+
+static void worker_free(ip_reassembly_worker_t *w) {
+  free(w->datagrams);
+  free(w->sources);
+  free(w->buckets);
+  free(w->source_buckets);
+  free(w->page_next);
+  free(w->pages);
+  free(w->frame);
+}
+
+int ip_reassembly_init(int num_workers,
+                       const ip_reassembly_options_t *options) {
+  if (num_workers <= 0 || options->memory_budget == 0) {
+    return -1;
+  }
+  // Разметка: на датаграмму - описатель, источник, две корзины и в
+  // среднем REASM_PAGES_PER_DATAGRAM страниц
+  size_t per_worker = options->memory_budget / (size_t)num_workers;
+  size_t unit =
+      sizeof(reasm_datagram_t) + sizeof(reasm_source_t) +
+      2 * sizeof(u_int32_t) +
+      REASM_PAGES_PER_DATAGRAM * (REASM_PAGE_SIZE + sizeof(u_int32_t));
+  size_t count = per_worker / unit;
+  if (count < REASM_MIN_DATAGRAMS) {
+    count = REASM_MIN_DATAGRAMS;
+  }
+  if (count > (1u << 24)) {
+    count = 1u << 24;
+  }
+  datagrams_per_worker = (u_int32_t)count;
+  pages_per_worker = datagrams_per_worker * REASM_PAGES_PER_DATAGRAM;
+  if (pages_per_worker < REASM_MAX_PAGES) {
+    pages_per_worker = REASM_MAX_PAGES;
+  }
+  // Источнику - доля арены, но одна датаграмма 64 КиБ помещается всегда
+  datagram_limit = datagrams_per_worker / IP_REASSEMBLY_SOURCE_SHARE;
+  if (datagram_limit == 0) {
+    datagram_limit = 1;
+  }
+  page_limit = pages_per_worker / IP_REASSEMBLY_SOURCE_SHARE;
+  if (page_limit < REASM_MAX_PAGES) {
+    page_limit = REASM_MAX_PAGES;
+  }
+  timeout_us = (u_int64_t)options->timeout * 1000000ULL;
+
+  workers = aligned_alloc(64, sizeof(ip_reassembly_worker_t) * num_workers);
+  if (workers == NULL) {
+    perror("ip_reassembly_init: Ошибка выделения памяти");
+    return -1;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  u_int32_t seed = flow_hash_mix32((u_int32_t)now.tv_nsec ^
+                                   (u_int32_t)now.tv_sec);
+  for (int i = 0; i < num_workers; i++) {
+    if (worker_init(&workers[i], seed + (u_int32_t)i) != 0) {
+      num_workers_global = i + 1; // Освободить и этот, частично выделенный
+      ip_reassembly_destroy();
+      return -1;
+    }
+  }
+  num_workers_global = num_workers;
+  memset(&reported, 0, sizeof(reported));
+  printf("ip_reassembly_init: %d арен сборки IPv4 по %u датаграмм и %u "
+         "страниц (%.1f МиБ всего), таймаут %u с.\n",
+         num_workers, datagrams_per_worker, pages_per_worker,
+         (double)unit * datagrams_per_worker * num_workers / (1024 * 1024),
+         options->timeout);
+  return 0;
+}
+
+ip_reassembly_worker_t *ip_reassembly_worker_get(int worker_id) {
+  if (workers == NULL || worker_id < 0 || worker_id >= num_workers_global) {
+    return NULL;
+  }
+  return &workers[worker_id];
+}
+
+unsigned int ip_reassembly_page_size(void) { return REASM_PAGE_SIZE; }
+
+void ip_reassembly_destroy(void) {
+  for (int i = 0; i < num_workers_global; i++) {
+    worker_free(&workers[i]);
+  }
+  free(workers);
+  workers = NULL;
+  num_workers_global = 0;
+}
+
+// --- Таблицы датаграмм и источников ---
+
+static u_int32_t datagram_bucket(const ip_reassembly_worker_t *w,
+                                 u_int32_t src, u_int32_t dst, u_int16_t id,
+                                 u_int8_t protocol) {
+  u_int32_t h = flow_hash_mix32(src ^ w->seed);
+  h = flow_hash_mix32(h ^ dst);
+  return flow_hash_mix32(h ^ ((u_int32_t)id << 8 | protocol)) & w->mask;
+}
+
+static u_int32_t source_bucket(const ip_reassembly_worker_t *w,
+                               u_int32_t addr) {
+  return flow_hash_mix32(addr ^ ~w->seed) & w->mask;
+}
+
+static u_int32_t datagram_find(const ip_reassembly_worker_t *w, u_int32_t src,
+                               u_int32_t dst, u_int16_t id,
+                               u_int8_t protocol) {
+  u_int32_t index = w->buckets[datagram_bucket(w, src, dst, id, protocol)];
+  while (index != REASM_NONE) {
+    const reasm_datagram_t *d = &w->datagrams[index];
+    if (d->src == src && d->dst == dst && d->id == id &&
+        d->protocol == protocol) {
+      return index;
+    }
+    index = d->hash_next;
+  }
+  return REASM_NONE;
+}
+
+// Запись источника addr; новая берется из свободных (их столько же, сколько
+// датаграмм, поэтому при свободной датаграмме она есть всегда)
+static u_int32_t source_acquire(ip_reassembly_worker_t *w, u_int32_t addr) {
+  u_int32_t *bucket = &w->source_buckets[source_bucket(w, addr)];
+  for (u_int32_t index = *bucket; index != REASM_NONE;
+       index = w->sources[index].next) {
+    if (w->sources[index].addr == addr) {
+      return index;
+    }
+  }
+  u_int32_t index = w->free_source;
+  reasm_source_t *source = &w->sources[index];
+  w->free_source = source->next;
+  source->addr = addr;
+  source->datagrams = 0;
+  source->pages = 0;
+  source->next = *bucket;
+  *bucket = index;
+  return index;
+}
+
+static void source_release(ip_reassembly_worker_t *w, u_int32_t index) {
+  u_int32_t *link =
+      &w->source_buckets[source_bucket(w, w->sources[index].addr)];
+  while (*link != index) {
+    link = &w->sources[*link].next;
+  }
+  *link = w->sources[index].next;
+  w->sources[index].next = w->free_source;
+  w->free_source = index;
+}
+
+// Возвращает страницы и описатель в свободные
+static void datagram_release(ip_reassembly_worker_t *w, u_int32_t index) {
+  reasm_datagram_t *d = &w->datagrams[index];
+  reasm_source_t *source = &w->sources[d->source];
+  for (u_int32_t p = 0; p < REASM_MAX_PAGES; p++) {
+    if (d->pages[p] != REASM_NONE) {
+      w->page_next[d->pages[p]] = w->free_page;
+      w->free_page = d->pages[p];
+      source->pages--;
+      w->pages_live--;
+    }
+  }
+  if (--source->datagrams == 0) {
+    source_release(w, d->source);
+  }
+
+  u_int32_t *link =
+      &w->buckets[datagram_bucket(w, d->src, d->dst, d->id, d->protocol)];
+  while (*link != index) {
+    link = &w->datagrams[*link].hash_next;
+  }
+  *link = d->hash_next;
+
+  if (d->older != REASM_NONE) {
+    w->datagrams[d->older].newer = d->newer;
+  } else {
+    w->oldest = d->newer;
+  }
+  if (d->newer != REASM_NONE) {
+    w->datagrams[d->newer].older = d->older;
+  } else {
+    w->newest = d->older;
+  }
+  d->hash_next = w->free_datagram;
+  w->free_datagram = index;
+  w->live--;
+}
+
+// Вытесняет самую старую датаграмму, кроме keep; 0 - вытеснять нечего
+static int evict_oldest(ip_reassembly_worker_t *w, u_int32_t keep) {
+  u_int32_t victim = w->oldest;
+  if (victim == keep && victim != REASM_NONE) {
+    victim = w->datagrams[victim].newer;
+  }
+  if (victim == REASM_NONE) {
+    return 0;
+  }
+  datagram_release(w, victim);
+  stats_add(&w->evicted, 1);
+  return 1;
+}
+
+// Датаграммы, первый фрагмент которых старше таймаута (по меткам пакетов)
+static void expire(ip_reassembly_worker_t *w, u_int64_t now_us) {
+  while (w->oldest != REASM_NONE &&
+         now_us > w->datagrams[w->oldest].first_us + timeout_us) {
+    datagram_release(w, w->oldest);
+    stats_add(&w->timeouts, 1);
+  }
+}
+
+static u_int32_t datagram_create(ip_reassembly_worker_t *w, u_int32_t src,
+                                 u_int32_t dst, u_int16_t id,
+                                 u_int8_t protocol, u_int64_t now_us) {
+  u_int32_t *bucket = &w->source_buckets[source_bucket(w, src)];
+  for (u_int32_t s = *bucket; s != REASM_NONE; s = w->sources[s].next) {
+    if (w->sources[s].addr == src &&
+        w->sources[s].datagrams >= datagram_limit) {
+      stats_add(&w->quota_drops, 1);
+      return REASM_NONE;
+    }
+  }
+  if (w->free_datagram == REASM_NONE && !evict_oldest(w, REASM_NONE)) {
+    return REASM_NONE;
+  }
+  u_int32_t index = w->free_datagram;
+  reasm_datagram_t *d = &w->datagrams[index];
+  w->free_datagram = d->hash_next;
+  d->src = src;
+  d->dst = dst;
+  d->id = id;
+  d->protocol = protocol;
+  d->flags = 0;
+  d->first_us = now_us;
+  d->data_len = 0;
+  d->header_len = 0;
+  d->ip_offset = 0;
+  d->range_count = 0;
+  memset(d->pages, 0xff, sizeof(d->pages));
+  d->source = source_acquire(w, src);
+  w->sources[d->source].datagrams++;
+
+  u_int32_t *head = &w->buckets[datagram_bucket(w, src, dst, id, protocol)];
+  d->hash_next = *head;
+  *head = index;
+  d->older = w->newest;
+  d->newer = REASM_NONE;
+  if (w->newest != REASM_NONE) {
+    w->datagrams[w->newest].newer = index;
+  } else {
+    w->oldest = index;
+  }
+  w->newest = index;
+  w->live++;
+  return index;
+}
+
+// Страницы под [start, end); 0 - нет места (датаграмма уже освобождена)
+static int reserve_pages(ip_reassembly_worker_t *w, u_int32_t index,
+                         u_int32_t start, u_int32_t end) {
+  reasm_datagram_t *d = &w->datagrams[index];
+  for (u_int32_t p = start >> REASM_PAGE_SHIFT;
+       p <= (end - 1) >> REASM_PAGE_SHIFT; p++) {
+    if (d->pages[p] != REASM_NONE) {
+      continue;
+    }
+    if (w->sources[d->source].pages >= page_limit) {
+      datagram_release(w, index);
+      stats_add(&w->quota_drops, 1);
+      return 0;
+    }
+    if (w->free_page == REASM_NONE && !evict_oldest(w, index)) {
+      datagram_release(w, index); // Не помещается даже одна
+      stats_add(&w->evicted, 1);
+      return 0;
+    }
+    d->pages[p] = w->free_page;
+    w->free_page = w->page_next[d->pages[p]];
+    w->sources[d->source].pages++;
+    w->pages_live++;
+  }
+  return 1;
+}
+
+static void copy_to_pages(ip_reassembly_worker_t *w, reasm_datagram_t *d,
+                          const u_char *data, u_int32_t start,
+                          u_int32_t end) {
+  for (u_int32_t offset = start; offset < end;) {
+    u_int32_t in_page = offset & (REASM_PAGE_SIZE - 1);
+    u_int32_t length = REASM_PAGE_SIZE - in_page;
+    if (length > end - offset) {
+      length = end - offset;
+    }
+    memcpy(w->pages +
+               (size_t)d->pages[offset >> REASM_PAGE_SHIFT] * REASM_PAGE_SIZE +
+               in_page,
+           data + (offset - start), length);
+    offset += length;
+  }
+}
+
+// Кадр из заголовков первого фрагмента и данных; заголовок IPv4 - как у
+// нефрагментированного пакета
+static const u_char *assemble(ip_reassembly_worker_t *w, u_int32_t index,
+                              const packet_descriptor_t *desc,
+                              struct pcap_pkthdr *header) {
+  reasm_datagram_t *d = &w->datagrams[index];
+  u_int32_t ihl = (u_int32_t)d->header_len - d->ip_offset;
+  u_int32_t total = ihl + d->data_len;
+  if (total > REASM_MAX_DATA) { // Опции первого фрагмента длиннее
+    datagram_release(w, index);
+    stats_add(&w->invalid, 1);
+    return NULL;
+  }
+  u_char *frame = w->frame;
+  memcpy(frame, d->header, d->header_len);
+  for (u_int32_t offset = 0; offset < d->data_len; offset += REASM_PAGE_SIZE) {
+    u_int32_t length = d->data_len - offset;
+    memcpy(frame + d->header_len + offset,
+           w->pages +
+               (size_t)d->pages[offset >> REASM_PAGE_SHIFT] * REASM_PAGE_SIZE,
+           length < REASM_PAGE_SIZE ? length : REASM_PAGE_SIZE);
+  }
+  u_char *ip = frame + d->ip_offset;
+  ip[2] = (u_char)(total >> 8);
+  ip[3] = (u_char)total;
+  ip[6] &= 0x40; // Остается только DF
+  ip[7] = 0;
+  ip[10] = ip[11] = 0;
+  u_int16_t sum = (u_int16_t)~checksum_fold(checksum_add(ip, ihl, 0));
+  memcpy(ip + 10, &sum, sizeof(sum));
+
+  header->ts = desc->ts;
+  header->caplen = header->len = d->header_len + d->data_len;
+  datagram_release(w, index);
+  stats_add(&w->assembled, 1);
+  return frame;
+}
+
+static const u_char *add_fragment(ip_reassembly_worker_t *w,
+                                  const packet_descriptor_t *desc,
+                                  const u_char *packet,
+                                  struct pcap_pkthdr *header) {
+  const parsed_ipv4_header_t *ip = &desc->ipv4;
+  u_int64_t now_us =
+      (u_int64_t)desc->ts.tv_sec * 1000000ULL + (u_int64_t)desc->ts.tv_usec;
+  expire(w, now_us);
+
+  u_int32_t src, dst;
+  memcpy(&src, &ip->source_ip, sizeof(src));
+  memcpy(&dst, &ip->destination_ip, sizeof(dst));
+  u_int32_t index =
+      datagram_find(w, src, dst, ip->identification, ip->protocol);
+  u_int32_t start = (u_int32_t)ip->fragment_offset * 8;
+  u_int32_t length =
+      ip->total_length > ip->ihl ? (u_int32_t)ip->total_length - ip->ihl : 0;
+  u_int32_t end = start + length;
+  // Данные не пусты, кратны 8 байтам (кроме последнего фрагмента), вся
+  // датаграмма не длиннее 64 КиБ
+  if (length == 0 || (ip->flags_mf && length % 8 != 0) ||
+      end + ip->ihl > REASM_MAX_DATA ||
+      (start == 0 && desc->l4_offset > REASM_MAX_HEADER)) {
+    stats_add(&w->invalid, 1);
+    if (index != REASM_NONE) {
+      datagram_release(w, index);
+    }
+    return NULL;
+  }
+  if ((bpf_u_int32)desc->l4_offset + length > desc->caplen) {
+    stats_add(&w->truncated, 1); // Без этих данных датаграмму не собрать
+    if (index != REASM_NONE) {
+      datagram_release(w, index);
+    }
+    return NULL;
+  }
+  if (index == REASM_NONE) {
+    index = datagram_create(w, src, dst, ip->identification, ip->protocol,
+                            now_us);
+    if (index == REASM_NONE) {
+      return NULL;
+    }
+  }
+  reasm_datagram_t *d = &w->datagrams[index];
+
+  // Точный или вложенный повтор ничего не меняет; частичное перекрытие
+  // (в том числе атаки вроде teardrop) отбрасывает датаграмму
+  int invalid = (d->flags & REASM_HAVE_LAST) &&
+                (ip->flags_mf ? end > d->data_len : end != d->data_len);
+  for (int i = 0; i < d->range_count && !invalid; i++) {
+    if (start >= d->ranges[i].start && end <= d->ranges[i].end) {
+      return NULL;
+    }
+    if (start < d->ranges[i].end && end > d->ranges[i].start) {
+      invalid = 1;
+    }
+    if (!ip->flags_mf && d->ranges[i].end > end) {
+      invalid = 1; // Данные за концом датаграммы
+    }
+  }
+  if (invalid) {
+    datagram_release(w, index);
+    stats_add(&w->invalid, 1);
+    return NULL;
+  }
+  if (!reserve_pages(w, index, start, end)) {
+    return NULL;
+  }
+  copy_to_pages(w, d, packet + desc->l4_offset, start, end);
+
+  // Соседние куски сливаются; перекрытий нет, поэтому слияний не больше двух
+  u_int32_t merged_start = start, merged_end = end;
+  for (int i = 0; i < d->range_count;) {
+    if (d->ranges[i].end == merged_start) {
+      merged_start = d->ranges[i].start;
+    } else if (d->ranges[i].start == merged_end) {
+      merged_end = d->ranges[i].end;
+    } else {
+      i++;
+      continue;
+    }
+    d->ranges[i] = d->ranges[--d->range_count];
+  }
+  if (d->range_count == REASM_MAX_RANGES) {
+    datagram_release(w, index); // Слишком много дыр
+    stats_add(&w->invalid, 1);
+    return NULL;
+  }
+  d->ranges[d->range_count].start = merged_start;
+  d->ranges[d->range_count].end = merged_end;
+  d->range_count++;
+
+  if (start == 0) {
+    memcpy(d->header, packet, desc->l4_offset);
+    d->header_len = desc->l4_offset;
+    d->ip_offset = desc->l3_offset;
+    d->flags |= REASM_HAVE_FIRST;
+  }
+  if (!ip->flags_mf) {
+    d->data_len = end;
+    d->flags |= REASM_HAVE_LAST;
+  }
+  if (d->flags == (REASM_HAVE_FIRST | REASM_HAVE_LAST) &&
+      d->range_count == 1 && d->ranges[0].start == 0 &&
+      d->ranges[0].end == d->data_len) {
+    return assemble(w, index, desc, header);
+  }
+  return NULL;
+}
+
+const u_char *ip_reassembly_add(ip_reassembly_worker_t *worker,
+                                const packet_descriptor_t *desc,
+                                const u_char *packet,
+                                struct pcap_pkthdr *header) {
+  const u_char *frame = add_fragment(worker, desc, packet, header);
+  stats_add(&worker->fragments, 1);
+  stats_set(&worker->pending, worker->live);
+  stats_set(&worker->pages_used, worker->pages_live);
+  return frame;
+}
+
+void ip_reassembly_get_stats(ip_reassembly_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (int i = 0; i < num_workers_global; i++) {
+    const ip_reassembly_worker_t *w = &workers[i];
+    stats->fragments += stats_load(&w->fragments);
+    stats->datagrams += stats_load(&w->assembled);
+    stats->timeouts += stats_load(&w->timeouts);
+    stats->evicted += stats_load(&w->evicted);
+    stats->quota_drops += stats_load(&w->quota_drops);
+    stats->invalid += stats_load(&w->invalid);
+    stats->truncated += stats_load(&w->truncated);
+    stats->pending += stats_load(&w->pending);
+    stats->pages_used += stats_load(&w->pages_used);
+  }
+  stats->pages_total =
+      (unsigned long long)pages_per_worker * num_workers_global;
+}
+
+void ip_reassembly_report_interval(void) {
+  if (workers == NULL) {
+    return;
+  }
+  ip_reassembly_stats_t current;
+  ip_reassembly_get_stats(&current);
+  if (current.fragments == reported.fragments) {
+    return; // Фрагментов не было - строка не нужна
+  }
+  printf("  Сборка IPv4: фрагментов %llu, собрано датаграмм %llu; не "
+         "собрано: таймаут %llu, вытеснено %llu, квота %llu; отброшено "
+         "фрагментов %llu; арена занята на %.1f%%\n",
+         current.fragments - reported.fragments,
+         current.datagrams - reported.datagrams,
+         current.timeouts - reported.timeouts,
+         current.evicted - reported.evicted,
+         current.quota_drops - reported.quota_drops,
+         current.invalid + current.truncated - reported.invalid -
+             reported.truncated,
+         current.pages_used * 100.0 / current.pages_total);
+  fflush(stdout);
+  reported = current;
+}
+
+void ip_reassembly_report_final(void) {
+  if (workers == NULL) {
+    return;
+  }
+  ip_reassembly_stats_t stats;
+  ip_reassembly_get_stats(&stats);
+  if (stats.fragments == 0) {
+    return;
+  }
+  printf("Сборка фрагментов IPv4: фрагментов %llu, собрано датаграмм %llu; "
+         "не собрано: по таймауту %llu, вытеснено (арена заполнена) %llu, "
+         "по квоте источника %llu, в сборке при завершении %llu; "
+         "отброшено фрагментов: некорректных %llu, обрезанных snaplen "
+         "%llu\n",
+         stats.fragments, stats.datagrams, stats.timeouts, stats.evicted,
+         stats.quota_drops, stats.pending, stats.invalid, stats.truncated);
+}
@@ -0,0 +1,104 @@
+#ifndef IP_REASSEMBLY_H
+#define IP_REASSEMBLY_H
+
+#include "packet_descriptor.h"
+#include <pcap.h>
+#include <sys/types.h>
+
+#define IP_REASSEMBLY_DEFAULT_MEMORY (16UL * 1024 * 1024) // На все арены
+#define IP_REASSEMBLY_DEFAULT_TIMEOUT 30 // Секунд с первого фрагмента
+#define IP_REASSEMBLY_SOURCE_SHARE 4 // Источнику - не больше 1/4 арены
+
+typedef struct {
+  size_t memory_budget; // Байт на все арены (по рабочим потокам), 0 - выкл.
+  unsigned int timeout; // Секунд на сборку датаграммы (по меткам пакетов)
+} ip_reassembly_options_t;
+
+// Арена и таблица сборки рабочего потока
+typedef struct ip_reassembly_worker ip_reassembly_worker_t;
+
+/**
+ * @brief Сборка фрагментированных датаграмм IPv4 по рабочим потокам.
+ *
+ * flow_hash_packet хэширует фрагменты IPv4 без портов, поэтому все
+ * фрагменты датаграммы попадают в один рабочий поток, и сборка идет без
+ * блокировок в его собственной арене. Датаграмма ищется по (источник,
+ * назначение, идентификатор, протокол). Память арены выделяется один раз:
+ * описатели датаграмм и страницы данных по 512 байт берутся из списков
+ * свободных, поэтому поток фрагментов не может занять больше бюджета.
+ * Один источник держит не больше 1/IP_REASSEMBLY_SOURCE_SHARE описателей
+ * и страниц (но всегда хватает на одну датаграмму 64 КиБ); датаграмма, не
+ * собранная за timeout секунд по меткам времени пакетов, освобождается,
+ * а при нехватке страниц или описателей вытесняется самая старая.
+ * Перекрывающиеся фрагменты (кроме точных повторов) отбрасывают всю
+ * датаграмму.
+ *
+ * @param num_workers Количество рабочих потоков.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int ip_reassembly_init(int num_workers, const ip_reassembly_options_t *options);
+
+void ip_reassembly_get_default_options(ip_reassembly_options_t *options);
+
+// Состояние рабочего потока, NULL - сборка выключена
+ip_reassembly_worker_t *ip_reassembly_worker_get(int worker_id);
+
+// Фрагмент IPv4: установлен MF или смещение не нулевое
+static inline int ip_reassembly_is_fragment(const packet_descriptor_t *desc) {
+  return (desc->layers & PACKET_HAS_IPV4) &&
+         (desc->ipv4.flags_mf || desc->ipv4.fragment_offset != 0);
+}
+
+/**
+ * @brief Добавляет фрагмент в сборку (только поток-владелец).
+ *
+ * Когда фрагмент закрывает последнюю дыру, датаграмма собирается в буфер
+ * потока: заголовки кадра первого фрагмента (Ethernet, метки, туннели,
+ * IPv4 с опциями), затем данные. В заголовке IPv4 исправляются полная
+ * длина и контрольная сумма, MF и смещение сбрасываются - кадр можно
+ * разбирать packet_describe как обычный нефрагментированный пакет.
+ *
+ * @param desc Дескриптор фрагмента (ip_reassembly_is_fragment).
+ * @param packet Кадр фрагмента.
+ * @param header Заполняется для собранного кадра (время - последнего
+ *               фрагмента, caplen = len).
+ * @return const u_char* Собранный кадр (действителен до следующего вызова)
+ *                       или NULL, если датаграмма еще не собрана или
+ *                       фрагмент отброшен.
+ */
+const u_char *ip_reassembly_add(ip_reassembly_worker_t *worker,
+                                const packet_descriptor_t *desc,
+                                const u_char *packet,
+                                struct pcap_pkthdr *header);
+
+// Счетчики сборки с начала работы (все нули, если сборка выключена)
+typedef struct {
+  unsigned long long fragments; // Фрагментов принято в сборку
+  unsigned long long datagrams; // Собрано датаграмм
+  unsigned long long timeouts;  // Датаграмм не собрано за таймаут
+  unsigned long long evicted;   // Датаграмм вытеснено: арена заполнена
+  unsigned long long quota_drops; // Датаграмм отброшено по квоте источника
+  unsigned long long invalid; // Фрагментов с неверной длиной, смещением,
+                              // перекрытием или слишком многими дырами
+  unsigned long long truncated; // Фрагментов, обрезанных snaplen
+  unsigned long long pending;   // Датаграмм в сборке сейчас
+  unsigned long long pages_used; // Страниц арен занято сейчас
+  unsigned long long pages_total;
+} ip_reassembly_stats_t;
+
+// Читается из любого потока без блокировок (до ip_reassembly_destroy)
+void ip_reassembly_get_stats(ip_reassembly_stats_t *stats);
+
+// Размер страницы арены, байт
+unsigned int ip_reassembly_page_size(void);
+
+// Строка отчета за интервал (хук stats_add_report_hook), если были
+// фрагменты
+void ip_reassembly_report_interval(void);
+
+// Итог после остановки рабочих потоков (если были фрагменты)
+void ip_reassembly_report_final(void);
+
+void ip_reassembly_destroy(void);
+
+#endif // IP_REASSEMBLY_H
@@ -0,0 +1,170 @@
+#include "latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static latency_worker_t *workers; // По набору гистограмм на рабочий поток
+static int num_workers_global;
+static latency_origin_t origin_global;
+
+// Снимки суммы всех потоков для отчетов за интервал (только поток отчетов)
+static latency_histogram_t previous_totals[LATENCY_METRIC_COUNT];
+static latency_histogram_t current_totals[LATENCY_METRIC_COUNT];
+
+static const char *const metric_names[LATENCY_METRIC_COUNT] = {
+    "в очереди", "обработка", "всего", "глубина кольца"};
+
+int latency_init(int num_workers, latency_origin_t origin) {
+  if (num_workers <= 0) {
+    return -1;
+  }
+  workers = aligned_alloc(64, sizeof(latency_worker_t) * num_workers);
+  if (workers == NULL) {
+    perror("latency_init: Ошибка выделения памяти");
+    return -1;
+  }
+  memset(workers, 0, sizeof(latency_worker_t) * num_workers);
+  memset(previous_totals, 0, sizeof(previous_totals));
+  num_workers_global = num_workers;
+  origin_global = origin;
+  return 0;
+}
+
+int latency_enabled(void) { return workers != NULL; }
+
+latency_worker_t *latency_worker_get(int worker_id) {
+  if (workers == NULL || worker_id < 0 || worker_id >= num_workers_global) {
+    return NULL;
+  }
+  return &workers[worker_id];
+}
+
+latency_origin_t latency_origin(void) { return origin_global; }
+
+void latency_destroy(void) {
+  free(workers);
+  workers = NULL;
+  num_workers_global = 0;
+}
+
+u_int64_t latency_bucket_upper(unsigned int bucket) {
+  if (bucket < 2 * LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+  unsigned int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+  u_int64_t sub = bucket - shift * LATENCY_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+u_int64_t latency_quantile(const latency_histogram_t *histogram,
+                           double quantile) {
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+    total += histogram->counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  // Ранг значения, округленный вверх (p50 из 3 значений - второе)
+  unsigned long long rank = (unsigned long long)(quantile * (double)total);
+  if ((double)rank < quantile * (double)total) {
+    rank++;
+  }
+  if (rank == 0) {
+    rank = 1;
+  }
+  unsigned long long seen = 0;
+  for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen >= rank) {
+      u_int64_t upper = latency_bucket_upper(i);
+      // Граница интервала не больше точного максимума (если он известен)
+      return histogram->max > 0 && upper > histogram->max ? histogram->max
+                                                          : upper;
+    }
+  }
+  return histogram->max;
+}
+
+void latency_collect(latency_histogram_t *totals) {
+  memset(totals, 0, sizeof(latency_histogram_t) * LATENCY_METRIC_COUNT);
+  for (int w = 0; w < num_workers_global; w++) {
+    for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+      const latency_histogram_t *from = &workers[w].metrics[m];
+      latency_histogram_t *into = &totals[m];
+      for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        into->counts[i] += stats_load(&from->counts[i]);
+      }
+      into->sum += stats_load(&from->sum);
+      unsigned long long max = stats_load(&from->max);
+      if (max > into->max) {
+        into->max = max;
+      }
+    }
+  }
+}
+
+static void print_histograms(const char *period,
+                             const latency_histogram_t *histograms) {
+  static const double quantiles[] = {0.5, 0.99, 0.999};
+  printf("  Задержка %s (от %s, мкс):\n", period,
+         origin_global == LATENCY_FROM_CAPTURE ? "захвата"
+                                               : "постановки в очередь");
+  for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+    const latency_histogram_t *histogram = &histograms[m];
+    // Глубина кольца - в задачах, остальное - из нс в мкс
+    int depth = m == LATENCY_QUEUE_DEPTH;
+    double scale = depth ? 1.0 : 1e-3;
+    unsigned long long count = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+      count += histogram->counts[i];
+    }
+    printf("    %s:", metric_names[m]);
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+      printf(" p%g %.*f", quantiles[q] * 100, depth ? 0 : 1,
+             (double)latency_quantile(histogram, quantiles[q]) * scale);
+    }
+    printf(", макс %.*f (%s %llu)\n", depth ? 0 : 1,
+           (double)histogram->max * scale, depth ? "извлечений" : "пакетов",
+           count);
+  }
+  fflush(stdout);
+}
+
+void latency_report_interval(void) {
+  if (workers == NULL) {
+    return;
+  }
+  latency_collect(current_totals);
+  static latency_histogram_t interval[LATENCY_METRIC_COUNT];
+  for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+    unsigned int highest = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+      interval[m].counts[i] =
+          current_totals[m].counts[i] - previous_totals[m].counts[i];
+      if (interval[m].counts[i] > 0) {
+        highest = i;
+      }
+    }
+    interval[m].sum = current_totals[m].sum - previous_totals[m].sum;
+    // Точный максимум копится за все время: за интервал - граница
+    // старшего непустого интервала гистограммы
+    interval[m].max = 0;
+    if (interval[m].counts[highest] > 0) {
+      interval[m].max = latency_bucket_upper(highest);
+      if (interval[m].max > current_totals[m].max) {
+        interval[m].max = current_totals[m].max;
+      }
+    }
+  }
+  memcpy(previous_totals, current_totals, sizeof(previous_totals));
+  print_histograms("за интервал", interval);
+}
+
+void latency_report_final(void) {
+  if (workers == NULL) {
+    return;
+  }
+  latency_collect(current_totals);
+  print_histograms("за все время", current_totals);
+}
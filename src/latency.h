@@ -0,0 +1,109 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "stats.h"
+#include <sys/types.h>
+#include <time.h>
+
+// Гистограмма в духе HDR: значения меньше 64 хранятся точно, дальше на
+// каждую степень двойки 32 интервала (погрешность не больше 1/32)
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS 40 // До 2^40 нс (~18 минут), больше - в последний
+#define LATENCY_BUCKETS                                                        \
+  ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+// Что измеряется (по гистограмме на рабочий поток)
+typedef enum {
+  LATENCY_QUEUE_WAIT = 0,  // Начало отсчета -> извлечение из кольца, нс
+  LATENCY_PROCESSING = 1,  // Извлечение -> конец обработки пачки, нс
+  LATENCY_TOTAL = 2,       // Начало отсчета -> конец обработки, нс
+  LATENCY_QUEUE_DEPTH = 3, // Задач в кольце при извлечении (со взятыми)
+  LATENCY_METRIC_COUNT
+} latency_metric_t;
+
+// Начало отсчета задержки
+typedef enum {
+  LATENCY_FROM_CAPTURE = 0, // Метка времени pcap (захват с интерфейса)
+  LATENCY_FROM_ENQUEUE = 1, // Постановка в очередь (чтение файла: метки
+                            // времени в прошлом)
+} latency_origin_t;
+
+typedef struct {
+  unsigned long long counts[LATENCY_BUCKETS];
+  unsigned long long max; // Точный максимум за все время
+  unsigned long long sum; // Сумма значений (для среднего)
+} latency_histogram_t;
+
+/**
+ * @brief Гистограммы рабочего потока.
+ *
+ * Как и stats_worker_t, пишет только владелец (обычные загрузка и запись
+ * без lock), поток отчетов читает счетчики в любой момент. Счетчики только
+ * растут, поэтому гистограмма за интервал - разность двух снимков суммы.
+ */
+typedef struct {
+  _Alignas(64) latency_histogram_t metrics[LATENCY_METRIC_COUNT];
+} latency_worker_t;
+
+static inline unsigned int latency_bucket(u_int64_t value) {
+  if (value >= (1ULL << LATENCY_MAX_BITS)) {
+    value = (1ULL << LATENCY_MAX_BITS) - 1;
+  }
+  if (value < 2 * LATENCY_SUB_BUCKETS) {
+    return (unsigned int)value;
+  }
+  // Старшие LATENCY_SUB_BUCKET_BITS + 1 бит значения
+  unsigned int shift =
+      (unsigned int)(63 - __builtin_clzll(value)) - LATENCY_SUB_BUCKET_BITS;
+  return shift * LATENCY_SUB_BUCKETS + (unsigned int)(value >> shift);
+}
+
+// Учет count значений value владельцем гистограммы
+static inline void latency_record(latency_histogram_t *histogram,
+                                  u_int64_t value, unsigned long long count) {
+  stats_add(&histogram->counts[latency_bucket(value)], count);
+  stats_add(&histogram->sum, value * count);
+  if (value > stats_load(&histogram->max)) {
+    stats_set(&histogram->max, value);
+  }
+}
+
+// Время для отсчета задержки: CLOCK_REALTIME, как у меток времени pcap
+static inline u_int64_t latency_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (u_int64_t)ts.tv_sec * 1000000000ULL + (u_int64_t)ts.tv_nsec;
+}
+
+// --- Гистограммы по рабочим потокам (индекс - queue_worker_id) ---
+
+/**
+ * @brief Выделяет гистограммы рабочих потоков.
+ *
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int latency_init(int num_workers, latency_origin_t origin);
+int latency_enabled(void);
+latency_worker_t *latency_worker_get(int worker_id); // NULL - выключено
+latency_origin_t latency_origin(void);
+void latency_destroy(void);
+
+// Верхняя граница интервала гистограммы с номером bucket
+u_int64_t latency_bucket_upper(unsigned int bucket);
+
+// Значение, не меньше которого доля quantile всех значений (0 - пусто)
+u_int64_t latency_quantile(const latency_histogram_t *histogram,
+                           double quantile);
+
+// Сумма гистограмм всех рабочих потоков (totals - LATENCY_METRIC_COUNT
+// штук): из любого потока, только загрузки счетчиков
+void latency_collect(latency_histogram_t *totals);
+
+// Поток отчетов: перцентили за интервал (разность со снимком прошлого)
+void latency_report_interval(void);
+
+// После остановки рабочих потоков: перцентили за все время
+void latency_report_final(void);
+
+#endif // LATENCY_H
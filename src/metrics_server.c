@@ -0,0 +1,526 @@
+#include "metrics_server.h"
+#include "ip_reassembly.h"
+#include "latency.h"
+#include "pcap_writer.h"
+#include "stats.h"
+#include "thread_pool_queue.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define METRICS_REQUEST_SIZE 4096
+#define METRICS_CLIENT_TIMEOUT_SEC 1 // Медленный клиент не держит поток
+#define METRICS_LISTEN_BACKLOG 16
+
+static int listen_fd = -1;
+static int wakeup_fd = -1; // eventfd: будит поток при остановке
+static pthread_t server_thread;
+static int server_started;
+static char unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static double start_time;
+// Снимок гистограмм задержки (пишет только поток сервера)
+static latency_histogram_t latency_totals[LATENCY_METRIC_COUNT];
+
+static const char *const latency_stage_labels[LATENCY_METRIC_COUNT] = {
+    "stage=\"queue_wait\"", "stage=\"processing\"", "stage=\"total\"", ""};
+
+// --- Текстовый формат Prometheus ---
+
+static void write_header(FILE *out, const char *name, const char *type,
+                         const char *help) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_counter(FILE *out, const char *name, const char *help,
+                          unsigned long long value) {
+  write_header(out, name, "counter", help);
+  fprintf(out, "%s %llu\n", name, value);
+}
+
+static void write_gauge(FILE *out, const char *name, const char *help,
+                        double value) {
+  write_header(out, name, "gauge", help);
+  fprintf(out, "%s %.9g\n", name, value);
+}
+
+// Значение метки: обратная косая черта, кавычка и перевод строки
+// экранируются
+static void write_label_value(FILE *out, const char *value) {
+  for (const char *p = value; *p != '\0'; p++) {
+    if (*p == '\\' || *p == '"') {
+      fputc('\\', out);
+      fputc(*p, out);
+    } else if (*p == '\n') {
+      fputs("\\n", out);
+    } else {
+      fputc(*p, out);
+    }
+  }
+}
+
+// Сводка (summary) по гистограмме: квантили, сумма и число значений;
+// labels - метки ряда без скобок ("" - без меток), scale переводит единицы
+// гистограммы в единицы метрики
+static void write_summary_series(FILE *out, const char *name,
+                                 const char *labels,
+                                 const latency_histogram_t *histogram,
+                                 double scale) {
+  static const double quantiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+  const char *separator = labels[0] != '\0' ? "," : "";
+  unsigned long long count = 0;
+  for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+    count += histogram->counts[i];
+  }
+  for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+    // Квантиль 1 - точный максимум, остальные - по гистограмме
+    u_int64_t value = quantiles[q] >= 1.0
+                          ? histogram->max
+                          : latency_quantile(histogram, quantiles[q]);
+    fprintf(out, "%s{%s%squantile=\"%g\"} %.9g\n", name, labels, separator,
+            quantiles[q], (double)value * scale);
+  }
+  if (labels[0] != '\0') {
+    fprintf(out, "%s_sum{%s} %.9g\n%s_count{%s} %llu\n", name, labels,
+            (double)histogram->sum * scale, name, labels, count);
+  } else {
+    fprintf(out, "%s_sum %.9g\n%s_count %llu\n", name,
+            (double)histogram->sum * scale, name, count);
+  }
+}
+
+static void write_stats(FILE *out) {
+  stats_totals_t totals;
+  stats_collect(&totals);
+  write_counter(out, "analyst_captured_packets_total",
+                "Пакетов захвачено (поставлено в очередь)", totals.captured);
+  write_counter(out, "analyst_captured_bytes_total",
+                "Байт захвачено (длина в сети)", totals.captured_bytes);
+  write_counter(out, "analyst_processed_packets_total",
+                "Пакетов обработано рабочими потоками", totals.packets);
+  write_counter(out, "analyst_processed_bytes_total",
+                "Байт обработано рабочими потоками", totals.bytes);
+
+  write_header(out, "analyst_ip_packets_total", "counter",
+               "Пакетов IPv4 и IPv6");
+  fprintf(out, "analyst_ip_packets_total{version=\"4\"} %llu\n", totals.ipv4);
+  fprintf(out, "analyst_ip_packets_total{version=\"6\"} %llu\n", totals.ipv6);
+  write_header(out, "analyst_protocol_packets_total", "counter",
+               "Пакетов по группам протоколов");
+  for (int p = 0; p < STATS_PROTO_COUNT; p++) {
+    fprintf(out, "analyst_protocol_packets_total{protocol=\"%s\"} %llu\n",
+            stats_protocol_name((stats_protocol_t)p), totals.protocols[p]);
+  }
+  write_counter(out, "analyst_parse_errors_total",
+                "Пакетов с ошибкой разбора", totals.parse_errors);
+  write_counter(out, "analyst_predicate_filtered_packets_total",
+                "Пакетов, отброшенных предикатом -P", totals.filtered);
+
+  write_counter(out, "analyst_queue_full_waits_total",
+                "Ожиданий потоков захвата на заполненном кольце",
+                totals.queue_full_waits);
+  write_header(out, "analyst_queue_full_wait_seconds_total", "counter",
+               "Время ожидания места в кольце, секунд");
+  fprintf(out, "analyst_queue_full_wait_seconds_total %.9g\n",
+          totals.queue_full_wait_ns / 1e9);
+
+  write_counter(out, "analyst_kernel_received_packets_total",
+                "Принято ядром (ps_recv, tp_packets)",
+                totals.kernel_received);
+  write_counter(out, "analyst_kernel_dropped_packets_total",
+                "Отброшено ядром: буфер полон (ps_drop, tp_drops)",
+                totals.kernel_drops);
+  write_counter(out, "analyst_interface_dropped_packets_total",
+                "Отброшено интерфейсом (ps_ifdrop)", totals.kernel_ifdrops);
+
+  int interfaces = stats_interface_count();
+  if (interfaces > 0) {
+    write_header(out, "analyst_interface_captured_packets_total", "counter",
+                 "Пакетов захвачено по интерфейсам");
+    for (int i = 0; i < interfaces; i++) {
+      fputs("analyst_interface_captured_packets_total{interface=\"", out);
+      write_label_value(out, stats_interface_name(i));
+      fprintf(out, "\"} %llu\n", totals.interfaces[i].captured);
+    }
+    write_header(out, "analyst_interface_kernel_dropped_packets_total",
+                 "counter", "Отброшено ядром по интерфейсам");
+    for (int i = 0; i < interfaces; i++) {
+      fputs("analyst_interface_kernel_dropped_packets_total{interface=\"",
+            out);
+      write_label_value(out, stats_interface_name(i));
+      fprintf(out, "\"} %llu\n", totals.interfaces[i].kernel_drops);
+    }
+  }
+
+  write_header(out, "analyst_worker_processed_packets_total", "counter",
+               "Пакетов обработано по рабочим потокам");
+  for (int i = 0; i < stats_worker_count(); i++) {
+    fprintf(out, "analyst_worker_processed_packets_total{worker=\"%d\"} %llu\n",
+            i, stats_load(&stats_worker_get(i)->packets));
+  }
+}
+
+static void write_queue(FILE *out) {
+  queue_stats_t queue_stats;
+  queue_get_stats(&queue_stats);
+  write_counter(out, "analyst_pool_exhausted_dropped_packets_total",
+                "Отброшено: пул задач исчерпан", queue_stats.pool_exhausted);
+  write_counter(out, "analyst_truncated_packets_total",
+                "Обрезано до snaplen пула", queue_stats.truncated);
+  write_gauge(out, "analyst_queue_depth", "Задач во всех кольцах сейчас",
+              (double)queue_depth());
+
+  pcap_writer_stats_t writer;
+  pcap_writer_get_stats(&writer);
+  if (pcap_writer_worker_get(0) != NULL) {
+    write_counter(out, "analyst_writer_packets_total",
+                  "Пакетов записано на диск", writer.packets);
+    write_counter(out, "analyst_writer_bytes_total", "Байт записано на диск",
+                  writer.bytes);
+    write_counter(out, "analyst_writer_dropped_packets_total",
+                  "Не записано: диск не успевает", writer.dropped);
+    write_counter(out, "analyst_writer_files_total", "Открыто файлов",
+                  writer.files);
+  }
+}
+
+static void write_reassembly(FILE *out) {
+  if (ip_reassembly_worker_get(0) == NULL) {
+    return;
+  }
+  ip_reassembly_stats_t stats;
+  ip_reassembly_get_stats(&stats);
+  // Собранные датаграммы передаются рабочему потоку-владельцу через очередь
+  queue_stats_t queue_stats;
+  queue_get_stats(&queue_stats);
+  write_counter(out, "analyst_ip_reassembly_fragments_total",
+                "Фрагментов IPv4 принято в сборку", stats.fragments);
+  write_counter(out, "analyst_ip_reassembly_datagrams_total",
+                "Собрано датаграмм IPv4", stats.datagrams);
+  write_counter(out, "analyst_ip_reassembly_forwarded_datagrams_total",
+                "Датаграмм передано рабочему потоку их потока",
+                queue_stats.forwarded);
+  write_header(out, "analyst_ip_reassembly_failed_datagrams_total",
+               "counter", "Датаграмм не собрано или не передано");
+  fprintf(out,
+          "analyst_ip_reassembly_failed_datagrams_total{reason=\"timeout\"} "
+          "%llu\n"
+          "analyst_ip_reassembly_failed_datagrams_total{reason=\"evicted\"} "
+          "%llu\n"
+          "analyst_ip_reassembly_failed_datagrams_total{reason=\"quota\"} "
+          "%llu\n"
+          "analyst_ip_reassembly_failed_datagrams_total{reason=\"forward\"} "
+          "%llu\n",
+          stats.timeouts, stats.evicted, stats.quota_drops,
+          queue_stats.forward_dropped);
+  write_header(out, "analyst_ip_reassembly_dropped_fragments_total",
+               "counter", "Фрагментов отброшено");
+  fprintf(out,
+          "analyst_ip_reassembly_dropped_fragments_total{reason=\"invalid\"} "
+          "%llu\n"
+          "analyst_ip_reassembly_dropped_fragments_total{reason="
+          "\"truncated\"} %llu\n",
+          stats.invalid, stats.truncated);
+  write_gauge(out, "analyst_ip_reassembly_pending_datagrams",
+              "Датаграмм в сборке сейчас", (double)stats.pending);
+  write_gauge(out, "analyst_ip_reassembly_arena_used_bytes",
+              "Занято страниц арен, байт",
+              (double)stats.pages_used * ip_reassembly_page_size());
+  write_gauge(out, "analyst_ip_reassembly_arena_bytes",
+              "Страниц арен всего, байт",
+              (double)stats.pages_total * ip_reassembly_page_size());
+}
+
+static void write_latency(FILE *out) {
+  if (!latency_enabled()) {
+    return;
+  }
+  latency_collect(latency_totals);
+  write_header(out, "analyst_latency_seconds", "summary",
+               latency_origin() == LATENCY_FROM_CAPTURE
+                   ? "Задержка пакета от метки времени захвата"
+                   : "Задержка пакета от постановки в очередь");
+  for (int m = 0; m < LATENCY_METRIC_COUNT; m++) {
+    if (m != LATENCY_QUEUE_DEPTH) {
+      write_summary_series(out, "analyst_latency_seconds",
+                           latency_stage_labels[m], &latency_totals[m], 1e-9);
+    }
+  }
+  write_header(out, "analyst_dequeue_depth", "summary",
+               "Задач в кольце при извлечении рабочим потоком");
+  write_summary_series(out, "analyst_dequeue_depth", "",
+                       &latency_totals[LATENCY_QUEUE_DEPTH], 1.0);
+}
+
+// Тело ответа; NULL при нехватке памяти
+static char *build_metrics(size_t *size) {
+  char *body = NULL;
+  FILE *out = open_memstream(&body, size);
+  if (out == NULL) {
+    return NULL;
+  }
+  write_gauge(out, "analyst_uptime_seconds", "Время работы, секунд",
+              monotonic_seconds() - start_time);
+  write_gauge(out, "analyst_workers", "Рабочих потоков",
+              (double)stats_worker_count());
+  write_stats(out);
+  write_queue(out);
+  write_reassembly(out);
+  write_latency(out);
+  if (fclose(out) != 0) {
+    free(body);
+    return NULL;
+  }
+  return body;
+}
+
+// --- HTTP ---
+
+static void send_all(int client, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(client, data, size, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      return; // Клиент ушел или не читает - ответ не важен
+    }
+    data += sent;
+    size -= (size_t)sent;
+  }
+}
+
+static void send_response(int client, const char *status,
+                          const char *content_type, const char *body,
+                          size_t size) {
+  char header[256];
+  int length = snprintf(header, sizeof(header),
+                        "HTTP/1.0 %s\r\nContent-Type: %s\r\n"
+                        "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                        status, content_type, size);
+  send_all(client, header, (size_t)length);
+  send_all(client, body, size);
+}
+
+static void handle_client(int client) {
+  struct timeval timeout = {METRICS_CLIENT_TIMEOUT_SEC, 0};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // Читаем до конца заголовков: у GET нет тела
+  char request[METRICS_REQUEST_SIZE];
+  size_t used = 0;
+  request[0] = '\0';
+  while (used < sizeof(request) - 1 && strstr(request, "\r\n\r\n") == NULL &&
+         strstr(request, "\n\n") == NULL) {
+    ssize_t received = recv(client, request + used, sizeof(request) - 1 - used,
+                            0);
+    if (received <= 0) {
+      if (received < 0 && errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    used += (size_t)received;
+    request[used] = '\0';
+  }
+
+  static const char text[] = "text/plain; charset=utf-8";
+  if (strncmp(request, "GET ", 4) != 0) {
+    static const char message[] = "Только GET /metrics\n";
+    send_response(client, "405 Method Not Allowed", text, message,
+                  sizeof(message) - 1);
+    return;
+  }
+  const char *path = request + 4;
+  size_t path_length = strcspn(path, " \r\n?");
+  if (!(path_length == 8 && strncmp(path, "/metrics", 8) == 0) &&
+      !(path_length == 1 && path[0] == '/')) {
+    static const char message[] = "Нет такой страницы, см. /metrics\n";
+    send_response(client, "404 Not Found", text, message,
+                  sizeof(message) - 1);
+    return;
+  }
+  size_t size = 0;
+  char *body = build_metrics(&size);
+  if (body == NULL) {
+    static const char message[] = "Нет памяти\n";
+    send_response(client, "500 Internal Server Error", text, message,
+                  sizeof(message) - 1);
+    return;
+  }
+  send_response(client, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                body, size);
+  free(body);
+}
+
+static void *server_loop(void *arg) {
+  (void)arg;
+  // Низший приоритет: запросы обслуживаются в простои захвата и рабочих
+  // потоков. Если политика недоступна, поток просто остается обычным
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+  struct pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wakeup_fd, POLLIN, 0}};
+  while (1) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("metrics_server: Ошибка poll");
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break; // metrics_server_stop
+    }
+    if (fds[0].revents & POLLIN) {
+      int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (client >= 0) {
+        handle_client(client);
+        close(client);
+      }
+    }
+  }
+  return NULL;
+}
+
+// --- Сокет ---
+
+static int listen_unix(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path[0] == '\0' || strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "metrics_server: Неверный путь сокета: %s\n", path);
+    return -1;
+  }
+  memcpy(addr.sun_path, path, strlen(path));
+  // Сокет от прошлого запуска заменяется, обычный файл - нет
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("metrics_server: Ошибка socket");
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "metrics_server: Не удалось занять %s: %s\n", path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  snprintf(unix_path, sizeof(unix_path), "%s", path);
+  return fd;
+}
+
+static int listen_tcp(const char *address) {
+  char host[INET_ADDRSTRLEN] = METRICS_SERVER_DEFAULT_HOST;
+  const char *port_text = address;
+  const char *colon = strrchr(address, ':');
+  if (colon != NULL) {
+    size_t host_length = (size_t)(colon - address);
+    if (host_length == 0 || host_length >= sizeof(host)) {
+      fprintf(stderr, "metrics_server: Неверный адрес: %s\n", address);
+      return -1;
+    }
+    memcpy(host, address, host_length);
+    host[host_length] = '\0';
+    port_text = colon + 1;
+  }
+  char *end;
+  unsigned long port = strtoul(port_text, &end, 10);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((u_int16_t)port);
+  if (port_text[0] == '\0' || *end != '\0' || port == 0 || port > 65535 ||
+      inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+    fprintf(stderr, "metrics_server: Неверный адрес: %s\n", address);
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("metrics_server: Ошибка socket");
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "metrics_server: Не удалось занять %s:%lu: %s\n", host,
+            port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void close_sockets(void) {
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    listen_fd = -1;
+  }
+  if (wakeup_fd >= 0) {
+    close(wakeup_fd);
+    wakeup_fd = -1;
+  }
+  if (unix_path[0] != '\0') {
+    unlink(unix_path);
+    unix_path[0] = '\0';
+  }
+}
+
+int metrics_server_start(const char *address) {
+  listen_fd = strncmp(address, "unix:", 5) == 0 ? listen_unix(address + 5)
+                                                 : listen_tcp(address);
+  if (listen_fd < 0) {
+    return -1;
+  }
+  if (listen(listen_fd, METRICS_LISTEN_BACKLOG) != 0) {
+    perror("metrics_server: Ошибка listen");
+    close_sockets();
+    return -1;
+  }
+  wakeup_fd = eventfd(0, EFD_CLOEXEC);
+  if (wakeup_fd < 0) {
+    perror("metrics_server: Ошибка eventfd");
+    close_sockets();
+    return -1;
+  }
+  start_time = monotonic_seconds();
+  int result = pthread_create(&server_thread, NULL, server_loop, NULL);
+  if (result != 0) {
+    fprintf(stderr, "Ошибка создания потока метрик: %s\n", strerror(result));
+    close_sockets();
+    return -1;
+  }
+  server_started = 1;
+  return 0;
+}
+
+void metrics_server_stop(void) {
+  if (!server_started) {
+    return;
+  }
+  u_int64_t one = 1;
+  if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one)) {
+    perror("metrics_server: Ошибка eventfd");
+  }
+  pthread_join(server_thread, NULL);
+  server_started = 0;
+  close_sockets();
+}
@@ -0,0 +1,30 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#define METRICS_SERVER_DEFAULT_HOST "127.0.0.1"
+
+/**
+ * @brief Запускает поток, отдающий счетчики в текстовом формате Prometheus.
+ *
+ * На каждый запрос GET /metrics поток собирает снимок счетчиков: stats
+ * (скорость, протоколы, ожидания очереди, потери ядра), очереди (пул,
+ * глубина колец), записи на диск, сборки фрагментов IPv4 и гистограмм
+ * задержки (-l). Все они читаются загрузками счетчиков, которые пишет
+ * только их владелец, - ни одной блокировки пути пакета и ни одной записи
+ * в строки кэша рабочих потоков. Сам поток работает с политикой
+ * SCHED_IDLE: он получает процессор, только когда захват и рабочие потоки
+ * простаивают.
+ *
+ * Вызывать после stats_init и queue_init; остановить до queue_shutdown.
+ *
+ * @param address "порт" (на METRICS_SERVER_DEFAULT_HOST), "адрес:порт"
+ *                (IPv4) или "unix:путь" (сокет Unix; старый файл
+ *                заменяется).
+ * @return int 0 при успехе, -1 при ошибке (сообщение в stderr).
+ */
+int metrics_server_start(const char *address);
+
+// Останавливает поток (если запущен), закрывает сокет
+void metrics_server_stop(void);
+
+#endif // METRICS_SERVER_H
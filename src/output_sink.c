@@ -0,0 +1,356 @@
+#include "output_sink.h"
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static atomic_int sink_enabled = 1;
+
+static __thread char sink_buffer[OUTPUT_SINK_BUFFER_SIZE];
+static __thread size_t sink_used;
+// Кэш строки времени: пересчитывается, только когда меняется секунда
+static __thread time_t cached_second = -1;
+static __thread char cached_time[32];
+
+void output_sink_set_enabled(int enabled) {
+  atomic_store_explicit(&sink_enabled, enabled != 0, memory_order_relaxed);
+}
+
+int output_sink_enabled(void) {
+  return atomic_load_explicit(&sink_enabled, memory_order_relaxed);
+}
+
+void output_sink_flush(void) {
+  if (sink_used == 0) {
+    return;
+  }
+  fwrite(sink_buffer, 1, sink_used, stdout);
+  sink_used = 0;
+}
+
+static void sink_printf(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+static void sink_printf(const char *format, ...) {
+  size_t space = sizeof(sink_buffer) - sink_used;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(sink_buffer + sink_used, space, format, args);
+  va_end(args);
+  if (written < 0) {
+    return;
+  }
+  if ((size_t)written >= space) {
+    written = (int)space - 1; // Обрезано (запись длиннее запаса)
+  }
+  sink_used += (size_t)written;
+}
+
+static const char *format_second(time_t seconds) {
+  if (seconds != cached_second) {
+    struct tm time_info;
+    if (localtime_r(&seconds, &time_info) == NULL) {
+      // Ошибка преобразования времени - выводим исходные секунды
+      snprintf(cached_time, sizeof(cached_time), "%ld (raw)", (long)seconds);
+    } else {
+      strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S",
+               &time_info);
+    }
+    cached_second = seconds;
+  }
+  return cached_time;
+}
+
+static void print_mac(const char *label, const u_char *mac_address) {
+  sink_printf("%s: %02x:%02x:%02x:%02x:%02x:%02x\n", label, mac_address[0],
+              mac_address[1], mac_address[2], mac_address[3], mac_address[4],
+              mac_address[5]);
+}
+
+static const char *transport_name(u_int8_t protocol) {
+  switch (protocol) {
+  case IPPROTO_TCP:
+    return "TCP";
+  case IPPROTO_UDP:
+    return "UDP";
+  case IPPROTO_ICMP:
+    return "ICMP";
+  case IPPROTO_ICMPV6:
+    return "ICMPv6";
+  default:
+    return "Неизвестный";
+  }
+}
+
+// Результат проверки суммы для вывода рядом со значением
+static const char *checksum_status(u_int8_t checksums, u_int8_t good,
+                                   u_int8_t bad, u_int8_t unchecked) {
+  if (checksums & good) {
+    return " (верна)";
+  }
+  if (checksums & bad) {
+    return " (неверна)";
+  }
+  if (checksums & unchecked) {
+    return " (не проверена)";
+  }
+  return "";
+}
+
+static void print_ipv4(const parsed_ipv4_header_t *ip, u_int8_t checksums) {
+  char src_ip_str[INET_ADDRSTRLEN];
+  char dst_ip_str[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &ip->source_ip, src_ip_str, sizeof(src_ip_str));
+  inet_ntop(AF_INET, &ip->destination_ip, dst_ip_str, sizeof(dst_ip_str));
+
+  sink_printf("  [IPv4 заголовок]\n");
+  sink_printf("    Версия: %u\n", ip->version);
+  sink_printf("    Длина заголовка (IHL): %u байт (%u слов по 4 байта)\n",
+              ip->ihl, ip->ihl / 4u);
+  sink_printf("    Тип сервиса (TOS): 0x%02x\n", ip->tos);
+  sink_printf("    Общая длина IP-пакета: %u байт\n", ip->total_length);
+  sink_printf("    Идентификатор: 0x%04x\n", ip->identification);
+  sink_printf("    Время жизни (TTL): %u\n", ip->ttl);
+  sink_printf("    Протокол: %u (%s)\n", ip->protocol,
+              transport_name(ip->protocol));
+  sink_printf("    Контрольная сумма заголовка: 0x%04x%s\n",
+              ip->header_checksum,
+              checksum_status(checksums, PACKET_CSUM_IP_GOOD,
+                              PACKET_CSUM_IP_BAD, 0));
+  sink_printf("    IP источника: %s\n", src_ip_str);
+  sink_printf("    IP назначения: %s\n", dst_ip_str);
+  if (ip->ihl > 20) {
+    sink_printf("  В IP-заголовке есть опции!\n");
+    sink_printf("    Длина опциональной части: %u байт\n", ip->ihl - 20u);
+  }
+}
+
+static void print_ipv6(const parsed_ipv6_header_t *ip,
+                       u_int8_t upper_protocol) {
+  char src_ip_str[INET6_ADDRSTRLEN];
+  char dst_ip_str[INET6_ADDRSTRLEN];
+  inet_ntop(AF_INET6, &ip->source_ip, src_ip_str, sizeof(src_ip_str));
+  inet_ntop(AF_INET6, &ip->destination_ip, dst_ip_str, sizeof(dst_ip_str));
+
+  sink_printf("  [IPv6 заголовок]\n");
+  sink_printf("    Класс трафика: 0x%02x\n", ip->traffic_class);
+  sink_printf("    Метка потока: 0x%05x\n", ip->flow_label);
+  sink_printf("    Длина данных: %u байт\n", ip->payload_length);
+  sink_printf("    Лимит переходов: %u\n", ip->hop_limit);
+  sink_printf("    IP источника: %s\n", src_ip_str);
+  sink_printf("    IP назначения: %s\n", dst_ip_str);
+  if (ip->ext_header_count > 0) {
+    sink_printf("    Заголовков расширения: %u (%u байт)\n",
+                ip->ext_header_count, ip->ext_header_length);
+  }
+  if (ip->has_fragment) {
+    sink_printf("    Фрагмент: идентификатор 0x%08x, смещение %u байт%s\n",
+                ip->fragment_id, ip->fragment_offset * 8u,
+                ip->flags_mf ? ", есть еще фрагменты" : "");
+  }
+  sink_printf("    Протокол: %u (%s)\n", upper_protocol,
+              transport_name(upper_protocol));
+}
+
+static void print_encap(const packet_descriptor_t *desc) {
+  const decap_result_t *encap = &desc->encap;
+  if (desc->layers & PACKET_HAS_VLAN) {
+    sink_printf("  [VLAN] Меток: %u, идентификатор: %u", encap->vlan_count,
+                encap->vlan_ids[0]);
+    if (encap->vlan_count > 1) {
+      sink_printf(", внутренний: %u", encap->vlan_ids[1]);
+    }
+    sink_printf("\n");
+  }
+  if (desc->layers & PACKET_HAS_MPLS) {
+    sink_printf("  [MPLS] Меток: %u, верхняя метка: %u\n", encap->mpls_count,
+                encap->mpls_label);
+  }
+  if (desc->layers & PACKET_HAS_TUNNEL) {
+    if (encap->tunnel_type == DECAP_TUNNEL_VXLAN) {
+      sink_printf("  [VXLAN] VNI: %u\n", encap->tunnel_id);
+    } else if (encap->tunnel_id != 0) {
+      sink_printf("  [GRE] Ключ: %u\n", encap->tunnel_id);
+    } else {
+      sink_printf("  [GRE]\n");
+    }
+  }
+  if (desc->errors & PACKET_ERR_BAD_ENCAP) {
+    sink_printf("  Метка или туннельный заголовок обрезаны\n");
+  }
+}
+
+static void print_transport(const packet_descriptor_t *desc) {
+  if (desc->layers & PACKET_HAS_TCP) {
+    const parsed_tcp_header_t *tcp = &desc->tcp;
+    sink_printf("  [TCP заголовок]\n");
+    sink_printf("    Порт источника: %u\n", tcp->source_port);
+    sink_printf("    Порт назначения: %u\n", tcp->destination_port);
+    sink_printf("    Номер последовательности: %u\n", tcp->sequence);
+    sink_printf("    Номер подтверждения: %u\n", tcp->acknowledgment);
+    sink_printf("    Длина заголовка: %u байт\n", tcp->data_offset);
+    sink_printf("    Флаги: 0x%02x%s%s%s%s%s%s\n", tcp->flags,
+                (tcp->flags & TCP_FLAG_SYN) ? " SYN" : "",
+                (tcp->flags & TCP_FLAG_ACK) ? " ACK" : "",
+                (tcp->flags & TCP_FLAG_FIN) ? " FIN" : "",
+                (tcp->flags & TCP_FLAG_RST) ? " RST" : "",
+                (tcp->flags & TCP_FLAG_PSH) ? " PSH" : "",
+                (tcp->flags & TCP_FLAG_URG) ? " URG" : "");
+    sink_printf("    Окно: %u\n", tcp->window);
+    sink_printf("    Контрольная сумма: 0x%04x%s\n", tcp->checksum,
+                checksum_status(desc->checksums, PACKET_CSUM_L4_GOOD,
+                                PACKET_CSUM_L4_BAD,
+                                PACKET_CSUM_L4_UNCHECKED));
+  } else if (desc->layers & PACKET_HAS_UDP) {
+    sink_printf("  [UDP заголовок]\n");
+    sink_printf("    Порт источника: %u\n", desc->udp.source_port);
+    sink_printf("    Порт назначения: %u\n", desc->udp.destination_port);
+    sink_printf("    Длина: %u байт\n", desc->udp.length);
+    sink_printf("    Контрольная сумма: 0x%04x%s\n", desc->udp.checksum,
+                checksum_status(desc->checksums, PACKET_CSUM_L4_GOOD,
+                                PACKET_CSUM_L4_BAD,
+                                PACKET_CSUM_L4_UNCHECKED));
+  } else if (desc->layers & PACKET_HAS_ICMP) {
+    sink_printf("  [%s заголовок]\n", transport_name(desc->ip_protocol));
+    sink_printf("    Тип: %u, код: %u\n", desc->icmp.type, desc->icmp.code);
+    u_int8_t type = desc->icmp.type;
+    int echo = desc->ip_protocol == IPPROTO_ICMPV6 ? (type == 128 || type == 129)
+                                                   : (type == 0 || type == 8);
+    if (echo) { // Эхо-запрос/ответ
+      sink_printf("    Идентификатор: 0x%04x, номер: %u\n",
+                  desc->icmp.identifier, desc->icmp.sequence);
+    }
+  } else if (desc->errors & PACKET_ERR_BAD_TRANSPORT) {
+    sink_printf("  [%s] Обрезанный заголовок\n",
+                transport_name(desc->ip_protocol));
+  }
+}
+
+void output_sink_print_packet(const packet_descriptor_t *desc) {
+  // Запись пакета целиком помещается в буфер, поэтому в stdout уходят
+  // только целые записи
+  if (sizeof(sink_buffer) - sink_used < OUTPUT_SINK_MAX_RECORD) {
+    output_sink_flush();
+  }
+
+  sink_printf("Захвачен пакет длиной %u байт\n", desc->len);
+  sink_printf("Время: %s.%06ld\n", format_second(desc->ts.tv_sec),
+              (long)desc->ts.tv_usec);
+  sink_printf("Разбор пакета:\n");
+  if (!(desc->layers & PACKET_HAS_ETHERNET)) {
+    sink_printf(
+        "  Ошибка разбора Ethernet-заголовка или пакет слишком короткий.\n");
+    sink_printf(
+        "------------------------------------------------------------\n");
+    return;
+  }
+  sink_printf("  [Ethernet заголовок]\n");
+  print_mac("    MAC назначения", desc->ethernet.ether_dhost);
+  print_mac("    MAC источника ", desc->ethernet.ether_shost);
+  print_encap(desc);
+
+  switch (desc->ether_type) {
+  case ETH_P_IP: // 0x0800 (IPv4)
+    sink_printf("  Протокол следующего уровня: IPv4\n");
+    if (desc->layers & PACKET_HAS_IPV4) {
+      print_ipv4(&desc->ipv4, desc->checksums);
+      print_transport(desc);
+    } else {
+      sink_printf("  [IPv4] Некорректный или обрезанный заголовок\n");
+    }
+    break;
+  case ETH_P_IPV6: // 0x86DD (IPv6)
+    sink_printf("  Протокол следующего уровня: IPv6\n");
+    if (desc->layers & PACKET_HAS_IPV6) {
+      print_ipv6(&desc->ipv6, desc->ip_protocol);
+      print_transport(desc);
+    } else {
+      sink_printf("  [IPv6] Некорректный или обрезанный заголовок\n");
+    }
+    break;
+  case ETH_P_ARP: // 0x0806 (ARP)
+    sink_printf("  Протокол следующего уровня: ARP\n");
+    break;
+  default:
+    sink_printf("  Протокол следующего уровня (EtherType 0x%04x) пока не "
+                "обрабатывается.\n",
+                desc->ether_type);
+    break;
+  }
+  sink_printf("------------------------------------------------------------\n");
+}
+
+// Адрес из ключа потока: IPv4-mapped печатается как IPv4, IPv6 - в
+// квадратных скобках (за адресом идет порт)
+static void format_flow_address(const u_int8_t address[16], char *buffer,
+                                socklen_t size) {
+  if (IN6_IS_ADDR_V4MAPPED((const struct in6_addr *)address)) {
+    inet_ntop(AF_INET, address + 12, buffer, size);
+    return;
+  }
+  buffer[0] = '[';
+  inet_ntop(AF_INET6, address, buffer + 1, size - 2);
+  strcat(buffer, "]");
+}
+
+void output_sink_print_flow(const flow_entry_t *flow,
+                            flow_end_reason_t reason) {
+  static const char *const reason_names[] = {"простой", "активный таймаут",
+                                             "вытеснен", "завершение"};
+  if (sizeof(sink_buffer) - sink_used < OUTPUT_SINK_MAX_RECORD) {
+    output_sink_flush();
+  }
+  char lo_str[INET6_ADDRSTRLEN + 2];
+  char hi_str[INET6_ADDRSTRLEN + 2];
+  format_flow_address(flow->key.ip_lo, lo_str, sizeof(lo_str));
+  format_flow_address(flow->key.ip_hi, hi_str, sizeof(hi_str));
+  sink_printf("Поток %s:%u <-> %s:%u %s: пакетов %llu, байт %llu, "
+              "длительность %.3f с, флаги TCP 0x%02x (%s)\n",
+              lo_str, flow->key.port_lo, hi_str, flow->key.port_hi,
+              transport_name(flow->key.protocol),
+              (unsigned long long)flow->packets,
+              (unsigned long long)flow->bytes,
+              (flow->last_seen_us - flow->first_seen_us) / 1e6,
+              flow->tcp_flags, reason_names[reason]);
+}
+
+void output_sink_print_topk(const char *period, topk_key_kind_t kind,
+                            topk_metric_t metric, const topk_entry_t *entries,
+                            unsigned int count) {
+  static const char *const kind_names[TOPK_KEY_COUNT] = {
+      "IP источника", "IP назначения", "потоки"};
+  static const char *const metric_names[TOPK_METRIC_COUNT] = {"байтам",
+                                                              "пакетам"};
+  if (sizeof(sink_buffer) - sink_used < OUTPUT_SINK_MAX_RECORD) {
+    output_sink_flush();
+  }
+  sink_printf("Самые активные %s по %s (%s):\n", kind_names[kind],
+              metric_names[metric], period);
+  for (unsigned int i = 0; i < count; i++) {
+    // Каждая строка - отдельная запись: список может не влезть в запас
+    if (sizeof(sink_buffer) - sink_used < OUTPUT_SINK_MAX_RECORD) {
+      output_sink_flush();
+    }
+    const topk_entry_t *entry = &entries[i];
+    char lo_str[INET6_ADDRSTRLEN + 2];
+    format_flow_address(entry->key.ip_lo, lo_str, sizeof(lo_str));
+    if (kind == TOPK_BY_FLOW) {
+      char hi_str[INET6_ADDRSTRLEN + 2];
+      format_flow_address(entry->key.ip_hi, hi_str, sizeof(hi_str));
+      sink_printf("  %2u. %s:%u <-> %s:%u %s", i + 1, lo_str,
+                  entry->key.port_lo, hi_str, entry->key.port_hi,
+                  transport_name(entry->key.protocol));
+    } else {
+      sink_printf("  %2u. %s", i + 1, lo_str);
+    }
+    sink_printf(": %llu", (unsigned long long)entry->count);
+    if (entry->error > 0) {
+      sink_printf(" (завышено не больше чем на %llu)",
+                  (unsigned long long)entry->error);
+    }
+    sink_printf("\n");
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include "flow_table.h"
+#include "packet_descriptor.h"
+#include "topk.h"
+
+#define OUTPUT_SINK_BUFFER_SIZE (64 * 1024) // Буфер вывода каждого потока
+#define OUTPUT_SINK_MAX_RECORD 2048 // Запас под текст одного пакета
+
+/**
+ * @brief Буферизованный вывод разобранных пакетов в читаемом виде.
+ *
+ * У каждого потока свой буфер: текст пакета форматируется без блокировок,
+ * а в stdout уходит крупными кусками (output_sink_flush или при заполнении
+ * буфера) по границам пакетов, поэтому записи разных потоков не
+ * перемешиваются. Строка времени кэшируется на секунду (localtime_r и
+ * strftime - раз в секунду на поток, а не на каждый пакет).
+ */
+
+// Включает или отключает печать пакетов (по умолчанию включена)
+void output_sink_set_enabled(int enabled);
+int output_sink_enabled(void);
+
+// Форматирует пакет в буфер текущего потока
+void output_sink_print_packet(const packet_descriptor_t *desc);
+
+// Форматирует запись завершенного потока в буфер текущего потока
+void output_sink_print_flow(const flow_entry_t *flow,
+                            flow_end_reason_t reason);
+
+// Форматирует список самых активных (entries упорядочены по убыванию)
+void output_sink_print_topk(const char *period, topk_key_kind_t kind,
+                            topk_metric_t metric, const topk_entry_t *entries,
+                            unsigned int count);
+
+// Сбрасывает буфер текущего потока в stdout
+void output_sink_flush(void);
+
+#endif // OUTPUT_SINK_H
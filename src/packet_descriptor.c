@@ -0,0 +1,175 @@
+#include "packet_descriptor.h"
+#include "checksum.h"
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <string.h>
+
+// Разбор транспортного заголовка первого (или единственного) фрагмента
+// (whole - пакет не фрагментирован)
+static void describe_transport(packet_descriptor_t *desc, const u_char *l4,
+                               bpf_u_int32 available, int whole) {
+  int header_len;
+  switch (desc->ip_protocol) {
+  case IPPROTO_TCP:
+    header_len = parse_tcp_header(l4, available, &desc->tcp);
+    if (header_len > 0) {
+      desc->layers |= PACKET_HAS_TCP;
+    }
+    break;
+  case IPPROTO_UDP:
+    header_len = parse_udp_header(l4, available, &desc->udp);
+    if (header_len > 0) {
+      desc->layers |= PACKET_HAS_UDP;
+    }
+    break;
+  case IPPROTO_ICMP:
+  case IPPROTO_ICMPV6: // Первые 8 байт устроены так же
+    header_len = parse_icmp_header(l4, available, &desc->icmp);
+    if (header_len > 0) {
+      desc->layers |= PACKET_HAS_ICMP;
+    }
+    break;
+  case IPPROTO_SCTP: // Полного разбора нет, но порты нужны для потока
+    header_len = 0;
+    break;
+  default:
+    return;
+  }
+
+  // Порты - по тем же правилам, что и в flow_hash_packet: только целый
+  // (нефрагментированный) пакет и первые 4 байта заголовка захвачены
+  if (desc->ip_protocol != IPPROTO_ICMP &&
+      desc->ip_protocol != IPPROTO_ICMPV6 && whole && available >= 4) {
+    desc->layers |= PACKET_HAS_PORTS;
+    desc->src_port = (u_int16_t)((l4[0] << 8) | l4[1]);
+    desc->dst_port = (u_int16_t)((l4[2] << 8) | l4[3]);
+  }
+
+  if (header_len < 0) {
+    desc->errors |= PACKET_ERR_BAD_TRANSPORT;
+    return;
+  }
+  // Опции TCP могут быть обрезаны snaplen: данные приложения начинаются
+  // не дальше конца захваченного
+  bpf_u_int32 skip = (bpf_u_int32)header_len;
+  desc->payload_offset += (u_int16_t)(skip < available ? skip : available);
+}
+
+// Проверка суммы TCP/UDP с псевдозаголовком: только целый пакет, который
+// захвачен полностью (иначе сумму не посчитать)
+static void verify_transport_checksum(packet_descriptor_t *desc,
+                                      const u_char *l4,
+                                      bpf_u_int32 available) {
+  u_int32_t l4_len;
+  u_int64_t sum;
+  if (desc->layers & PACKET_HAS_IPV4) {
+    l4_len = (u_int32_t)desc->ipv4.total_length - desc->ipv4.ihl;
+    if (desc->ipv4.total_length < desc->ipv4.ihl ||
+        ((desc->layers & PACKET_HAS_UDP) && desc->udp.checksum == 0)) {
+      desc->checksums |= PACKET_CSUM_L4_UNCHECKED; // UDP без суммы
+      return;
+    }
+    sum = checksum_pseudo_ipv4(&desc->ipv4.source_ip,
+                               &desc->ipv4.destination_ip, desc->ip_protocol,
+                               l4_len);
+  } else {
+    l4_len =
+        (u_int32_t)desc->ipv6.payload_length - desc->ipv6.ext_header_length;
+    if (desc->ipv6.payload_length < desc->ipv6.ext_header_length) {
+      desc->checksums |= PACKET_CSUM_L4_UNCHECKED;
+      return;
+    }
+    sum = checksum_pseudo_ipv6(&desc->ipv6.source_ip,
+                               &desc->ipv6.destination_ip, desc->ip_protocol,
+                               l4_len);
+  }
+  if (l4_len > available) {
+    desc->checksums |= PACKET_CSUM_L4_UNCHECKED; // Обрезан snaplen
+    return;
+  }
+  sum = checksum_add(l4, l4_len, sum);
+  desc->checksums |= checksum_fold(sum) == 0xFFFF ? PACKET_CSUM_L4_GOOD
+                                                  : PACKET_CSUM_L4_BAD;
+}
+
+int packet_describe(const struct pcap_pkthdr *pkthdr, const u_char *packet,
+                    packet_descriptor_t *desc) {
+  memset(desc, 0, sizeof(*desc));
+  desc->ts = pkthdr->ts;
+  desc->caplen = pkthdr->caplen;
+  desc->len = pkthdr->len;
+
+  parse_ethernet_header(packet, pkthdr->caplen, &desc->ethernet);
+  if (pkthdr->caplen < sizeof(parsed_ethernet_header_t)) {
+    desc->errors |= PACKET_ERR_SHORT_ETHERNET;
+    return -1;
+  }
+  desc->layers |= PACKET_HAS_ETHERNET;
+
+  // Метки и туннели снимаются до IP; дальше разбирается внутренний пакет
+  if (decap_packet(packet, pkthdr->caplen, &desc->encap) != 0) {
+    desc->errors |= PACKET_ERR_BAD_ENCAP;
+  }
+  desc->ether_type = desc->encap.ether_type;
+  desc->l3_offset = desc->encap.l3_offset;
+  if (desc->encap.vlan_count > 0) {
+    desc->layers |= PACKET_HAS_VLAN;
+  }
+  if (desc->encap.mpls_count > 0) {
+    desc->layers |= PACKET_HAS_MPLS;
+  }
+  if (desc->encap.tunnel_count > 0) {
+    desc->layers |= PACKET_HAS_TUNNEL;
+  }
+
+  const u_char *l3 = packet + desc->l3_offset;
+  bpf_u_int32 l3_len = pkthdr->caplen - desc->l3_offset;
+  ip_parse_result_t ip_result;
+  int first_fragment, whole;
+  checksum_mode_t checksum_mode = checksum_get_mode();
+  switch (desc->ether_type) {
+  case ETH_P_IP:
+    ip_result = parse_ipv4_header(l3, l3_len, &desc->ipv4);
+    if (ip_result.payload_ptr == NULL) {
+      desc->errors |= PACKET_ERR_BAD_IPV4;
+      return 0;
+    }
+    desc->layers |= PACKET_HAS_IPV4;
+    if (checksum_mode != CHECKSUM_MODE_NONE) {
+      desc->checksums |=
+          checksum_fold(checksum_add(l3, desc->ipv4.ihl, 0)) == 0xFFFF
+              ? PACKET_CSUM_IP_GOOD
+              : PACKET_CSUM_IP_BAD;
+    }
+    first_fragment = desc->ipv4.fragment_offset == 0;
+    whole = first_fragment && !desc->ipv4.flags_mf;
+    break;
+  case ETH_P_IPV6:
+    ip_result = parse_ipv6_header(l3, l3_len, &desc->ipv6);
+    if (ip_result.payload_ptr == NULL) {
+      desc->errors |= PACKET_ERR_BAD_IPV6;
+      return 0;
+    }
+    desc->layers |= PACKET_HAS_IPV6;
+    first_fragment = desc->ipv6.fragment_offset == 0;
+    whole = first_fragment && !desc->ipv6.flags_mf;
+    break;
+  default:
+    return 0;
+  }
+
+  // Дальше IPv4 и IPv6 разбираются одинаково
+  desc->ip_protocol = ip_result.transport_protocol;
+  desc->l4_offset = (u_int16_t)(ip_result.payload_ptr - packet);
+  desc->payload_offset = desc->l4_offset;
+  if (first_fragment) {
+    describe_transport(desc, ip_result.payload_ptr,
+                       ip_result.payload_available_len, whole);
+  }
+  if (checksum_mode == CHECKSUM_MODE_ALL && whole &&
+      (desc->layers & (PACKET_HAS_TCP | PACKET_HAS_UDP))) {
+    verify_transport_checksum(desc, ip_result.payload_ptr,
+                              ip_result.payload_available_len);
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef PACKET_DESCRIPTOR_H
+#define PACKET_DESCRIPTOR_H
+
+#include "decap.h"
+#include "ethernet_parser.h"
+#include "ip_parser.h"
+#include "transport_parser.h"
+#include <pcap.h>
+#include <sys/types.h>
+
+// Ошибки разбора (битовые флаги packet_descriptor_t.errors)
+#define PACKET_ERR_SHORT_ETHERNET 0x01 // Кадр короче Ethernet-заголовка
+#define PACKET_ERR_BAD_IPV4 0x02       // Неверная версия/IHL или обрезан
+#define PACKET_ERR_BAD_TRANSPORT 0x04  // Заголовок TCP/UDP/ICMP обрезан
+#define PACKET_ERR_BAD_IPV6 0x08       // Обрезан или цепочка расширений длинная
+#define PACKET_ERR_BAD_ENCAP 0x10 // Метка или туннель обрезаны (decap_packet)
+
+// Что удалось разобрать (битовые флаги packet_descriptor_t.layers)
+#define PACKET_HAS_ETHERNET 0x01
+#define PACKET_HAS_IPV4 0x02
+#define PACKET_HAS_TCP 0x04
+#define PACKET_HAS_UDP 0x08
+#define PACKET_HAS_ICMP 0x10
+#define PACKET_HAS_PORTS 0x20 // src_port/dst_port заполнены
+#define PACKET_HAS_IPV6 0x40
+#define PACKET_HAS_VLAN 0x80
+#define PACKET_HAS_MPLS 0x100
+#define PACKET_HAS_TUNNEL 0x200 // GRE или VXLAN
+
+// Результаты проверки контрольных сумм (packet_descriptor_t.checksums);
+// ни одного флага - не проверялась (см. checksum_set_mode)
+#define PACKET_CSUM_IP_GOOD 0x01
+#define PACKET_CSUM_IP_BAD 0x02
+#define PACKET_CSUM_L4_GOOD 0x04
+#define PACKET_CSUM_L4_BAD 0x08
+#define PACKET_CSUM_L4_UNCHECKED 0x10 // Обрезан, UDP без суммы и т.п.
+
+/**
+ * @brief Результат разбора пакета без какого-либо вывода.
+ *
+ * Заполняется packet_describe в рабочем потоке; печать (если нужна) идет
+ * отдельно через output_sink. Смещения считаются от начала кадра.
+ */
+typedef struct {
+  struct timeval ts;     // Время захвата
+  bpf_u_int32 caplen;    // Захвачено байт
+  bpf_u_int32 len;       // Длина пакета в сети
+  u_int16_t layers;      // PACKET_HAS_*
+  u_int8_t errors;       // PACKET_ERR_*
+  u_int8_t checksums;    // PACKET_CSUM_*
+  u_int16_t ether_type;  // Внутренний EtherType (после меток и туннелей)
+  u_int16_t l3_offset;   // Начало внутреннего заголовка сетевого уровня
+  u_int16_t l4_offset;   // Начало данных транспортного уровня
+  u_int16_t payload_offset; // Начало данных приложения (не больше caplen)
+  u_int8_t ip_protocol;  // Протокол транспортного уровня, 0 - нет
+  u_int16_t src_port;    // Порты TCP/UDP/SCTP (нефрагментированный пакет)
+  u_int16_t dst_port;
+  parsed_ethernet_header_t ethernet; // Внешний заголовок
+  decap_result_t encap; // VLAN, MPLS, туннель (PACKET_HAS_VLAN/MPLS/TUNNEL)
+  union {
+    parsed_ipv4_header_t ipv4; // Действителен при PACKET_HAS_IPV4
+    parsed_ipv6_header_t ipv6; // Действителен при PACKET_HAS_IPV6
+  };
+  union { // Действителен при PACKET_HAS_TCP / _UDP / _ICMP
+    parsed_tcp_header_t tcp;
+    parsed_udp_header_t udp;
+    parsed_icmp_header_t icmp;
+  };
+} packet_descriptor_t;
+
+/**
+ * @brief Разбирает пакет в дескриптор (Ethernet, метки VLAN/MPLS и туннели
+ * GRE/VXLAN, IPv4/IPv6, TCP/UDP/ICMP), ничего не печатая.
+ *
+ * Транспортный заголовок разбирается только в пакете без смещения
+ * фрагмента (в остальных фрагментах его нет). Контрольные суммы
+ * проверяются в режиме checksum_get_mode().
+ *
+ * @param pkthdr Заголовок pcap (время и длины).
+ * @param packet Начало Ethernet-кадра.
+ * @param desc Дескриптор для заполнения.
+ * @return int 0, если разобран хотя бы Ethernet-заголовок, -1 иначе.
+ */
+int packet_describe(const struct pcap_pkthdr *pkthdr, const u_char *packet,
+                    packet_descriptor_t *desc);
+
+#endif // PACKET_DESCRIPTOR_H
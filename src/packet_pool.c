@@ -0,0 +1,187 @@
+#include "packet_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PACKET_POOL_ALIGN 64
+#define PACKET_POOL_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+#define FREE_INDEX(head) ((u_int32_t)((head) & 0xFFFFFFFFu))
+#define FREE_TAG(head) ((u_int32_t)((head) >> 32))
+#define MAKE_FREE_HEAD(tag, index)                                             \
+  (((u_int64_t)(tag) << 32) | (u_int64_t)(index))
+
+static inline packet_task_t *slot_at(const packet_pool_t *pool,
+                                     u_int32_t index) {
+  return (packet_task_t *)(pool->memory + (size_t)index * pool->slot_size);
+}
+
+static inline u_int32_t slot_index(const packet_pool_t *pool,
+                                   const packet_task_t *task) {
+  return (u_int32_t)(((const unsigned char *)task - pool->memory) /
+                     pool->slot_size);
+}
+
+// Данные пакета лежат сразу за packet_task_t (с выравниванием)
+static inline size_t slot_header_size(void) {
+  return (sizeof(packet_task_t) + PACKET_POOL_ALIGN - 1) &
+         ~(size_t)(PACKET_POOL_ALIGN - 1);
+}
+
+static void *map_pool_memory(size_t *size, int use_huge_pages,
+                             int *got_huge_pages) {
+  void *memory = MAP_FAILED;
+  *got_huge_pages = 0;
+#ifdef MAP_HUGETLB
+  if (use_huge_pages) {
+    size_t huge_size = (*size + PACKET_POOL_HUGE_PAGE_SIZE - 1) &
+                       ~(PACKET_POOL_HUGE_PAGE_SIZE - 1);
+    memory = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+      *size = huge_size;
+      *got_huge_pages = 1;
+      return memory;
+    }
+    fprintf(stderr, "packet_pool: huge pages недоступны (MAP_HUGETLB), "
+                    "используются обычные страницы\n");
+  }
+#endif
+  memory = mmap(NULL, *size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if (use_huge_pages) {
+    madvise(memory, *size, MADV_HUGEPAGE); // Прозрачные huge pages, если есть
+  }
+#endif
+  return memory;
+}
+
+int packet_pool_init(packet_pool_t *pool, u_int32_t slot_count,
+                     u_int32_t data_size, int use_huge_pages) {
+  if (pool == NULL || slot_count == 0 || data_size == 0) {
+    return -1;
+  }
+  memset(pool, 0, sizeof(*pool));
+  pool->slot_count = slot_count;
+  pool->data_size = data_size;
+  pool->slot_size = (slot_header_size() + data_size + PACKET_POOL_ALIGN - 1) &
+                    ~(size_t)(PACKET_POOL_ALIGN - 1);
+  pool->memory_size = pool->slot_size * slot_count;
+
+  pool->memory = map_pool_memory(&pool->memory_size, use_huge_pages,
+                                 &pool->huge_pages);
+  if (pool->memory == NULL) {
+    perror("packet_pool_init: Ошибка mmap");
+    return -1;
+  }
+  pool->next_free = calloc(slot_count, sizeof(*pool->next_free));
+  if (pool->next_free == NULL) {
+    perror("packet_pool_init: Ошибка выделения памяти для списка слотов");
+    munmap(pool->memory, pool->memory_size);
+    pool->memory = NULL;
+    return -1;
+  }
+
+  // Размечаем слоты и связываем их в стек: 0 -> 1 -> ... -> n-1
+  for (u_int32_t i = 0; i < slot_count; i++) {
+    packet_task_t *task = slot_at(pool, i);
+    task->packet_data = (u_char *)task + slot_header_size();
+    atomic_init(&pool->next_free[i], i + 1 < slot_count ? i + 2 : 0);
+  }
+  atomic_init(&pool->free_head, MAKE_FREE_HEAD(0, 1));
+  atomic_init(&pool->exhausted, 0);
+  atomic_init(&pool->truncated, 0);
+  return 0;
+}
+
+void packet_pool_destroy(packet_pool_t *pool) {
+  if (pool == NULL || pool->memory == NULL) {
+    return;
+  }
+  munmap(pool->memory, pool->memory_size);
+  free(pool->next_free);
+  pool->memory = NULL;
+  pool->next_free = NULL;
+}
+
+packet_task_t *packet_pool_alloc(packet_pool_t *pool) {
+  u_int64_t head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+  while (1) {
+    u_int32_t index_plus_one = FREE_INDEX(head);
+    if (index_plus_one == 0) {
+      atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+      return NULL;
+    }
+    u_int32_t next = atomic_load_explicit(&pool->next_free[index_plus_one - 1],
+                                          memory_order_relaxed);
+    u_int64_t new_head = MAKE_FREE_HEAD(FREE_TAG(head) + 1, next);
+    if (atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+                                              new_head, memory_order_acquire,
+                                              memory_order_acquire)) {
+      packet_task_t *task = slot_at(pool, index_plus_one - 1);
+      // Слот мог использоваться без копирования (zero-copy) - возвращаем
+      // встроенный буфер
+      task->packet_data = (u_char *)task + slot_header_size();
+      task->release = NULL;
+      task->forwarded = 0;
+      return task;
+    }
+  }
+}
+
+void packet_pool_free(packet_pool_t *pool, packet_task_t *task) {
+  u_int32_t index = slot_index(pool, task);
+  u_int64_t head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+  u_int64_t new_head;
+  do {
+    atomic_store_explicit(&pool->next_free[index], FREE_INDEX(head),
+                          memory_order_relaxed);
+    new_head = MAKE_FREE_HEAD(FREE_TAG(head) + 1, index + 1);
+  } while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+                                                  new_head,
+                                                  memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+void packet_pool_free_bulk(packet_pool_t *pool, packet_task_t **tasks,
+                           unsigned int count) {
+  if (count == 0) {
+    return;
+  }
+  // Связываем слоты в цепочку локально, затем одним CAS вешаем ее на
+  // вершину стека
+  u_int32_t first = slot_index(pool, tasks[0]);
+  u_int32_t last = first;
+  for (unsigned int i = 1; i < count; i++) {
+    u_int32_t index = slot_index(pool, tasks[i]);
+    atomic_store_explicit(&pool->next_free[last], index + 1,
+                          memory_order_relaxed);
+    last = index;
+  }
+  u_int64_t head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+  u_int64_t new_head;
+  do {
+    atomic_store_explicit(&pool->next_free[last], FREE_INDEX(head),
+                          memory_order_relaxed);
+    new_head = MAKE_FREE_HEAD(FREE_TAG(head) + 1, first + 1);
+  } while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head,
+                                                  new_head,
+                                                  memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+void packet_pool_fill(packet_pool_t *pool, packet_task_t *task,
+                      const struct pcap_pkthdr *pkthdr,
+                      const u_char *packet_content) {
+  task->header = *pkthdr; // Копирование структуры заголовка pcap
+  if (task->header.caplen > pool->data_size) {
+    task->header.caplen = pool->data_size;
+    atomic_fetch_add_explicit(&pool->truncated, 1, memory_order_relaxed);
+  }
+  memcpy(task->packet_data, packet_content, task->header.caplen);
+}
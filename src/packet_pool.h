@@ -0,0 +1,70 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include "thread_pool_queue.h"
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/**
+ * @brief Пул заранее выделенных слотов задач с встроенным буфером пакета.
+ *
+ * Вся память выделяется одним куском (mmap, по возможности на huge pages)
+ * при инициализации. Слот = packet_task_t + данные пакета размером
+ * data_size, выровненный по кэш-линии. Свободные слоты лежат в lock-free
+ * стеке (Treiber) индексов; в голове стека хранится счетчик версий, чтобы
+ * исключить ABA при одновременных alloc/free из разных потоков.
+ */
+typedef struct {
+  unsigned char *memory;  // Начало области слотов
+  size_t memory_size;     // Размер отображения (для munmap)
+  size_t slot_size;       // Размер одного слота в байтах
+  u_int32_t slot_count;   // Количество слотов
+  u_int32_t data_size;    // Сколько байт пакета помещается в слот
+  int huge_pages;         // 1, если память получена с MAP_HUGETLB
+  _Atomic u_int32_t *next_free; // Следующий свободный слот (индекс + 1)
+  _Alignas(64) _Atomic u_int64_t free_head; // (версия << 32) | (индекс + 1)
+  _Alignas(64) _Atomic unsigned long long exhausted; // Отказы: пул пуст
+  _Atomic unsigned long long truncated; // Пакеты длиннее data_size
+} packet_pool_t;
+
+/**
+ * @brief Создает пул.
+ *
+ * @param pool Указатель на структуру пула.
+ * @param slot_count Количество слотов.
+ * @param data_size Размер буфера пакета в слоте (обычно snaplen).
+ * @param use_huge_pages 1 - попытаться взять huge pages (MAP_HUGETLB, при
+ *                       неудаче - обычные страницы с MADV_HUGEPAGE).
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int packet_pool_init(packet_pool_t *pool, u_int32_t slot_count,
+                     u_int32_t data_size, int use_huge_pages);
+
+void packet_pool_destroy(packet_pool_t *pool);
+
+/**
+ * @brief Берет свободный слот.
+ *
+ * @return packet_task_t* Задача с packet_data, указывающим на встроенный
+ *                        буфер, или NULL, если пул исчерпан (отказ
+ *                        учитывается в счетчике exhausted).
+ */
+packet_task_t *packet_pool_alloc(packet_pool_t *pool);
+
+// Возвращает слот в пул (можно из любого потока)
+void packet_pool_free(packet_pool_t *pool, packet_task_t *task);
+
+// Возвращает в пул сразу count слотов одной атомарной операцией
+void packet_pool_free_bulk(packet_pool_t *pool, packet_task_t **tasks,
+                           unsigned int count);
+
+/**
+ * @brief Копирует пакет в слот, обрезая его до data_size.
+ *
+ * Обрезка отражается в task->header.caplen и в счетчике truncated.
+ */
+void packet_pool_fill(packet_pool_t *pool, packet_task_t *task,
+                      const struct pcap_pkthdr *pkthdr,
+                      const u_char *packet_content);
+
+#endif // PACKET_POOL_H
@@ -0,0 +1,185 @@
+#include "pcap_capture.h"
+#include "capture_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void pcap_packet_callback(u_char *user_args,
+                                 const struct pcap_pkthdr *pkthdr,
+                                 const u_char *packet_content) {
+  pcap_capture_t *capture = (pcap_capture_t *)user_args;
+
+  if (!*capture->owner->keep_running) { // Проверка флага остановки
+    return;
+  }
+  stats_add(&capture->stats->packets, 1);
+  stats_add(&capture->stats->bytes, pkthdr->len);
+  // Добавляем пакет в пачку; полная пачка уходит в очередь сама
+  queue_batch_add(&capture->batch, pkthdr, packet_content);
+}
+
+// Счетчики ядра для интерфейса (у файла их нет): pcap_stats возвращает
+// значения с момента открытия
+static void update_kernel_stats(pcap_capture_t *capture) {
+  struct pcap_stat ps;
+  if (capture->dev_name == NULL || pcap_stats(capture->handle, &ps) != 0) {
+    return;
+  }
+  stats_set(&capture->stats->kernel_received, ps.ps_recv);
+  stats_set(&capture->stats->kernel_drops, ps.ps_drop);
+  stats_set(&capture->stats->kernel_ifdrops, ps.ps_ifdrop);
+}
+
+// Цикл захвата: pcap_dispatch отдает сразу все пакеты из буфера, пачка
+// отправляется в очередь одной операцией на кольцо
+static void *capture_loop(void *arg) {
+  pcap_capture_t *capture = (pcap_capture_t *)arg;
+  pcap_capture_set_t *set = capture->owner;
+  queue_set_producer_stats(capture->stats);
+  while (*set->keep_running) {
+    int limit = QUEUE_MAX_BATCH;
+    if (set->limited) {
+      long long remaining = atomic_load(&set->remaining);
+      if (remaining <= 0) {
+        break;
+      }
+      if (remaining < limit) {
+        limit = (int)remaining;
+      }
+    }
+    int result = pcap_dispatch(capture->handle, limit, pcap_packet_callback,
+                               (u_char *)capture);
+    queue_add_packet_batch(&capture->batch);
+    if (capture->dev_name != NULL && stats_kernel_refresh_due(capture->stats)) {
+      update_kernel_stats(capture);
+    }
+    if (result == -1) {
+      fprintf(stderr, "Ошибка pcap_dispatch (%s): %s\n",
+              capture->dev_name != NULL ? capture->dev_name : "файл",
+              pcap_geterr(capture->handle));
+      break;
+    }
+    if (result == -2 || (result == 0 && set->offline)) {
+      break; // pcap_breakloop или конец файла
+    }
+    if (set->limited && result > 0 &&
+        atomic_fetch_sub(&set->remaining, result) <= result) {
+      // Лимит исчерпан - останавливаем и остальные интерфейсы
+      *set->keep_running = 0;
+      if (set->count > 1) {
+        pcap_capture_break(set);
+      }
+      break;
+    }
+  }
+  update_kernel_stats(capture);
+  return NULL;
+}
+
+int pcap_capture_init(pcap_capture_set_t *set, int capacity) {
+  memset(set, 0, sizeof(*set));
+  if (capacity <= 0) {
+    return -1;
+  }
+  // Пачка крупная - массив в куче, а не на стеке
+  set->captures = aligned_alloc(64, sizeof(pcap_capture_t) * capacity);
+  if (set->captures == NULL) {
+    perror("pcap_capture_init: Ошибка выделения памяти");
+    return -1;
+  }
+  memset(set->captures, 0, sizeof(pcap_capture_t) * capacity);
+  set->capacity = capacity;
+  return 0;
+}
+
+int pcap_capture_add(pcap_capture_set_t *set, pcap_t *handle,
+                     const char *dev_name) {
+  if (set->count >= set->capacity) {
+    return -1;
+  }
+  pcap_capture_t *capture = &set->captures[set->count++];
+  capture->handle = handle;
+  capture->dev_name = dev_name;
+  capture->owner = set;
+  set->offline = dev_name == NULL;
+  return 0;
+}
+
+int pcap_capture_run(pcap_capture_set_t *set, int packet_count,
+                     volatile int *keep_running) {
+  set->keep_running = keep_running;
+  set->limited = packet_count > 0;
+  atomic_store(&set->remaining, packet_count);
+  for (int i = 0; i < set->count; i++) {
+    set->captures[i].stats = stats_producer_get(i);
+    if (set->captures[i].stats == NULL) {
+      fprintf(stderr, "pcap_capture_run: нет счетчиков для дескриптора %d\n",
+              i);
+      return -1;
+    }
+    if (set->captures[i].dev_name != NULL) {
+      stats_producer_set_interface(set->captures[i].stats,
+                                   set->captures[i].dev_name);
+    }
+  }
+  if (set->count == 1) {
+    capture_loop(&set->captures[0]); // Без лишнего потока
+    return 0;
+  }
+
+  int result = 0;
+  for (int i = 0; i < set->count; i++) {
+    int error = pthread_create(&set->captures[i].thread, NULL, capture_loop,
+                               &set->captures[i]);
+    if (error != 0) {
+      fprintf(stderr, "Ошибка создания потока захвата (%s): %s\n",
+              set->captures[i].dev_name, strerror(error));
+      *keep_running = 0;
+      pcap_capture_break(set);
+      result = -1;
+      break;
+    }
+    set->started = i + 1;
+  }
+  for (int i = 0; i < set->started; i++) {
+    pthread_join(set->captures[i].thread, NULL);
+  }
+  set->started = 0;
+  return result;
+}
+
+int pcap_capture_run_index(pcap_capture_set_t *set, const char *path,
+                           const capture_index_query_t *query,
+                           volatile int *keep_running) {
+  if (set->count != 1 || set->captures[0].dev_name != NULL) {
+    fprintf(stderr, "pcap_capture_run_index: запрос только к одному файлу\n");
+    return -1;
+  }
+  pcap_capture_t *capture = &set->captures[0];
+  set->keep_running = keep_running;
+  capture->stats = stats_producer_get(0);
+  if (capture->stats == NULL) {
+    fprintf(stderr, "pcap_capture_run_index: нет счетчиков для файла\n");
+    return -1;
+  }
+  queue_set_producer_stats(capture->stats);
+  long long found = capture_index_query(path, query, pcap_packet_callback,
+                                        (u_char *)capture, keep_running);
+  queue_add_packet_batch(&capture->batch);
+  return found < 0 ? -1 : 0;
+}
+
+void pcap_capture_break(pcap_capture_set_t *set) {
+  for (int i = 0; i < set->count; i++) {
+    pcap_breakloop(set->captures[i].handle);
+  }
+}
+
+void pcap_capture_close(pcap_capture_set_t *set) {
+  for (int i = 0; i < set->count; i++) {
+    pcap_close(set->captures[i].handle);
+  }
+  free(set->captures);
+  set->captures = NULL;
+  set->count = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef PCAP_CAPTURE_H
+#define PCAP_CAPTURE_H
+
+#include "capture_index.h"
+#include "stats.h"
+#include "thread_pool_queue.h"
+#include <pcap.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+struct pcap_capture_set;
+
+// Дескриптор libpcap и поток, который его читает
+typedef struct {
+  _Alignas(64) packet_batch_t batch; // Пачка задач этого потока захвата
+  pcap_t *handle;
+  const char *dev_name;    // NULL - файл
+  stats_producer_t *stats; // Пишет только поток захвата
+  pthread_t thread;
+  struct pcap_capture_set *owner;
+} pcap_capture_t;
+
+/**
+ * @brief Захват через libpcap с нескольких интерфейсов одновременно.
+ *
+ * У каждого дескриптора свой поток захвата, все они кормят общий пул
+ * рабочих потоков (задачи распределяются по хэшу потока, поэтому поток,
+ * который виден на двух интерфейсах, попадает в одну таблицу потоков).
+ * Один дескриптор (файл или один интерфейс) читается в вызывающем потоке,
+ * как раньше.
+ */
+typedef struct pcap_capture_set {
+  pcap_capture_t *captures;
+  int count;
+  int capacity;
+  int started;            // Сколько потоков запущено
+  int offline;            // Чтение файла: конец файла - конец захвата
+  atomic_llong remaining; // Сколько пакетов осталось захватить (-c)
+  int limited;            // 0 - без ограничения
+  volatile int *keep_running; // Общий флаг остановки
+} pcap_capture_set_t;
+
+// Выделяет место под capacity дескрипторов; 0 при успехе, -1 при ошибке
+int pcap_capture_init(pcap_capture_set_t *set, int capacity);
+
+// Добавляет открытый дескриптор (владение переходит набору)
+int pcap_capture_add(pcap_capture_set_t *set, pcap_t *handle,
+                     const char *dev_name);
+
+/**
+ * @brief Захватывает пакеты со всех дескрипторов до остановки.
+ *
+ * Дескриптор i ведет счетчики в stats_producer_get(i), поэтому stats_init
+ * вызывается раньше с числом продюсеров не меньше count.
+ *
+ * @param packet_count Сколько пакетов захватить всего (0 - до остановки
+ *                     или конца файла).
+ * @param keep_running Флаг остановки; сбрасывается, когда packet_count
+ *                     исчерпан.
+ * @return int 0 при успехе, -1, если не удалось запустить потоки.
+ */
+int pcap_capture_run(pcap_capture_set_t *set, int packet_count,
+                     volatile int *keep_running);
+
+/**
+ * @brief Вместо чтения всего файла передает рабочим потокам только записи,
+ * найденные по индексу (capture_index_query).
+ *
+ * Набор должен состоять из одного файла path, открытого pcap_open_offline
+ * (дескриптор нужен для типа канального уровня и счетчиков).
+ *
+ * @return int 0 при успехе, -1 при ошибке (нет индекса, индекс устарел).
+ */
+int pcap_capture_run_index(pcap_capture_set_t *set, const char *path,
+                           const capture_index_query_t *query,
+                           volatile int *keep_running);
+
+// Прерывает pcap_dispatch всех дескрипторов (из обработчика сигнала)
+void pcap_capture_break(pcap_capture_set_t *set);
+
+// Закрывает дескрипторы и освобождает набор
+void pcap_capture_close(pcap_capture_set_t *set);
+
+#endif // PCAP_CAPTURE_H
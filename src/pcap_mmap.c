@@ -0,0 +1,342 @@
+#include "pcap_mmap.h"
+#include "stats.h"
+#include "thread_pool_queue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_MMAP_MAX_CAPLEN 262144 // Больше не пишет ни один захват
+#define PCAP_MMAP_SYNC_SECONDS 3600 // Соседние записи ближе по времени
+#define PCAP_MMAP_PENDING_BIAS (1LL << 40) // Пока поток чтения в части
+
+// Часть файла: задачи ссылаются на нее, пока рабочие потоки их не отдали
+typedef struct {
+  _Alignas(64) atomic_llong pending; // Задач в очереди + смещение на чтение
+  u_int64_t begin;                   // Байты части в отображении
+  u_int64_t end;
+} pcap_mmap_chunk_t;
+
+typedef struct {
+  _Alignas(64) packet_batch_t batch;
+  stats_producer_t *stats;
+  pthread_t thread;
+  unsigned long long chunks;
+  unsigned long long packets;
+  unsigned long long filtered;
+  unsigned long long sync_errors;
+  unsigned long long tail_bytes;
+} pcap_mmap_reader_t;
+
+static const pcap_mmap_file_t *mapped;
+static const struct bpf_program *bpf_filter;
+static volatile int *keep_running_flag;
+static pcap_mmap_chunk_t *chunks;
+static size_t chunk_count;
+static atomic_size_t next_chunk;
+static pcap_mmap_stats_t totals;
+
+int pcap_mmap_open(const char *path, pcap_mmap_file_t *file, int quiet) {
+  memset(file, 0, sizeof(*file));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "pcap_mmap: Не удалось открыть %s: %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < PCAP_MMAP_FILE_HEADER_SIZE) {
+    if (!quiet) {
+      fprintf(stderr, "pcap_mmap: %s - не файл pcap\n", path);
+    }
+    close(fd);
+    return -1;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("pcap_mmap: Ошибка mmap");
+    return -1;
+  }
+  u_int32_t header[6];
+  memcpy(header, data, sizeof(header));
+  if (header[0] != PCAP_MAGIC_USEC && header[0] != PCAP_MAGIC_NSEC) {
+    if (!quiet) {
+      fprintf(stderr, "pcap_mmap: %s - не классический pcap с порядком "
+                      "байт машины\n",
+              path);
+    }
+    munmap(data, (size_t)st.st_size);
+    return -1;
+  }
+  file->data = data;
+  file->size = (size_t)st.st_size;
+  file->nsec = header[0] == PCAP_MAGIC_NSEC;
+  file->snaplen = header[4];
+  file->linktype = header[5] & 0x0FFFFFFF; // Старшие биты - FCS
+  return 0;
+}
+
+void pcap_mmap_close(pcap_mmap_file_t *file) {
+  if (file == mapped) {
+    free(chunks);
+    chunks = NULL;
+    mapped = NULL;
+  }
+  if (file->data != NULL) {
+    munmap((void *)file->data, file->size);
+  }
+  file->data = NULL;
+}
+
+u_int32_t pcap_mmap_record(const pcap_mmap_file_t *file, u_int64_t offset,
+                           struct pcap_pkthdr *header, const u_char **data) {
+  if (offset + PCAP_MMAP_RECORD_HEADER_SIZE > file->size) {
+    return 0;
+  }
+  u_int32_t fields[4];
+  memcpy(fields, file->data + offset, sizeof(fields));
+  if (fields[2] > file->size - offset - PCAP_MMAP_RECORD_HEADER_SIZE) {
+    return 0;
+  }
+  header->ts.tv_sec = fields[0];
+  header->ts.tv_usec = file->nsec ? fields[1] / 1000 : fields[1];
+  header->caplen = fields[2];
+  header->len = fields[3];
+  *data = file->data + offset + PCAP_MMAP_RECORD_HEADER_SIZE;
+  return PCAP_MMAP_RECORD_HEADER_SIZE + fields[2];
+}
+
+// Заголовок записи правдоподобен (без проверки, что данные в файле)
+static int record_header_plausible(const pcap_mmap_file_t *file,
+                                   const u_int32_t fields[4]) {
+  u_int32_t max_caplen = PCAP_MMAP_MAX_CAPLEN;
+  if (file->snaplen > 0 && file->snaplen < max_caplen) {
+    max_caplen = file->snaplen;
+  }
+  u_int32_t fraction_limit = file->nsec ? 1000000000 : 1000000;
+  return fields[1] < fraction_limit && fields[2] <= max_caplen &&
+         fields[2] <= fields[3] && fields[3] != 0 &&
+         fields[3] <= PCAP_MMAP_MAX_CAPLEN;
+}
+
+// Цепочка правдоподобных заголовков с offset (см. pcap_mmap_find_record)
+static int records_chain_from(const pcap_mmap_file_t *file,
+                              u_int64_t offset) {
+  u_int32_t previous_sec = 0;
+  for (int i = 0; i < PCAP_MMAP_SYNC_RECORDS; i++) {
+    if (offset == file->size) {
+      return i > 0; // Цепочка ровно дошла до конца файла
+    }
+    if (offset + PCAP_MMAP_RECORD_HEADER_SIZE > file->size) {
+      return 0;
+    }
+    u_int32_t fields[4];
+    memcpy(fields, file->data + offset, sizeof(fields));
+    if (!record_header_plausible(file, fields)) {
+      return 0;
+    }
+    if (i > 0 && (fields[0] - previous_sec + PCAP_MMAP_SYNC_SECONDS) >
+                     2 * PCAP_MMAP_SYNC_SECONDS) {
+      return 0;
+    }
+    previous_sec = fields[0];
+    offset += PCAP_MMAP_RECORD_HEADER_SIZE + (u_int64_t)fields[2];
+    if (offset > file->size) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+u_int64_t pcap_mmap_find_record(const pcap_mmap_file_t *file, u_int64_t from) {
+  if (from <= PCAP_MMAP_FILE_HEADER_SIZE) {
+    return PCAP_MMAP_FILE_HEADER_SIZE;
+  }
+  // Без ограничения окна: если границы нет, предыдущая часть дочитает
+  // файл одна - медленнее, но без пропусков и повторов
+  for (u_int64_t offset = from; offset < file->size; offset++) {
+    if (records_chain_from(file, offset)) {
+      return offset;
+    }
+  }
+  return file->size;
+}
+
+static void drop_chunk_pages(const pcap_mmap_chunk_t *chunk) {
+  // Страницы файла остаются в кэше ядра, отображение отпускает их: память
+  // процесса не растет на 50 ГБ архива. Запись соседней части, которая
+  // заходит сюда, просто перечитает страницу из кэша
+  madvise((void *)(mapped->data + chunk->begin), chunk->end - chunk->begin,
+          MADV_DONTNEED);
+}
+
+static void release_record(void *cookie) {
+  pcap_mmap_chunk_t *chunk = (pcap_mmap_chunk_t *)cookie;
+  if (atomic_fetch_sub_explicit(&chunk->pending, 1, memory_order_acq_rel) ==
+      1) {
+    drop_chunk_pages(chunk);
+  }
+}
+
+static void read_chunk(pcap_mmap_reader_t *reader, size_t index) {
+  pcap_mmap_chunk_t *chunk = &chunks[index];
+  chunk->begin = (u_int64_t)index * PCAP_MMAP_CHUNK_SIZE;
+  chunk->end = chunk->begin + PCAP_MMAP_CHUNK_SIZE;
+  if (chunk->end > mapped->size) {
+    chunk->end = mapped->size;
+  }
+  atomic_store_explicit(&chunk->pending, PCAP_MMAP_PENDING_BIAS,
+                        memory_order_relaxed);
+  madvise((void *)(mapped->data + chunk->begin), chunk->end - chunk->begin,
+          MADV_WILLNEED);
+  // Часть - записи, которые начинаются в [начало, начало следующей)
+  u_int64_t offset = pcap_mmap_find_record(mapped, chunk->begin);
+  u_int64_t stop = chunk->end == mapped->size
+                       ? mapped->size
+                       : pcap_mmap_find_record(mapped, chunk->end);
+  long long queued = 0;
+  while (offset < stop && *keep_running_flag) {
+    struct pcap_pkthdr header;
+    const u_char *data;
+    u_int32_t size = pcap_mmap_record(mapped, offset, &header, &data);
+    if (size == 0) {
+      // Запись не помещается в файл: последняя не дописана (файл обрезан
+      // или еще пишется) либо заголовок испорчен
+      int truncated = offset + PCAP_MMAP_RECORD_HEADER_SIZE > mapped->size;
+      if (!truncated) {
+        u_int32_t fields[4];
+        memcpy(fields, mapped->data + offset, sizeof(fields));
+        truncated = record_header_plausible(mapped, fields);
+      }
+      if (truncated) {
+        reader->tail_bytes += mapped->size - offset;
+        offset = stop;
+        break;
+      }
+      // Испорченный заголовок: ищем следующую запись, как на границе части
+      reader->sync_errors++;
+      offset = pcap_mmap_find_record(mapped, offset + 1);
+      if (offset > stop) {
+        offset = stop; // Дальше - следующая часть
+      }
+      continue;
+    }
+    offset += size;
+    if (bpf_filter != NULL &&
+        pcap_offline_filter(bpf_filter, &header, data) == 0) {
+      reader->filtered++;
+      continue;
+    }
+    stats_add(&reader->stats->packets, 1);
+    stats_add(&reader->stats->bytes, header.len);
+    queue_batch_add_zero_copy(&reader->batch, &header, data, release_record,
+                              chunk);
+    queued++;
+  }
+  queue_add_packet_batch(&reader->batch);
+  if (offset > stop) {
+    reader->sync_errors++; // Запись перешагнула найденную границу
+  }
+  reader->chunks++;
+  reader->packets += queued;
+  // Смещение снимается вместе с числом задач: ноль - когда отданы все
+  if (atomic_fetch_add_explicit(&chunk->pending,
+                                queued - PCAP_MMAP_PENDING_BIAS,
+                                memory_order_acq_rel) ==
+      PCAP_MMAP_PENDING_BIAS - queued) {
+    drop_chunk_pages(chunk);
+  }
+}
+
+static void *reader_loop(void *arg) {
+  pcap_mmap_reader_t *reader = (pcap_mmap_reader_t *)arg;
+  queue_set_producer_stats(reader->stats);
+  while (*keep_running_flag) {
+    size_t index = atomic_fetch_add(&next_chunk, 1);
+    if (index >= chunk_count) {
+      break;
+    }
+    read_chunk(reader, index);
+  }
+  return NULL;
+}
+
+int pcap_mmap_run(const pcap_mmap_file_t *file, int reader_count,
+                  const struct bpf_program *filter,
+                  volatile int *keep_running) {
+  if (reader_count <= 0 || reader_count > PCAP_MMAP_MAX_READERS) {
+    fprintf(stderr, "pcap_mmap_run: неверное количество потоков %d\n",
+            reader_count);
+    return -1;
+  }
+  mapped = file;
+  bpf_filter = filter;
+  keep_running_flag = keep_running;
+  memset(&totals, 0, sizeof(totals));
+  chunk_count = (file->size + PCAP_MMAP_CHUNK_SIZE - 1) / PCAP_MMAP_CHUNK_SIZE;
+  atomic_store(&next_chunk, 0);
+  // Части живут до queue_shutdown (на них ссылаются задачи), поэтому
+  // освобождаются при следующем запуске
+  free(chunks);
+  chunks = aligned_alloc(64, sizeof(*chunks) * chunk_count);
+  pcap_mmap_reader_t *readers =
+      aligned_alloc(64, sizeof(*readers) * reader_count);
+  if (chunks == NULL || readers == NULL) {
+    perror("pcap_mmap_run: Ошибка выделения памяти");
+    free(readers);
+    return -1;
+  }
+  memset(chunks, 0, sizeof(*chunks) * chunk_count);
+  memset(readers, 0, sizeof(*readers) * reader_count);
+  for (int i = 0; i < reader_count; i++) {
+    readers[i].stats = stats_producer_get(i);
+    if (readers[i].stats == NULL) {
+      fprintf(stderr, "pcap_mmap_run: нет счетчиков для потока чтения %d\n",
+              i);
+      free(readers);
+      return -1;
+    }
+  }
+
+  int result = 0, started = 0;
+  if (reader_count == 1) {
+    reader_loop(&readers[0]); // Без лишнего потока
+    started = 1;
+  } else {
+    for (int i = 0; i < reader_count; i++) {
+      int error =
+          pthread_create(&readers[i].thread, NULL, reader_loop, &readers[i]);
+      if (error != 0) {
+        fprintf(stderr, "Ошибка создания потока чтения #%d: %s\n", i,
+                strerror(error));
+        *keep_running = 0;
+        result = -1;
+        break;
+      }
+      started = i + 1;
+    }
+    for (int i = 0; i < started; i++) {
+      pthread_join(readers[i].thread, NULL);
+    }
+  }
+  for (int i = 0; i < started; i++) {
+    totals.chunks += readers[i].chunks;
+    totals.packets += readers[i].packets;
+    totals.filtered += readers[i].filtered;
+    totals.sync_errors += readers[i].sync_errors;
+    totals.tail_bytes += readers[i].tail_bytes;
+  }
+  free(readers);
+  return result;
+}
+
+void pcap_mmap_get_stats(pcap_mmap_stats_t *stats) { *stats = totals; }
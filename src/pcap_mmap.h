@@ -0,0 +1,94 @@
+#ifndef PCAP_MMAP_H
+#define PCAP_MMAP_H
+
+#include <pcap.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define PCAP_MMAP_FILE_HEADER_SIZE 24
+#define PCAP_MMAP_RECORD_HEADER_SIZE 16
+#define PCAP_MMAP_CHUNK_SIZE (8UL * 1024 * 1024) // Часть файла на поток
+#define PCAP_MMAP_SYNC_RECORDS 8 // Заголовков подряд для поиска границы
+#define PCAP_MMAP_MAX_READERS 64
+
+// Файл pcap, отображенный в память (классический pcap, порядок байт машины)
+typedef struct {
+  const u_char *data;
+  size_t size;
+  int nsec;           // Наносекунды в записях вместо микросекунд
+  u_int32_t snaplen;  // Из заголовка файла
+  u_int32_t linktype; // DLT_*
+} pcap_mmap_file_t;
+
+/**
+ * @brief Отображает файл pcap в память.
+ *
+ * Поддерживается классический pcap с порядком байт машины (микро- или
+ * наносекунды); pcapng и файлы с другим порядком байт читает libpcap.
+ *
+ * @param quiet 1 - не печатать, что формат не поддерживается (вызывающий
+ *              перейдет на libpcap).
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int pcap_mmap_open(const char *path, pcap_mmap_file_t *file, int quiet);
+
+// Снимает отображение (после queue_shutdown, если файл читал
+// pcap_mmap_run)
+void pcap_mmap_close(pcap_mmap_file_t *file);
+
+// Запись по смещению; размер записи с заголовком или 0 (конец файла или
+// запись обрезана)
+u_int32_t pcap_mmap_record(const pcap_mmap_file_t *file, u_int64_t offset,
+                           struct pcap_pkthdr *header, const u_char **data);
+
+/**
+ * @brief Ищет первую запись, которая начинается не раньше from.
+ *
+ * В pcap нет маркеров записей, поэтому граница - смещение, с которого
+ * PCAP_MMAP_SYNC_RECORDS заголовков подряд правдоподобны (caplen не больше
+ * snaplen и len, микросекунды меньше секунды, время соседних записей
+ * отличается меньше чем на час) или цепочка ровно доходит до конца файла.
+ * Функция детерминирована: потоки, которые ищут одну границу, получают
+ * одно смещение.
+ *
+ * @return u_int64_t Смещение записи или file->size, если ее нет.
+ */
+u_int64_t pcap_mmap_find_record(const pcap_mmap_file_t *file, u_int64_t from);
+
+// Счетчики чтения (после pcap_mmap_run)
+typedef struct {
+  unsigned long long chunks;       // Частей файла
+  unsigned long long packets;      // Записей передано рабочим потокам
+  unsigned long long filtered;     // Отброшено фильтром BPF
+  unsigned long long sync_errors;  // Испорченные заголовки и расхождения
+                                   // цепочки записей с границей части
+  unsigned long long tail_bytes;   // Обрезанная запись в конце файла
+} pcap_mmap_stats_t;
+
+/**
+ * @brief Читает файл несколькими потоками и отдает записи рабочим потокам
+ * без копирования.
+ *
+ * Файл делится на части по PCAP_MMAP_CHUNK_SIZE, которые потоки чтения
+ * берут по порядку (atomic); часть начинается с первой записи не раньше
+ * своего начала и заканчивается там, где начинается следующая. Задачи
+ * ссылаются на данные в отображении (queue_batch_add_zero_copy) и
+ * распределяются по хэшу потока, как при обычном чтении, поэтому поток
+ * трафика из соседних частей попадает в одну таблицу и частичные
+ * результаты частей сходятся в ней сами. Обработанные части отдаются ядру
+ * (MADV_DONTNEED), и память процесса не растет с размером файла.
+ *
+ * Отображение нельзя закрывать до queue_shutdown. Поток чтения i ведет
+ * счетчики в stats_producer_get(i).
+ *
+ * @param filter Программа BPF (pcap_offline_filter) или NULL.
+ * @param keep_running Флаг остановки.
+ * @return int 0 при успехе, -1, если не удалось запустить потоки.
+ */
+int pcap_mmap_run(const pcap_mmap_file_t *file, int reader_count,
+                  const struct bpf_program *filter,
+                  volatile int *keep_running);
+
+void pcap_mmap_get_stats(pcap_mmap_stats_t *stats);
+
+#endif // PCAP_MMAP_H
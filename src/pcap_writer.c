@@ -0,0 +1,498 @@
+#include "pcap_writer.h"
+#include "capture_index.h"
+#include "futex_event.h"
+#include "ring_buffer.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PCAP_WRITER_ALIGN 4096 // Выравнивание адреса, длины и смещения
+                               // для O_DIRECT
+#define PCAP_WRITER_OUTPUT_SIZE (4 * 1024 * 1024) // Одна запись на диск
+#define PCAP_WRITER_FLUSH_AGE 1.0   // Секунд до сдачи неполного блока
+#define PCAP_WRITER_POLL_MS 100     // Перепроверка остановки писателем
+#define PCAP_WRITER_DEQUEUE_BURST 16
+
+// Заголовки формата pcap (libpcap, микросекунды)
+typedef struct {
+  u_int32_t magic;
+  u_int16_t version_major;
+  u_int16_t version_minor;
+  int32_t thiszone;
+  u_int32_t sigfigs;
+  u_int32_t snaplen;
+  u_int32_t linktype;
+} pcap_writer_file_header_t;
+
+typedef struct {
+  u_int32_t ts_sec;
+  u_int32_t ts_usec;
+  u_int32_t caplen;
+  u_int32_t len;
+} pcap_writer_record_header_t;
+
+// Перед каждой записью в блоке - хэш потока для индекса (в файл не идет)
+typedef struct {
+  u_int32_t key_hash;
+  u_int32_t has_key;
+} pcap_writer_record_prefix_t;
+
+struct pcap_writer_chunk {
+  size_t used;
+  u_char *data; // PCAP_WRITER_CHUNK_SIZE байт: префикс и запись pcap
+};
+
+static pcap_writer_options_t writer_options;
+static pcap_writer_worker_t *workers; // По состоянию на рабочий поток
+static int num_workers_global;
+static pcap_writer_chunk_t *chunks;
+static unsigned int num_chunks;
+static u_char *chunk_memory;
+static ring_buffer_t free_chunks; // Писатель -> рабочие потоки
+static ring_buffer_t full_chunks; // Рабочие потоки -> писатель
+static u_int32_t max_caplen;      // Не больше блока и snaplen записи
+
+static pthread_t writer_thread;
+static int writer_started;
+static atomic_int writer_stop_requested;
+static futex_event_t writer_wakeup;
+
+// Дальше - только поток писателя (и main после его остановки)
+static u_char *output;      // Выровненный буфер перед записью в файл
+static size_t output_used;
+static int file_fd = -1;
+static char file_name[4096];
+static capture_index_builder_t index_builder;
+static int file_direct;     // Файл открыт с O_DIRECT
+static int direct_warned;
+static unsigned int file_index;
+static double file_opened;
+static unsigned long long file_bytes; // Байт текущего файла вместе с буфером
+static int write_failed;              // После ошибки записи пакеты теряются
+// Счетчики писателя; читает еще поток отчетов
+static unsigned long long written_packets;
+static unsigned long long written_bytes;
+static unsigned long long lost_packets; // Отброшены из-за ошибки записи
+static unsigned long long files_opened;
+// Прошлые значения для строки за интервал (поток отчетов)
+static unsigned long long reported_packets;
+static unsigned long long reported_bytes;
+static unsigned long long reported_dropped;
+
+// Грубые часы рабочего потока: vDSO без обращения к счетчику времени
+static double coarse_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void pcap_writer_get_default_options(pcap_writer_options_t *options) {
+  memset(options, 0, sizeof(*options));
+  options->linktype = DLT_EN10MB;
+  options->buffer_memory = PCAP_WRITER_DEFAULT_MEMORY;
+}
+
+// --- Рабочие потоки ---
+
+static void hand_off_chunk(pcap_writer_worker_t *worker) {
+  pcap_writer_chunk_t *chunk = worker->current;
+  worker->current = NULL;
+  // Кольцо вмещает все блоки - место есть всегда
+  ring_enqueue_burst(&full_chunks, (void **)&chunk, 1);
+  futex_event_notify(&writer_wakeup, 0);
+}
+
+static int take_free_chunk(pcap_writer_worker_t *worker) {
+  pcap_writer_chunk_t *chunk;
+  if (ring_dequeue_burst(&free_chunks, (void **)&chunk, 1) != 1) {
+    return -1;
+  }
+  chunk->used = 0;
+  worker->current = chunk;
+  return 0;
+}
+
+void pcap_writer_add(pcap_writer_worker_t *worker,
+                     const struct pcap_pkthdr *header, const u_char *data,
+                     const flow_key_t *key) {
+  u_int32_t caplen = header->caplen < max_caplen ? header->caplen : max_caplen;
+  size_t need = sizeof(pcap_writer_record_prefix_t) +
+                sizeof(pcap_writer_record_header_t) + caplen;
+  pcap_writer_chunk_t *chunk = worker->current;
+  if (chunk == NULL || chunk->used + need > PCAP_WRITER_CHUNK_SIZE) {
+    if (chunk != NULL) {
+      hand_off_chunk(worker);
+    }
+    if (take_free_chunk(worker) != 0) {
+      stats_add(&worker->dropped, 1); // Диск отстал - не ждем
+      return;
+    }
+    chunk = worker->current;
+  }
+  if (chunk->used == 0) {
+    worker->chunk_started = coarse_seconds();
+  }
+  pcap_writer_record_prefix_t prefix;
+  prefix.has_key = writer_options.build_index && key != NULL;
+  prefix.key_hash = prefix.has_key ? capture_index_key_hash(key) : 0;
+  pcap_writer_record_header_t record;
+  record.ts_sec = (u_int32_t)header->ts.tv_sec;
+  record.ts_usec = (u_int32_t)header->ts.tv_usec;
+  record.caplen = caplen;
+  record.len = header->len;
+  u_char *out = chunk->data + chunk->used;
+  memcpy(out, &prefix, sizeof(prefix));
+  memcpy(out + sizeof(prefix), &record, sizeof(record));
+  memcpy(out + sizeof(prefix) + sizeof(record), data, caplen);
+  chunk->used += need;
+  stats_add(&worker->packets, 1);
+}
+
+void pcap_writer_worker_tick(pcap_writer_worker_t *worker) {
+  if (worker->current != NULL && worker->current->used > 0 &&
+      coarse_seconds() - worker->chunk_started > PCAP_WRITER_FLUSH_AGE) {
+    hand_off_chunk(worker); // Редкий трафик не залеживается в памяти
+  }
+}
+
+pcap_writer_worker_t *pcap_writer_worker_get(int worker_id) {
+  if (worker_id < 0 || worker_id >= num_workers_global) {
+    return NULL;
+  }
+  return &workers[worker_id];
+}
+
+// --- Поток писателя ---
+
+static int write_all(const u_char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(file_fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      perror("pcap_writer: Ошибка записи в файл");
+      write_failed = 1;
+      return -1;
+    }
+    data += written;
+    size -= (size_t)written;
+    stats_add(&written_bytes, (unsigned long long)written);
+  }
+  return 0;
+}
+
+// Пишет из буфера все целые куски по PCAP_WRITER_ALIGN, остаток - в начало
+static void flush_aligned(void) {
+  size_t aligned = output_used & ~(size_t)(PCAP_WRITER_ALIGN - 1);
+  if (aligned == 0 || write_all(output, aligned) != 0) {
+    return;
+  }
+  memmove(output, output + aligned, output_used - aligned);
+  output_used -= aligned;
+}
+
+static void close_file(void) {
+  if (file_fd < 0) {
+    return;
+  }
+  if (!write_failed) {
+    flush_aligned();
+  }
+  // Хвост не кратен блоку: дописываем его уже без O_DIRECT
+  if (!write_failed && output_used > 0 && file_direct) {
+    int flags = fcntl(file_fd, F_GETFL);
+    if (flags < 0 || fcntl(file_fd, F_SETFL, flags & ~O_DIRECT) != 0) {
+      perror("pcap_writer: Не удалось снять O_DIRECT");
+    }
+  }
+  if (!write_failed && output_used > 0) {
+    write_all(output, output_used);
+  }
+  output_used = 0;
+  close(file_fd);
+  file_fd = -1;
+  if (writer_options.build_index && !write_failed) {
+    capture_index_builder_write(&index_builder, file_name, file_bytes);
+  }
+  capture_index_builder_free(&index_builder);
+}
+
+static int open_next_file(void) {
+  close_file();
+  char *name = file_name;
+  int rotating =
+      writer_options.rotate_bytes > 0 || writer_options.rotate_seconds > 0;
+  if (rotating) {
+    snprintf(name, sizeof(file_name), "%s.%05u", writer_options.path,
+             file_index);
+  } else {
+    snprintf(name, sizeof(file_name), "%s", writer_options.path);
+  }
+  file_index++;
+  file_direct = 1;
+  file_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (file_fd < 0 && errno == EINVAL) {
+    // Файловая система без O_DIRECT (например, tmpfs)
+    if (!direct_warned) {
+      fprintf(stderr, "pcap_writer: %s не поддерживает O_DIRECT, запись "
+                      "через страничный кэш\n",
+              name);
+      direct_warned = 1;
+    }
+    file_direct = 0;
+    file_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (file_fd < 0) {
+    fprintf(stderr, "pcap_writer: Не удалось открыть %s: %s\n", name,
+            strerror(errno));
+    write_failed = 1;
+    return -1;
+  }
+  pcap_writer_file_header_t header;
+  header.magic = 0xa1b2c3d4;
+  header.version_major = 2;
+  header.version_minor = 4;
+  header.thiszone = 0;
+  header.sigfigs = 0;
+  header.snaplen = writer_options.snaplen > 0 ? writer_options.snaplen
+                                              : writer_options.file_snaplen;
+  header.linktype = (u_int32_t)writer_options.linktype;
+  memcpy(output, &header, sizeof(header));
+  output_used = sizeof(header);
+  file_bytes = sizeof(header);
+  file_opened = monotonic_seconds();
+  stats_add(&files_opened, 1);
+  return 0;
+}
+
+// Переносит записи блока в выходной буфер, открывая новый файл на границе
+// записи, когда текущий достиг размера или возраста ротации
+static void write_chunk(const pcap_writer_chunk_t *chunk, double now) {
+  size_t offset = 0;
+  while (offset < chunk->used) {
+    pcap_writer_record_prefix_t prefix;
+    pcap_writer_record_header_t record;
+    memcpy(&prefix, chunk->data + offset, sizeof(prefix));
+    const u_char *bytes = chunk->data + offset + sizeof(prefix);
+    memcpy(&record, bytes, sizeof(record));
+    size_t size = sizeof(record) + record.caplen;
+    offset += sizeof(prefix) + size;
+    if (write_failed) {
+      stats_add(&lost_packets, 1);
+      continue;
+    }
+    if (file_fd < 0 ||
+        (writer_options.rotate_bytes > 0 &&
+         file_bytes > sizeof(pcap_writer_file_header_t) &&
+         file_bytes + size > writer_options.rotate_bytes) ||
+        (writer_options.rotate_seconds > 0 &&
+         now - file_opened >= writer_options.rotate_seconds)) {
+      if (open_next_file() != 0) {
+        stats_add(&lost_packets, 1);
+        continue;
+      }
+    }
+    if (writer_options.build_index) {
+      capture_index_builder_add(&index_builder, file_bytes, (u_int32_t)size,
+                                record.ts_sec, prefix.key_hash,
+                                prefix.has_key);
+    }
+    memcpy(output + output_used, bytes, size);
+    output_used += size;
+    file_bytes += size;
+    stats_add(&written_packets, 1);
+    if (output_used >= PCAP_WRITER_OUTPUT_SIZE) {
+      flush_aligned();
+    }
+  }
+}
+
+static unsigned int drain_full_chunks(void) {
+  pcap_writer_chunk_t *batch[PCAP_WRITER_DEQUEUE_BURST];
+  unsigned int count = ring_dequeue_burst(&full_chunks, (void **)batch,
+                                          PCAP_WRITER_DEQUEUE_BURST);
+  double now = monotonic_seconds();
+  for (unsigned int i = 0; i < count; i++) {
+    write_chunk(batch[i], now);
+  }
+  // Писатель - единственный производитель свободных блоков
+  if (count > 0) {
+    ring_enqueue_burst(&free_chunks, (void **)batch, count);
+  }
+  return count;
+}
+
+static void *writer_loop(void *arg) {
+  (void)arg;
+  while (1) {
+    u_int32_t seq = futex_event_prepare(&writer_wakeup);
+    if (ring_count(&full_chunks) > 0) {
+      futex_event_cancel(&writer_wakeup);
+      drain_full_chunks();
+      continue;
+    }
+    if (atomic_load(&writer_stop_requested)) {
+      futex_event_cancel(&writer_wakeup);
+      break;
+    }
+    futex_event_wait(&writer_wakeup, seq, PCAP_WRITER_POLL_MS);
+    if (ring_count(&full_chunks) == 0 && file_fd >= 0 && !write_failed) {
+      flush_aligned(); // Простой - отдаем на диск накопленное
+    }
+  }
+  while (drain_full_chunks() > 0) {
+  }
+  close_file();
+  return NULL;
+}
+
+// --- Инициализация и итог ---
+
+int pcap_writer_init(int num_workers, const pcap_writer_options_t *options) {
+  if (num_workers <= 0 || options->path == NULL) {
+    return -1;
+  }
+  writer_options = *options;
+  max_caplen = PCAP_WRITER_CHUNK_SIZE - sizeof(pcap_writer_record_prefix_t) -
+               sizeof(pcap_writer_record_header_t);
+  if (options->snaplen > 0 && options->snaplen < max_caplen) {
+    max_caplen = options->snaplen;
+  }
+  // Каждому рабочему потоку - хотя бы пара блоков, иначе запись
+  // отбрасывала бы пакеты при любой задержке диска
+  num_chunks = (unsigned int)(options->buffer_memory / PCAP_WRITER_CHUNK_SIZE);
+  if (num_chunks < (unsigned int)num_workers * 2) {
+    num_chunks = (unsigned int)num_workers * 2;
+  }
+  workers = aligned_alloc(64, sizeof(pcap_writer_worker_t) * num_workers);
+  chunks = calloc(num_chunks, sizeof(pcap_writer_chunk_t));
+  chunk_memory = aligned_alloc(PCAP_WRITER_ALIGN,
+                               (size_t)num_chunks * PCAP_WRITER_CHUNK_SIZE);
+  output = aligned_alloc(PCAP_WRITER_ALIGN,
+                         PCAP_WRITER_OUTPUT_SIZE + PCAP_WRITER_CHUNK_SIZE);
+  if (workers == NULL || chunks == NULL || chunk_memory == NULL ||
+      output == NULL) {
+    perror("pcap_writer_init: Ошибка выделения памяти");
+    pcap_writer_close();
+    return -1;
+  }
+  memset(workers, 0, sizeof(pcap_writer_worker_t) * num_workers);
+  num_workers_global = num_workers;
+  if (ring_init(&free_chunks, num_chunks, RING_F_SP_ENQ) != 0 ||
+      ring_init(&full_chunks, num_chunks, RING_F_SC_DEQ) != 0) {
+    pcap_writer_close();
+    return -1;
+  }
+  for (unsigned int i = 0; i < num_chunks; i++) {
+    chunks[i].data = chunk_memory + (size_t)i * PCAP_WRITER_CHUNK_SIZE;
+    pcap_writer_chunk_t *chunk = &chunks[i];
+    ring_enqueue_burst(&free_chunks, (void **)&chunk, 1);
+  }
+  // Первый файл открывается сразу: ошибка пути видна до начала захвата
+  if (open_next_file() != 0) {
+    pcap_writer_close();
+    return -1;
+  }
+  atomic_store(&writer_stop_requested, 0);
+  futex_event_init(&writer_wakeup);
+  int result = pthread_create(&writer_thread, NULL, writer_loop, NULL);
+  if (result != 0) {
+    fprintf(stderr, "Ошибка создания потока записи: %s\n", strerror(result));
+    pcap_writer_close();
+    return -1;
+  }
+  writer_started = 1;
+  return 0;
+}
+
+static void sum_worker_counters(unsigned long long *packets,
+                                unsigned long long *dropped) {
+  *packets = 0;
+  *dropped = 0;
+  for (int i = 0; i < num_workers_global; i++) {
+    *packets += stats_load(&workers[i].packets);
+    *dropped += stats_load(&workers[i].dropped);
+  }
+}
+
+void pcap_writer_get_stats(pcap_writer_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (workers == NULL) {
+    return;
+  }
+  unsigned long long queued;
+  sum_worker_counters(&queued, &stats->dropped);
+  stats->packets = stats_load(&written_packets);
+  stats->bytes = stats_load(&written_bytes);
+  stats->files = stats_load(&files_opened);
+}
+
+void pcap_writer_report_interval(void) {
+  if (workers == NULL) {
+    return;
+  }
+  unsigned long long queued, dropped;
+  sum_worker_counters(&queued, &dropped);
+  unsigned long long packets = stats_load(&written_packets);
+  unsigned long long bytes = stats_load(&written_bytes);
+  printf("  Запись на диск: пакетов %llu, %.2f МиБ, отброшено %llu (диск не "
+         "успевает), файлов %llu\n",
+         packets - reported_packets,
+         (bytes - reported_bytes) / (1024.0 * 1024.0),
+         dropped - reported_dropped, stats_load(&files_opened));
+  fflush(stdout);
+  reported_packets = packets;
+  reported_bytes = bytes;
+  reported_dropped = dropped;
+}
+
+void pcap_writer_close(void) {
+  if (writer_started) {
+    // Рабочие потоки остановлены - их неполные блоки тоже уходят писателю
+    for (int i = 0; i < num_workers_global; i++) {
+      if (workers[i].current != NULL && workers[i].current->used > 0) {
+        hand_off_chunk(&workers[i]);
+      }
+    }
+    atomic_store(&writer_stop_requested, 1);
+    futex_event_notify(&writer_wakeup, 1);
+    pthread_join(writer_thread, NULL);
+    writer_started = 0;
+
+    unsigned long long queued, dropped;
+    sum_worker_counters(&queued, &dropped);
+    printf("Запись на диск: %llu пакетов, %llu байт в %llu файл(ах); "
+           "отброшено %llu (диск не успевал)",
+           written_packets, written_bytes, files_opened, dropped);
+    if (lost_packets > 0) {
+      printf(", потеряно из-за ошибки записи %llu", lost_packets);
+    }
+    printf("\n");
+  } else {
+    close_file();
+  }
+  ring_destroy(&free_chunks);
+  ring_destroy(&full_chunks);
+  free(workers);
+  free(chunks);
+  free(chunk_memory);
+  free(output);
+  workers = NULL;
+  chunks = NULL;
+  chunk_memory = NULL;
+  output = NULL;
+  num_workers_global = 0;
+  num_chunks = 0;
+  file_index = 0;
+  write_failed = 0;
+  written_packets = written_bytes = lost_packets = files_opened = 0;
+  reported_packets = reported_bytes = reported_dropped = 0;
+}
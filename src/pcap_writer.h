@@ -0,0 +1,84 @@
+#ifndef PCAP_WRITER_H
+#define PCAP_WRITER_H
+
+#include "flow_table.h"
+#include <pcap.h>
+#include <sys/types.h>
+
+#define PCAP_WRITER_CHUNK_SIZE (1024 * 1024) // Блок рабочего потока
+#define PCAP_WRITER_DEFAULT_MEMORY (64UL * 1024 * 1024)
+
+typedef struct {
+  const char *path;        // Файл; при ротации - префикс path.00000, ...
+  unsigned long long rotate_bytes; // Новый файл после N байт (0 - нет)
+  unsigned int rotate_seconds;     // Новый файл через N секунд (0 - нет)
+  unsigned int snaplen;    // Сколько байт пакета писать (0 - весь захват)
+  unsigned int file_snaplen; // snaplen в заголовке файла без обрезки
+  int linktype;            // DLT_* для заголовка файла
+  size_t buffer_memory;    // Байт на все блоки рабочих потоков
+  int build_index;         // 1 - рядом с каждым файлом индекс (.idx)
+} pcap_writer_options_t;
+
+// Блок записей pcap, который рабочий поток заполняет и передает писателю
+typedef struct pcap_writer_chunk pcap_writer_chunk_t;
+
+// Состояние рабочего потока: пишет только владелец, счетчики читает отчет
+typedef struct {
+  _Alignas(64) pcap_writer_chunk_t *current; // NULL - нет свободного блока
+  double chunk_started; // Когда в блок легла первая запись
+  unsigned long long packets; // Переданы писателю
+  unsigned long long dropped; // Нет свободного блока: диск не успевает
+} pcap_writer_worker_t;
+
+/**
+ * @brief Запись трафика на диск параллельно с анализом.
+ *
+ * Рабочий поток копирует запись pcap (заголовок и до snaplen байт) в свой
+ * блок на 1 МиБ; полный блок уходит писателю через кольцо, взамен берется
+ * свободный. Если свободных блоков нет (диск отстал), пакет не ждет, а
+ * отбрасывается со счетчиком - захват и анализ диском не тормозятся.
+ * Поток писателя собирает блоки в выровненный буфер и пишет его кусками,
+ * кратными 4 КиБ, через O_DIRECT (мимо страничного кэша), открывая новый
+ * файл по размеру или времени. Порядок записей сохраняется внутри рабочего
+ * потока (то есть внутри потока трафика), но не между рабочими потоками.
+ * С build_index писатель строит индекс времени и потоков (capture_index) по
+ * ходу записи и кладет его рядом с файлом при закрытии.
+ *
+ * @param num_workers Количество рабочих потоков.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int pcap_writer_init(int num_workers, const pcap_writer_options_t *options);
+
+void pcap_writer_get_default_options(pcap_writer_options_t *options);
+
+// Состояние рабочего потока, NULL - запись выключена
+pcap_writer_worker_t *pcap_writer_worker_get(int worker_id);
+
+// Копирует пакет в блок рабочего потока (или считает его отброшенным);
+// key - ключ потока для индекса, NULL для пакетов не IP
+void pcap_writer_add(pcap_writer_worker_t *worker,
+                     const struct pcap_pkthdr *header, const u_char *data,
+                     const flow_key_t *key);
+
+// Раз в пачку: отдает писателю неполный блок, если он ждет дольше секунды
+void pcap_writer_worker_tick(pcap_writer_worker_t *worker);
+
+// Счетчики записи с начала работы (все нули, если запись выключена)
+typedef struct {
+  unsigned long long packets; // Записано в файлы
+  unsigned long long bytes;
+  unsigned long long dropped; // Отброшено: диск не успевает
+  unsigned long long files;   // Открыто файлов
+} pcap_writer_stats_t;
+
+// Читается из любого потока без блокировок (до pcap_writer_close)
+void pcap_writer_get_stats(pcap_writer_stats_t *stats);
+
+// Строка отчета за интервал (хук stats_add_report_hook)
+void pcap_writer_report_interval(void);
+
+// Дописывает все блоки, закрывает файл и печатает итог; вызывать после
+// остановки рабочих потоков
+void pcap_writer_close(void);
+
+#endif // PCAP_WRITER_H
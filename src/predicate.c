@@ -0,0 +1,394 @@
+#include "predicate.h"
+#include "transport_parser.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Слова признаков пакета, которые сравнивают проверки
+#define WORD_META 0  // layers, протокол, флаги TCP, ошибки, VLAN
+#define WORD_PORTS 1 // Порты и ключ туннеля
+#define WORD_SRC 2   // Адрес источника (2 слова, IPv4-mapped)
+#define WORD_DST 4   // Адрес назначения (2 слова)
+#define PREDICATE_WORDS 6
+
+#define META_PROTOCOL_SHIFT 16
+#define META_FLAGS_SHIFT 24
+#define META_ERRORS_SHIFT 32
+#define META_VLAN_SHIFT 40
+#define PORTS_DST_SHIFT 16
+#define PORTS_TUNNEL_SHIFT 32
+
+#define PREDICATE_MAX_TOKEN 64
+
+// Скомпилированный предикат: дизъюнкт i - проверки
+// [clause_end[i - 1], clause_end[i])
+static predicate_check_t checks[PREDICATE_MAX_CHECKS];
+static unsigned int clause_end[PREDICATE_MAX_CLAUSES];
+static unsigned int clause_count; // 0 - предикат не задан
+
+// Дизъюнкт во время разбора
+typedef struct {
+  predicate_check_t checks[PREDICATE_MAX_CHECKS];
+  unsigned int count;
+} clause_t;
+
+// Условие: одна проверка или две альтернативы (src или dst)
+typedef struct {
+  predicate_check_t alternatives[2];
+  unsigned int count;
+} atom_t;
+
+typedef struct {
+  const char *text;
+  const char *position;        // Начало текущей лексемы (для ошибок)
+  char token[PREDICATE_MAX_TOKEN]; // Текущая лексема, "" - конец
+} lexer_t;
+
+static void extract_words(const packet_descriptor_t *desc,
+                          u_int64_t words[PREDICATE_WORDS]) {
+  u_int64_t layers = desc->layers;
+  u_int64_t flags = (layers & PACKET_HAS_TCP) ? desc->tcp.flags : 0;
+  u_int64_t vlan =
+      (layers & PACKET_HAS_VLAN) ? (desc->encap.vlan_ids[0] & 0x0FFF) : 0;
+  u_int64_t tunnel = (layers & PACKET_HAS_TUNNEL) ? desc->encap.tunnel_id : 0;
+  u_int64_t ports = (layers & PACKET_HAS_PORTS)
+                        ? (desc->src_port |
+                           ((u_int64_t)desc->dst_port << PORTS_DST_SHIFT))
+                        : 0;
+  words[WORD_META] = layers |
+                     ((u_int64_t)desc->ip_protocol << META_PROTOCOL_SHIFT) |
+                     (flags << META_FLAGS_SHIFT) |
+                     ((u_int64_t)desc->errors << META_ERRORS_SHIFT) |
+                     (vlan << META_VLAN_SHIFT);
+  words[WORD_PORTS] = ports | (tunnel << PORTS_TUNNEL_SHIFT);
+
+  u_int8_t addresses[32];
+  if (layers & PACKET_HAS_IPV4) {
+    memset(addresses, 0, sizeof(addresses));
+    addresses[10] = addresses[11] = addresses[26] = addresses[27] = 0xff;
+    memcpy(addresses + 12, &desc->ipv4.source_ip, 4);
+    memcpy(addresses + 28, &desc->ipv4.destination_ip, 4);
+  } else if (layers & PACKET_HAS_IPV6) {
+    memcpy(addresses, &desc->ipv6.source_ip, 16);
+    memcpy(addresses + 16, &desc->ipv6.destination_ip, 16);
+  } else {
+    memset(addresses, 0, sizeof(addresses));
+  }
+  memcpy(&words[WORD_SRC], addresses, sizeof(addresses));
+}
+
+int predicate_enabled(void) { return clause_count > 0; }
+
+int predicate_match(const packet_descriptor_t *desc) {
+  u_int64_t words[PREDICATE_WORDS];
+  extract_words(desc, words);
+  const predicate_check_t *check = checks;
+  for (unsigned int c = 0; c < clause_count; c++) {
+    // Все проверки дизъюнкта без досрочного выхода: ветвление только на
+    // границе дизъюнктов
+    u_int64_t failed = 0;
+    const predicate_check_t *end = checks + clause_end[c];
+    for (; check < end; check++) {
+      u_int64_t diff =
+          ((words[check->word] & check->mask[0]) ^ check->value[0]) |
+          ((words[check->word + 1] & check->mask[1]) ^ check->value[1]);
+      failed |= (u_int64_t)(diff != 0) ^ check->negate;
+    }
+    if (failed == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// --- Разбор ---
+
+static void lexer_next(lexer_t *lexer) {
+  const char *p = lexer->text;
+  while (isspace((unsigned char)*p)) {
+    p++;
+  }
+  lexer->position = p;
+  size_t length = 0;
+  if (*p == '!' && p[1] != '\0' && p[1] != '=') {
+    length = 1; // "!tcp" - отрицание отдельной лексемой
+  } else {
+    while (p[length] != '\0' && !isspace((unsigned char)p[length])) {
+      length++;
+    }
+  }
+  if (length >= sizeof(lexer->token)) {
+    length = sizeof(lexer->token) - 1;
+  }
+  memcpy(lexer->token, p, length);
+  lexer->token[length] = '\0';
+  lexer->text = p + length;
+}
+
+static int syntax_error(const lexer_t *lexer, const char *expression,
+                        const char *message) {
+  fprintf(stderr, "predicate_compile: %s в позиции %ld (\"%s\")\n", message,
+          (long)(lexer->position - expression) + 1, lexer->token);
+  return -1;
+}
+
+static int parse_number(const char *token, unsigned long max,
+                        unsigned long *value) {
+  char *end;
+  if (!isdigit((unsigned char)token[0])) {
+    return -1;
+  }
+  *value = strtoul(token, &end, 0);
+  return *end == '\0' && *value <= max ? 0 : -1;
+}
+
+static void atom_single(atom_t *atom, int word, u_int64_t mask0,
+                        u_int64_t value0, u_int64_t mask1, u_int64_t value1) {
+  memset(atom, 0, sizeof(*atom));
+  atom->count = 1;
+  predicate_check_t *check = &atom->alternatives[0];
+  check->word = (u_int8_t)word;
+  check->mask[0] = mask0;
+  check->value[0] = value0;
+  check->mask[1] = mask1;
+  check->value[1] = value1;
+}
+
+// Условие с направлением: src, dst или оба (две альтернативы)
+static void atom_directed(atom_t *atom, int direction, int src_word,
+                          int dst_word, const u_int64_t mask[2],
+                          const u_int64_t src_value[2],
+                          const u_int64_t dst_value[2],
+                          const u_int64_t dst_mask[2]) {
+  memset(atom, 0, sizeof(*atom));
+  if (direction <= 0) { // src или без направления
+    predicate_check_t *check = &atom->alternatives[atom->count++];
+    check->word = (u_int8_t)src_word;
+    memcpy(check->mask, mask, sizeof(check->mask));
+    memcpy(check->value, src_value, sizeof(check->value));
+  }
+  if (direction >= 0) { // dst или без направления
+    predicate_check_t *check = &atom->alternatives[atom->count++];
+    check->word = (u_int8_t)dst_word;
+    memcpy(check->mask, dst_mask, sizeof(check->mask));
+    memcpy(check->value, dst_value, sizeof(check->value));
+  }
+}
+
+static int parse_atom(lexer_t *lexer, const char *expression, atom_t *atom) {
+  static const struct {
+    const char *name;
+    u_int16_t layer;
+  } layers[] = {{"ip", PACKET_HAS_IPV4},   {"ip6", PACKET_HAS_IPV6},
+                {"tcp", PACKET_HAS_TCP},   {"udp", PACKET_HAS_UDP},
+                {"icmp", PACKET_HAS_ICMP}, {"mpls", PACKET_HAS_MPLS}};
+  static const struct {
+    const char *name;
+    u_int8_t flag;
+  } flags[] = {{"syn", TCP_FLAG_SYN}, {"ack", TCP_FLAG_ACK},
+               {"fin", TCP_FLAG_FIN}, {"rst", TCP_FLAG_RST},
+               {"psh", TCP_FLAG_PSH}, {"urg", TCP_FLAG_URG}};
+  const char *word = lexer->token;
+  unsigned long number;
+
+  for (size_t i = 0; i < sizeof(layers) / sizeof(layers[0]); i++) {
+    if (strcmp(word, layers[i].name) == 0) {
+      atom_single(atom, WORD_META, layers[i].layer, layers[i].layer, 0, 0);
+      lexer_next(lexer);
+      return 0;
+    }
+  }
+  for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+    if (strcmp(word, flags[i].name) == 0) {
+      u_int64_t flag = (u_int64_t)flags[i].flag << META_FLAGS_SHIFT;
+      atom_single(atom, WORD_META, flag, flag, 0, 0);
+      lexer_next(lexer);
+      return 0;
+    }
+  }
+  if (strcmp(word, "error") == 0) {
+    atom_single(atom, WORD_META, 0xFFULL << META_ERRORS_SHIFT, 0, 0, 0);
+    atom->alternatives[0].negate = 1; // Есть хотя бы одна ошибка
+    lexer_next(lexer);
+    return 0;
+  }
+  if (strcmp(word, "vlan") == 0) {
+    lexer_next(lexer);
+    if (parse_number(lexer->token, 0x0FFF, &number) == 0) {
+      atom_single(atom, WORD_META,
+                  PACKET_HAS_VLAN | (0x0FFFULL << META_VLAN_SHIFT),
+                  PACKET_HAS_VLAN | ((u_int64_t)number << META_VLAN_SHIFT),
+                  0, 0);
+      lexer_next(lexer);
+    } else {
+      atom_single(atom, WORD_META, PACKET_HAS_VLAN, PACKET_HAS_VLAN, 0, 0);
+    }
+    return 0;
+  }
+  if (strcmp(word, "tunnel") == 0) {
+    lexer_next(lexer);
+    if (parse_number(lexer->token, 0xFFFFFFFFUL, &number) == 0) {
+      atom_single(atom, WORD_META, PACKET_HAS_TUNNEL, PACKET_HAS_TUNNEL,
+                  0xFFFFFFFFULL << PORTS_TUNNEL_SHIFT,
+                  (u_int64_t)number << PORTS_TUNNEL_SHIFT);
+      lexer_next(lexer);
+    } else {
+      atom_single(atom, WORD_META, PACKET_HAS_TUNNEL, PACKET_HAS_TUNNEL, 0,
+                  0);
+    }
+    return 0;
+  }
+  if (strcmp(word, "proto") == 0) {
+    lexer_next(lexer);
+    if (parse_number(lexer->token, 255, &number) != 0) {
+      return syntax_error(lexer, expression, "ожидался номер протокола");
+    }
+    atom_single(atom, WORD_META, 0xFFULL << META_PROTOCOL_SHIFT,
+                (u_int64_t)number << META_PROTOCOL_SHIFT, 0, 0);
+    lexer_next(lexer);
+    return 0;
+  }
+
+  // [src|dst] port/host/net
+  int direction = 0; // -1 - src, 1 - dst, 0 - любое
+  if (strcmp(word, "src") == 0 || strcmp(word, "dst") == 0) {
+    direction = word[0] == 's' ? -1 : 1;
+    lexer_next(lexer);
+    word = lexer->token;
+  }
+  if (strcmp(word, "port") == 0) {
+    lexer_next(lexer);
+    if (parse_number(lexer->token, 0xFFFF, &number) != 0) {
+      return syntax_error(lexer, expression, "ожидался номер порта");
+    }
+    // Пара слов: флаг наличия портов и сам порт
+    const u_int64_t src_mask[2] = {PACKET_HAS_PORTS, 0xFFFF};
+    const u_int64_t dst_mask[2] = {PACKET_HAS_PORTS,
+                                   0xFFFFULL << PORTS_DST_SHIFT};
+    const u_int64_t src_value[2] = {PACKET_HAS_PORTS, number};
+    const u_int64_t dst_value[2] = {PACKET_HAS_PORTS,
+                                    (u_int64_t)number << PORTS_DST_SHIFT};
+    atom_directed(atom, direction, WORD_META, WORD_META, src_mask, src_value,
+                  dst_value, dst_mask);
+    lexer_next(lexer);
+    return 0;
+  }
+  if (strcmp(word, "host") == 0 || strcmp(word, "net") == 0) {
+    int is_host = word[0] == 'h';
+    lexer_next(lexer);
+    u_int8_t network[16], mask_bytes[16];
+    int prefix;
+    if (parse_ip_prefix(lexer->token, network, mask_bytes, &prefix) != 0 ||
+        (is_host && strchr(lexer->token, '/') != NULL)) {
+      return syntax_error(lexer, expression,
+                          is_host ? "ожидался адрес" : "ожидалась подсеть");
+    }
+    u_int64_t mask[2], value[2];
+    memcpy(mask, mask_bytes, sizeof(mask));
+    memcpy(value, network, sizeof(value));
+    atom_directed(atom, direction, WORD_SRC, WORD_DST, mask, value, value,
+                  mask);
+    lexer_next(lexer);
+    return 0;
+  }
+  return syntax_error(lexer, expression,
+                      word[0] == '\0' ? "неожиданный конец выражения"
+                                      : "неизвестное условие");
+}
+
+static int is_word(const lexer_t *lexer, const char *word,
+                   const char *symbol) {
+  return strcmp(lexer->token, word) == 0 || strcmp(lexer->token, symbol) == 0;
+}
+
+int predicate_compile(const char *expression) {
+  clause_count = 0;
+  if (expression == NULL || expression[0] == '\0') {
+    return 0;
+  }
+  // Дизъюнкты: готовые и текущая конъюнкция (может размножиться)
+  static clause_t clauses[PREDICATE_MAX_CLAUSES];
+  unsigned int done = 0;     // Готовых дизъюнктов
+  unsigned int current = 1;  // Дизъюнктов текущей конъюнкции
+  unsigned int total_checks = 0;
+  clauses[0].count = 0;
+
+  lexer_t lexer = {expression, expression, ""};
+  lexer_next(&lexer);
+  for (;;) {
+    int negate = 0;
+    while (is_word(&lexer, "not", "!")) {
+      negate ^= 1;
+      lexer_next(&lexer);
+    }
+    atom_t atom;
+    if (parse_atom(&lexer, expression, &atom) != 0) {
+      return -1;
+    }
+    if (negate && atom.count == 2) {
+      // not (src или dst) = not src and not dst
+      atom.alternatives[0].negate ^= 1;
+      atom.alternatives[1].negate ^= 1;
+    } else if (negate) {
+      atom.alternatives[0].negate ^= 1;
+    }
+    // Альтернативы размножают дизъюнкты, отрицание - добавляет обе
+    unsigned int copies = (atom.count == 2 && !negate) ? 2 : 1;
+    unsigned int per_clause = copies == 1 ? atom.count : 1;
+    if (done + current * copies > PREDICATE_MAX_CLAUSES) {
+      return syntax_error(&lexer, expression, "слишком много дизъюнктов");
+    }
+    unsigned int added = 0;
+    for (unsigned int c = 0; c < current; c++) {
+      added += clauses[done + c].count * (copies - 1);
+    }
+    added += current * copies * per_clause;
+    if (total_checks + added > PREDICATE_MAX_CHECKS) {
+      return syntax_error(&lexer, expression, "слишком много условий");
+    }
+    total_checks += added;
+    if (copies == 2) {
+      memcpy(&clauses[done + current], &clauses[done],
+             sizeof(clause_t) * current);
+    }
+    for (unsigned int copy = 0; copy < copies; copy++) {
+      for (unsigned int c = 0; c < current; c++) {
+        clause_t *clause = &clauses[done + copy * current + c];
+        for (unsigned int a = 0; a < per_clause; a++) {
+          clause->checks[clause->count++] = atom.alternatives[copy + a];
+        }
+      }
+    }
+    current *= copies;
+
+    if (lexer.token[0] == '\0') {
+      break;
+    } else if (is_word(&lexer, "and", "&&")) {
+      lexer_next(&lexer);
+    } else if (is_word(&lexer, "or", "||")) {
+      lexer_next(&lexer);
+      done += current;
+      if (done >= PREDICATE_MAX_CLAUSES) {
+        return syntax_error(&lexer, expression, "слишком много дизъюнктов");
+      }
+      current = 1;
+      clauses[done].count = 0;
+    } else {
+      return syntax_error(&lexer, expression, "ожидалось and или or");
+    }
+  }
+  done += current;
+
+  // Плоский массив: дизъюнкты подряд
+  unsigned int count = 0;
+  for (unsigned int c = 0; c < done; c++) {
+    memcpy(&checks[count], clauses[c].checks,
+           sizeof(predicate_check_t) * clauses[c].count);
+    count += clauses[c].count;
+    clause_end[c] = count;
+  }
+  clause_count = done;
+  return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include "packet_descriptor.h"
+#include <sys/types.h>
+
+#define PREDICATE_MAX_CHECKS 64  // Проверок во всех дизъюнктах вместе
+#define PREDICATE_MAX_CLAUSES 16 // Дизъюнктов (конъюнкций, связанных or)
+
+/**
+ * @brief Проверка одного условия над словами признаков пакета.
+ *
+ * Условие верно, если (words[word] & mask[0]) == value[0] и
+ * (words[word + 1] & mask[1]) == value[1]; negate переворачивает
+ * результат. Пара слов позволяет одной проверкой сравнить адрес IPv6 или
+ * вместе с портом проверить флаг его наличия.
+ */
+typedef struct {
+  u_int64_t mask[2];
+  u_int64_t value[2];
+  u_int8_t word;
+  u_int8_t negate;
+} predicate_check_t;
+
+/**
+ * @brief Компилирует выражение над полями разобранного пакета.
+ *
+ * Второй этап фильтрации после BPF: условия проверяются по дескриптору,
+ * поэтому видят метки VLAN, туннели и внутренний пакет. Грамматика:
+ * условия, связанные and (&&) и or (||), and связывает сильнее; not (!)
+ * перед условием. Скобок нет. Условия: ip, ip6, tcp, udp, icmp, vlan [N],
+ * mpls, tunnel [N] (ключ GRE или VNI VXLAN), proto N, syn, ack, fin, rst,
+ * psh, urg, error, [src|dst] port N, [src|dst] host адрес,
+ * [src|dst] net адрес/длина.
+ *
+ * Выражение один раз приводится к дизъюнкции конъюнкций (условие без
+ * src/dst размножает дизъюнкт на два) и хранится плоским массивом
+ * проверок маска/значение; проверка пакета - проход по массиву без
+ * ветвлений внутри дизъюнкта.
+ *
+ * @param expression Текст выражения; NULL или пустая строка снимают
+ *                   предикат.
+ * @return int 0 при успехе, -1 при ошибке разбора (сообщение в stderr).
+ */
+int predicate_compile(const char *expression);
+
+// 1, если предикат задан
+int predicate_enabled(void);
+
+// 1, если пакет удовлетворяет предикату (вызывать при predicate_enabled)
+int predicate_match(const packet_descriptor_t *desc);
+
+#endif // PREDICATE_H
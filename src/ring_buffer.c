@@ -0,0 +1,136 @@
+#include "ring_buffer.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Сколько раз крутиться в ожидании предыдущего производителя/потребителя,
+// прежде чем уступить процессор (его могли вытеснить посреди операции)
+#define RING_TAIL_SPINS_BEFORE_YIELD 1024
+
+unsigned int ring_round_up_pow2(unsigned int value) {
+  unsigned int result = 1;
+  while (result < value && result < (1u << 31)) {
+    result <<= 1;
+  }
+  return result;
+}
+
+int ring_init(ring_buffer_t *ring, unsigned int capacity, unsigned int flags) {
+  if (ring == NULL || capacity == 0) {
+    return -1;
+  }
+  memset(ring, 0, sizeof(*ring));
+  ring->capacity = ring_round_up_pow2(capacity);
+  ring->mask = ring->capacity - 1;
+  ring->flags = flags;
+  ring->slots = calloc(ring->capacity, sizeof(void *));
+  if (ring->slots == NULL) {
+    return -1;
+  }
+  atomic_init(&ring->prod_head, 0);
+  atomic_init(&ring->prod_tail, 0);
+  atomic_init(&ring->cons_head, 0);
+  atomic_init(&ring->cons_tail, 0);
+  return 0;
+}
+
+void ring_destroy(ring_buffer_t *ring) {
+  if (ring == NULL) {
+    return;
+  }
+  free(ring->slots);
+  ring->slots = NULL;
+  ring->capacity = 0;
+  ring->mask = 0;
+}
+
+unsigned int ring_count(const ring_buffer_t *ring) {
+  u_int32_t prod_tail =
+      atomic_load_explicit(&ring->prod_tail, memory_order_acquire);
+  u_int32_t cons_tail =
+      atomic_load_explicit(&ring->cons_tail, memory_order_acquire);
+  return prod_tail - cons_tail;
+}
+
+// Ждем, пока хвост дойдет до нашей головы (предыдущие участники закончили
+// запись/чтение своих слотов), затем публикуем свой диапазон
+static inline void ring_publish_tail(_Atomic u_int32_t *tail,
+                                     u_int32_t old_head, u_int32_t new_head) {
+  unsigned int spins = 0;
+  while (atomic_load_explicit(tail, memory_order_relaxed) != old_head) {
+    if (++spins < RING_TAIL_SPINS_BEFORE_YIELD) {
+      ring_cpu_relax();
+    } else {
+      spins = 0;
+      sched_yield();
+    }
+  }
+  atomic_store_explicit(tail, new_head, memory_order_release);
+}
+
+unsigned int ring_enqueue_burst(ring_buffer_t *ring, void *const *objs,
+                                unsigned int count) {
+  u_int32_t old_head;
+  u_int32_t new_head;
+  unsigned int n;
+
+  // 1. Резервируем слоты сдвигом prod_head
+  old_head = atomic_load_explicit(&ring->prod_head, memory_order_relaxed);
+  do {
+    u_int32_t cons_tail =
+        atomic_load_explicit(&ring->cons_tail, memory_order_acquire);
+    u_int32_t free_entries = ring->capacity + cons_tail - old_head;
+    n = count < free_entries ? count : free_entries;
+    if (n == 0) {
+      return 0;
+    }
+    new_head = old_head + n;
+    if (ring->flags & RING_F_SP_ENQ) {
+      atomic_store_explicit(&ring->prod_head, new_head, memory_order_relaxed);
+      break;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &ring->prod_head, &old_head, new_head, memory_order_relaxed,
+      memory_order_relaxed));
+
+  // 2. Записываем указатели в зарезервированные слоты
+  for (unsigned int i = 0; i < n; i++) {
+    ring->slots[(old_head + i) & ring->mask] = objs[i];
+  }
+
+  // 3. Публикуем для потребителей
+  ring_publish_tail(&ring->prod_tail, old_head, new_head);
+  return n;
+}
+
+unsigned int ring_dequeue_burst(ring_buffer_t *ring, void **objs,
+                                unsigned int count) {
+  u_int32_t old_head;
+  u_int32_t new_head;
+  unsigned int n;
+
+  old_head = atomic_load_explicit(&ring->cons_head, memory_order_relaxed);
+  do {
+    u_int32_t prod_tail =
+        atomic_load_explicit(&ring->prod_tail, memory_order_acquire);
+    u_int32_t entries = prod_tail - old_head;
+    n = count < entries ? count : entries;
+    if (n == 0) {
+      return 0;
+    }
+    new_head = old_head + n;
+    if (ring->flags & RING_F_SC_DEQ) {
+      atomic_store_explicit(&ring->cons_head, new_head, memory_order_relaxed);
+      break;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &ring->cons_head, &old_head, new_head, memory_order_relaxed,
+      memory_order_relaxed));
+
+  for (unsigned int i = 0; i < n; i++) {
+    objs[i] = ring->slots[(old_head + i) & ring->mask];
+  }
+
+  ring_publish_tail(&ring->cons_tail, old_head, new_head);
+  return n;
+}
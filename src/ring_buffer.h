@@ -0,0 +1,79 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define RING_CACHE_LINE_SIZE 64
+
+// Флаги режима кольца: один производитель и/или один потребитель.
+// В однопоточном режиме голова сдвигается простой записью, без CAS.
+#define RING_F_SP_ENQ 0x1
+#define RING_F_SC_DEQ 0x2
+
+/**
+ * @brief Ограниченное lock-free кольцо указателей (MPMC, схема как в
+ * DPDK rte_ring).
+ *
+ * Каждая сторона резервирует диапазон слотов сдвигом своей головы (head),
+ * заполняет/читает его и публикует результат сдвигом хвоста (tail).
+ * Индексы 32-битные и переполняются естественным образом, емкость - степень
+ * двойки. Голова/хвост производителей и потребителей лежат в разных
+ * кэш-линиях, чтобы поток захвата и рабочие потоки не делили одну линию.
+ */
+typedef struct {
+  _Alignas(RING_CACHE_LINE_SIZE) _Atomic u_int32_t prod_head;
+  _Atomic u_int32_t prod_tail;
+  _Alignas(RING_CACHE_LINE_SIZE) _Atomic u_int32_t cons_head;
+  _Atomic u_int32_t cons_tail;
+  _Alignas(RING_CACHE_LINE_SIZE) u_int32_t capacity;
+  u_int32_t mask;
+  unsigned int flags;
+  void **slots;
+} ring_buffer_t;
+
+/**
+ * @brief Инициализирует кольцо.
+ *
+ * @param ring Указатель на кольцо.
+ * @param capacity Желаемая емкость, округляется вверх до степени двойки.
+ * @param flags Комбинация RING_F_SP_ENQ / RING_F_SC_DEQ или 0 (MPMC).
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int ring_init(ring_buffer_t *ring, unsigned int capacity, unsigned int flags);
+
+// Освобождает память слотов (объекты в кольце не трогает)
+void ring_destroy(ring_buffer_t *ring);
+
+/**
+ * @brief Кладет до count указателей в кольцо.
+ *
+ * @return unsigned int Сколько реально положено (0, если кольцо полно).
+ */
+unsigned int ring_enqueue_burst(ring_buffer_t *ring, void *const *objs,
+                                unsigned int count);
+
+/**
+ * @brief Извлекает до count указателей из кольца.
+ *
+ * @return unsigned int Сколько реально извлечено (0, если кольцо пусто).
+ */
+unsigned int ring_dequeue_burst(ring_buffer_t *ring, void **objs,
+                                unsigned int count);
+
+// Приблизительное количество элементов (для статистики и проверок пустоты)
+unsigned int ring_count(const ring_buffer_t *ring);
+
+// Округление вверх до степени двойки (0 -> 1)
+unsigned int ring_round_up_pow2(unsigned int value);
+
+// Подсказка процессору внутри циклов активного ожидания
+static inline void ring_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,281 @@
+#include "stats.h"
+#include "futex_event.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static stats_worker_t *workers; // По блоку на рабочий поток
+static int num_workers_global;
+static stats_producer_t *producers; // По блоку на поток захвата
+static int num_producers_global;
+
+// Номер интервала: меняет только поток отчетов, продюсеры лишь читают
+static _Alignas(64) _Atomic unsigned int refresh_epoch;
+
+static pthread_t reporter_thread;
+static int reporter_started;
+static atomic_int reporter_stop_requested;
+static futex_event_t reporter_wakeup; // Будит поток отчетов при остановке
+static unsigned int reporter_interval_ms;
+static stats_report_hook_fn report_hooks[STATS_MAX_REPORT_HOOKS];
+static int num_report_hooks;
+static char interface_names[STATS_MAX_INTERFACES][32];
+static int num_interfaces;
+
+static const char *const protocol_names[STATS_PROTO_COUNT] = {
+    "TCP", "UDP", "ICMP", "другие IP", "не IP"};
+static const char *const protocol_short_names[STATS_PROTO_COUNT] = {
+    "tcp", "udp", "icmp", "other_ip", "non_ip"};
+
+int stats_init(int num_workers, int num_producers) {
+  if (num_workers <= 0 || num_producers <= 0) {
+    return -1;
+  }
+  workers = aligned_alloc(64, sizeof(stats_worker_t) * num_workers);
+  producers = aligned_alloc(64, sizeof(stats_producer_t) * num_producers);
+  if (workers == NULL || producers == NULL) {
+    perror("stats_init: Ошибка выделения памяти");
+    stats_destroy();
+    return -1;
+  }
+  memset(workers, 0, sizeof(stats_worker_t) * num_workers);
+  memset(producers, 0, sizeof(stats_producer_t) * num_producers);
+  num_workers_global = num_workers;
+  num_producers_global = num_producers;
+  atomic_store(&refresh_epoch, 0);
+  return 0;
+}
+
+stats_worker_t *stats_worker_get(int worker_id) {
+  if (worker_id < 0 || worker_id >= num_workers_global) {
+    return NULL;
+  }
+  return &workers[worker_id];
+}
+
+stats_producer_t *stats_producer_get(int index) {
+  if (index < 0 || index >= num_producers_global) {
+    return NULL;
+  }
+  return &producers[index];
+}
+
+int stats_worker_count(void) { return num_workers_global; }
+
+int stats_interface_count(void) { return num_interfaces; }
+
+const char *stats_interface_name(int interface_id) {
+  if (interface_id < 0 || interface_id >= num_interfaces) {
+    return "";
+  }
+  return interface_names[interface_id];
+}
+
+const char *stats_protocol_name(stats_protocol_t protocol) {
+  return protocol_short_names[protocol];
+}
+
+int stats_producer_set_interface(stats_producer_t *producer,
+                                 const char *name) {
+  for (int i = 0; i < num_interfaces; i++) {
+    if (strcmp(interface_names[i], name) == 0) {
+      producer->interface_id = i;
+      return 0;
+    }
+  }
+  if (num_interfaces >= STATS_MAX_INTERFACES) {
+    return -1;
+  }
+  snprintf(interface_names[num_interfaces], sizeof(interface_names[0]), "%s",
+           name);
+  producer->interface_id = num_interfaces++;
+  return 0;
+}
+
+void stats_destroy(void) {
+  num_report_hooks = 0;
+  num_interfaces = 0;
+  free(workers);
+  free(producers);
+  workers = NULL;
+  producers = NULL;
+  num_workers_global = 0;
+  num_producers_global = 0;
+}
+
+unsigned int stats_current_epoch(void) {
+  return atomic_load_explicit(&refresh_epoch, memory_order_relaxed);
+}
+
+int stats_add_report_hook(stats_report_hook_fn hook) {
+  if (num_report_hooks >= STATS_MAX_REPORT_HOOKS) {
+    return -1;
+  }
+  report_hooks[num_report_hooks++] = hook;
+  return 0;
+}
+
+int stats_kernel_refresh_due(stats_producer_t *producer) {
+  unsigned int epoch =
+      atomic_load_explicit(&refresh_epoch, memory_order_relaxed);
+  if (producer->refresh_epoch == epoch) {
+    return 0;
+  }
+  producer->refresh_epoch = epoch;
+  return 1;
+}
+
+void stats_collect(stats_totals_t *totals) {
+  memset(totals, 0, sizeof(*totals));
+  for (int i = 0; i < num_workers_global; i++) {
+    const stats_worker_t *w = &workers[i];
+    totals->packets += stats_load(&w->packets);
+    totals->bytes += stats_load(&w->bytes);
+    totals->ipv4 += stats_load(&w->ipv4);
+    totals->ipv6 += stats_load(&w->ipv6);
+    for (int p = 0; p < STATS_PROTO_COUNT; p++) {
+      totals->protocols[p] += stats_load(&w->protocols[p]);
+    }
+    totals->parse_errors += stats_load(&w->parse_errors);
+    totals->filtered += stats_load(&w->filtered);
+  }
+  for (int i = 0; i < num_producers_global; i++) {
+    const stats_producer_t *p = &producers[i];
+    totals->captured += stats_load(&p->packets);
+    totals->captured_bytes += stats_load(&p->bytes);
+    totals->queue_full_waits += stats_load(&p->queue_full_waits);
+    totals->queue_full_wait_ns += stats_load(&p->queue_full_wait_ns);
+    totals->kernel_received += stats_load(&p->kernel_received);
+    totals->kernel_drops += stats_load(&p->kernel_drops);
+    totals->kernel_ifdrops += stats_load(&p->kernel_ifdrops);
+    stats_interface_totals_t *iface = &totals->interfaces[p->interface_id];
+    iface->captured += stats_load(&p->packets);
+    iface->captured_bytes += stats_load(&p->bytes);
+    iface->kernel_received += stats_load(&p->kernel_received);
+    iface->kernel_drops += stats_load(&p->kernel_drops);
+  }
+}
+
+// Приращения между двумя снимками: скорости и доля протоколов
+static void print_report(const char *title, const stats_totals_t *before,
+                         const stats_totals_t *after, double seconds) {
+  unsigned long long packets = after->packets - before->packets;
+  unsigned long long bytes = after->bytes - before->bytes;
+  double pps = seconds > 0 ? packets / seconds : 0.0;
+  double mbps = seconds > 0 ? bytes * 8.0 / seconds / 1e6 : 0.0;
+
+  printf("%s (%.2f с): захвачено %llu, обработано %llu пакетов "
+         "(%.0f пак/с, %.2f Мбит/с), IPv4 %llu, IPv6 %llu, ошибок "
+         "разбора %llu\n",
+         title, seconds, after->captured - before->captured, packets, pps,
+         mbps, after->ipv4 - before->ipv4, after->ipv6 - before->ipv6,
+         after->parse_errors - before->parse_errors);
+  if (after->filtered > 0) {
+    printf("  Отброшено предикатом: %llu\n",
+           after->filtered - before->filtered);
+  }
+  printf("  Протоколы:");
+  for (int p = 0; p < STATS_PROTO_COUNT; p++) {
+    unsigned long long count = after->protocols[p] - before->protocols[p];
+    printf("%s %s %.1f%%", p == 0 ? "" : ",", protocol_names[p],
+           packets > 0 ? count * 100.0 / packets : 0.0);
+  }
+  printf("\n");
+  // Доля времени, которую потоки захвата простояли на полном кольце
+  double stall_ms =
+      (after->queue_full_wait_ns - before->queue_full_wait_ns) / 1e6;
+  printf("  Ожиданий места в очереди: %llu (%.1f мс, %.1f%% времени "
+         "захвата)",
+         after->queue_full_waits - before->queue_full_waits, stall_ms,
+         seconds > 0 ? stall_ms / 10.0 / seconds / num_producers_global
+                     : 0.0);
+  if (after->kernel_received > 0) { // При чтении файла счетчиков ядра нет
+    printf("; ядро: принято %llu, отброшено %llu (ps_drop), интерфейсом "
+           "%llu (ps_ifdrop)",
+           after->kernel_received - before->kernel_received,
+           after->kernel_drops - before->kernel_drops,
+           after->kernel_ifdrops - before->kernel_ifdrops);
+  }
+  printf("\n");
+  for (int i = 0; num_interfaces > 1 && i < num_interfaces; i++) {
+    const stats_interface_totals_t *b = &before->interfaces[i];
+    const stats_interface_totals_t *a = &after->interfaces[i];
+    unsigned long long iface_bytes = a->captured_bytes - b->captured_bytes;
+    printf("  %s: захвачено %llu (%.2f Мбит/с), ядро: принято %llu, "
+           "отброшено %llu\n",
+           interface_names[i], a->captured - b->captured,
+           seconds > 0 ? iface_bytes * 8.0 / seconds / 1e6 : 0.0,
+           a->kernel_received - b->kernel_received,
+           a->kernel_drops - b->kernel_drops);
+  }
+  fflush(stdout);
+}
+
+static void *reporter_loop(void *arg) {
+  (void)arg;
+  stats_totals_t previous, current;
+  stats_collect(&previous);
+  double last = monotonic_seconds();
+
+  while (!atomic_load(&reporter_stop_requested)) {
+    u_int32_t seq = futex_event_prepare(&reporter_wakeup);
+    if (atomic_load(&reporter_stop_requested)) {
+      futex_event_cancel(&reporter_wakeup);
+      break;
+    }
+    futex_event_wait(&reporter_wakeup, seq, reporter_interval_ms);
+    double now = monotonic_seconds();
+    // Раньше срока будит только остановка - итог напечатает main
+    if (atomic_load(&reporter_stop_requested) ||
+        now - last < reporter_interval_ms / 1000.0 * 0.5) {
+      continue;
+    }
+    stats_collect(&current);
+    print_report("Статистика за интервал", &previous, &current, now - last);
+    for (int i = 0; i < num_report_hooks; i++) {
+      report_hooks[i]();
+    }
+    // Новый интервал: продюсеры обновят счетчики ядра после ближайшего
+    // захвата, рабочие потоки опубликуют данные для следующих отчетов
+    atomic_fetch_add_explicit(&refresh_epoch, 1, memory_order_relaxed);
+    previous = current;
+    last = now;
+  }
+  return NULL;
+}
+
+int stats_reporter_start(unsigned int interval_ms) {
+  if (interval_ms == 0 || workers == NULL) {
+    return -1;
+  }
+  reporter_interval_ms = interval_ms;
+  atomic_store(&reporter_stop_requested, 0);
+  futex_event_init(&reporter_wakeup);
+  int result = pthread_create(&reporter_thread, NULL, reporter_loop, NULL);
+  if (result != 0) {
+    fprintf(stderr, "Ошибка создания потока отчетов: %s\n", strerror(result));
+    return -1;
+  }
+  reporter_started = 1;
+  return 0;
+}
+
+void stats_reporter_stop(void) {
+  if (!reporter_started) {
+    return;
+  }
+  atomic_store(&reporter_stop_requested, 1);
+  futex_event_notify(&reporter_wakeup, 1);
+  pthread_join(reporter_thread, NULL);
+  reporter_started = 0;
+}
+
+void stats_print_summary(double seconds) {
+  stats_totals_t zero, totals;
+  memset(&zero, 0, sizeof(zero));
+  stats_collect(&totals);
+  print_report("Статистика за все время", &zero, &totals, seconds);
+}
@@ -0,0 +1,161 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <sys/types.h>
+#include <time.h>
+
+// Группы протоколов для доли трафика (stats_worker_t.protocols)
+typedef enum {
+  STATS_PROTO_TCP = 0,
+  STATS_PROTO_UDP = 1,
+  STATS_PROTO_ICMP = 2,     // ICMP и ICMPv6
+  STATS_PROTO_OTHER_IP = 3, // Остальные протоколы поверх IPv4/IPv6
+  STATS_PROTO_NON_IP = 4,   // ARP и прочее
+  STATS_PROTO_COUNT
+} stats_protocol_t;
+
+// Счетчики рабочего потока: пишет только владелец, читает поток отчетов
+typedef struct {
+  _Alignas(64) unsigned long long packets; // Обработано
+  unsigned long long bytes;                // Длина пакетов в сети
+  unsigned long long ipv4;
+  unsigned long long ipv6;
+  unsigned long long protocols[STATS_PROTO_COUNT];
+  unsigned long long parse_errors; // Пакеты хотя бы с одним PACKET_ERR_*
+  unsigned long long filtered;     // Отброшены предикатом (не в packets)
+} stats_worker_t;
+
+// Счетчики потока захвата (продюсера очереди): пишет только владелец
+typedef struct {
+  _Alignas(64) unsigned long long packets; // Захвачено
+  unsigned long long bytes;
+  unsigned long long queue_full_waits; // Сколько раз ждал места в кольце
+  unsigned long long queue_full_wait_ns; // Сколько всего ждал, нс
+  unsigned long long kernel_received;  // pcap_stats ps_recv / tp_packets
+  unsigned long long kernel_drops;     // ps_drop / tp_drops
+  unsigned long long kernel_ifdrops;   // ps_ifdrop
+  unsigned int refresh_epoch; // Последний учтенный запрос потока отчетов
+  int interface_id; // Номер интерфейса (stats_producer_set_interface)
+} stats_producer_t;
+
+#define STATS_MAX_INTERFACES 16 // Интерфейсов с отдельными строками отчета
+
+/**
+ * @brief Счетчики по потокам без общих кэш-линий.
+ *
+ * Каждый блок занимает свои строки кэша и пишется только своим потоком,
+ * поэтому увеличение счетчика - обычные загрузка и запись без lock и без
+ * перебрасывания строки между ядрами. Поток отчетов раз в интервал читает
+ * все блоки (атомарно, но без барьеров) и печатает приращения и скорости.
+ * Счетчики ядра (pcap_stats, PACKET_STATISTICS) обновляет сам поток
+ * захвата, увидев новый интервал (stats_kernel_refresh_due), поэтому в
+ * отчете они отстают не больше чем на интервал.
+ */
+
+// Увеличение счетчика владельцем блока
+static inline void stats_add(unsigned long long *counter,
+                             unsigned long long value) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+                   __ATOMIC_RELAXED);
+}
+
+// Запись накопленного значения (счетчики pcap_stats уже суммарные)
+static inline void stats_set(unsigned long long *counter,
+                             unsigned long long value) {
+  __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline unsigned long long stats_load(const unsigned long long *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Монотонное время в секундах (для замеров скорости и интервалов)
+static inline double monotonic_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// --- Блоки счетчиков (индекс - queue_worker_id и номер потока захвата) ---
+int stats_init(int num_workers, int num_producers);
+stats_worker_t *stats_worker_get(int worker_id);
+stats_producer_t *stats_producer_get(int index);
+int stats_worker_count(void);
+void stats_destroy(void);
+
+// Счетчики захвата одного интерфейса
+typedef struct {
+  unsigned long long captured;
+  unsigned long long captured_bytes;
+  unsigned long long kernel_received;
+  unsigned long long kernel_drops;
+} stats_interface_totals_t;
+
+// Сумма всех блоков на момент чтения
+typedef struct {
+  unsigned long long packets;
+  unsigned long long bytes;
+  unsigned long long ipv4;
+  unsigned long long ipv6;
+  unsigned long long protocols[STATS_PROTO_COUNT];
+  unsigned long long parse_errors;
+  unsigned long long filtered;
+  unsigned long long captured;
+  unsigned long long captured_bytes;
+  unsigned long long queue_full_waits;
+  unsigned long long queue_full_wait_ns;
+  unsigned long long kernel_received;
+  unsigned long long kernel_drops;
+  unsigned long long kernel_ifdrops;
+  stats_interface_totals_t interfaces[STATS_MAX_INTERFACES];
+} stats_totals_t;
+
+// Снимок суммы всех блоков: из любого потока, только загрузки счетчиков
+// (без блокировок и без записи в строки кэша рабочих потоков)
+void stats_collect(stats_totals_t *totals);
+
+// Интерфейсы из stats_producer_set_interface (номер - interface_id)
+int stats_interface_count(void);
+const char *stats_interface_name(int interface_id);
+
+// Короткое имя группы протоколов ("tcp", "udp", ...)
+const char *stats_protocol_name(stats_protocol_t protocol);
+
+// Привязывает продюсера к интерфейсу (до запуска захвата). Если
+// интерфейсов больше одного, отчет печатает строку на каждый; продюсеры с
+// одним именем (несколько сокетов на интерфейс) суммируются. -1, если
+// интерфейсов больше STATS_MAX_INTERFACES
+int stats_producer_set_interface(stats_producer_t *producer,
+                                 const char *name);
+
+// 1, если поток отчетов начал новый интервал и продюсеру пора обновить
+// счетчики ядра (проверка - одна загрузка строки, которая меняется раз в
+// интервал)
+int stats_kernel_refresh_due(stats_producer_t *producer);
+
+// Номер текущего интервала отчетов (растет при каждом отчете)
+unsigned int stats_current_epoch(void);
+
+// Дополнительный отчет (например, самые активные адреса): поток отчетов
+// вызывает его каждый интервал после своей строки
+typedef void (*stats_report_hook_fn)(void);
+#define STATS_MAX_REPORT_HOOKS 8
+
+// Регистрирует отчет до stats_reporter_start; -1, если мест нет
+int stats_add_report_hook(stats_report_hook_fn hook);
+
+/**
+ * @brief Запускает поток отчетов.
+ *
+ * @param interval_ms Интервал между отчетами в миллисекундах.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int stats_reporter_start(unsigned int interval_ms);
+
+// Останавливает поток отчетов (если запущен) и дожидается его
+void stats_reporter_stop(void);
+
+// Итог за все время работы; seconds - длительность для средних скоростей
+void stats_print_summary(double seconds);
+
+#endif // STATS_H
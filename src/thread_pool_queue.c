@@ -1,31 +1,319 @@
 #include "thread_pool_queue.h"
+#include "flow_hash.h"
+#include "futex_event.h"
+#include "latency.h"
+#include "packet_pool.h"
+#include "ring_buffer.h"
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-#define QUEUE_CAPACITY 100 // Примерный максимальный размер очереди
+// Таймаут сна на futex: страховка, чтобы спящий поток периодически
+// перепроверял флаг остановки
+#define QUEUE_WAIT_TIMEOUT_MS 100
+// Запас слотов пула на задачи, которые продюсеры уже взяли из пула, но еще
+// ждут места в кольце (не меньше одной неполной пачки packet_batch_t)
+#define QUEUE_POOL_PRODUCER_SLACK QUEUE_MAX_BATCH
 
-static packet_task_t
-    *task_queue[QUEUE_CAPACITY]; // Сама очередь (циклический буфер)
-static int queue_count = 0; // Текущее количество элементов в очереди
-static int queue_head = 0; // Индекс для извлечения (голова)
-static int queue_tail = 0; // Индекс для добавления (хвост)
+// Кольцо задач и событие "кольцо не пусто" одного рабочего потока (или
+// общее кольцо в режиме QUEUE_DISPATCH_SHARED)
+typedef struct {
+  ring_buffer_t ring;
+  ring_buffer_t forwarded; // Задачи от других рабочих потоков (если
+                           // forwarding_enabled)
+  futex_event_t not_empty; // Ждут рабочие потоки этого кольца
+  // Группа продюсера, который кормит это кольцо (queue_set_producer_group):
+  // в нее же передаются пакеты, порожденные рабочим потоком. 0 - все кольца
+  int group_first;
+  int group_count;
+} worker_queue_t;
 
-static pthread_mutex_t queue_mutex; // Мьютекс для защиты очереди
-static pthread_cond_t queue_not_empty_cond;
-static pthread_cond_t queue_not_full_cond;
+static worker_queue_t *worker_queues; // Сами очереди (lock-free кольца)
+static int num_queues_global;
+static int forwarding_enabled; // Кольца передачи: по хэшу и колец больше 1
+static _Atomic unsigned long long forwarded_count;
+static _Atomic unsigned long long forward_dropped_count;
+static futex_event_t queue_not_full_event; // Ждет поток захвата
+static packet_pool_t task_pool; // Заранее выделенные слоты задач
+static queue_stats_t final_stats; // Снимок счетчиков при shutdown
+static queue_options_t queue_options = {
+    QUEUE_DEFAULT_CAPACITY, QUEUE_DEFAULT_SPIN_COUNT, QUEUE_DEFAULT_SNAPLEN, 0,
+    0, QUEUE_DISPATCH_FLOW, QUEUE_DEFAULT_BATCH_SIZE, 1};
 
 static pthread_t *worker_threads; // Массив для хранения рабочих потоков
 static int num_threads_global;
 static packet_processing_fn processing_function_handler; // Указатель на функцию
-static volatile int keep_running_global = 1; // Флаг для остановки потоков
+static packet_batch_processing_fn batch_function_handler; // Пакетный вариант
+static atomic_int keep_running_global = 1; // Флаг для остановки потоков
+static __thread int current_worker_id = -1; // Номер рабочего потока
+// Группа колец потока-продюсера (queue_set_producer_group), 0 - все кольца
+static __thread int producer_first_queue = 0;
+static __thread int producer_queue_count = 0;
+static __thread stats_producer_t *producer_stats = NULL;
 static void *worker_loop(void *arg);
 
 // --- Реализация функций ---
-// --- Добавление пакета---
+void queue_get_default_options(queue_options_t *options) {
+  options->capacity = QUEUE_DEFAULT_CAPACITY;
+  options->spin_count = QUEUE_DEFAULT_SPIN_COUNT;
+  options->snaplen = QUEUE_DEFAULT_SNAPLEN;
+  options->pool_size = 0;
+  options->use_huge_pages = 0;
+  options->dispatch_mode = QUEUE_DISPATCH_FLOW;
+  options->batch_size = QUEUE_DEFAULT_BATCH_SIZE;
+  options->producers = 1;
+}
+
+void queue_set_options(const queue_options_t *options) {
+  queue_options = *options;
+  if (queue_options.capacity == 0) {
+    queue_options.capacity = QUEUE_DEFAULT_CAPACITY;
+  }
+  if (queue_options.snaplen == 0) {
+    queue_options.snaplen = QUEUE_DEFAULT_SNAPLEN;
+  }
+  if (queue_options.batch_size == 0) {
+    queue_options.batch_size = 1;
+  }
+  if (queue_options.batch_size > QUEUE_MAX_BATCH) {
+    queue_options.batch_size = QUEUE_MAX_BATCH;
+  }
+}
+
+void queue_get_stats(queue_stats_t *stats) {
+  if (task_pool.memory == NULL) {
+    *stats = final_stats;
+    return;
+  }
+  stats->pool_exhausted =
+      atomic_load_explicit(&task_pool.exhausted, memory_order_relaxed);
+  stats->truncated =
+      atomic_load_explicit(&task_pool.truncated, memory_order_relaxed);
+  stats->forwarded =
+      atomic_load_explicit(&forwarded_count, memory_order_relaxed);
+  stats->forward_dropped =
+      atomic_load_explicit(&forward_dropped_count, memory_order_relaxed);
+}
+
+unsigned int queue_depth(void) {
+  unsigned int depth = 0;
+  for (int i = 0; i < num_queues_global; i++) {
+    depth += ring_count(&worker_queues[i].ring);
+    if (forwarding_enabled) {
+      depth += ring_count(&worker_queues[i].forwarded);
+    }
+  }
+  return depth;
+}
+
+int queue_worker_id(void) { return current_worker_id; }
+
+// Задачи в кольцах рабочего потока: свое и кольцо передачи
+static unsigned int queue_task_count(const worker_queue_t *queue) {
+  unsigned int count = ring_count(&queue->ring);
+  if (forwarding_enabled) {
+    count += ring_count(&queue->forwarded);
+  }
+  return count;
+}
+
+// Условия пробуждения. Остановка тоже считается поводом проснуться.
+static int queue_has_space(const worker_queue_t *queue) {
+  return !atomic_load_explicit(&keep_running_global, memory_order_relaxed) ||
+         ring_count(&queue->ring) < queue->ring.capacity;
+}
+
+static int queue_has_tasks(const worker_queue_t *queue) {
+  return !atomic_load_explicit(&keep_running_global, memory_order_relaxed) ||
+         queue_task_count(queue) > 0;
+}
+
+// Адаптивное ожидание: сначала короткое активное ожидание (дешево, если
+// другая сторона вот-вот освободит место/положит задачу), затем сон на futex
+static void queue_adaptive_wait(futex_event_t *event,
+                                const worker_queue_t *queue,
+                                int (*condition)(const worker_queue_t *)) {
+  for (unsigned int i = 0; i < queue_options.spin_count; i++) {
+    if (condition(queue)) {
+      return;
+    }
+    ring_cpu_relax();
+  }
+  u_int32_t seq = futex_event_prepare(event);
+  if (condition(queue)) {
+    futex_event_cancel(event);
+    return;
+  }
+  futex_event_wait(event, seq, QUEUE_WAIT_TIMEOUT_MS);
+}
+
+// Кольцо, в которое попадет пакет с данным хэшем потока. Умножение вместо
+// деления по модулю: равномерно и без дорогой операции div.
+static inline worker_queue_t *queue_for_hash(u_int32_t flow_hash) {
+  if (producer_queue_count == 0 || num_queues_global == 1) {
+    return &worker_queues[((u_int64_t)flow_hash *
+                           (u_int64_t)num_queues_global) >>
+                          32];
+  }
+  return &worker_queues[producer_first_queue +
+                        (((u_int64_t)flow_hash *
+                          (u_int64_t)producer_queue_count) >>
+                         32)];
+}
+
+void queue_set_producer_group(int first_worker, int worker_count) {
+  producer_first_queue = 0;
+  producer_queue_count = 0;
+  if (worker_count <= 0 || first_worker < 0 ||
+      first_worker + worker_count > num_queues_global) {
+    return; // Все кольца
+  }
+  producer_first_queue = first_worker;
+  producer_queue_count = worker_count;
+  // Рабочие потоки группы увидят ее раньше первой задачи продюсера (запись
+  // до постановки в кольцо)
+  for (int i = first_worker; i < first_worker + worker_count; i++) {
+    worker_queues[i].group_first = first_worker;
+    worker_queues[i].group_count = worker_count;
+  }
+}
+
+void queue_set_producer_stats(stats_producer_t *stats) {
+  producer_stats = stats;
+}
+
+static void destroy_worker_queues(int count) {
+  for (int i = 0; i < count; i++) {
+    ring_destroy(&worker_queues[i].ring);
+    if (forwarding_enabled) {
+      ring_destroy(&worker_queues[i].forwarded);
+    }
+  }
+  free(worker_queues);
+  worker_queues = NULL;
+  num_queues_global = 0;
+  forwarding_enabled = 0;
+}
+
+static void wake_all_threads(void) {
+  for (int i = 0; i < num_queues_global; i++) {
+    futex_event_notify(&worker_queues[i].not_empty, 1);
+  }
+  futex_event_notify(&queue_not_full_event, 1);
+}
+
+// Возвращает задачи в пул, сначала освобождая внешние буферы (zero-copy)
+static void release_tasks(packet_task_t **tasks, unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    if (tasks[i]->release != NULL) {
+      tasks[i]->release(tasks[i]->release_cookie);
+    }
+  }
+  packet_pool_free_bulk(&task_pool, tasks, count);
+}
+
+static u_int64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u_int64_t)ts.tv_sec * 1000000000ULL + (u_int64_t)ts.tv_nsec;
+}
+
+// Кладет count задач в кольцо, ожидая места, если оно заполнено. При
+// остановке непоставленные задачи возвращаются в пул.
+static void enqueue_tasks(worker_queue_t *queue, packet_task_t **tasks,
+                          unsigned int count) {
+  unsigned int done = 0;
+  u_int64_t wait_start = 0; // Часы читаются только при ожидании
+  while (done < count) {
+    done += ring_enqueue_burst(&queue->ring, (void **)(tasks + done),
+                               count - done);
+    if (done == count) {
+      break;
+    }
+    if (!atomic_load_explicit(&keep_running_global, memory_order_relaxed)) {
+      // Остановка, пакеты не будут добавлены
+      release_tasks(tasks + done, count - done);
+      break;
+    }
+    if (producer_stats != NULL) {
+      stats_add(&producer_stats->queue_full_waits, 1);
+      if (wait_start == 0) {
+        wait_start = monotonic_ns();
+      }
+    }
+    queue_adaptive_wait(&queue_not_full_event, queue, queue_has_space);
+  }
+  if (wait_start != 0) {
+    stats_add(&producer_stats->queue_full_wait_ns,
+              monotonic_ns() - wait_start);
+  }
+  // Сигнализировать, что очередь не пуста (только если кто-то спит)
+  futex_event_notify(&queue->not_empty, 0);
+}
+
+// Берет слот из пула, копирует пакет и считает хэш потока
+static packet_task_t *prepare_task(const struct pcap_pkthdr *pkthdr,
+                                   const u_char *packet_content) {
+  // Берем слот из пула (без malloc); пустой пул учитывается в счетчике
+  packet_task_t *new_task = packet_pool_alloc(&task_pool);
+  if (new_task == NULL) {
+    return NULL;
+  }
+  // Скопировать pkthdr и packet_content в слот
+  packet_pool_fill(&task_pool, new_task, pkthdr, packet_content);
+  // Хэш потока определяет кольцо: все пакеты потока (в обе стороны) идут
+  // одному рабочему потоку и сохраняют порядок
+  new_task->flow_hash =
+      flow_hash_packet(new_task->packet_data, new_task->header.caplen);
+  return new_task;
+}
+
+// Время постановки для гистограмм задержки при чтении файла (одно чтение
+// часов на пачку)
+static void stamp_enqueue(packet_task_t **tasks, unsigned int count) {
+  if (!latency_enabled() || latency_origin() != LATENCY_FROM_ENQUEUE) {
+    return;
+  }
+  u_int64_t now = latency_now_ns();
+  for (unsigned int i = 0; i < count; i++) {
+    tasks[i]->enqueue_ns = now;
+  }
+}
+
+// Задержки пачки: от начала отсчета (метка pcap или постановка) до
+// извлечения и до конца обработки; отрицательные (часы сдвинули) - 0
+static void record_latency(latency_worker_t *latency, packet_task_t **tasks,
+                           unsigned int count, u_int64_t dequeue_ns) {
+  u_int64_t done_ns = latency_now_ns();
+  int from_capture = latency_origin() == LATENCY_FROM_CAPTURE;
+  for (unsigned int i = 0; i < count; i++) {
+    const packet_task_t *task = tasks[i];
+    u_int64_t start_ns =
+        from_capture ? (u_int64_t)task->header.ts.tv_sec * 1000000000ULL +
+                           (u_int64_t)task->header.ts.tv_usec * 1000ULL
+                     : task->enqueue_ns;
+    latency_record(&latency->metrics[LATENCY_QUEUE_WAIT],
+                   dequeue_ns > start_ns ? dequeue_ns - start_ns : 0, 1);
+    latency_record(&latency->metrics[LATENCY_TOTAL],
+                   done_ns > start_ns ? done_ns - start_ns : 0, 1);
+  }
+  latency_record(&latency->metrics[LATENCY_PROCESSING],
+                 done_ns > dequeue_ns ? done_ns - dequeue_ns : 0, count);
+}
+
+// --- Инициализация ---
 int queue_init(int num_worker_threads,
                packet_processing_fn processing_function) {
+  return queue_init_batch(num_worker_threads, processing_function, NULL);
+}
+
+int queue_init_batch(int num_worker_threads,
+                     packet_processing_fn processing_function,
+                     packet_batch_processing_fn batch_function) {
   printf("queue_init: Инициализация с %d потоками.\n", num_worker_threads);
   // Проверка входных данных
   if (num_worker_threads <= 0) {
@@ -36,43 +324,96 @@ int queue_init(int num_worker_threads,
     fprintf(stderr, "Не передана функция обработки пакетов\n");
     return -1;
   }
-  // Сохраняем указатель на функцию
+  // Сохраняем указатели на функции
   processing_function_handler = processing_function;
+  batch_function_handler = batch_function;
   // Сохраняем количество потоков
   num_threads_global = num_worker_threads;
-  // Устанавливаем флаг и переменные управления очередью
-  keep_running_global = 1;
-  queue_count = 0;
-  queue_head = 0;
-  queue_tail = 0;
-  // Мьютекс, условные переменные
-  if (pthread_mutex_init(&queue_mutex, NULL) != 0) {
-    perror("queue_init: Ошибка инициализации мьютекса");
-    return -1;
-  }
-  if (pthread_cond_init(&queue_not_empty_cond, NULL) != 0) {
-    perror("queue_init: Ошибка инициализации условной переменной "
-           "queue_not_empty_cond");
-    pthread_mutex_destroy(&queue_mutex);
+  // Устанавливаем флаг
+  atomic_store(&keep_running_global, 1);
 
+  // Кольца задач: по одному на рабочий поток (емкость делится между ними)
+  // или одно общее
+  int flow_dispatch = queue_options.dispatch_mode == QUEUE_DISPATCH_FLOW;
+  int num_queues = flow_dispatch ? num_worker_threads : 1;
+  unsigned int ring_capacity = queue_options.capacity / (unsigned int)num_queues;
+  if (ring_capacity < QUEUE_MIN_RING_CAPACITY) {
+    ring_capacity = QUEUE_MIN_RING_CAPACITY;
+  }
+  worker_queues = aligned_alloc(RING_CACHE_LINE_SIZE,
+                                sizeof(worker_queue_t) * (size_t)num_queues);
+  if (worker_queues == NULL) {
+    perror("queue_init: Ошибка выделения памяти для колец задач");
     return -1;
   }
-  if (pthread_cond_init(&queue_not_full_cond, NULL) != 0) {
-    perror("queue_init: Ошибка инициализации условной переменной "
-           "queue_not_full_cond");
-    pthread_cond_destroy(&queue_not_empty_cond);
-    pthread_mutex_destroy(&queue_mutex);
+  // Передавать задачи между рабочими потоками есть смысл, только если
+  // у каждого свое кольцо
+  forwarding_enabled = flow_dispatch && num_queues > 1;
+  for (int i = 0; i < num_queues; i++) {
+    // У кольца рабочего потока ровно один потребитель
+    if (ring_init(&worker_queues[i].ring, ring_capacity,
+                  flow_dispatch ? RING_F_SC_DEQ : 0) != 0) {
+      perror("queue_init: Ошибка выделения памяти для кольца задач");
+      destroy_worker_queues(i);
+      return -1;
+    }
+    if (forwarding_enabled &&
+        ring_init(&worker_queues[i].forwarded, QUEUE_FORWARD_RING_CAPACITY,
+                  RING_F_SC_DEQ) != 0) {
+      perror("queue_init: Ошибка выделения памяти для кольца передачи");
+      ring_destroy(&worker_queues[i].ring);
+      destroy_worker_queues(i);
+      return -1;
+    }
+    futex_event_init(&worker_queues[i].not_empty);
+    worker_queues[i].group_first = 0;
+    worker_queues[i].group_count = 0;
+  }
+  num_queues_global = num_queues;
 
+  // Пул задач: по слоту на каждое место в кольцах, на пачку задач, которую
+  // держит каждый рабочий поток, и на пачку каждого продюсера. Поэтому при
+  // нормальной работе продюсер упирается в заполненное кольцо раньше, чем в
+  // пустой пул. Кольца передачи между рабочими потоками - сверх того
+  unsigned int pool_size = queue_options.pool_size;
+  if (pool_size == 0) {
+    unsigned int producers =
+        queue_options.producers > 0 ? queue_options.producers : 1;
+    pool_size = worker_queues[0].ring.capacity * (unsigned int)num_queues +
+                (unsigned int)num_worker_threads * queue_options.batch_size +
+                producers * QUEUE_POOL_PRODUCER_SLACK;
+    if (forwarding_enabled) {
+      pool_size +=
+          worker_queues[0].forwarded.capacity * (unsigned int)num_queues;
+    }
+  }
+  if (packet_pool_init(&task_pool, pool_size, queue_options.snaplen,
+                       queue_options.use_huge_pages) != 0) {
+    destroy_worker_queues(num_queues);
     return -1;
   }
+  memset(&final_stats, 0, sizeof(final_stats));
+  atomic_store(&forwarded_count, 0);
+  atomic_store(&forward_dropped_count, 0);
+  printf("queue_init: Пул задач: %u слотов по %zu байт (%s).\n", pool_size,
+         task_pool.slot_size,
+         task_pool.huge_pages ? "huge pages" : "обычные страницы");
+  futex_event_init(&queue_not_full_event);
+  // На одном ядре активное ожидание бессмысленно: другая сторона не может
+  // выполняться, пока мы крутимся
+  if (sysconf(_SC_NPROCESSORS_ONLN) == 1) {
+    queue_options.spin_count = 0;
+  }
+  printf("queue_init: %s: колец задач %d, емкость каждого %u, пачка до %u.\n",
+         flow_dispatch ? "Распределение по хэшу потока" : "Общая очередь",
+         num_queues, worker_queues[0].ring.capacity, queue_options.batch_size);
+
   // Выделяем память под worker_threads
   worker_threads = malloc(num_worker_threads * sizeof(pthread_t));
   if (worker_threads == NULL) {
     perror("queue_init: Ошибка выделения памяти для worker_threads");
-    pthread_cond_destroy(&queue_not_empty_cond);
-    pthread_cond_destroy(&queue_not_full_cond);
-    pthread_mutex_destroy(&queue_mutex);
-
+    packet_pool_destroy(&task_pool);
+    destroy_worker_queues(num_queues);
     return -1;
   }
 
@@ -84,12 +425,8 @@ int queue_init(int num_worker_threads,
     if (result != 0) {
       fprintf(stderr, "Ошибка создания потока #%d: %s\n", i, strerror(result));
 
-      pthread_mutex_lock(&queue_mutex); // Захватываем для избежания гонки
-
-      keep_running_global = 0;
-      pthread_cond_broadcast(&queue_not_empty_cond);
-      pthread_cond_broadcast(&queue_not_full_cond);
-      pthread_mutex_unlock(&queue_mutex); // Освобождаем
+      atomic_store(&keep_running_global, 0);
+      wake_all_threads();
 
       for (int j = 0; j < i;
            ++j) { // j < i что бы не особождать не созданные потоки
@@ -103,12 +440,9 @@ int queue_init(int num_worker_threads,
         }
       }
       free(worker_threads);
-      worker_threads =
-          NULL; // Освобождаем массивы и указатели, мьютексы и переменные
-
-      pthread_cond_destroy(&queue_not_full_cond);
-      pthread_cond_destroy(&queue_not_empty_cond);
-      pthread_mutex_destroy(&queue_mutex);
+      worker_threads = NULL; // Освобождаем массивы и указатели, кольца, пул
+      packet_pool_destroy(&task_pool);
+      destroy_worker_queues(num_queues);
       return -1;
     }
   }
@@ -119,67 +453,159 @@ int queue_init(int num_worker_threads,
 // --- Добавление пакета ---
 void queue_add_packet(const struct pcap_pkthdr *pkthdr,
                       const u_char *packet_content) {
-  printf("queue_add_packet: Добавлен пакет, caplen %d.\n", pkthdr->caplen);
+  if (!atomic_load_explicit(&keep_running_global, memory_order_relaxed)) {
+    return;
+  }
 
-  // Заблокировать мьютекс
-  pthread_mutex_lock(&queue_mutex);
+  packet_task_t *new_task = prepare_task(pkthdr, packet_content);
+  if (new_task == NULL) {
+    return;
+  }
+  stamp_enqueue(&new_task, 1);
+  // Положить задачу в кольцо ее потока; если оно полно - подождать (на
+  // queue_not_full_event)
+  enqueue_tasks(queue_for_hash(new_task->flow_hash), &new_task, 1);
+}
 
-  // Подождать, если очередь полна (на queue_not_full_cond)
-  while (queue_count == QUEUE_CAPACITY && keep_running_global) {
-    printf("Продюсер: очередь полна (%d), ожидание...\n", queue_count);
-    pthread_cond_wait(&queue_not_full_cond, &queue_mutex);
-    printf("Продюсер: проснулся после ожидания на queue_not_full_cond.\n");
+void queue_batch_add(packet_batch_t *batch, const struct pcap_pkthdr *pkthdr,
+                     const u_char *packet_content) {
+  if (!atomic_load_explicit(&keep_running_global, memory_order_relaxed)) {
+    return;
   }
-  if (!keep_running_global) {
-    pthread_mutex_unlock(&queue_mutex);
-    // printf("Продюсер: остановка, пакет не будет добавлен.\n");
+  packet_task_t *new_task = prepare_task(pkthdr, packet_content);
+  if (new_task == NULL) {
     return;
   }
+  batch->tasks[batch->count++] = new_task;
+  if (batch->count == QUEUE_MAX_BATCH) {
+    queue_add_packet_batch(batch);
+  }
+}
 
-  // Выделяем память под packet_task_t и packet_task_t->packet_data
-  packet_task_t *new_task = malloc(sizeof(*new_task));
+void queue_batch_add_zero_copy(packet_batch_t *batch,
+                               const struct pcap_pkthdr *pkthdr,
+                               const u_char *packet_content,
+                               packet_release_fn release, void *cookie) {
+  packet_task_t *new_task = NULL;
+  if (atomic_load_explicit(&keep_running_global, memory_order_relaxed)) {
+    new_task = packet_pool_alloc(&task_pool);
+  }
   if (new_task == NULL) {
-    perror("queue_add_packet: Ошибка malloc для packet_task_t");
-    pthread_mutex_unlock(&queue_mutex); // Освободить мьютекс перед выходом
-    // Можно сделать более сложную логику обработки ошибок!!!!!!!!!!!!
+    release(cookie); // Пакет отброшен - буфер больше не нужен
     return;
   }
-  new_task->packet_data = (u_char *)malloc(pkthdr->caplen); // Используем caplen
-  if (new_task->packet_data == NULL) {
-    perror("queue_add_packet: Ошибка malloc для packet_data");
-    free(new_task); // Освободить память для структуры
-    pthread_mutex_unlock(&queue_mutex);
-    return;
+  // Слот хранит только заголовок и указатель на внешний буфер
+  new_task->header = *pkthdr;
+  new_task->packet_data = (u_char *)packet_content;
+  new_task->release = release;
+  new_task->release_cookie = cookie;
+  new_task->flow_hash = flow_hash_packet(packet_content, pkthdr->caplen);
+  batch->tasks[batch->count++] = new_task;
+  if (batch->count == QUEUE_MAX_BATCH) {
+    queue_add_packet_batch(batch);
   }
+}
 
-  // Скопировать pkthdr и packet_content в новую задачу
-  new_task->header = *pkthdr; // Копирование структуры заголовка pcap
-  memcpy(new_task->packet_data, packet_content, pkthdr->caplen);
+void queue_add_packet_batch(packet_batch_t *batch) {
+  packet_task_t *group[QUEUE_MAX_BATCH];
+  worker_queue_t *targets[QUEUE_MAX_BATCH];
+  unsigned char taken[QUEUE_MAX_BATCH];
+  unsigned int count = batch->count;
 
-  // Добавить задачу в task_queue, обновить queue_tail, queue_count
-  task_queue[queue_tail] = new_task;
-  queue_tail = (queue_tail + 1) % QUEUE_CAPACITY;
-  queue_count++;
-  printf("Продюсер: пакет добавлен. Задач в очереди: %d\n", queue_count);
+  stamp_enqueue(batch->tasks, count);
+  for (unsigned int i = 0; i < count; i++) {
+    targets[i] = queue_for_hash(batch->tasks[i]->flow_hash);
+    taken[i] = 0;
+  }
+  // Группируем задачи по кольцам, сохраняя порядок внутри каждого кольца
+  for (unsigned int i = 0; i < count; i++) {
+    if (taken[i]) {
+      continue;
+    }
+    unsigned int group_size = 0;
+    for (unsigned int j = i; j < count; j++) {
+      if (!taken[j] && targets[j] == targets[i]) {
+        group[group_size++] = batch->tasks[j];
+        taken[j] = 1;
+      }
+    }
+    enqueue_tasks(targets[i], group, group_size);
+  }
+  batch->count = 0;
+}
 
-  // Сигнализировать, что очередь не пуста (queue_not_empty_cond)
-  pthread_cond_signal(&queue_not_empty_cond);
-  pthread_mutex_unlock(&queue_mutex);
+int queue_forward_packet(const struct pcap_pkthdr *pkthdr,
+                         const u_char *packet_content, u_int32_t flow_hash) {
+  int worker_id = current_worker_id;
+  if (!forwarding_enabled || worker_id < 0) {
+    return 1;
+  }
+  // Кольцо выбирается так же, как у продюсера группы (queue_for_hash)
+  const worker_queue_t *own = &worker_queues[worker_id];
+  int first = own->group_count > 0 ? own->group_first : 0;
+  int count = own->group_count > 0 ? own->group_count : num_queues_global;
+  int target =
+      first + (int)(((u_int64_t)flow_hash * (u_int64_t)count) >> 32);
+  if (target == worker_id) {
+    return 1;
+  }
+  packet_task_t *task = packet_pool_alloc(&task_pool);
+  if (task == NULL) {
+    atomic_fetch_add_explicit(&forward_dropped_count, 1, memory_order_relaxed);
+    return -1;
+  }
+  if (pkthdr->caplen <= task_pool.data_size) {
+    packet_pool_fill(&task_pool, task, pkthdr, packet_content);
+  } else {
+    // Слот мал (пул zero-copy хранит только заголовок): внешний буфер,
+    // освобождается после обработки, как буфер zero-copy
+    u_char *copy = malloc(pkthdr->caplen);
+    if (copy == NULL) {
+      packet_pool_free(&task_pool, task);
+      atomic_fetch_add_explicit(&forward_dropped_count, 1,
+                                memory_order_relaxed);
+      return -1;
+    }
+    memcpy(copy, packet_content, pkthdr->caplen);
+    task->header = *pkthdr;
+    task->packet_data = copy;
+    task->release = free;
+    task->release_cookie = copy;
+  }
+  task->flow_hash = flow_hash;
+  task->forwarded = 1;
+  stamp_enqueue(&task, 1);
+  worker_queue_t *queue = &worker_queues[target];
+  if (ring_enqueue_burst(&queue->forwarded, (void **)&task, 1) != 1) {
+    release_tasks(&task, 1);
+    atomic_fetch_add_explicit(&forward_dropped_count, 1, memory_order_relaxed);
+    return -1;
+  }
+  atomic_fetch_add_explicit(&forwarded_count, 1, memory_order_relaxed);
+  futex_event_notify(&queue->not_empty, 0);
+  return 0;
+}
+
+// Обработка извлеченных задач функцией, заданной в queue_init_batch
+static void process_tasks(packet_task_t **tasks, unsigned int count) {
+  if (batch_function_handler != NULL) {
+    batch_function_handler(tasks, count);
+  } else if (processing_function_handler != NULL) {
+    for (unsigned int i = 0; i < count; i++) {
+      processing_function_handler(tasks[i]);
+    }
+  }
 }
 // --- Закрытие очереди ---
 void queue_shutdown() {
   printf("queue_shutdown: Завершение работы.\n");
-  // Установить keep_running_global = 0
-
-  // Разбудить все потоки (broadcast на обе условные переменные)
-  pthread_mutex_lock(&queue_mutex);
-  keep_running_global = 0;
-  printf("queue_shutdown: Отправка broadcast на условные переменные...\n");
-  pthread_cond_broadcast(&queue_not_empty_cond);
-  pthread_cond_broadcast(&queue_not_full_cond);
-  pthread_mutex_unlock(&queue_mutex);
+  // Установить keep_running_global = 0 и разбудить все потоки
+  atomic_store(&keep_running_global, 0);
+  printf("queue_shutdown: Пробуждение ожидающих потоков...\n");
+  wake_all_threads();
 
-  // Дождаться завершения всех рабочих потоков (pthread_join)
+  // Дождаться завершения всех рабочих потоков (pthread_join). Перед выходом
+  // они дорабатывают все задачи, оставшиеся в их кольцах.
   printf("queue_shutdown: Ожидание завершения %d рабочих потоков...\n",
          num_threads_global);
   if (worker_threads) { // Проверка, что worker_threads был выделен
@@ -190,51 +616,74 @@ void queue_shutdown() {
         snprintf(err_buf, sizeof(err_buf),
                  "queue_shutdown: Ошибка pthread_join для потока %d", i);
         perror(err_buf);
-      } else {
-        // printf("queue_shutdown: Рабочий поток %d успешно завершен.\n", i);
       }
     }
   }
   printf("queue_shutdown: Все рабочие потоки должны были завершиться.\n");
 
-  // Освободить память, выделенную для worker_threads
+  // Задачу могли передать рабочему потоку, который уже вышел (его кольца
+  // опустели раньше). Дорабатываем такие задачи здесь от имени владельца:
+  // рабочие потоки остановлены, их состояние никто не трогает
+  if (forwarding_enabled) {
+    int forwarded_tasks_count = 0;
+    packet_task_t *tasks[QUEUE_MAX_BATCH];
+    for (int i = 0; i < num_queues_global; i++) {
+      current_worker_id = i;
+      unsigned int count;
+      while ((count = ring_dequeue_burst(&worker_queues[i].forwarded,
+                                         (void **)tasks, QUEUE_MAX_BATCH)) >
+             0) {
+        process_tasks(tasks, count);
+        release_tasks(tasks, count);
+        forwarded_tasks_count += (int)count;
+      }
+    }
+    current_worker_id = -1;
+    if (forwarded_tasks_count > 0) {
+      printf("queue_shutdown: Дообработано %d задач из колец передачи.\n",
+             forwarded_tasks_count);
+    }
+  }
+
+  // Вернуть в пул задачи, которые могли остаться в кольцах
   printf("queue_shutdown: Очистка оставшихся задач в очереди (если есть)...\n");
-  pthread_mutex_lock(&queue_mutex);
   int freed_tasks_count = 0;
-  while (queue_count > 0) {
-    packet_task_t *task = task_queue[queue_head];
-    task_queue[queue_head] = NULL; // Хорошая практика
-    queue_head = (queue_head + 1) % QUEUE_CAPACITY;
-    queue_count--;
-    if (task) {
-      if (task->packet_data) {
-        free(task->packet_data);
+  packet_task_t *task = NULL;
+  for (int i = 0; i < num_queues_global; i++) {
+    while (ring_dequeue_burst(&worker_queues[i].ring, (void **)&task, 1) ==
+           1) {
+      if (task) {
+        release_tasks(&task, 1);
+        freed_tasks_count++;
       }
-      free(task);
-      freed_tasks_count++;
     }
   }
   if (freed_tasks_count > 0) {
     printf("queue_shutdown: Освобождено %d необработанных задач из очереди.\n",
            freed_tasks_count);
   }
-  pthread_mutex_unlock(&queue_mutex);
 
-  // Уничтожить мьютекс и условные переменные
+  // Освободить память, выделенную для worker_threads, кольца и пул
   printf("queue_shutdown: Освобождение основных ресурсов...\n");
   if (worker_threads != NULL) {
     free(worker_threads);
     worker_threads = NULL;
   }
-  if (pthread_mutex_destroy(&queue_mutex) != 0) {
-    perror("queue_shutdown: Ошибка pthread_mutex_destroy");
-  }
-  if (pthread_cond_destroy(&queue_not_empty_cond) != 0) {
-    perror("queue_shutdown: Ошибка pthread_cond_destroy (not_empty)");
-  }
-  if (pthread_cond_destroy(&queue_not_full_cond) != 0) {
-    perror("queue_shutdown: Ошибка pthread_cond_destroy (not_full)");
+  if (task_pool.memory != NULL) {
+    queue_get_stats(&final_stats);
+    if (final_stats.pool_exhausted > 0 || final_stats.truncated > 0) {
+      printf("queue_shutdown: Пул задач: отброшено (пул исчерпан) %llu, "
+             "обрезано до snaplen %llu пакетов.\n",
+             final_stats.pool_exhausted, final_stats.truncated);
+    }
+    if (final_stats.forwarded > 0 || final_stats.forward_dropped > 0) {
+      printf("queue_shutdown: Передано между рабочими потоками %llu, "
+             "отброшено при передаче %llu задач.\n",
+             final_stats.forwarded, final_stats.forward_dropped);
+    }
+    packet_pool_destroy(&task_pool);
   }
+  destroy_worker_queues(num_queues_global);
 
   printf("queue_shutdown: Завершение работы пула потоков выполнено.\n");
 }
@@ -242,58 +691,56 @@ void queue_shutdown() {
 // --- Функция, которую будет выполнять каждый рабочий поток ---
 static void *worker_loop(void *arg) {
   int thread_id = (int)(intptr_t)arg;
+  current_worker_id = thread_id;
+  // Свое кольцо при распределении по потокам, иначе общее
+  worker_queue_t *queue =
+      &worker_queues[num_queues_global > 1 ? thread_id : 0];
   printf("Рабочий поток %d запущен.\n", thread_id);
 
+  packet_task_t *tasks[QUEUE_MAX_BATCH];
+  unsigned int batch_size = queue_options.batch_size;
+  latency_worker_t *latency = latency_worker_get(thread_id); // NULL - нет
+
   while (1) {
-    packet_task_t *task = NULL;
-    // Блокируем мьютекс
-    pthread_mutex_lock(&queue_mutex);
-
-    // Подождать, если очередь пуста И keep_running_global == 1 (на
-    // queue_not_empty_cond)
-    while (queue_count == 0 && keep_running_global) {
-      printf("Поток %d: очередь пуста, ожидание...\n", thread_id);
-      pthread_cond_wait(&queue_not_empty_cond, &queue_mutex);
-      printf("Поток %d: проснулся\n", thread_id);
-    }
-    // Если keep_running_global == 0 И очередь пуста, выйти из цикла
-    if (!keep_running_global && queue_count == 0) {
-      pthread_mutex_unlock(&queue_mutex);
-      printf("Поток %d: выход, keep_running=0, очередь пуста\n", thread_id);
-      break; // Выход из главного цикла while(1)
+    // Сначала задачи от других рабочих потоков (их немного), затем до
+    // batch_size задач из своего кольца одной операцией
+    unsigned int forwarded = 0;
+    if (forwarding_enabled) {
+      forwarded =
+          ring_dequeue_burst(&queue->forwarded, (void **)tasks, batch_size);
     }
-    if (queue_count == 0) {
-      pthread_mutex_unlock(&queue_mutex);
+    unsigned int count =
+        forwarded + ring_dequeue_burst(&queue->ring,
+                                       (void **)(tasks + forwarded),
+                                       batch_size - forwarded);
+    if (count == 0) {
+      // Если keep_running_global == 0 И очередь пуста, выйти из цикла
+      if (!atomic_load_explicit(&keep_running_global, memory_order_acquire) &&
+          queue_task_count(queue) == 0) {
+        printf("Поток %d: выход, keep_running=0, очередь пуста\n", thread_id);
+        break; // Выход из главного цикла while(1)
+      }
+      // Подождать, пока появится задача (на not_empty своего кольца)
+      queue_adaptive_wait(&queue->not_empty, queue, queue_has_tasks);
       continue; // К следующей итерации главного цикла
     }
+    // Сигнализировать, что очередь не полна (только если продюсер спит).
+    // Будим всех: продюсер мог ждать другое кольцо, а продюсеров мало
+    futex_event_notify(&queue_not_full_event, 1);
+    u_int64_t dequeue_ns = 0;
+    if (latency != NULL) {
+      dequeue_ns = latency_now_ns();
+      latency_record(&latency->metrics[LATENCY_QUEUE_DEPTH],
+                     count + queue_task_count(queue), 1);
+    }
 
-    // Извлечь задачу из task_queue, обновить queue_head, queue_count
-
-    task = task_queue[queue_head];
-    queue_head = (queue_head + 1) % QUEUE_CAPACITY;
-    queue_count--;
-    printf("Поток %d: извлек задачу. В очереди: %d\n", thread_id, queue_count);
-    // Сигнализировать, что очередь не полна (queue_not_full_cond)
-    pthread_cond_signal(&queue_not_full_cond);
-    // Освобождаем мьютекс так как извлекли пакет из очереди
-    pthread_mutex_unlock(&queue_mutex);
-
-    if (task) {
-      printf("Рабочий поток %d взял задачу.\n",
-             thread_id /* (unsigned long)pthread_self() */);
-      // processing_function_handler(task);
-      if (processing_function_handler != NULL) {
-        processing_function_handler(task);
-      }
-      // Освободить память, выделенную для task->packet_data и для
-      if (task->packet_data != NULL) {
-        free(task->packet_data);
-        task->packet_data = NULL;
-      }
-      free(task);
-      task = NULL;
-      printf("Поток %d: задача обработана и освобождена\n", thread_id);
+    process_tasks(tasks, count);
+    if (latency != NULL) {
+      record_latency(latency, tasks, count, dequeue_ns);
     }
+    // Вернуть слоты в пул одной операцией (lock-free, из любого потока),
+    // внешние буферы zero-copy - их владельцу
+    release_tasks(tasks, count);
   }
 
   printf("Рабочий поток %d завершается.\n", thread_id);
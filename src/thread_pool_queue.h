@@ -1,12 +1,24 @@
 #ifndef THREAD_POOL_QUEUE_H
 #define THREAD_POOL_QUEUE_H
 
+#include "stats.h"
 #include <pcap.h>
 #include <pthread.h>
 
+// Освобождение внешнего буфера пакета (zero-copy): вызывается рабочим
+// потоком после обработки задачи
+typedef void (*packet_release_fn)(void *cookie);
+
 typedef struct {
   struct pcap_pkthdr header; // Копия заголовка pcap
-  u_char *packet_data;       // Копия данных пакета
+  u_char *packet_data; // Данные пакета: встроенный буфер слота пула или
+                       // внешний буфер (zero-copy, см. release)
+  u_int32_t flow_hash; // Симметричный хэш потока (считается при постановке)
+  u_int32_t forwarded; // 1 - передан другим рабочим потоком
+                       // (queue_forward_packet)
+  packet_release_fn release; // NULL - данные скопированы в слот пула
+  void *release_cookie;      // Аргумент release
+  u_int64_t enqueue_ns; // Время постановки (только LATENCY_FROM_ENQUEUE)
 } packet_task_t;
 
 // 2. Прототип функции, которую будут выполнять рабочие потоки
@@ -14,22 +26,174 @@ typedef struct {
 //    Именно сюда ты "подключишь" свой текущий packet_handler (адаптированный).
 typedef void (*packet_processing_fn)(packet_task_t *task);
 
+// Пакетный вариант: рабочий поток передает сразу до batch_size задач,
+// извлеченных из кольца одной операцией
+typedef void (*packet_batch_processing_fn)(packet_task_t **tasks,
+                                           unsigned int count);
+
+// Максимальный размер пачки (и для постановки, и для извлечения)
+#define QUEUE_MAX_BATCH 64
+
+// Пачка задач, накапливаемая потоком захвата (например, за один вызов
+// pcap_dispatch) и ставящаяся в очередь одной операцией на кольцо
+typedef struct {
+  packet_task_t *tasks[QUEUE_MAX_BATCH];
+  unsigned int count;
+} packet_batch_t;
+
+// Параметры очереди, задаются до queue_init (иначе используются значения по
+// умолчанию из queue_get_default_options)
+// Как распределять пакеты по рабочим потокам
+typedef enum {
+  QUEUE_DISPATCH_SHARED = 0, // Одно общее кольцо на все потоки
+  QUEUE_DISPATCH_FLOW = 1, // Кольцо на поток, выбор по хэшу потока (как RSS)
+} queue_dispatch_mode_t;
+
+typedef struct {
+  unsigned int capacity;   // Суммарная емкость колец задач (2^n на кольцо)
+  unsigned int spin_count; // Итераций активного ожидания перед сном на futex
+  unsigned int snaplen;    // Размер буфера пакета в слоте пула
+  unsigned int pool_size;  // Слотов в пуле, 0 - по емкости кольца и потокам
+  int use_huge_pages;      // 1 - пул на huge pages (если доступны)
+  queue_dispatch_mode_t dispatch_mode; // По умолчанию QUEUE_DISPATCH_FLOW
+  unsigned int batch_size; // Сколько задач рабочий поток берет за раз
+  unsigned int producers;  // Потоков захвата: у каждого своя пачка задач
+} queue_options_t;
+
+#define QUEUE_DEFAULT_CAPACITY 1024
+#define QUEUE_DEFAULT_SPIN_COUNT 256
+#define QUEUE_DEFAULT_SNAPLEN 65535
+#define QUEUE_MIN_RING_CAPACITY 64 // Минимум на кольцо рабочего потока
+#define QUEUE_DEFAULT_BATCH_SIZE 32
+#define QUEUE_FORWARD_RING_CAPACITY 64 // Кольцо передачи между рабочими
+
+// Счетчики очереди (читаются в любой момент, в том числе после shutdown)
+typedef struct {
+  unsigned long long pool_exhausted; // Пакеты, отброшенные: пул пуст
+  unsigned long long truncated;      // Пакеты, обрезанные до snaplen
+  unsigned long long forwarded; // Передано между рабочими потоками
+  unsigned long long forward_dropped; // Не передано: кольцо передачи
+                                      // заполнено или пул исчерпан
+} queue_stats_t;
+
+void queue_get_default_options(queue_options_t *options);
+void queue_set_options(const queue_options_t *options);
+
 // 3. Функции для управления пулом потоков и очередью
-//    Инициализация: создает очередь, мьютексы, условные переменные,
+//    Инициализация: создает lock-free кольцо задач и события ожидания,
 //    запускает 'num_worker_threads' рабочих потоков.
 //    'processing_function' - это указатель на функцию, которая будет
 //    обрабатывать пакеты.
 int queue_init(int num_worker_threads,
                packet_processing_fn processing_function);
 
+//    То же, но с пакетной функцией обработки: если batch_function не NULL,
+//    рабочие потоки вызывают ее для каждой извлеченной пачки, иначе
+//    processing_function для каждой задачи по очереди.
+int queue_init_batch(int num_worker_threads,
+                     packet_processing_fn processing_function,
+                     packet_batch_processing_fn batch_function);
+
 //    Добавление пакета в очередь (будет вызываться из pcap callback)
-//    Эта функция должна внутри себя выделить память и скопировать данные.
+//    Берет слот из пула и копирует в него данные; если пул исчерпан,
+//    пакет отбрасывается и учитывается в queue_stats_t.pool_exhausted.
 void queue_add_packet(const struct pcap_pkthdr *pkthdr,
                       const u_char *packet_content);
 
+/**
+ * @brief Копирует пакет в слот пула и добавляет задачу в пачку.
+ *
+ * Вызывается из pcap callback вместо queue_add_packet. Данные копируются
+ * сразу (буфер libpcap действителен только внутри callback), а постановка
+ * в кольца откладывается до queue_add_packet_batch. Заполненная пачка
+ * отправляется автоматически.
+ */
+void queue_batch_add(packet_batch_t *batch, const struct pcap_pkthdr *pkthdr,
+                     const u_char *packet_content);
+
+/**
+ * @brief Добавляет пакет в пачку без копирования данных (zero-copy).
+ *
+ * В задаче сохраняется указатель на packet_content, поэтому буфер должен
+ * оставаться действительным до вызова release(cookie). release вызывается
+ * ровно один раз: рабочим потоком после обработки либо сразу, если пакет
+ * отброшен (пул исчерпан, очередь остановлена).
+ */
+void queue_batch_add_zero_copy(packet_batch_t *batch,
+                               const struct pcap_pkthdr *pkthdr,
+                               const u_char *packet_content,
+                               packet_release_fn release, void *cookie);
+
+/**
+ * @brief Ставит в очередь все задачи пачки и очищает ее.
+ *
+ * Задачи группируются по кольцам рабочих потоков (порядок внутри потока
+ * сохраняется), на каждое кольцо - одна операция ring_enqueue_burst и одно
+ * пробуждение.
+ */
+void queue_add_packet_batch(packet_batch_t *batch);
+
+/**
+ * @brief Ограничивает кольца, в которые ставит задачи текущий поток.
+ *
+ * Для нескольких потоков захвата (PACKET_FANOUT): каждый поток захвата
+ * кормит свою группу рабочих потоков [first_worker, first_worker +
+ * worker_count), внутри группы задачи распределяются по хэшу потока.
+ * worker_count == 0 - все рабочие потоки (по умолчанию). В режиме
+ * QUEUE_DISPATCH_SHARED не действует.
+ */
+void queue_set_producer_group(int first_worker, int worker_count);
+
+/**
+ * @brief Блок счетчиков текущего потока-продюсера.
+ *
+ * Ожидания места в заполненном кольце учитываются в
+ * stats->queue_full_waits, их длительность - в stats->queue_full_wait_ns;
+ * NULL - не учитывать (по умолчанию).
+ */
+void queue_set_producer_stats(stats_producer_t *stats);
+
+/**
+ * @brief Передает пакет рабочему потоку, которому он принадлежит по хэшу.
+ *
+ * Вызывается из processing_function, когда рабочий поток сам породил пакет
+ * (например, собрал датаграмму из фрагментов, которые распределялись по
+ * хэшу без портов), а его хэш потока указывает на другое кольцо группы
+ * этого рабочего потока (queue_set_producer_group). Данные копируются в
+ * слот пула (или во внешний буфер, если не помещаются), задача с
+ * forwarded = 1 кладется в отдельное кольцо передачи владельца: кольца
+ * продюсеров бывают заполнены подолгу, а ждать места в чужом кольце из
+ * рабочего потока нельзя - два потока могут ждать друг друга. Поэтому
+ * вызов не блокируется: если кольцо передачи заполнено или пул исчерпан,
+ * пакет отбрасывается и учитывается в queue_stats_t.forward_dropped.
+ *
+ * @return int 1 - пакет принадлежит текущему рабочему потоку (или
+ *             распределения по хэшу нет), ничего не сделано - обработать
+ *             на месте; 0 - передан; -1 - отброшен.
+ */
+int queue_forward_packet(const struct pcap_pkthdr *pkthdr,
+                         const u_char *packet_content, u_int32_t flow_hash);
+
 //    Корректное завершение работы: останавливает добавление новых задач,
 //    дает рабочим потокам обработать оставшиеся задачи,
 //    освобождает все ресурсы.
 void queue_shutdown();
 
+void queue_get_stats(queue_stats_t *stats);
+
+// Задач во всех кольцах сейчас (приблизительно, без блокировок; из любого
+// потока между queue_init и queue_shutdown)
+unsigned int queue_depth(void);
+
+/**
+ * @brief Номер рабочего потока, в котором выполняется вызов.
+ *
+ * @return int От 0 до num_worker_threads - 1 внутри processing_function,
+ *             -1 в любом другом потоке. При QUEUE_DISPATCH_FLOW все пакеты
+ *             одного потока (flow) обрабатываются одним и тем же рабочим
+ *             потоком, поэтому состояние потока можно хранить без блокировок
+ *             в структурах, индексированных этим номером.
+ */
+int queue_worker_id(void);
+
 #endif // THREAD_POOL_QUEUE_H
\ No newline at end of file
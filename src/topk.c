@@ -0,0 +1,359 @@
+#include "topk.h"
+#include "flow_hash.h"
+#include "output_sink.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static topk_worker_t *workers; // По набору скетчей на рабочий поток
+static int num_workers_global;
+static topk_set_t merged; // Слияние (только поток отчетов или main)
+static unsigned int report_size;
+static int interval_reported; // Был хотя бы один отчет за интервал
+
+static int sketch_init(topk_sketch_t *sketch, u_int32_t capacity) {
+  u_int32_t index_size = 1;
+  while (index_size < capacity * 2) {
+    index_size <<= 1;
+  }
+  sketch->heap = aligned_alloc(64, sizeof(topk_entry_t) * capacity);
+  sketch->index = calloc(index_size, sizeof(u_int32_t));
+  if (sketch->heap == NULL || sketch->index == NULL) {
+    perror("topk_init: Ошибка выделения памяти для скетча");
+    return -1;
+  }
+  sketch->capacity = capacity;
+  sketch->count = 0;
+  sketch->index_mask = index_size - 1;
+  return 0;
+}
+
+static void sketch_reset(topk_sketch_t *sketch) {
+  memset(sketch->index, 0, sizeof(u_int32_t) * (sketch->index_mask + 1));
+  sketch->count = 0;
+}
+
+static void sketch_free(topk_sketch_t *sketch) {
+  free(sketch->heap);
+  free(sketch->index);
+  sketch->heap = NULL;
+  sketch->index = NULL;
+}
+
+// Запись счетчика в позицию кучи с обновлением индекса
+static inline void heap_place(topk_sketch_t *sketch, u_int32_t pos,
+                              const topk_entry_t *entry) {
+  sketch->heap[pos] = *entry;
+  sketch->index[entry->slot] = pos + 1;
+}
+
+static void sift_down(topk_sketch_t *sketch, u_int32_t pos) {
+  topk_entry_t entry = sketch->heap[pos];
+  for (;;) {
+    u_int32_t child = 2 * pos + 1;
+    if (child >= sketch->count) {
+      break;
+    }
+    if (child + 1 < sketch->count &&
+        sketch->heap[child + 1].count < sketch->heap[child].count) {
+      child++;
+    }
+    if (sketch->heap[child].count >= entry.count) {
+      break;
+    }
+    heap_place(sketch, pos, &sketch->heap[child]);
+    pos = child;
+  }
+  heap_place(sketch, pos, &entry);
+}
+
+static void sift_up(topk_sketch_t *sketch, u_int32_t pos) {
+  topk_entry_t entry = sketch->heap[pos];
+  while (pos > 0) {
+    u_int32_t parent = (pos - 1) / 2;
+    if (sketch->heap[parent].count <= entry.count) {
+      break;
+    }
+    heap_place(sketch, pos, &sketch->heap[parent]);
+    pos = parent;
+  }
+  heap_place(sketch, pos, &entry);
+}
+
+// Слот индекса с ключом или первый пустой слот цепочки
+static u_int32_t index_find(const topk_sketch_t *sketch, const flow_key_t *key,
+                            u_int32_t hash) {
+  u_int32_t slot = hash & sketch->index_mask;
+  while (sketch->index[slot] != 0) {
+    const topk_entry_t *entry = &sketch->heap[sketch->index[slot] - 1];
+    if (entry->hash == hash && memcmp(&entry->key, key, sizeof(*key)) == 0) {
+      return slot;
+    }
+    slot = (slot + 1) & sketch->index_mask;
+  }
+  return slot;
+}
+
+// Удаление сдвигом назад: записи за дыркой, которые могут в нее встать,
+// переносятся, поэтому поиск не видит "надгробий"
+static void index_remove(topk_sketch_t *sketch, u_int32_t slot) {
+  u_int32_t mask = sketch->index_mask;
+  u_int32_t hole = slot;
+  u_int32_t next = (slot + 1) & mask;
+  sketch->index[hole] = 0;
+  while (sketch->index[next] != 0) {
+    topk_entry_t *entry = &sketch->heap[sketch->index[next] - 1];
+    u_int32_t home = entry->hash & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      sketch->index[hole] = sketch->index[next];
+      sketch->index[next] = 0;
+      entry->slot = hole;
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+}
+
+// Space-Saving с весом: error - погрешность, которую ключ уже несет (при
+// слиянии скетчей)
+static void sketch_update(topk_sketch_t *sketch, const flow_key_t *key,
+                          u_int32_t hash, u_int64_t weight, u_int64_t error) {
+  u_int32_t slot = index_find(sketch, key, hash);
+  if (sketch->index[slot] != 0) {
+    u_int32_t pos = sketch->index[slot] - 1;
+    sketch->heap[pos].count += weight;
+    sketch->heap[pos].error += error;
+    sift_down(sketch, pos);
+    return;
+  }
+  topk_entry_t entry;
+  entry.key = *key;
+  entry.hash = hash;
+  if (sketch->count < sketch->capacity) {
+    entry.count = weight;
+    entry.error = error;
+    entry.slot = slot;
+    heap_place(sketch, sketch->count, &entry);
+    sketch->count++;
+    sift_up(sketch, sketch->count - 1);
+    return;
+  }
+  // Вытесняем минимальный счетчик: новый ключ наследует его значение
+  u_int64_t base = sketch->heap[0].count;
+  index_remove(sketch, sketch->heap[0].slot);
+  entry.count = base + weight;
+  entry.error = base + error;
+  entry.slot = index_find(sketch, key, hash); // Цепочка могла сдвинуться
+  heap_place(sketch, 0, &entry);
+  sift_down(sketch, 0);
+}
+
+static int set_init(topk_set_t *set, u_int32_t capacity) {
+  for (int k = 0; k < TOPK_KEY_COUNT; k++) {
+    for (int m = 0; m < TOPK_METRIC_COUNT; m++) {
+      if (sketch_init(&set->sketches[k][m], capacity) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void set_reset(topk_set_t *set) {
+  for (int k = 0; k < TOPK_KEY_COUNT; k++) {
+    for (int m = 0; m < TOPK_METRIC_COUNT; m++) {
+      sketch_reset(&set->sketches[k][m]);
+    }
+  }
+}
+
+static void set_free(topk_set_t *set) {
+  for (int k = 0; k < TOPK_KEY_COUNT; k++) {
+    for (int m = 0; m < TOPK_METRIC_COUNT; m++) {
+      sketch_free(&set->sketches[k][m]);
+    }
+  }
+}
+
+// Слияние: счетчики и погрешности складываются (оценки остаются верхними)
+static void set_merge(topk_set_t *into, const topk_set_t *from) {
+  for (int k = 0; k < TOPK_KEY_COUNT; k++) {
+    for (int m = 0; m < TOPK_METRIC_COUNT; m++) {
+      const topk_sketch_t *sketch = &from->sketches[k][m];
+      for (u_int32_t i = 0; i < sketch->count; i++) {
+        const topk_entry_t *entry = &sketch->heap[i];
+        sketch_update(&into->sketches[k][m], &entry->key, entry->hash,
+                      entry->count, entry->error);
+      }
+    }
+  }
+}
+
+int topk_init(int num_workers, unsigned int report) {
+  if (num_workers <= 0 || report == 0 || report > TOPK_MAX_REPORT) {
+    fprintf(stderr, "topk_init: неверные параметры (%d потоков, топ-%u)\n",
+            num_workers, report);
+    return -1;
+  }
+  u_int32_t capacity = report * TOPK_CAPACITY_PER_REPORT;
+  if (capacity < TOPK_DEFAULT_CAPACITY) {
+    capacity = TOPK_DEFAULT_CAPACITY;
+  }
+  workers = aligned_alloc(64, sizeof(topk_worker_t) * num_workers);
+  if (workers == NULL) {
+    perror("topk_init: Ошибка выделения памяти");
+    return -1;
+  }
+  memset(workers, 0, sizeof(topk_worker_t) * num_workers);
+  memset(&merged, 0, sizeof(merged));
+  num_workers_global = num_workers;
+  for (int i = 0; i < num_workers; i++) {
+    atomic_init(&workers[i].published_ready, 0);
+    if (set_init(&workers[i].sets[0], capacity) != 0 ||
+        set_init(&workers[i].sets[1], capacity) != 0) {
+      topk_destroy();
+      return -1;
+    }
+  }
+  if (set_init(&merged, capacity) != 0) {
+    topk_destroy();
+    return -1;
+  }
+  report_size = report;
+  interval_reported = 0;
+  return 0;
+}
+
+int topk_enabled(void) { return workers != NULL; }
+
+topk_worker_t *topk_worker_get(int worker_id) {
+  if (worker_id < 0 || worker_id >= num_workers_global) {
+    return NULL;
+  }
+  return &workers[worker_id];
+}
+
+void topk_destroy(void) {
+  for (int i = 0; i < num_workers_global && workers != NULL; i++) {
+    set_free(&workers[i].sets[0]);
+    set_free(&workers[i].sets[1]);
+  }
+  set_free(&merged);
+  free(workers);
+  workers = NULL;
+  num_workers_global = 0;
+}
+
+// Ключ-адрес: IPv4-mapped или IPv6 в ip_lo, остальное - нули
+static u_int32_t address_key(const packet_descriptor_t *desc, int source,
+                             flow_key_t *key) {
+  memset(key, 0, sizeof(*key));
+  if (desc->layers & PACKET_HAS_IPV4) {
+    key->ip_lo[10] = key->ip_lo[11] = 0xff;
+    memcpy(key->ip_lo + 12,
+           source ? &desc->ipv4.source_ip : &desc->ipv4.destination_ip, 4);
+  } else {
+    memcpy(key->ip_lo,
+           source ? &desc->ipv6.source_ip : &desc->ipv6.destination_ip, 16);
+  }
+  u_int32_t words[4];
+  memcpy(words, key->ip_lo, sizeof(words));
+  u_int32_t hash = 0;
+  for (int i = 0; i < 4; i++) {
+    hash = flow_hash_mix32(hash ^ words[i]);
+  }
+  return hash;
+}
+
+void topk_count_packet(topk_worker_t *worker, const packet_descriptor_t *desc,
+                       const flow_key_t *flow_key, u_int32_t flow_hash) {
+  topk_set_t *set = &worker->sets[worker->active];
+  flow_key_t address;
+  u_int32_t hash = address_key(desc, 1, &address);
+  sketch_update(&set->sketches[TOPK_BY_SOURCE][TOPK_METRIC_BYTES], &address,
+                hash, desc->len, 0);
+  sketch_update(&set->sketches[TOPK_BY_SOURCE][TOPK_METRIC_PACKETS],
+                &address, hash, 1, 0);
+  hash = address_key(desc, 0, &address);
+  sketch_update(&set->sketches[TOPK_BY_DESTINATION][TOPK_METRIC_BYTES],
+                &address, hash, desc->len, 0);
+  sketch_update(&set->sketches[TOPK_BY_DESTINATION][TOPK_METRIC_PACKETS],
+                &address, hash, 1, 0);
+  sketch_update(&set->sketches[TOPK_BY_FLOW][TOPK_METRIC_BYTES], flow_key,
+                flow_hash, desc->len, 0);
+  sketch_update(&set->sketches[TOPK_BY_FLOW][TOPK_METRIC_PACKETS], flow_key,
+                flow_hash, 1, 0);
+}
+
+void topk_worker_tick(topk_worker_t *worker) {
+  unsigned int epoch = stats_current_epoch();
+  if (epoch == worker->epoch ||
+      atomic_load_explicit(&worker->published_ready, memory_order_acquire)) {
+    return; // Интервал тот же или прошлый набор еще не забран
+  }
+  worker->epoch = epoch;
+  worker->published = worker->active;
+  worker->active ^= 1;
+  set_reset(&worker->sets[worker->active]);
+  atomic_store_explicit(&worker->published_ready, 1, memory_order_release);
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const topk_entry_t *x = a, *y = b;
+  return x->count < y->count ? 1 : (x->count > y->count ? -1 : 0);
+}
+
+// Емкость скетча не больше TOPK_MAX_REPORT * TOPK_CAPACITY_PER_REPORT
+_Static_assert(TOPK_DEFAULT_CAPACITY <=
+                   TOPK_MAX_REPORT * TOPK_CAPACITY_PER_REPORT,
+               "буфер сортировки меньше скетча");
+
+static void print_set(const char *period) {
+  static topk_entry_t sorted[TOPK_MAX_REPORT * TOPK_CAPACITY_PER_REPORT];
+  for (int k = 0; k < TOPK_KEY_COUNT; k++) {
+    for (int m = 0; m < TOPK_METRIC_COUNT; m++) {
+      const topk_sketch_t *sketch = &merged.sketches[k][m];
+      memcpy(sorted, sketch->heap, sizeof(topk_entry_t) * sketch->count);
+      qsort(sorted, sketch->count, sizeof(topk_entry_t), compare_entries);
+      output_sink_print_topk(period, (topk_key_kind_t)k, (topk_metric_t)m,
+                             sorted,
+                             sketch->count < report_size ? sketch->count
+                                                         : report_size);
+    }
+  }
+  output_sink_flush();
+  fflush(stdout);
+}
+
+void topk_report_interval(void) {
+  if (workers == NULL) {
+    return;
+  }
+  set_reset(&merged);
+  for (int i = 0; i < num_workers_global; i++) {
+    topk_worker_t *worker = &workers[i];
+    if (atomic_load_explicit(&worker->published_ready, memory_order_acquire)) {
+      set_merge(&merged, &worker->sets[worker->published]);
+      atomic_store_explicit(&worker->published_ready, 0, memory_order_release);
+    }
+  }
+  interval_reported = 1;
+  print_set("за предыдущий интервал");
+}
+
+void topk_report_final(void) {
+  if (workers == NULL) {
+    return;
+  }
+  set_reset(&merged);
+  for (int i = 0; i < num_workers_global; i++) {
+    topk_worker_t *worker = &workers[i];
+    if (atomic_load_explicit(&worker->published_ready, memory_order_acquire)) {
+      set_merge(&merged, &worker->sets[worker->published]);
+      atomic_store_explicit(&worker->published_ready, 0, memory_order_release);
+    }
+    set_merge(&merged, &worker->sets[worker->active]);
+  }
+  print_set(interval_reported ? "с последнего отчета" : "за все время");
+}
@@ -0,0 +1,104 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include "flow_table.h"
+#include "packet_descriptor.h"
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define TOPK_DEFAULT_REPORT 10     // Сколько строк в каждом списке
+#define TOPK_MAX_REPORT 100
+#define TOPK_DEFAULT_CAPACITY 1024 // Счетчиков в одном скетче (минимум)
+#define TOPK_CAPACITY_PER_REPORT 16 // Счетчиков на строку отчета
+
+// По какому ключу ищутся самые активные
+typedef enum {
+  TOPK_BY_SOURCE = 0,      // IP источника
+  TOPK_BY_DESTINATION = 1, // IP назначения
+  TOPK_BY_FLOW = 2,        // 5-кортеж (оба направления - один ключ)
+  TOPK_KEY_COUNT
+} topk_key_kind_t;
+
+typedef enum {
+  TOPK_METRIC_BYTES = 0,
+  TOPK_METRIC_PACKETS = 1,
+  TOPK_METRIC_COUNT
+} topk_metric_t;
+
+// Счетчик Space-Saving: истинное значение в [count - error, count]
+typedef struct {
+  flow_key_t key; // Для адресов заполнен только ip_lo
+  u_int64_t count;
+  u_int64_t error;
+  u_int32_t hash;
+  u_int32_t slot; // Позиция ключа в индексе (для обновления при перестановке)
+} topk_entry_t;
+
+/**
+ * @brief Скетч Space-Saving с весами фиксированного размера.
+ *
+ * capacity счетчиков в минимальной куче по count и индекс ключ -> позиция в
+ * куче (открытая адресация, линейное пробирование, удаление сдвигом
+ * назад). Новый ключ при заполненном скетче занимает место минимального
+ * счетчика и наследует его значение как погрешность, поэтому память не
+ * зависит от числа различных ключей, а любой ключ с долей больше
+ * 1/capacity гарантированно остается в скетче.
+ */
+typedef struct {
+  topk_entry_t *heap;
+  u_int32_t *index; // Позиция в куче + 1, 0 - пусто
+  u_int32_t capacity;
+  u_int32_t count;
+  u_int32_t index_mask;
+} topk_sketch_t;
+
+// Скетчи по всем ключам и метрикам
+typedef struct {
+  topk_sketch_t sketches[TOPK_KEY_COUNT][TOPK_METRIC_COUNT];
+} topk_set_t;
+
+/**
+ * @brief Скетчи рабочего потока: активный набор и опубликованный.
+ *
+ * Владелец обновляет sets[active]. Увидев новый интервал
+ * (stats_current_epoch), он отдает активный набор потоку отчетов
+ * (published_ready = 1) и начинает чистый, если прошлый опубликованный уже
+ * забран. Поток отчетов сливает опубликованные наборы и сбрасывает флаг.
+ * Блокировок нет: каждый набор в любой момент принадлежит одному потоку.
+ */
+typedef struct {
+  _Alignas(64) topk_set_t sets[2];
+  int active;             // Только владелец
+  int published;          // Какой набор отдан (пишется до published_ready)
+  unsigned int epoch;     // Последний увиденный интервал
+  atomic_int published_ready;
+} topk_worker_t;
+
+// --- Скетчи по рабочим потокам (индекс - queue_worker_id) ---
+
+/**
+ * @brief Выделяет скетчи рабочих потоков и общий для слияния.
+ *
+ * @param report_size Сколько строк печатать в каждом списке (1..
+ *                    TOPK_MAX_REPORT); от него зависит емкость скетчей.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int topk_init(int num_workers, unsigned int report_size);
+int topk_enabled(void);
+topk_worker_t *topk_worker_get(int worker_id);
+void topk_destroy(void);
+
+// Учет пакета: flow_key и flow_hash - ключ и хэш из таблицы потоков
+void topk_count_packet(topk_worker_t *worker, const packet_descriptor_t *desc,
+                       const flow_key_t *flow_key, u_int32_t flow_hash);
+
+// Раз в пачку: публикация набора, если начался новый интервал
+void topk_worker_tick(topk_worker_t *worker);
+
+// Поток отчетов: слить опубликованные наборы и напечатать списки
+void topk_report_interval(void);
+
+// После остановки рабочих потоков: слить все, что осталось, и напечатать
+void topk_report_final(void);
+
+#endif // TOPK_H
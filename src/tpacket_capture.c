@@ -0,0 +1,277 @@
+#include "tpacket_capture.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TPACKET_RELEASE_WAIT_MS 100
+
+// snaplen в TPACKET_V3 задается фильтром сокета: ядро сохраняет столько
+// байт, сколько вернула программа BPF
+static int attach_snaplen_filter(int fd, unsigned int snaplen) {
+  struct sock_filter code[] = {{BPF_RET | BPF_K, 0, 0, snaplen}};
+  struct sock_fprog program = {1, code};
+  return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program,
+                    sizeof(program));
+}
+
+// Программа pcap_compile: struct bpf_insn и struct sock_filter совпадают
+// по раскладке (code, jt, jf, k)
+static int attach_program_filter(int fd, const struct bpf_program *filter) {
+  _Static_assert(sizeof(struct bpf_insn) == sizeof(struct sock_filter),
+                 "bpf_insn и sock_filter различаются");
+  struct sock_fprog program = {(unsigned short)filter->bf_len,
+                               (struct sock_filter *)filter->bf_insns};
+  return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program,
+                    sizeof(program));
+}
+
+int tpacket_open(tpacket_capture_t *cap, const char *dev_name,
+                 unsigned int snaplen, const struct bpf_program *filter,
+                 unsigned int block_size, unsigned int block_count) {
+  memset(cap, 0, sizeof(*cap));
+  cap->fd = -1;
+  cap->block_size = block_size ? block_size : TPACKET_DEFAULT_BLOCK_SIZE;
+  cap->block_count = block_count ? block_count : TPACKET_DEFAULT_BLOCK_COUNT;
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size > 0 && cap->block_size % (unsigned int)page_size != 0) {
+    fprintf(stderr, "tpacket_open: размер блока %u не кратен странице %ld\n",
+            cap->block_size, page_size);
+    return -1;
+  }
+
+  unsigned int ifindex = if_nametoindex(dev_name);
+  if (ifindex == 0) {
+    perror("tpacket_open: Не найден интерфейс");
+    return -1;
+  }
+  cap->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (cap->fd < 0) {
+    perror("tpacket_open: Ошибка socket(AF_PACKET)");
+    return -1;
+  }
+  int version = TPACKET_V3;
+  if (setsockopt(cap->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) < 0) {
+    perror("tpacket_open: TPACKET_V3 не поддерживается");
+    goto fail;
+  }
+  if (filter != NULL) {
+    if (attach_program_filter(cap->fd, filter) < 0) {
+      perror("tpacket_open: Ошибка установки фильтра BPF");
+      goto fail;
+    }
+  } else if (snaplen > 0 && attach_snaplen_filter(cap->fd, snaplen) < 0) {
+    perror("tpacket_open: Ошибка установки snaplen");
+    goto fail;
+  }
+
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = cap->block_size;
+  req.tp_block_nr = cap->block_count;
+  req.tp_frame_size = TPACKET_FRAME_SIZE;
+  req.tp_frame_nr = (cap->block_size / TPACKET_FRAME_SIZE) * cap->block_count;
+  req.tp_retire_blk_tov = TPACKET_BLOCK_TIMEOUT_MS;
+  if (setsockopt(cap->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+    perror("tpacket_open: Ошибка PACKET_RX_RING");
+    goto fail;
+  }
+  cap->ring_size = (size_t)cap->block_size * cap->block_count;
+  cap->ring = mmap(NULL, cap->ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, cap->fd, 0);
+  if (cap->ring == MAP_FAILED) {
+    perror("tpacket_open: Ошибка mmap кольца");
+    cap->ring = NULL;
+    goto fail;
+  }
+  cap->blocks = aligned_alloc(64, sizeof(*cap->blocks) * cap->block_count);
+  if (cap->blocks == NULL) {
+    perror("tpacket_open: Ошибка выделения памяти для блоков");
+    goto fail;
+  }
+  for (unsigned int i = 0; i < cap->block_count; i++) {
+    atomic_init(&cap->blocks[i].refs, 0);
+    atomic_init(&cap->blocks[i].in_flight, 0);
+    cap->blocks[i].desc =
+        (struct tpacket_block_desc *)(cap->ring + (size_t)i * cap->block_size);
+    cap->blocks[i].owner = cap;
+  }
+  futex_event_init(&cap->block_released);
+
+  struct sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = (int)ifindex;
+  if (bind(cap->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("tpacket_open: Ошибка bind");
+    goto fail;
+  }
+  // Неразборчивый режим, как pcap_open_live(..., promisc = 1, ...)
+  struct packet_mreq mreq;
+  memset(&mreq, 0, sizeof(mreq));
+  mreq.mr_ifindex = (int)ifindex;
+  mreq.mr_type = PACKET_MR_PROMISC;
+  if (setsockopt(cap->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq,
+                 sizeof(mreq)) < 0) {
+    perror("tpacket_open: Не удалось включить неразборчивый режим");
+  }
+  printf("tpacket_open: %s: кольцо TPACKET_V3 %u блоков по %u байт.\n",
+         dev_name, cap->block_count, cap->block_size);
+  return 0;
+
+fail:
+  tpacket_close(cap);
+  return -1;
+}
+
+int tpacket_join_fanout(tpacket_capture_t *cap, u_int16_t group_id,
+                        int fanout_type) {
+  int flags = 0;
+  if (fanout_type == PACKET_FANOUT_HASH) {
+    // Фрагменты без портов иначе попали бы в другие сокеты
+    flags |= PACKET_FANOUT_FLAG_DEFRAG;
+  }
+  int arg = group_id | ((fanout_type | flags) << 16);
+  if (setsockopt(cap->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+    perror("tpacket_join_fanout: Ошибка PACKET_FANOUT");
+    return -1;
+  }
+  return 0;
+}
+
+void tpacket_release_frame(void *cookie) {
+  tpacket_block_ref_t *block = cookie;
+  if (atomic_fetch_sub_explicit(&block->refs, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+  // Последняя ссылка: отдаем блок ядру, затем разрешаем потоку захвата
+  // снова ждать его (порядок важен - иначе поток захвата увидит старый
+  // TP_STATUS_USER и разберет блок повторно)
+  __atomic_store_n(&block->desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                   __ATOMIC_RELEASE);
+  atomic_store_explicit(&block->in_flight, 0, memory_order_release);
+  futex_event_notify(&block->owner->block_released, 0);
+}
+
+static int block_in_flight(const tpacket_block_ref_t *block) {
+  return atomic_load_explicit(&block->in_flight, memory_order_acquire);
+}
+
+// Берет следующий блок, если ядро его заполнило. 0 - блока нет, -1 - ошибка
+static int acquire_block(tpacket_capture_t *cap, int timeout_ms) {
+  tpacket_block_ref_t *block = &cap->blocks[cap->current_block];
+  if (block_in_flight(block)) {
+    // Кольцо прошло полный круг, а блок еще обрабатывается
+    u_int32_t seq = futex_event_prepare(&cap->block_released);
+    if (!block_in_flight(block)) {
+      futex_event_cancel(&cap->block_released);
+    } else {
+      futex_event_wait(&cap->block_released, seq, TPACKET_RELEASE_WAIT_MS);
+      if (block_in_flight(block)) {
+        return 0;
+      }
+    }
+  }
+  struct tpacket_block_desc *desc = block->desc;
+  if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+        TP_STATUS_USER)) {
+    struct pollfd pfd = {cap->fd, POLLIN | POLLERR, 0};
+    if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR) {
+      perror("tpacket_dispatch: Ошибка poll");
+      return -1;
+    }
+    if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER)) {
+      return 0;
+    }
+  }
+  // Ссылка на каждый кадр плюс одна - пока поток захвата разбирает блок
+  cap->frames_left = desc->hdr.bh1.num_pkts;
+  atomic_store_explicit(&block->refs, cap->frames_left + 1,
+                        memory_order_relaxed);
+  atomic_store_explicit(&block->in_flight, 1, memory_order_relaxed);
+  cap->next_frame = (struct tpacket3_hdr *)((u_char *)desc +
+                                            desc->hdr.bh1.offset_to_first_pkt);
+  return 1;
+}
+
+int tpacket_dispatch(tpacket_capture_t *cap, int max_packets, int timeout_ms,
+                     tpacket_handler_fn handler, u_char *user) {
+  tpacket_block_ref_t *block = &cap->blocks[cap->current_block];
+  if (cap->frames_left == 0) {
+    int result = acquire_block(cap, timeout_ms);
+    if (result <= 0) {
+      return result;
+    }
+  }
+
+  int delivered = 0;
+  while (cap->frames_left > 0 && (max_packets <= 0 || delivered < max_packets)) {
+    struct tpacket3_hdr *frame = cap->next_frame;
+    const struct sockaddr_ll *sll =
+        (const struct sockaddr_ll *)((u_char *)frame +
+                                     TPACKET_ALIGN(sizeof(*frame)));
+    cap->next_frame =
+        (struct tpacket3_hdr *)((u_char *)frame + frame->tp_next_offset);
+    cap->frames_left--;
+
+    // На loopback каждый пакет виден дважды (исходящий и входящий) -
+    // исходящую копию пропускаем, как libpcap
+    if (sll->sll_hatype == ARPHRD_LOOPBACK &&
+        sll->sll_pkttype == PACKET_OUTGOING) {
+      tpacket_release_frame(block);
+      continue;
+    }
+    struct pcap_pkthdr header;
+    header.ts.tv_sec = frame->tp_sec;
+    header.ts.tv_usec = frame->tp_nsec / 1000;
+    header.caplen = frame->tp_snaplen;
+    header.len = frame->tp_len;
+    handler(user, &header, (const u_char *)frame + frame->tp_mac, block);
+    delivered++;
+  }
+
+  if (cap->frames_left == 0) {
+    // Блок разобран: снимаем ссылку потока захвата и переходим к следующему
+    tpacket_release_frame(block);
+    cap->current_block = (cap->current_block + 1) % cap->block_count;
+  }
+  return delivered;
+}
+
+int tpacket_get_stats(tpacket_capture_t *cap, unsigned long long *packets,
+                      unsigned long long *drops) {
+  struct tpacket_stats_v3 stats;
+  socklen_t len = sizeof(stats);
+  if (getsockopt(cap->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0) {
+    perror("tpacket_get_stats: Ошибка PACKET_STATISTICS");
+    return -1;
+  }
+  *packets = stats.tp_packets;
+  *drops = stats.tp_drops;
+  return 0;
+}
+
+void tpacket_close(tpacket_capture_t *cap) {
+  if (cap->ring != NULL) {
+    munmap(cap->ring, cap->ring_size);
+    cap->ring = NULL;
+  }
+  free(cap->blocks);
+  cap->blocks = NULL;
+  if (cap->fd >= 0) {
+    close(cap->fd);
+    cap->fd = -1;
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef TPACKET_CAPTURE_H
+#define TPACKET_CAPTURE_H
+
+#include "futex_event.h"
+#include <linux/if_packet.h>
+#include <pcap.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define TPACKET_DEFAULT_BLOCK_SIZE (1u << 20) // 1 МиБ, кратно странице
+#define TPACKET_DEFAULT_BLOCK_COUNT 32
+#define TPACKET_FRAME_SIZE 2048 // Для расчета tp_frame_nr (в V3 не ограничивает)
+#define TPACKET_BLOCK_TIMEOUT_MS 60 // Ядро отдает неполный блок через 60 мс
+
+struct tpacket_capture;
+
+// Счетчик ссылок на блок кольца: блок возвращается ядру, только когда
+// обработаны все его кадры (и поток захвата дочитал блок)
+typedef struct {
+  _Alignas(64) _Atomic u_int32_t refs;
+  atomic_int in_flight; // 1 - блок у нас (пока refs > 0)
+  struct tpacket_block_desc *desc;
+  struct tpacket_capture *owner;
+} tpacket_block_ref_t;
+
+/**
+ * @brief Захват через AF_PACKET с кольцом PACKET_RX_RING (TPACKET_V3).
+ *
+ * Ядро пишет пакеты прямо в блоки кольца, отображенного в память процесса.
+ * Задачи ссылаются на кадры внутри блока без копирования; блок отдается
+ * ядру обратно (TP_STATUS_KERNEL), когда рабочие потоки обработали все его
+ * кадры. Если все блоки заняты необработанными пакетами, ядро отбрасывает
+ * новые и учитывает их в tp_drops.
+ */
+typedef struct tpacket_capture {
+  int fd;
+  u_char *ring;          // Отображение кольца (block_size * block_count)
+  size_t ring_size;
+  unsigned int block_size;
+  unsigned int block_count;
+  tpacket_block_ref_t *blocks;
+  futex_event_t block_released; // Ждет поток захвата, когда кольцо занято
+  // Разбор текущего блока (только поток захвата)
+  unsigned int current_block;
+  unsigned int frames_left; // 0 - текущий блок не взят
+  struct tpacket3_hdr *next_frame;
+} tpacket_capture_t;
+
+/**
+ * @brief Обработчик кадра: владеет ссылкой cookie и обязан передать ее в
+ * tpacket_release_frame (сам или через очередь задач).
+ */
+typedef void (*tpacket_handler_fn)(u_char *user,
+                                   const struct pcap_pkthdr *pkthdr,
+                                   const u_char *packet, void *cookie);
+
+/**
+ * @brief Открывает сокет AF_PACKET на интерфейсе и отображает кольцо.
+ *
+ * @param dev_name Имя интерфейса.
+ * @param snaplen Сколько байт пакета сохранять (через BPF-фильтр сокета).
+ * @param filter Программа BPF (compile_socket_filter) или NULL. Ставится
+ *               до bind, поэтому в кольцо не попадает ни одного лишнего
+ *               пакета; snaplen тогда задает ее возвращаемое значение.
+ * @param block_size Размер блока (кратен размеру страницы), 0 - по
+ *                   умолчанию.
+ * @param block_count Количество блоков, 0 - по умолчанию.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int tpacket_open(tpacket_capture_t *cap, const char *dev_name,
+                 unsigned int snaplen, const struct bpf_program *filter,
+                 unsigned int block_size, unsigned int block_count);
+
+/**
+ * @brief Передает обработчику до max_packets пакетов из текущего блока.
+ *
+ * @param timeout_ms Сколько ждать готового блока.
+ * @return int Количество переданных пакетов, 0 - таймаут, -1 - ошибка.
+ */
+int tpacket_dispatch(tpacket_capture_t *cap, int max_packets, int timeout_ms,
+                     tpacket_handler_fn handler, u_char *user);
+
+/**
+ * @brief Включает сокет в группу PACKET_FANOUT.
+ *
+ * Ядро распределяет пакеты интерфейса между сокетами группы, каждый сокет
+ * обслуживается своим потоком захвата.
+ *
+ * @param group_id Номер группы (общий для всех сокетов группы).
+ * @param fanout_type PACKET_FANOUT_HASH (симметричный хэш потока, фрагменты
+ *                    IP собираются вместе), PACKET_FANOUT_CPU или
+ *                    PACKET_FANOUT_LB.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int tpacket_join_fanout(tpacket_capture_t *cap, u_int16_t group_id,
+                        int fanout_type);
+
+// Освобождает кадр (cookie из обработчика). Можно из любого потока
+void tpacket_release_frame(void *cookie);
+
+// Счетчики ядра: принято и отброшено пакетов с прошлого вызова
+int tpacket_get_stats(tpacket_capture_t *cap, unsigned long long *packets,
+                      unsigned long long *drops);
+
+// Закрывает сокет; вызывать после queue_shutdown (задачи ссылаются на кольцо)
+void tpacket_close(tpacket_capture_t *cap);
+
+#endif // TPACKET_CAPTURE_H
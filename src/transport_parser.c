@@ -0,0 +1,61 @@
+#include "transport_parser.h"
+#include <arpa/inet.h>
+#include <string.h>
+
+// Невыровненное чтение полей в сетевом порядке
+static inline u_int16_t load_be16(const u_char *p) {
+  return (u_int16_t)((p[0] << 8) | p[1]);
+}
+
+static inline u_int32_t load_be32(const u_char *p) {
+  u_int32_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohl(value);
+}
+
+int parse_tcp_header(const u_char *segment, bpf_u_int32 len,
+                     parsed_tcp_header_t *header) {
+  // Одна проверка границ на всю фиксированную часть, дальше - без проверок
+  if (len < TCP_MIN_HEADER_LEN) {
+    return -1;
+  }
+  u_int8_t data_offset = (u_int8_t)((segment[12] >> 4) * 4);
+  if (data_offset < TCP_MIN_HEADER_LEN) {
+    return -1;
+  }
+  header->source_port = load_be16(segment);
+  header->destination_port = load_be16(segment + 2);
+  header->sequence = load_be32(segment + 4);
+  header->acknowledgment = load_be32(segment + 8);
+  header->data_offset = data_offset;
+  header->flags = segment[13];
+  header->window = load_be16(segment + 14);
+  header->checksum = load_be16(segment + 16);
+  header->urgent_pointer = load_be16(segment + 18);
+  return data_offset;
+}
+
+int parse_udp_header(const u_char *datagram, bpf_u_int32 len,
+                     parsed_udp_header_t *header) {
+  if (len < UDP_HEADER_LEN) {
+    return -1;
+  }
+  header->source_port = load_be16(datagram);
+  header->destination_port = load_be16(datagram + 2);
+  header->length = load_be16(datagram + 4);
+  header->checksum = load_be16(datagram + 6);
+  return UDP_HEADER_LEN;
+}
+
+int parse_icmp_header(const u_char *message, bpf_u_int32 len,
+                      parsed_icmp_header_t *header) {
+  if (len < ICMP_HEADER_LEN) {
+    return -1;
+  }
+  header->type = message[0];
+  header->code = message[1];
+  header->checksum = load_be16(message + 2);
+  header->identifier = load_be16(message + 4);
+  header->sequence = load_be16(message + 6);
+  return ICMP_HEADER_LEN;
+}
@@ -0,0 +1,82 @@
+#ifndef TRANSPORT_PARSER_H
+#define TRANSPORT_PARSER_H
+
+#include <pcap.h>
+#include <sys/types.h>
+
+#define TCP_MIN_HEADER_LEN 20
+#define UDP_HEADER_LEN 8
+#define ICMP_HEADER_LEN 8 // Тип, код, контрольная сумма и 4 байта данных
+
+// Флаги TCP (байт 13 заголовка)
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+#define TCP_FLAG_PSH 0x08
+#define TCP_FLAG_ACK 0x10
+#define TCP_FLAG_URG 0x20
+#define TCP_FLAG_ECE 0x40
+#define TCP_FLAG_CWR 0x80
+
+// Структура для хранения TCP-заголовка (все поля в хостовом порядке)
+typedef struct {
+  u_int16_t source_port;
+  u_int16_t destination_port;
+  u_int32_t sequence;
+  u_int32_t acknowledgment;
+  u_int8_t data_offset; // Длина заголовка в байтах (с опциями)
+  u_int8_t flags;       // TCP_FLAG_*
+  u_int16_t window;
+  u_int16_t checksum;
+  u_int16_t urgent_pointer;
+} parsed_tcp_header_t;
+
+// Структура для хранения UDP-заголовка (все поля в хостовом порядке)
+typedef struct {
+  u_int16_t source_port;
+  u_int16_t destination_port;
+  u_int16_t length; // Длина заголовка и данных из заголовка
+  u_int16_t checksum;
+} parsed_udp_header_t;
+
+// Структура для хранения ICMP-заголовка (все поля в хостовом порядке)
+typedef struct {
+  u_int8_t type;
+  u_int8_t code;
+  u_int16_t checksum;
+  u_int16_t identifier; // Для эхо-запроса/ответа, иначе первые байты данных
+  u_int16_t sequence;
+} parsed_icmp_header_t;
+
+/**
+ * @brief Разбирает TCP-заголовок (без вывода).
+ *
+ * Нужна только фиксированная часть (20 байт): опции могут быть обрезаны
+ * snaplen, тогда данные начинаются за пределами захваченного.
+ *
+ * @param segment Указатель на начало TCP-заголовка.
+ * @param len Длина доступных данных, начиная с segment.
+ * @param header Куда записать поля заголовка.
+ * @return int Длина заголовка в байтах (data offset) или -1, если
+ *             фиксированная часть обрезана или data offset меньше 20.
+ */
+int parse_tcp_header(const u_char *segment, bpf_u_int32 len,
+                     parsed_tcp_header_t *header);
+
+/**
+ * @brief Разбирает UDP-заголовок (без вывода).
+ *
+ * @return int UDP_HEADER_LEN или -1, если заголовок обрезан.
+ */
+int parse_udp_header(const u_char *datagram, bpf_u_int32 len,
+                     parsed_udp_header_t *header);
+
+/**
+ * @brief Разбирает ICMP-заголовок (без вывода).
+ *
+ * @return int ICMP_HEADER_LEN или -1, если заголовок обрезан.
+ */
+int parse_icmp_header(const u_char *message, bpf_u_int32 len,
+                      parsed_icmp_header_t *header);
+
+#endif // TRANSPORT_PARSER_H
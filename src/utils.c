@@ -1,113 +1,236 @@
 #include "utils.h"
-#include "ethernet_parser.h"
-#include "ip_parser.h"
+#include "checksum.h"
+#include "flow_hash.h"
+#include "hll.h"
+#include "ip_reassembly.h"
+#include "output_sink.h"
+#include "packet_descriptor.h"
+#include "pcap_writer.h"
+#include "predicate.h"
+#include "stats.h"
 #include "thread_pool_queue.h" // для packet_task_t
+#include "topk.h"
 #include <errno.h>             // для errno
 #include <fcntl.h>             // для open
 #include <linux/if_packet.h>
 #include <pcap.h>
 #include <stdio.h>
+#include <stdlib.h> // для strtol
 #include <string.h> // для strcpy, strcat, strerror
-#include <time.h>
 #include <unistd.h> // для read, close
-// Обработчик пакетов
-void process_packet_task(
-    packet_task_t *task) { // Тут мы получаем структуру для переработки функции
-                           // под многопоточность
-  const struct pcap_pkthdr *pkthdr =
-      &task->header; // Приводим структуру к pkthdr
-  const u_char *packet = task->packet_data; // Приводим структуру к packet
-
-  time_t seconds = pkthdr->ts.tv_sec;
-  long microseconds = pkthdr->ts.tv_usec;
-  char time_buffer[80];
-  struct tm time_info;
-
-  if (localtime_r(&seconds, &time_info) == NULL) {
-    // Ошибка преобразования времени, можно вывести сообщение или использовать
-    // резервный вариант
-    perror("localtime_r");
-    // В качестве резерва можно просто вывести исходные секунды и микросекунды
-    printf("Захвачен пакет длиной %d байт (захвачено %d байт)\n", pkthdr->len,
-           pkthdr->caplen);
-    printf("Время (raw): %ld.%06ld\n", seconds, microseconds);
+// Группа протокола для доли трафика в статистике
+static stats_protocol_t protocol_group(const packet_descriptor_t *desc) {
+  if (!(desc->layers & (PACKET_HAS_IPV4 | PACKET_HAS_IPV6))) {
+    return STATS_PROTO_NON_IP;
+  }
+  switch (desc->ip_protocol) {
+  case IPPROTO_TCP:
+    return STATS_PROTO_TCP;
+  case IPPROTO_UDP:
+    return STATS_PROTO_UDP;
+  case IPPROTO_ICMP:
+  case IPPROTO_ICMPV6:
+    return STATS_PROTO_ICMP;
+  default:
+    return STATS_PROTO_OTHER_IP;
+  }
+}
+
+// Состояние рабочего потока, нужное для разбора пакетов (NULL - выключено)
+typedef struct {
+  flow_table_t *flows;
+  stats_worker_t *stats;
+  checksum_counters_t *sums;
+  topk_worker_t *topk;
+  hll_worker_t *hll;
+  pcap_writer_worker_t *writer; // Запись трафика на диск (-w)
+  ip_reassembly_worker_t *reassembly; // Сборка фрагментов IPv4 (-A)
+  int filter; // Задан предикат второго этапа
+  int print;
+} worker_context_t;
+
+static void worker_context_get(worker_context_t *ctx) {
+  int worker_id = queue_worker_id();
+  ctx->flows = flow_tables_get(worker_id);
+  ctx->stats = stats_worker_get(worker_id);
+  ctx->sums = checksum_counters_get(worker_id);
+  ctx->topk = topk_worker_get(worker_id);
+  ctx->hll = hll_worker_get(worker_id);
+  ctx->writer = pcap_writer_worker_get(worker_id);
+  ctx->reassembly = ip_reassembly_worker_get(worker_id);
+  ctx->filter = predicate_enabled();
+  ctx->print = output_sink_enabled();
+}
+
+// Учет пакета с ключом потока в таблице потоков и top-k
+static void count_flow(const packet_descriptor_t *desc, const flow_key_t *key,
+                       u_int8_t tcp_flags, u_int32_t flow_hash,
+                       const worker_context_t *ctx) {
+  if (ctx->flows != NULL) {
+    u_int64_t ts_us =
+        (u_int64_t)desc->ts.tv_sec * 1000000ULL + (u_int64_t)desc->ts.tv_usec;
+    flow_table_update(ctx->flows, flow_hash, key, ts_us, desc->len,
+                      tcp_flags);
+  }
+  if (ctx->topk != NULL) {
+    topk_count_packet(ctx->topk, desc, key, flow_hash);
+  }
+}
+
+// Собранная датаграмма идет по обычному разбору транспортного уровня и
+// учитывается в потоке, top-k и HLL со своими портами один раз (вместо
+// фрагментов). Пакетные счетчики, печать и запись на диск учитывают сами
+// фрагменты
+static void handle_datagram(const struct pcap_pkthdr *header,
+                            const u_char *frame, u_int32_t flow_hash,
+                            const worker_context_t *ctx) {
+  packet_descriptor_t desc;
+  packet_describe(header, frame, &desc);
+  if (ctx->filter && !predicate_match(&desc)) {
     return;
   }
-  strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", &time_info);
-  printf("Захвачен пакет длиной %d байт\n", pkthdr->len);
-  printf("Время: %s.%06ld\n", time_buffer, microseconds);
-
-  // Разбор пакета
-  printf("Разбор пакета:\n");
-  // Указатели для след уровней парсинга
-  const u_char *next_layer_packet = packet + sizeof(struct ether_header);
-  bpf_u_int32 next_layer_len = pkthdr->caplen - sizeof(struct ether_header);
-
-  // Заглушка пока
-  (void)next_layer_packet; // Явно указываем, что next_layer_packet (пока) не
-                           // используется
-  (void)next_layer_len; // Явно указываем, что next_layer_len (пока) не
-                        // используется
-  // Возвращаем EtherType для анализа следующего уровня парсинга
-
-  u_int16_t ether_type = parse_ethernet_header(packet, pkthdr);
-
-  if (ether_type == 0) {
-    printf("  Ошибка разбора Ethernet-заголовка или пакет слишком короткий.\n");
-    printf("------------------------------------------------------------\n");
-    return; // Прекращаем дальнейший разбор этого пакета
-  }
-  // Теперь, на основе ether_type, мы будем решать, какой парсер вызывать дальше
-  switch (ether_type) {
-  case ETH_P_IP: // 0x0800 (IPv4)
-    printf("  Протокол следующего уровня: IPv4\n");
-    ipv4_parse_result_t ip_result =
-        parse_ipv4_header(next_layer_packet, next_layer_len);
-    if (ip_result.payload_ptr != NULL && ip_result.transport_protocol != 0) {
-      switch (ip_result.transport_protocol) {
-      case IPPROTO_TCP:
-        printf("    Это TCP. Вызываем парсер TCP...\n");
-        // parse_tcp_header(ip_result.payload_ptr,
-        // ip_result.payload_available_len); // TODO
-        break;
-      case IPPROTO_UDP:
-        printf("    Это UDP. Вызываем парсер UDP...\n");
-        // parse_udp_header(ip_result.payload_ptr,
-        // ip_result.payload_available_len); // TODO
-        break;
-      case IPPROTO_ICMP:
-        printf("    Это ICMP. Вызываем парсер ICMP...\n");
-        // parse_icmp_packet(ip_result.payload_ptr,
-        // ip_result.payload_available_len); // TODO
-        break;
-      default:
-        printf("    Неизвестный транспортный протокол IPv4: %u\n",
-               ip_result.transport_protocol);
-        break;
+  checksum_counters_t *sums = ctx->sums;
+  if (sums != NULL) {
+    sums->l4_good += (desc.checksums & PACKET_CSUM_L4_GOOD) != 0;
+    sums->l4_bad += (desc.checksums & PACKET_CSUM_L4_BAD) != 0;
+    sums->l4_unchecked += (desc.checksums & PACKET_CSUM_L4_UNCHECKED) != 0;
+  }
+  if (ctx->hll != NULL) {
+    hll_count_packet(ctx->hll, &desc, flow_hash);
+  }
+  flow_key_t key;
+  u_int8_t tcp_flags;
+  if (flow_key_from_packet(&desc, &key, &tcp_flags) == 0) {
+    count_flow(&desc, &key, tcp_flags, flow_hash, ctx);
+  }
+}
+
+// Разбор одного пакета и учет в таблице потоков и скетчах рабочего потока;
+// печать - в буфер потока, если вывод включен
+static void handle_packet(const packet_task_t *task,
+                          const worker_context_t *ctx) {
+  if (task->forwarded) {
+    // Датаграмма, собранная другим рабочим потоком: ее фрагменты уже
+    // учтены там
+    handle_datagram(&task->header, task->packet_data, task->flow_hash, ctx);
+    return;
+  }
+  packet_descriptor_t desc;
+  packet_describe(&task->header, task->packet_data, &desc);
+  // Фрагмент уходит в сборку до предиката: порты есть только у датаграммы
+  int reassembling =
+      ctx->reassembly != NULL && ip_reassembly_is_fragment(&desc);
+  if (reassembling) {
+    struct pcap_pkthdr header;
+    const u_char *frame = ip_reassembly_add(ctx->reassembly, &desc,
+                                            task->packet_data, &header);
+    if (frame != NULL) {
+      // Фрагменты распределялись по хэшу без портов. Хэш с портами
+      // указывает на рабочий поток, которому достаются нефрагментированные
+      // пакеты того же потока: датаграмма учитывается в его таблице
+      u_int32_t flow_hash = flow_hash_packet(frame, header.caplen);
+      if (queue_forward_packet(&header, frame, flow_hash) > 0) {
+        handle_datagram(&header, frame, flow_hash, ctx);
       }
     }
-    break;
-  case ETH_P_IPV6: // 0x86DD (IPv6)
-    printf("  Протокол следующего уровня: IPv6\n");
-    // parse_ipv6_header(next_layer_packet, next_layer_len); // TODO:
-    // Реализовать
-    break;
-  case ETH_P_ARP: // 0x0806 (ARP)
-    printf("  Протокол следующего уровня: ARP\n");
-    // parse_arp_packet(next_layer_packet, next_layer_len); // TODO: Реализовать
-    break;
-  default:
-    printf("  Протокол следующего уровня (EtherType 0x%04x) пока не "
-           "обрабатывается.\n",
-           ether_type);
-    break;
   }
+  stats_worker_t *stats = ctx->stats;
+  if (ctx->filter && !predicate_match(&desc)) {
+    if (stats != NULL) {
+      stats_add(&stats->filtered, 1);
+    }
+    return;
+  }
+  if (stats != NULL) {
+    stats_add(&stats->packets, 1);
+    stats_add(&stats->bytes, desc.len);
+    stats_add(&stats->ipv4, (desc.layers & PACKET_HAS_IPV4) != 0);
+    stats_add(&stats->ipv6, (desc.layers & PACKET_HAS_IPV6) != 0);
+    stats_add(&stats->protocols[protocol_group(&desc)], 1);
+    stats_add(&stats->parse_errors, desc.errors != 0);
+  }
+  checksum_counters_t *sums = ctx->sums;
+  if (sums != NULL && desc.checksums != 0) {
+    sums->ip_good += (desc.checksums & PACKET_CSUM_IP_GOOD) != 0;
+    sums->ip_bad += (desc.checksums & PACKET_CSUM_IP_BAD) != 0;
+    sums->l4_good += (desc.checksums & PACKET_CSUM_L4_GOOD) != 0;
+    sums->l4_bad += (desc.checksums & PACKET_CSUM_L4_BAD) != 0;
+    sums->l4_unchecked += (desc.checksums & PACKET_CSUM_L4_UNCHECKED) != 0;
+  }
+  if (ctx->print) {
+    output_sink_print_packet(&desc);
+  }
+  if (ctx->hll != NULL && !reassembling) {
+    hll_count_packet(ctx->hll, &desc, task->flow_hash);
+  }
+  if (ctx->writer == NULL && ctx->flows == NULL && ctx->topk == NULL) {
+    return;
+  }
+  // Ключ потока один на таблицу потоков, скетчи и индекс записи на диск
+  flow_key_t key;
+  u_int8_t tcp_flags;
+  int has_key = flow_key_from_packet(&desc, &key, &tcp_flags) == 0;
+  if (ctx->writer != NULL) {
+    pcap_writer_add(ctx->writer, &task->header, task->packet_data,
+                    has_key ? &key : NULL);
+  }
+  // Фрагменты в сборке учтет в потоке собранная датаграмма
+  if (has_key && !reassembling) {
+    count_flow(&desc, &key, tcp_flags, task->flow_hash, ctx);
+  }
+}
 
-  // TODO: Здесь дальнейший разбор пакета (IP, TCP/UDP и т.д.)
-  printf("------------------------------------------------------------\n");
+// Работа раз в пачку: шаг обхода таймаутов (без остановки всей таблицы),
+// публикация скетчей и регистров HLL, сдача залежавшегося блока записи,
+// сброс вывода в stdout
+static void finish_batch(const worker_context_t *ctx) {
+  if (ctx->flows != NULL) {
+    flow_table_sweep(ctx->flows);
+  }
+  if (ctx->topk != NULL) {
+    topk_worker_tick(ctx->topk);
+  }
+  if (ctx->hll != NULL) {
+    hll_worker_tick(ctx->hll);
+  }
+  if (ctx->writer != NULL) {
+    pcap_writer_worker_tick(ctx->writer);
+  }
+  if (ctx->print) {
+    output_sink_flush();
+  }
+}
+
+void export_flow_record(const flow_entry_t *flow, flow_end_reason_t reason) {
+  if (output_sink_enabled()) {
+    output_sink_print_flow(flow, reason);
+  }
+}
+
+// Обработчик пачки пакетов: пока разбирается текущий пакет, данные
+// следующего (заголовки Ethernet и IP) уже подтягиваются в кэш. Вывод
+// сбрасывается в stdout один раз на пачку
+void process_packet_batch(packet_task_t **tasks, unsigned int count) {
+  worker_context_t ctx;
+  worker_context_get(&ctx);
+  for (unsigned int i = 0; i < count; i++) {
+    if (i + 1 < count) {
+      __builtin_prefetch(tasks[i + 1]->packet_data, 0, 3);
+      __builtin_prefetch(tasks[i + 1]->packet_data + 64, 0, 3);
+    }
+    handle_packet(tasks[i], &ctx);
+  }
+  finish_batch(&ctx);
+}
+
+// Обработчик пакетов
+void process_packet_task(packet_task_t *task) {
+  worker_context_t ctx;
+  worker_context_get(&ctx);
+  handle_packet(task, &ctx);
+  finish_batch(&ctx);
 }
 
-// Печать Mac-адресов интерфейсов
 void print_mac_address_sysfs(const char *if_name) {
   char path[256];
   char mac_addr_str[18];
@@ -206,4 +329,84 @@ void print_addresses(pcap_if_t *dev) {
       printf("  Неизвестный тип адреса (семейство: %d)\n", sa->sa_family);
     }
   }
-}
\ No newline at end of file
+}
+int parse_ip_prefix(const char *text, u_int8_t network[16], u_int8_t mask[16],
+                    int *prefix_length) {
+  char address[INET6_ADDRSTRLEN];
+  const char *slash = strchr(text, '/');
+  size_t length = slash != NULL ? (size_t)(slash - text) : strlen(text);
+  if (length >= sizeof(address)) {
+    return -1;
+  }
+  memcpy(address, text, length);
+  address[length] = '\0';
+
+  int max_prefix;
+  memset(network, 0, 16);
+  if (inet_pton(AF_INET, address, network + 12) == 1) {
+    network[10] = network[11] = 0xff;
+    max_prefix = 32;
+  } else if (inet_pton(AF_INET6, address, network) == 1) {
+    max_prefix = 128;
+  } else {
+    return -1;
+  }
+  int prefix = max_prefix;
+  if (slash != NULL) {
+    char *end;
+    long value = strtol(slash + 1, &end, 10);
+    if (*end != '\0' || end == slash + 1 || value < 0 || value > max_prefix) {
+      return -1;
+    }
+    prefix = (int)value;
+  }
+  int bits = prefix + (128 - max_prefix); // IPv4-mapped: еще 96 бит
+  for (int i = 0; i < 16; i++) {
+    int take = bits > 8 ? 8 : (bits > 0 ? bits : 0);
+    mask[i] = (u_int8_t)(0xff00 >> take);
+    network[i] &= mask[i];
+    bits -= 8;
+  }
+  *prefix_length = prefix;
+  return 0;
+}
+
+int set_capture_filter(pcap_t *handle, const char *dev_name,
+                       const char *expression) {
+  bpf_u_int32 net = 0;
+  bpf_u_int32 netmask = PCAP_NETMASK_UNKNOWN;
+  char errbuf[PCAP_ERRBUF_SIZE];
+  if (dev_name != NULL &&
+      pcap_lookupnet(dev_name, &net, &netmask, errbuf) < 0) {
+    netmask = PCAP_NETMASK_UNKNOWN; // Интерфейс без IPv4 - не ошибка
+  }
+  struct bpf_program program;
+  if (pcap_compile(handle, &program, expression, 1, netmask) < 0) {
+    fprintf(stderr, "Ошибка в фильтре \"%s\": %s\n", expression,
+            pcap_geterr(handle));
+    return -1;
+  }
+  int result = pcap_setfilter(handle, &program);
+  if (result < 0) {
+    fprintf(stderr, "Ошибка установки фильтра: %s\n", pcap_geterr(handle));
+  }
+  pcap_freecode(&program);
+  return result < 0 ? -1 : 0;
+}
+
+int compile_socket_filter(const char *expression, int linktype, int snaplen,
+                          struct bpf_program *program) {
+  pcap_t *dead = pcap_open_dead(linktype, snaplen);
+  if (dead == NULL) {
+    fprintf(stderr, "Ошибка pcap_open_dead для компиляции фильтра\n");
+    return -1;
+  }
+  int result = pcap_compile(dead, program, expression, 1,
+                            PCAP_NETMASK_UNKNOWN);
+  if (result < 0) {
+    fprintf(stderr, "Ошибка в фильтре \"%s\": %s\n", expression,
+            pcap_geterr(dead));
+  }
+  pcap_close(dead);
+  return result < 0 ? -1 : 0;
+}
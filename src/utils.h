@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "flow_table.h"
 #include "thread_pool_queue.h"
 #include <arpa/inet.h> // Для AF_INET, AF_INET6, sockaddr_in, sockaddr_in6, inet_ntop
 #include <pcap.h> // Для u_char, pcap_pkthdr, pcap_if_t, pcap_addr
@@ -10,5 +11,41 @@
 void print_mac_address_sysfs(const char *if_name);
 void print_addresses(pcap_if_t *dev);
 void process_packet_task(packet_task_t *task);
+// Обработка пачки задач с предвыборкой данных следующего пакета
+void process_packet_batch(packet_task_t **tasks, unsigned int count);
+// Экспорт завершенного потока (flow_table_options_t.export_fn): печать
+// записи, если вывод включен
+void export_flow_record(const flow_entry_t *flow, flow_end_reason_t reason);
+
+/**
+ * @brief Разбирает подсеть вида адрес/длина (без длины - один адрес).
+ *
+ * Адрес и маска - 16 байт, IPv4 в виде IPv4-mapped (::ffff:a.b.c.d), как
+ * ключи таблицы потоков; биты адреса вне маски обнуляются.
+ *
+ * @param prefix_length Длина префикса в семействе адреса (до 32 или 128).
+ * @return int 0 при успехе, -1 при ошибке разбора.
+ */
+int parse_ip_prefix(const char *text, u_int8_t network[16], u_int8_t mask[16],
+                    int *prefix_length);
+
+/**
+ * @brief Компилирует выражение BPF и ставит фильтр на дескриптор pcap.
+ *
+ * Для интерфейса фильтр выполняет ядро, и лишние пакеты не копируются из
+ * сокета; для файла - libpcap до вызова обработчика.
+ *
+ * @param dev_name Интерфейс (для маски сети в выражениях broadcast), NULL
+ *                 для файла.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int set_capture_filter(pcap_t *handle, const char *dev_name,
+                       const char *expression);
+
+// Компилирует выражение BPF для кадров типа linktype (DLT_EN10MB для
+// сокетов tpacket, тип файла для потоков чтения -R); программа возвращает
+// snaplen для подходящих пакетов. Освобождать pcap_freecode
+int compile_socket_filter(const char *expression, int linktype, int snaplen,
+                          struct bpf_program *program);
 
 #endif
\ No newline at end of file